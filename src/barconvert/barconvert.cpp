@@ -0,0 +1,129 @@
+/*
+Copyright (C) 2018 Adrian Michel
+http://www.amichel.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "../fileplugins/datasource.h"
+#include "../fileplugins/binarydatasource.h"
+
+// makes the binary bar files of all the text bar files in a data directory,
+// ahead of the sessions, so they don't pay for the conversion on first use:
+//
+//   barconvert <format 1-4> <path> [extension] [hierarchical]
+//
+// the binary files that are up to date with their text files are left alone
+
+using namespace tradery;
+
+/**
+ * Adds the symbols of the files with an extension in a directory, and in its
+ * subdirectories if the data is hierarchical
+ */
+static void findSymbols(const std::string& path, const std::string& ext,
+                        bool hierarchical, std::vector<std::string>& symbols) {
+  WIN32_FIND_DATAA data;
+  HANDLE find = FindFirstFileA((addFSlash(path) + "*").c_str(), &data);
+  if (find == INVALID_HANDLE_VALUE) return;
+
+  do {
+    std::string name(data.cFileName);
+    if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+      if (hierarchical && name != "." && name != "..")
+        findSymbols(addFSlash(path) + name, ext, hierarchical, symbols);
+    } else if (name.length() > ext.length() + 1 &&
+               _stricmp(name.substr(name.length() - ext.length() - 1).c_str(),
+                        ("." + ext).c_str()) == 0)
+      symbols.push_back(name.substr(0, name.length() - ext.length() - 1));
+  } while (FindNextFileA(find, &data));
+
+  FindClose(find);
+}
+
+static void usage() {
+  std::cout << "usage: barconvert <format 1-4> <path> [extension] "
+               "[hierarchical]"
+            << std::endl
+            << std::endl
+            << "  format        1: mm/dd/yyyy,h:m:s,o,h,l,c,v" << std::endl
+            << "                2: yymmdd,hhmm,o,h,l,c,v" << std::endl
+            << "                3: mm/dd/yyyy,o,h,l,c,v" << std::endl
+            << "                4: yyyymmdd,o,h,l,c,v" << std::endl
+            << "  extension     of the text files, csv by default" << std::endl
+            << "  hierarchical  if the files are in the symbol subdirectories"
+            << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 3) {
+    usage();
+    return 1;
+  }
+
+  unsigned int format;
+  try {
+    format = boost::lexical_cast<unsigned int>(argv[1]);
+  } catch (const boost::bad_lexical_cast&) {
+    format = 0;
+  }
+  if (format < 1 || format > 4) {
+    std::cout << "invalid format: " << argv[1] << std::endl;
+    usage();
+    return 1;
+  }
+
+  const std::string path(argv[2]);
+  const std::string ext(argc > 3 ? argv[3] : "csv");
+  const bool hierarchical(argc > 4 && std::string(argv[4]) == "hierarchical");
+
+  std::vector<std::string> symbols;
+  findSymbols(path, ext, hierarchical, symbols);
+
+  try {
+    BinaryDataSource ds(
+        Info("barconvert", "barconvert binary data source"), path,
+        FileDataSource::make(Info("barconvert text", "barconvert data source"),
+                             path, ext, (Format)(format - 1), !hierarchical,
+                             fatal),
+        !hierarchical, fatal);
+
+    size_t converted = 0;
+    size_t upToDate = 0;
+    size_t failed = 0;
+
+    for (size_t n = 0; n < symbols.size(); n++) {
+      try {
+        DataInfo dataInfo(&ds, SymbolConstPtr(new Symbol(symbols[n])));
+        if (ds.update(&dataInfo))
+          converted++;
+        else
+          upToDate++;
+      } catch (const CoreException& e) {
+        std::cout << symbols[n] << ": " << e.message() << std::endl;
+        failed++;
+      }
+    }
+
+    std::cout << symbols.size() << " symbols: " << converted << " converted, "
+              << upToDate << " up to date, " << failed << " failed"
+              << std::endl;
+    return failed == 0 ? 0 : 1;
+  } catch (const CoreException& e) {
+    std::cout << "error: " << e.message() << std::endl;
+    return 1;
+  }
+}
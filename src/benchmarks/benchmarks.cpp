@@ -0,0 +1,184 @@
+/*
+Copyright (C) 2018 Adrian Michel
+http://www.amichel.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "filebenchmarks.h"
+
+// runs the microbenchmarks of the framework internals:
+//
+//   benchmarks <name> [arguments]
+//
+// without a name, lists the benchmarks and their arguments
+
+using namespace tradery;
+
+/**
+ * The arguments that follow the name of the benchmark, each of which has a
+ * default value
+ */
+class Arguments {
+ private:
+  std::vector<std::string> _args;
+
+ public:
+  Arguments(int argc, char* argv[]) {
+    for (int n = 2; n < argc; n++) _args.push_back(argv[n]);
+  }
+
+  size_t get(size_t n, size_t defaultValue) const {
+    return n < _args.size() ? boost::lexical_cast<size_t>(_args[n])
+                            : defaultValue;
+  }
+
+  std::string get(size_t n, const std::string& defaultValue) const {
+    return n < _args.size() ? _args[n] : defaultValue;
+  }
+};
+
+static unsigned int processors() {
+  return max2(std::thread::hardware_concurrency(), 1u);
+}
+
+static void cacheContention(const Arguments& args) {
+  benchmarks::cacheContention(std::cout,
+                              (unsigned int)args.get(0, processors()),
+                              args.get(1, 500), args.get(2, 4));
+}
+
+static void cacheLatency(const Arguments& args) {
+  benchmarks::cacheLatency(std::cout, (unsigned int)args.get(0, processors()),
+                           args.get(1, 100000));
+}
+
+static void cacheIds(const Arguments& args) {
+  benchmarks::cacheIds(std::cout, args.get(0, 500), args.get(1, 12),
+                       args.get(2, 20));
+}
+
+static void seriesKernels(const Arguments& args) {
+  benchmarks::seriesKernels(std::cout, args.get(0, 1000000),
+                            (unsigned int)args.get(1, 20), args.get(2, 10));
+}
+
+static void compoundOps(const Arguments& args) {
+  // the old way goes through the series cache
+  tradery::init(100);
+  benchmarks::compoundOps(std::cout, args.get(0, 1000000), args.get(1, 10));
+  tradery::uninit();
+}
+
+static void expressions(const Arguments& args) {
+  // the operators only defer the expressions on the series of the cache
+  tradery::init(100, 0, gdsf_cache_policy, true);
+  benchmarks::expressions(std::cout, args.get(0, 1000000), args.get(1, 10));
+  tradery::uninit();
+}
+
+static void positions(const Arguments& args) {
+  benchmarks::positions(std::cout, args.get(0, 1000000), args.get(1, 3));
+}
+
+static void refCounts(const Arguments& args) {
+  benchmarks::refCounts(std::cout, args.get(0, 1000000));
+}
+
+static void logging(const Arguments& args) {
+  benchmarks::logging(std::cout, (unsigned int)args.get(0, processors()),
+                      args.get(1, 100000));
+}
+
+static void threadPlacement(const Arguments& args) {
+  benchmarks::threadPlacement(std::cout,
+                              (unsigned int)args.get(0, processors()),
+                              args.get(1, 64), args.get(2, 10));
+}
+
+static void fileLoad(const Arguments& args) {
+  benchmarks::fileLoad(std::cout, args.get(0, 1000000), args.get(1, 5));
+}
+
+static void fileRange(const Arguments& args) {
+  benchmarks::fileRange(std::cout, args.get(0, 1000000), args.get(1, 390),
+                        args.get(2, 5));
+}
+
+static void fileSync(const Arguments& args) {
+  benchmarks::fileSync(std::cout, args.get(0, 500), args.get(1, 2500),
+                       args.get(2, 3));
+}
+
+struct Benchmark {
+  const char* name;
+  const char* arguments;
+  void (*run)(const Arguments& args);
+};
+
+static const Benchmark _benchmarks[] = {
+    {"cache-contention", "[threads] [symbols] [passes]", cacheContention},
+    {"cache-latency", "[threads] [lookups]", cacheLatency},
+    {"cache-ids", "[symbols] [depth] [repeats]", cacheIds},
+    {"series-kernels", "[values] [period] [repeats]", seriesKernels},
+    {"compound-ops", "[values] [repeats]", compoundOps},
+    {"expressions", "[values] [repeats]", expressions},
+    {"positions", "[positions] [repeats]", positions},
+    {"ref-counts", "[copies]", refCounts},
+    {"log", "[threads] [lines]", logging},
+    {"thread-placement", "[threads] [megabytes] [passes]", threadPlacement},
+    {"file-load", "[bars] [repeats]", fileLoad},
+    {"file-range", "[bars] [range bars] [repeats]", fileRange},
+    {"file-sync", "[symbols] [bars] [repeats]", fileSync},
+};
+
+static const size_t _benchmarksCount =
+    sizeof(_benchmarks) / sizeof(_benchmarks[0]);
+
+static void usage() {
+  std::cout << "usage: benchmarks <name> [arguments]" << std::endl
+            << std::endl;
+  for (size_t n = 0; n < _benchmarksCount; n++)
+    std::cout << "  " << std::left << std::setw(20) << _benchmarks[n].name
+              << std::right << _benchmarks[n].arguments << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    usage();
+    return 1;
+  }
+
+  for (size_t n = 0; n < _benchmarksCount; n++) {
+    if (_benchmarks[n].name == std::string(argv[1])) {
+      try {
+        _benchmarks[n].run(Arguments(argc, argv));
+        return 0;
+      } catch (const boost::bad_lexical_cast&) {
+        std::cout << "invalid argument" << std::endl;
+      } catch (const std::exception& e) {
+        std::cout << "error: " << e.what() << std::endl;
+      } catch (...) {
+        std::cout << "benchmark failed" << std::endl;
+      }
+      return 1;
+    }
+  }
+
+  std::cout << "unknown benchmark: " << argv[1] << std::endl;
+  usage();
+  return 1;
+}
@@ -0,0 +1,314 @@
+/*
+Copyright (C) 2018 Adrian Michel
+http://www.amichel.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "../fileplugins/datasource.h"
+#include "filebenchmarks.h"
+
+using namespace tradery::benchmarks;
+
+// parses a format 1 line the way it was done before the lines were scanned in
+// place: split into strings by a Tokenizer, with the date and time made
+// through Date and TimeDuration
+static const Bar* tokenizerBarLine(const std::string& str) {
+  if (str.empty() || str[0] == '$' || str[0] == '#' ||
+      (str.length() > 1 && str[0] == '/' && str[1] == '/'))
+    return 0;
+
+  Tokenizer tokens(str, ", \t");
+  if (tokens.size() < 7) return 0;
+
+  Tokenizer time(tokens[1], ":");
+  unsigned int hour = time.size() > 0 ? atoi(time[0].c_str()) : 0;
+  unsigned int min = time.size() > 1 ? atoi(time[1].c_str()) : 0;
+  unsigned int sec = time.size() > 2 ? atoi(time[2].c_str()) : 0;
+
+  char* p;
+  return new Bar(DateTime(Date(tokens[0], us), TimeDuration(hour, min, sec, 0)),
+                 strtod(tokens[2].c_str(), &p), strtod(tokens[3].c_str(), &p),
+                 strtod(tokens[4].c_str(), &p), strtod(tokens[5].c_str(), &p),
+                 atol(tokens[6].c_str()));
+}
+
+// a format 1 data source which exposes the two ways it can parse a file
+class BenchmarkDataSource : public FileDataSourceFormat1 {
+ public:
+  BenchmarkDataSource(const std::string& path)
+      : FileDataSourceFormat1(Info("benchmark", "benchmark data source"),
+                              path, "csv", true, fatal) {}
+
+  // loads the bars of the file in the range, from the mapped view or through
+  // the stream, seeking with the index if there is one
+  BarsPtr load(const std::string& fileName, bool mapped,
+               DateTimeRangePtr range, const DateIndex* index = 0,
+               const std::string& symbol = "benchmark") const {
+    BarsPtr bars(tradery::createBars(name(), symbol,
+                                     tradery::BarsAbstr::Type::stock, 60,
+                                     range, fatal));
+    FilePositionInfo p;
+    if (mapped) {
+      MappedFile file(fileName);
+      p = parseBars(bars.get(), file, range, index);
+    } else {
+      std::ifstream file(fileName.c_str(), ios_base::in | ios_base::binary);
+      p = parseBars(bars.get(), file, range, symbol, index);
+    }
+    bars->setDataLocationInfo(
+        tradery::makeDataFileLocationInfo(fileName, p.start(), p.count()));
+    return bars;
+  }
+
+  // loads the bars of the file in the range the way it was done before the
+  // lines were scanned in place: read through the stream, parsed by
+  // tokenizerBarLine and added one at a time. The baseline of the other paths
+  BarsPtr loadBaseline(const std::string& fileName,
+                       DateTimeRangePtr range) const {
+    BarsPtr bars(tradery::createBars(name(), "benchmark",
+                                     tradery::BarsAbstr::Type::stock, 60,
+                                     range, fatal));
+    std::ifstream file(fileName.c_str(), ios_base::in | ios_base::binary);
+    if (range) {
+      __int64 start = findStart(range->from(), file);
+      if (start < 0) return bars;
+      file.clear();
+      file.seekg(start);
+    }
+
+    std::string str;
+    while (std::getline(file, str)) {
+      std::auto_ptr<const Bar> bar(tokenizerBarLine(str));
+      if (bar.get() == 0)
+        continue;
+      else if (range && *range > *bar)
+        continue;
+      else if (range && *range < *bar)
+        break;
+      bars->add(*bar);
+    }
+    return bars;
+  }
+
+  // makes the date index of the file, or gets the one made by a previous call
+  DateIndexPtr dateIndex(const std::string& fileName) const {
+    MappedFile file(fileName);
+    // the file is only written by the benchmark, so any stamp will do
+    return getDateIndex(fileName, "benchmark", &file);
+  }
+};
+
+static std::string tempPath() {
+  char path[MAX_PATH + 1];
+  return GetTempPathA(MAX_PATH + 1, path) > 0 ? path : ".\\";
+}
+
+// writes minute bars in format 1, 390 a day starting on 1/3/2000, and returns
+// the size of the file. If gap is not 0, one bar out of every gap bars is left
+// out, so the bars of different files are not aligned
+static unsigned __int64 writeBars(const std::string& fileName, size_t count,
+                                  unsigned int seed = 12345, size_t gap = 0) {
+  static const unsigned int days[] = {31, 28, 31, 30, 31, 30,
+                                      31, 31, 30, 31, 30, 31};
+
+  std::ofstream file(fileName.c_str(), ios_base::out | ios_base::binary);
+  unsigned int year = 2000;
+  unsigned int month = 1;
+  unsigned int day = 3;
+  double price = 100;
+  unsigned int random = seed;
+  char line[128];
+
+  for (size_t n = 0; n < count; n++) {
+    size_t minute = 9 * 60 + 30 + n % 390;
+    if (n > 0 && n % 390 == 0) {
+      bool leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+      if (++day > days[month - 1] + (month == 2 && leap ? 1 : 0)) {
+        day = 1;
+        if (++month > 12) {
+          month = 1;
+          year++;
+        }
+      }
+    }
+
+    random = random * 1103515245 + 12345;
+    double change = ((int)((random >> 8) % 201) - 100) / 1000.0;
+    double open = price;
+    price = max2(price + change, 1.0);
+    sprintf_s(line, "%u/%u/%u,%u:%02u:00,%.2f,%.2f,%.2f,%.2f,%u\n", month,
+              day, year, (unsigned int)(minute / 60),
+              (unsigned int)(minute % 60), open, max2(open, price) + 0.05,
+              min2(open, price) - 0.05, price, (random >> 16) % 5000 + 100);
+    if (gap == 0 || n % gap != gap - 1) file << line;
+  }
+  return (unsigned __int64)file.tellp();
+}
+
+void tradery::benchmarks::fileLoad(std::ostream& os, size_t bars,
+                                   size_t repeats) {
+  std::string path(tempPath());
+  std::string fileName(path + "benchmark.csv");
+  double mb = writeBars(fileName, bars) / (1024.0 * 1024.0);
+  BenchmarkDataSource dataSource(path);
+
+  os << "file load - " << bars << " bars, " << std::fixed
+     << std::setprecision(1) << mb << " MB, best of " << repeats << std::endl;
+  os << std::setw(10) << "path" << std::setw(10) << "bars" << std::setw(12)
+     << "seconds" << std::setw(10) << "MB/s" << std::setw(14) << "bars/s"
+     << std::endl;
+
+  static const char* const kinds[] = {"tokenizer", "stream", "mapped"};
+  for (int kind = 0; kind < 3; kind++) {
+    double best = 0;
+    size_t count = 0;
+    for (size_t n = 0; n < repeats; n++) {
+      Clock::time_point start(Clock::now());
+      if (kind == 0)
+        count = dataSource.loadBaseline(fileName, DateTimeRangePtr())->size();
+      else
+        count = dataSource.load(fileName, kind == 2, DateTimeRangePtr())
+                    ->size();
+      double s = seconds(start);
+      if (n == 0 || s < best) best = s;
+    }
+
+    os << std::setw(10) << kinds[kind] << std::setw(10) << count
+       << std::setw(12) << std::setprecision(3) << best << std::setw(10)
+       << std::setprecision(1) << mb / best << std::setw(14)
+       << std::setprecision(0) << count / best << std::endl;
+  }
+
+  ::DeleteFileA(fileName.c_str());
+}
+
+void tradery::benchmarks::fileRange(std::ostream& os, size_t bars,
+                                    size_t rangeBars, size_t repeats) {
+  std::string path(tempPath());
+  std::string fileName(path + "benchmark.csv");
+  std::string indexFileName(fileName + DATE_INDEX_EXTENSION);
+  double mb = writeBars(fileName, bars) / (1024.0 * 1024.0);
+  ::DeleteFileA(indexFileName.c_str());
+  BenchmarkDataSource dataSource(path);
+
+  // the range covers the last bars of the file
+  BarsPtr all(dataSource.load(fileName, true, DateTimeRangePtr()));
+  const BarsAbstr* b = dynamic_cast<const BarsAbstr*>(all.get());
+  assert(b != 0 && b->size() > 0);
+  rangeBars = min2(max2(rangeBars, (size_t)1), b->size());
+  DateTimeRangePtr range(new DateTimeRange(
+      b->time(b->size() - rangeBars), b->time(b->size() - 1)));
+
+  Clock::time_point indexStart(Clock::now());
+  DateIndexPtr index(dataSource.dateIndex(fileName));
+  double indexSeconds = seconds(indexStart);
+
+  os << "file range - last " << rangeBars << " of " << bars << " bars, "
+     << std::fixed << std::setprecision(1) << mb << " MB, best of " << repeats
+     << ", index made in " << std::setprecision(3) << indexSeconds
+     << " seconds" << std::endl;
+  os << std::setw(10) << "path" << std::setw(10) << "index" << std::setw(10)
+     << "bars" << std::setw(14) << "milliseconds" << std::endl;
+
+  // the tokenizer baseline has no index
+  static const char* const kinds[] = {"tokenizer", "stream", "mapped"};
+  for (int kind = 0; kind < 3; kind++) {
+    for (int indexed = 0; indexed < (kind == 0 ? 1 : 2); indexed++) {
+      double best = 0;
+      size_t count = 0;
+      for (size_t n = 0; n < repeats; n++) {
+        Clock::time_point start(Clock::now());
+        if (kind == 0)
+          count = dataSource.loadBaseline(fileName, range)->size();
+        else
+          count = dataSource
+                      .load(fileName, kind == 2, range,
+                            indexed ? index.get() : 0)
+                      ->size();
+        double s = seconds(start);
+        if (n == 0 || s < best) best = s;
+      }
+
+      os << std::setw(10) << kinds[kind] << std::setw(10)
+         << (indexed ? "yes" : "no") << std::setw(10) << count << std::setw(14)
+         << std::setprecision(3) << best * 1000 << std::endl;
+    }
+  }
+
+  ::DeleteFileA(indexFileName.c_str());
+  ::DeleteFileA(fileName.c_str());
+}
+
+void tradery::benchmarks::fileSync(std::ostream& os, size_t symbols,
+                                   size_t bars, size_t repeats) {
+  symbols = max2(symbols, (size_t)2);
+  std::string path(tempPath() + "benchmark-sync\\");
+  ::CreateDirectoryA(path.c_str(), 0);
+
+  std::vector<std::string> names;
+  std::vector<std::string> fileNames;
+  double mb = 0;
+  for (size_t s = 0; s < symbols; s++) {
+    std::ostringstream name;
+    name << "SYMBOL" << s;
+    names.push_back(name.str());
+    fileNames.push_back(path + name.str() + ".csv");
+    // the first symbol, the reference, has all the bars, the others each miss
+    // one every 50 to 99 bars
+    mb += writeBars(fileNames.back(), bars, 12345 + (unsigned int)s,
+                    s == 0 ? 0 : 50 + s % 50) /
+          (1024.0 * 1024.0);
+  }
+  BenchmarkDataSource dataSource(path);
+
+  os << "file sync - " << symbols << " symbols, " << bars << " bars each, "
+     << std::fixed << std::setprecision(1) << mb << " MB, best of " << repeats
+     << std::endl;
+  os << std::setw(12) << "load" << std::setw(12) << "sync" << std::setw(12)
+     << "total" << std::setw(14) << "bars/s" << std::endl;
+
+  double load = 0;
+  double sync = 0;
+  for (size_t r = 0; r < max2(repeats, (size_t)1); r++) {
+    // the bars are loaded again each time, as the synchronization indexes are
+    // shared for as long as the synchronized bars are in use
+    std::vector<BarsPtr> data(symbols);
+    Clock::time_point start(Clock::now());
+    for (size_t s = 0; s < symbols; s++)
+      data[s] = dataSource.load(fileNames[s], true, DateTimeRangePtr(), 0,
+                                names[s]);
+    double l = seconds(start);
+
+    Bars ref(dynamic_cast<const BarsAbstr*>(data[0].get()));
+    start = Clock::now();
+    for (size_t s = 1; s < symbols; s++) {
+      Bars b(dynamic_cast<const BarsAbstr*>(data[s].get()));
+      b.synchronize(ref);
+    }
+    double y = seconds(start);
+
+    if (r == 0 || l < load) load = l;
+    if (r == 0 || y < sync) sync = y;
+  }
+
+  os << std::setprecision(3) << std::setw(12) << load << std::setw(12) << sync
+     << std::setw(12) << load + sync << std::setw(14) << std::setprecision(0)
+     << (double)symbols * bars / (load + sync) << std::endl;
+
+  for (size_t s = 0; s < symbols; s++) ::DeleteFileA(fileNames[s].c_str());
+  ::RemoveDirectoryA(path.c_str());
+}
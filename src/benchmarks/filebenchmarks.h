@@ -0,0 +1,68 @@
+/*
+Copyright (C) 2018 Adrian Michel
+http://www.amichel.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+// the benchmarks of the file data source, which is not part of core
+
+namespace tradery {
+namespace benchmarks {
+
+/**
+ * File load: writes a file of minute bars in format 1, and loads it the way it
+ * used to be, each line split into strings by a Tokenizer, then from a mapped
+ * view of the file, and through a stream, the path taken when the file can't
+ * be mapped
+ *
+ * @param os      receives the results
+ * @param bars    the number of bars in the file
+ * @param repeats the number of loads of each kind, the fastest one is reported
+ */
+void fileLoad(std::ostream& os, size_t bars, size_t repeats);
+
+/**
+ * File range: loads a short range at the end of a long file of minute bars,
+ * the way a session on recent data does, with and without the date index of
+ * the file, from a mapped view and through a stream, and the way it used
+ * to be, with the lines split by a Tokenizer
+ *
+ * @param os        receives the results
+ * @param bars      the number of bars in the file
+ * @param rangeBars the number of bars in the range
+ * @param repeats   the number of loads of each kind, the fastest one is
+ *                  reported
+ */
+void fileRange(std::ostream& os, size_t bars, size_t rangeBars,
+               size_t repeats);
+
+/**
+ * File sync: writes the files of minute bars of many symbols, with a few bars
+ * missing from all but the first one, loads them, and synchronizes them all to
+ * the first one, as a session on a list of symbols does
+ *
+ * @param os      receives the results
+ * @param symbols the number of symbols
+ * @param bars    the number of bars in each file, before the missing ones
+ * @param repeats the number of loads and synchronizations, the fastest ones
+ *                are reported
+ */
+void fileSync(std::ostream& os, size_t symbols, size_t bars, size_t repeats);
+
+}  // namespace benchmarks
+}  // namespace tradery
@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "stdafx.h"
+#include <boost/weak_ptr.hpp>
 #include "cache.h"
 #include "seriesimpl.h"
 #include "bars.h"
@@ -28,6 +29,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 extern SeriesCache* _cache;
 
+void cacheableShared(const tradery::DataCollection* data) {
+  const BarsImpl* bars = dynamic_cast<const BarsImpl*>(data);
+  if (bars != 0) bars->share();
+}
+
 const Series BarsImpl::TrueRange() const {
   return _cache->findAndAdd(MakeTrueRangeSeries(*this));
 }
@@ -312,103 +318,216 @@ const Series BarsImpl::CdlMatHold(double penetration) const {
   return _cache->findAndAdd(MakeCdlMatHold(*this, penetration));
 }
 
-class SynchronizerImpl : public Synchronizer {
- private:
-  std::vector<int> _syncVector;
-  std::string _refSymbol;
-  TimeSeries _ts;
-  bool _modified;
-  // the bars collection we're synchronizing with
-
- private:
-  int index(size_t ix) const {
-    if (ix < _syncVector.size())
-      return _syncVector[ix];
-    else
-      throw SynchronizedSeriesIndexOutOfRangeException(_syncVector.size(), ix);
-  }
-
-  // indicates whether a sync required modification
-  // if not modified, then the 2 bars were the same in terms
-  // of bar indexes and timestamps
-  virtual bool modified() const { return _modified; }
-
-  virtual size_t size() const { return _syncVector.size(); }
-
-  void insertData(size_t refIx, size_t syncedIx) {
-    assert(refIx < _syncVector.size());
-    assert(_syncVector[refIx] == -1);
+typedef std::vector<__int64> TimeTicks;
+typedef boost::shared_ptr<const TimeTicks> TimeTicksPtr;
 
-    //    COUT << "inserting: " << ( refIx + 1 ) << _T( " -> " ) << ( syncedIx +
-    //    1 )<< std::endl;
+// the ticks of the times of a time series, from the first to size
+static TimeTicksPtr timeTicks(const TimeSeries& ts, size_t size, bool synced) {
+  boost::shared_ptr<TimeTicks> t(new TimeTicks(size));
+  for (size_t n = 0; n < size; n++)
+    (*t)[n] = (synced ? ts[n] : ts.at(n)).ticks();
+  return t;
+}
 
-    _syncVector[refIx] = syncedIx;
-  }
+/**
+ * The indexes of the bars synchronized to each bar of the reference bars
+ *
+ * The two series of times are merged in one pass: each reference bar gets the
+ * synchronized bar with the same time, or the last one before it, or the
+ * first one if there is none.
+ */
+class SyncIndex {
+ public:
+  const TimeTicksPtr _ref;
+  // identify the synchronized bars
+  const Id _syncedId;
+  const size_t _syncedSize;
+  const __int64 _syncedFirst;
+  const __int64 _syncedLast;
+  std::vector<int> _indexes;
+  // false if the two bars had the same times
+  bool _modified;
 
  public:
-  // synchronizes bars2 to bars1 (the base is bars1)
-  SynchronizerImpl(Bars ref, Bars synced)
-      : _syncVector(ref.size(), -1),
-        _refSymbol(ref.getSymbol()),
-        _ts(ref.timeSeries()),
+  SyncIndex(TimeTicksPtr ref, const TimeTicks& synced, const Id& syncedId)
+      : _ref(ref),
+        _syncedId(syncedId),
+        _syncedSize(synced.size()),
+        _syncedFirst(synced.front()),
+        _syncedLast(synced.back()),
+        _indexes(ref->size()),
         _modified(false) {
-    assert(synced.unsyncSize() > 0);
+    assert(!synced.empty());
+    const TimeTicks& r(*ref);
+    const size_t last = synced.size() - 1;
     size_t lastSynced = 0;
 
-    for (size_t indexSynced = 0, indexRef = 0; indexRef < ref.size();) {
-      //      COUT << _T( "ref size: " ) << ref.size() << std::endl;
+    for (size_t indexSynced = 0, indexRef = 0; indexRef < r.size();) {
+      __int64 refTime = r[indexRef];
+      __int64 syncedTime = synced[indexSynced];
 
-      std::string refDate = ref.time(indexRef).date().to_simple_string();
-      std::string syncedDate =
-          synced.time(indexSynced).date().to_simple_string();
-
-      if (ref.time(indexRef) == synced.time(indexSynced)) {
-        //        COUT << _T( " == ix1: " ) << ( indexRef )<< ( ", date1: " ) <<
-        //        refDate << _T( ", ix2: " ) << ( indexSynced )<< _T( ", date2:
-        //        " ) << syncedDate << _T( ", last: " ) << ( lastSynced )<<
-        //        std::endl;
+      if (refTime == syncedTime) {
         // the 2 times are equal - insert the data
-        insertData(indexRef++, indexSynced);
-        // increment unsynced if not at the end already
+        _indexes[indexRef++] = (int)indexSynced;
+        // increment synced if not at the end already
         lastSynced = indexSynced;
-        if (indexSynced < (synced.unsyncSize() - 1)) indexSynced++;
-      } else if (ref.time(indexRef) > synced.time(indexSynced)) {
-        // ref time > synced time
-        //        COUT << _T( " >> ix1: " ) << ( indexRef )<< ( ", date1: " ) <<
-        //        refDate << _T( ", ix2: " ) << ( indexSynced )<< _T( ", date2:
-        //        " ) << syncedDate << _T( ", last: " ) << ( lastSynced )<<
-        //        std::endl;
-
+        if (indexSynced < last) indexSynced++;
+      } else if (refTime > syncedTime) {
         // only insert the index if it's the last synchronized bar - then we
         // need to sync to it. otherwise, continue until the ref time is <
         // synced time, then we use the last synced index
         lastSynced = indexSynced;
-        if (indexSynced < (synced.unsyncSize() - 1))
+        if (indexSynced < last)
           indexSynced++;
         else
-          insertData(indexRef++, lastSynced);
+          _indexes[indexRef++] = (int)lastSynced;
         _modified = true;
-      } else if (ref.time(indexRef) < synced.time(indexSynced)) {
+      } else {
         // if ref < synced, then we insert the last good synced index.
-        //        COUT <<_T( " << ix1: " ) << ( indexRef )<< ( ", date1: " ) <<
-        //        refDate << _T( ", ix2: " ) << ( indexSynced )<< _T( ", date2:
-        //        " ) << syncedDate << _T( ", last: " ) << ( lastSynced )<<
-        //        std::endl;
-        insertData(indexRef++, lastSynced);
+        _indexes[indexRef++] = (int)lastSynced;
         _modified = true;
       }
     }
+  }
+
+  bool matches(TimeTicksPtr ref, const Id& syncedId, const TimeSeries& synced,
+               size_t syncedSize) const {
+    return _ref == ref && _syncedId == syncedId && _syncedSize == syncedSize &&
+           _syncedFirst == synced.at(0).ticks() &&
+           _syncedLast == synced.at(syncedSize - 1).ticks();
+  }
+};
+
+typedef boost::shared_ptr<const SyncIndex> SyncIndexPtr;
 
-      // the whole sync vector must be initialized
-      //    assert( std::find( _syncVector.begin(), _syncVector.end(), -1 ) ==
-      //    _syncVector.end() );
+/**
+ * Identifies the times of reference bars without copying them: the vector
+ * that holds them, with their number and the first and last ones, the same
+ * way the synchronized bars are identified
+ */
+class RefTimesKey {
+ private:
+  const TimeSeriesImpl* _times;
+  size_t _size;
+  __int64 _first;
+  __int64 _last;
+
+ public:
+  RefTimesKey(const TimeSeries& ts, size_t size)
+      : _times(ts.times()),
+        _size(size),
+        _first(size > 0 ? ts[0].ticks() : 0),
+        _last(size > 0 ? ts[size - 1].ticks() : 0) {}
 
-#ifdef _DEBUG
-    std::ofstream os("c:\\syncVector.txt");
-    for (size_t n = 0; n < _syncVector.size(); n++)
-      os << n << "\t" << _syncVector[n] << std::endl;
-#endif
+  bool operator<(const RefTimesKey& key) const {
+    if (_times != key._times) return _times < key._times;
+    if (_size != key._size) return _size < key._size;
+    if (_first != key._first) return _first < key._first;
+    return _last < key._last;
   }
+};
+
+/**
+ * The synchronization indexes in use, by reference symbol and synchronized
+ * bars, so all the systems that synchronize the same bars to the same
+ * reference share one index vector, and the synchronizations to the same
+ * reference times share one copy of them
+ *
+ * The reference times are only copied the first time they are used. A found
+ * index is used if it was made from the same copy.
+ *
+ * Only weak references are kept, so the indexes are released with the last
+ * synchronizer that uses them. The expired entries are dropped when the maps
+ * have doubled in size since the last time, so adding an entry takes constant
+ * time on average.
+ *
+ * Thread safe. The indexes are calculated without holding the lock
+ */
+class SyncIndexes {
+ private:
+  typedef std::pair<std::string, Id> Key;
+  typedef std::map<Key, boost::weak_ptr<const SyncIndex> > IndexMap;
+  typedef std::map<RefTimesKey, boost::weak_ptr<const TimeTicks> > TicksMap;
+
+  NonRecursiveMutex _mutex;
+  IndexMap _indexes;
+  TicksMap _refTicks;
+  // the number of entries at which the expired ones are dropped
+  size_t _dropAt;
+
+ private:
+  template <class Map>
+  static void dropExpired(Map& map) {
+    for (typename Map::iterator i = map.begin(); i != map.end();) {
+      if (i->second.expired())
+        i = map.erase(i);
+      else
+        ++i;
+    }
+  }
+
+ public:
+  SyncIndexes() : _dropAt(64) {}
+
+  SyncIndexPtr get(const std::string& refSymbol, const TimeSeries& ref,
+                   size_t refSize, const Id& syncedId,
+                   const TimeSeries& synced, size_t syncedSize) {
+    Key key(to_lower_case(refSymbol), syncedId);
+    RefTimesKey refKey(ref, refSize);
+    TimeTicksPtr refTicks;
+    {
+      NonRecursiveLock lock(_mutex);
+      refTicks = _refTicks[refKey].lock();
+      SyncIndexPtr index(_indexes[key].lock());
+      if (index && index->matches(refTicks, syncedId, synced, syncedSize))
+        return index;
+    }
+
+    if (!refTicks) refTicks = timeTicks(ref, refSize, true);
+    SyncIndexPtr index(new SyncIndex(
+        refTicks, *timeTicks(synced, syncedSize, false), syncedId));
+
+    NonRecursiveLock lock(_mutex);
+    if (_indexes.size() + _refTicks.size() >= _dropAt) {
+      dropExpired(_indexes);
+      dropExpired(_refTicks);
+      _dropAt = max2<size_t>(64, 2 * (_indexes.size() + _refTicks.size()));
+    }
+    _indexes[key] = index;
+    boost::weak_ptr<const TimeTicks>& shared(_refTicks[refKey]);
+    if (shared.expired()) shared = refTicks;
+    return index;
+  }
+};
+
+static SyncIndexes _syncIndexes;
+
+class SynchronizerImpl : public Synchronizer {
+ private:
+  SyncIndexPtr _index;
+  std::string _refSymbol;
+  TimeSeries _ts;
+
+ private:
+  int index(size_t ix) const {
+    if (ix < _index->_indexes.size())
+      return _index->_indexes[ix];
+    else
+      throw SynchronizedSeriesIndexOutOfRangeException(
+          _index->_indexes.size(), ix);
+  }
+
+  // indicates whether a sync required modification
+  // if not modified, then the 2 bars were the same in terms
+  // of bar indexes and timestamps
+  virtual bool modified() const { return _index->_modified; }
+
+  virtual size_t size() const { return _index->_indexes.size(); }
+
+ public:
+  // synchronizes bars2 to bars1 (the base is bars1)
+  SynchronizerImpl(Bars ref, SyncIndexPtr index)
+      : _index(index), _refSymbol(ref.getSymbol()), _ts(ref.timeSeries()) {}
 
   virtual TimeSeries timeSeries() const {
     //    COUT << _T( "getting time series from synchronizer" ) << std::endl;
@@ -428,5 +547,51 @@ class SynchronizerImpl : public Synchronizer {
 };
 
 CORE_API Synchronizer* Synchronizer::create(Bars ref, Bars syncd) {
-  return new SynchronizerImpl(ref, syncd);
+  assert(syncd.unsyncSize() > 0);
+  TimeTicksPtr synced(
+      timeTicks(syncd.timeSeries(), syncd.unsyncSize(), false));
+  return new SynchronizerImpl(
+      ref, SyncIndexPtr(new SyncIndex(
+               timeTicks(ref.timeSeries(), ref.size(), true), *synced, Id())));
+}
+
+SynchronizerPtr BarsImpl::makeSynchronizer(Bars ref) const {
+  assert(unsyncSize() > 0);
+  return SynchronizerPtr(new SynchronizerImpl(
+      ref, _syncIndexes.get(ref.getSymbol(), ref.timeSeries(), ref.size(),
+                            getId(), _timeSeries, unsyncSize())));
+}
+
+CORE_API AlignedBars AlignedBars::make(const std::vector<Bars>& bars) {
+  AlignedBars aligned;
+  aligned._bars = bars;
+  aligned._indexes.resize(bars.size());
+
+  std::vector<TimeTicksPtr> times(bars.size());
+  TimeTicks calendar;
+  for (size_t n = 0; n < bars.size(); n++) {
+    times[n] = timeTicks(bars[n].timeSeries(), bars[n].unsyncSize(), false);
+    calendar.insert(calendar.end(), times[n]->begin(), times[n]->end());
+  }
+  std::sort(calendar.begin(), calendar.end());
+  calendar.erase(std::unique(calendar.begin(), calendar.end()),
+                 calendar.end());
+
+  aligned._calendar.reserve(calendar.size());
+  for (size_t n = 0; n < calendar.size(); n++)
+    aligned._calendar.push_back(DateTime::fromTicks(calendar[n]));
+
+  // the times of each bars are in order, so each one is merged with the
+  // calendar in one pass
+  for (size_t n = 0; n < bars.size(); n++) {
+    const TimeTicks& t(*times[n]);
+    std::vector<int>& indexes(aligned._indexes[n]);
+    indexes.resize(calendar.size());
+    int bar = -1;
+    for (size_t c = 0, next = 0; c < calendar.size(); c++) {
+      while (next < t.size() && t[next] <= calendar[c]) bar = (int)next++;
+      indexes[c] = bar;
+    }
+  }
+  return aligned;
 }
@@ -53,7 +53,10 @@ class InvalidBars {
 
 // TODO: add iterators and other stuff so I can use algorithms on this
 
-class BarsImpl : public tradery::BarsAbstr, public BarsBase, public Ideable {
+class BarsImpl : public tradery::BarsAbstr,
+                 public BarsBase,
+                 public BarColumnsAddable,
+                 public Ideable {
   OBJ_COUNTER(BarsImpl)
  private:
   // interval between bars in seconds. Usually it goes from 1 minute to 1 month
@@ -85,16 +88,21 @@ class BarsImpl : public tradery::BarsAbstr, public BarsBase, public Ideable {
            ErrorHandlingMode errorHandlingMode)
       : _resolution(resolution),
         _type(type),
-        Ideable(dataSourceName + " - bars - " + symbol +
-                (range == 0 ? "" : " - range: " + range->getId())),
+        Ideable(Id("bars") << dataSourceName << symbol
+                           << (range == 0 ? std::string() : range->getId())),
         BarsBase(symbol),
         _errorHandlingMode(errorHandlingMode) {}
 
   virtual ~BarsImpl() {}
 
+ private:
+  // the synchronizer to the reference bars, which shares its indexes with
+  // the other synchronizers of the same bars to the same reference
+  SynchronizerPtr makeSynchronizer(Bars ref) const;
+
  public:
   virtual void synchronize(Bars bars) {
-    _synchronizer = Synchronizer::create(bars, Bars(this));
+    _synchronizer = makeSynchronizer(bars);
     _lowSeries.synchronize(_synchronizer);
     _highSeries.synchronize(_synchronizer);
     _openSeries.synchronize(_synchronizer);
@@ -104,6 +112,14 @@ class BarsImpl : public tradery::BarsAbstr, public BarsBase, public Ideable {
     _timeSeries.synchronize(_synchronizer);
   }
 
+  // marks the series as shared, once the bars are held by the data cache
+  void share() const {
+    const Series* series[] = {&_lowSeries,   &_highSeries,   &_openSeries,
+                              &_closeSeries, &_volumeSeries, &_openInterest};
+    for (size_t n = 0; n < sizeof(series) / sizeof(series[0]); n++)
+      dynamic_cast<const SeriesImpl&>(series[n]->getSeries()).share();
+  }
+
   virtual ErrorHandlingMode getErrorHandlingMode() const {
     return _errorHandlingMode;
   }
@@ -187,6 +203,36 @@ class BarsImpl : public tradery::BarsAbstr, public BarsBase, public Ideable {
     _extraInfoSeries.push_back(bar.getBarExtraInfo());
   }
 
+  // implemented from base class BarColumnsAddable
+  void addColumns(BarColumns& columns) {
+    size_t count = columns.size();
+    assert(columns.open.size() == count && columns.high.size() == count &&
+           columns.low.size() == count && columns.close.size() == count &&
+           columns.volume.size() == count &&
+           columns.openInterest.size() == count);
+
+    for (size_t n = 0; n < count; n++) {
+      if (!Bar::isValid(columns.open[n], columns.high[n], columns.low[n],
+                        columns.close[n], (unsigned long)columns.volume[n])) {
+        // the bar is only made to report the error, same as in add
+        const Bar bar(columns.bar(n));
+        if (_errorHandlingMode == fatal)
+          throw BarException(bar.getStatusAsString());
+        else if (_errorHandlingMode == warning)
+          _invalidBars.add(bar.getStatusAsString());
+      }
+    }
+    _lowSeries.append(columns.low);
+    _highSeries.append(columns.high);
+    _openSeries.append(columns.open);
+    _closeSeries.append(columns.close);
+    _volumeSeries.append(columns.volume);
+    _openInterest.append(columns.openInterest);
+    _timeSeries.append(columns.time);
+    _extraInfoSeries.resize(_extraInfoSeries.size() + count,
+                            (const BarExtraInfo*)0);
+  }
+
   virtual void forEach(tradery::BarHandler& barHandler,
                        size_t startBar = 0) const
       throw(BarIndexOutOfRangeException) {
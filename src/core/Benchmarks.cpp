@@ -0,0 +1,1059 @@
+/*
+Copyright (C) 2018 Adrian Michel
+http://www.amichel.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "seriesimpl.h"
+#include "bars.h"
+#include "indicators.h"
+#include "positions.h"
+#include "datamanager.h"
+#include "system.h"
+#include "Scheduler.h"
+#include "serieskernels.h"
+#include "seriesexpression.h"
+#include <benchmarks.h>
+#include <functional>
+#include <limits>
+
+#ifdef _DEBUG
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#define new DEBUG_NEW
+#endif
+
+using namespace tradery::benchmarks;
+
+// stands for an indicator calculation: a running average over the bars
+class MakeBenchmarkSeries : public CacheableBuilderX {
+ private:
+  const size_t _bars;
+  // counts the builds, each id should only be built once
+  std::atomic<size_t>& _builds;
+
+ public:
+  MakeBenchmarkSeries(const Id& id, size_t bars, std::atomic<size_t>& builds)
+      : CacheableBuilderX(id), _bars(bars), _builds(builds) {}
+
+  virtual CacheableSeriesPtr make() const {
+    _builds++;
+    std::auto_ptr<SeriesImpl> series(
+        new SeriesImpl(_bars, SynchronizerPtr(), id()));
+    double sum = 0;
+    for (size_t n = 0; n < _bars; n++) {
+      sum += (double)(n % 97);
+      series->at(n) = sum / (n + 1);
+    }
+    return CacheableSeriesPtr(new IndicatorCacheable(series.release(), id()));
+  }
+};
+
+CORE_API void tradery::benchmarks::cacheContention(std::ostream& os,
+                                                   unsigned int threads,
+                                                   size_t symbols,
+                                                   size_t passes) {
+  const size_t indicators = 8;
+  const size_t bars = 2500;
+
+  os << "cache contention - " << symbols << " symbols, " << indicators
+     << " indicators, " << passes << " passes" << std::endl;
+  os << std::setw(8) << "threads" << std::setw(12) << "mode" << std::setw(12)
+     << "seconds" << std::setw(16) << "lookups/s" << std::setw(10) << "builds"
+     << std::endl;
+
+  std::vector<unsigned int> counts(threadCounts(threads));
+  for (size_t c = 0; c < counts.size(); c++) {
+    for (int serialized = 0; serialized < 2; serialized++) {
+      // big enough to hold all the series, so only the first lookups build
+      SeriesCache cache((unsigned int)(symbols * indicators * 2), true);
+      std::atomic<size_t> builds(0);
+      Mutex mutex;
+      unsigned int t = counts[c];
+
+      double s = runThreads(t, [&](unsigned int thread) {
+        // each thread starts at a different symbol, and goes through all of
+        // them
+        size_t first = thread * symbols / t;
+        for (size_t pass = 0; pass < passes; pass++)
+          for (size_t n = 0; n < symbols; n++)
+            for (size_t i = 0; i < indicators; i++) {
+              Id id(Id("benchmark") << (unsigned int)((first + n) % symbols)
+                                    << (unsigned int)i);
+              MakeBenchmarkSeries builder(id, bars, builds);
+              if (serialized) {
+                Lock lock(mutex);
+                cache.findAndAdd(builder);
+              } else
+                cache.findAndAdd(builder);
+            }
+      });
+
+      double lookups = (double)t * passes * symbols * indicators;
+      os << std::setw(8) << t << std::setw(12)
+         << (serialized ? "serialized" : "sharded") << std::setw(12)
+         << std::fixed << std::setprecision(3) << s << std::setw(16)
+         << std::setprecision(0) << lookups / s << std::setw(10)
+         << (size_t)builds << std::endl;
+    }
+  }
+}
+
+CORE_API void tradery::benchmarks::cacheLatency(std::ostream& os,
+                                                unsigned int threads,
+                                                size_t lookups) {
+  const size_t ids = 4000;
+  const size_t bars = 500;
+
+  os << "cache lookup latency - " << threads << " threads, " << lookups
+     << " lookups each, " << ids << " ids, cache of " << ids / 2
+     << " items, in microseconds" << std::endl;
+  os << std::setw(10) << "janitor" << std::setw(10) << "p50" << std::setw(10)
+     << "p90" << std::setw(10) << "p99" << std::setw(10) << "p99.9"
+     << std::setw(10) << "max" << std::setw(12) << "evictions" << std::endl;
+
+  for (int janitor = 0; janitor < 2; janitor++) {
+    SeriesCache cache((unsigned int)(ids / 2), true);
+    std::atomic<size_t> builds(0);
+    std::vector<std::vector<double> > samples(threads);
+
+    std::atomic<bool> stop(false);
+    std::thread polling;
+    if (janitor)
+      polling = std::thread([&cache, &stop]() {
+        while (!stop) {
+          cache.evict();
+          std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+      });
+
+    runThreads(threads, [&](unsigned int thread) {
+      std::vector<double>& s = samples[thread];
+      s.reserve(lookups);
+      // a different sequence of ids in each thread
+      unsigned int random = 12345 + thread * 7919;
+      for (size_t n = 0; n < lookups; n++) {
+        random = random * 1103515245 + 12345;
+        Id id(Id("benchmark") << (unsigned int)((random >> 8) % ids));
+        MakeBenchmarkSeries builder(id, bars, builds);
+
+        Clock::time_point start(Clock::now());
+        cache.findAndAdd(builder);
+        s.push_back(seconds(start) * 1e6);
+      }
+    });
+
+    stop = true;
+    if (polling.joinable()) polling.join();
+
+    std::vector<double> all;
+    for (unsigned int t = 0; t < threads; t++)
+      all.insert(all.end(), samples[t].begin(), samples[t].end());
+    std::sort(all.begin(), all.end());
+
+    os << std::setw(10) << (janitor ? "10 ms" : "none") << std::fixed
+       << std::setprecision(2) << std::setw(10) << percentile(all, 50)
+       << std::setw(10) << percentile(all, 90) << std::setw(10)
+       << percentile(all, 99) << std::setw(10) << percentile(all, 99.9)
+       << std::setw(10) << percentile(all, 100) << std::setw(12)
+       << cache.stats().evictions << std::endl;
+  }
+}
+
+// runs a function once on each thread of a pool
+class OnEachThread : public TaskSource {
+ private:
+  const std::function<void(size_t)> _f;
+  // each element is only changed by its own thread
+  std::vector<char> _done;
+  std::atomic<size_t> _finished;
+
+ public:
+  OnEachThread(size_t threads, const std::function<void(size_t)>& f)
+      : _f(f), _done(threads, 0), _finished(0) {}
+
+  virtual bool runTask(size_t thread) {
+    if (_done[thread]) return false;
+    _f(thread);
+    _done[thread] = 1;
+    _finished++;
+    return true;
+  }
+
+  // returns the seconds it took for all the threads to run the function
+  double run(ThreadPool& pool) {
+    Clock::time_point start(Clock::now());
+    pool.add(this, 1);
+    while (_finished < _done.size()) std::this_thread::yield();
+    double s = seconds(start);
+    pool.remove(this);
+    return s;
+  }
+};
+
+CORE_API void tradery::benchmarks::threadPlacement(std::ostream& os,
+                                                   unsigned int threads,
+                                                   size_t megabytes,
+                                                   size_t passes) {
+  static const struct {
+    ThreadPlacement placement;
+    const char* name;
+  } placements[] = {{no_placement, "none"},
+                    {ideal_processor_placement, "ideal"},
+                    {compact_placement, "compact"},
+                    {scatter_placement, "scatter"},
+                    {node_placement, "node"}};
+
+  const size_t values = megabytes * 1024 * 1024 / sizeof(double);
+  const double gb = (double)threads * passes * values * sizeof(double) / 1e9;
+
+  os << "thread placement - " << threads << " threads, " << megabytes
+     << " MB each, " << passes << " passes, in GB/s" << std::endl;
+  os << std::setw(10) << "placement" << std::setw(8) << "nodes"
+     << std::setw(10) << "local" << std::setw(10) << "remote" << std::endl;
+
+  for (size_t p = 0; p < sizeof(placements) / sizeof(placements[0]); p++) {
+    ThreadPool pool(threads, placements[p].placement);
+    std::vector<std::vector<double> > buffers(threads);
+    std::vector<double> sums(threads, 0);
+
+    // each thread fills its own buffer, so the pages are allocated on the
+    // node of the thread
+    OnEachThread(threads, [&buffers, values](size_t t) {
+      buffers[t].assign(values, 1.0);
+    }).run(pool);
+
+    // the buffer each thread reads remotely: the next one that was filled on
+    // another node, or just the next one if all the threads are on one node
+    std::vector<size_t> remote(threads);
+    for (size_t t = 0; t < threads; t++) {
+      remote[t] = (t + 1) % threads;
+      for (size_t n = 1; n < threads; n++)
+        if (pool.node((t + n) % threads) != pool.node(t)) {
+          remote[t] = (t + n) % threads;
+          break;
+        }
+    }
+
+    auto read = [&buffers, &sums, values, passes](size_t t, size_t b) {
+      const double* v = &buffers[b][0];
+      double sum = 0;
+      for (size_t pass = 0; pass < passes; pass++)
+        for (size_t n = 0; n < values; n++) sum += v[n];
+      sums[t] += sum;
+    };
+
+    double local =
+        OnEachThread(threads, [&read](size_t t) { read(t, t); }).run(pool);
+    double other =
+        OnEachThread(threads, [&read, &remote](size_t t) {
+          read(t, remote[t]);
+        }).run(pool);
+
+    // all the values are 1, and the sums keep the reads from being optimized
+    // away
+    for (size_t t = 0; t < threads; t++)
+      if (sums[t] != 2.0 * passes * values) os << "wrong sum" << std::endl;
+
+    os << std::setw(10) << placements[p].name << std::setw(8) << pool.nodes()
+       << std::fixed << std::setprecision(2) << std::setw(10) << gb / local
+       << std::setw(10) << gb / other << std::endl;
+  }
+}
+
+// the operations of the expressions, as in the T3 and adaptive bands systems
+static const char* const _operations[] = {"EMA", "SMA", "StdDev",
+                                          "multiply by value"};
+
+// the ids of an expression on the close of a symbol, each series calculated
+// from the previous one, made the way they were when ids were strings: the
+// id of the input followed by the operation and its parameters
+static void makeIds(size_t symbol, size_t depth,
+                    std::vector<std::string>& ids) {
+  std::ostringstream close;
+  // the bars ids were made of the location of their data
+  close << "c:\\data\\symbol" << symbol << ".csv - 0 - 2500 - close";
+  std::string id(close.str());
+  for (size_t n = 0; n < depth; n++) {
+    std::ostringstream o;
+    o << id << " - " << _operations[n % 4] << " - " << (unsigned int)(10 + n);
+    id = o.str();
+    ids.push_back(id);
+  }
+}
+
+// the same ids, as they are made now
+static void makeIds(size_t symbol, size_t depth, std::vector<Id>& ids) {
+  Id id(Id("close") << (unsigned int)symbol);
+  for (size_t n = 0; n < depth; n++) {
+    id = Id(_operations[n % 4]) << id << (unsigned int)(10 + n);
+    ids.push_back(id);
+  }
+}
+
+static size_t idBytes(const std::string& id) { return id.size(); }
+static size_t idBytes(const Id& id) { return sizeof(id); }
+
+template <class T>
+static void idCost(std::ostream& os, const char* name, size_t symbols,
+                   size_t depth, size_t repeats) {
+  std::vector<T> ids;
+  ids.reserve(symbols * depth);
+
+  Clock::time_point start(Clock::now());
+  for (size_t r = 0; r < repeats; r++) {
+    ids.clear();
+    for (size_t s = 0; s < symbols; s++) makeIds(s, depth, ids);
+  }
+  double build = seconds(start);
+
+  // the cache map is ordered by id
+  std::map<T, size_t> map;
+  size_t bytes = 0;
+  for (size_t n = 0; n < ids.size(); n++) {
+    map.insert(std::make_pair(ids[n], n));
+    bytes += idBytes(ids[n]);
+  }
+
+  size_t found = 0;
+  start = Clock::now();
+  for (size_t r = 0; r < repeats; r++)
+    for (size_t n = 0; n < ids.size(); n++)
+      found += map.find(ids[n]) != map.end() ? 1 : 0;
+  double lookup = seconds(start);
+
+  double count = (double)repeats * ids.size();
+  os << std::setw(8) << name << std::setw(10) << ids.size() << std::setw(12)
+     << bytes / max2(ids.size(), (size_t)1) << std::fixed
+     << std::setprecision(1) << std::setw(12) << build / count * 1e9
+     << std::setw(12) << lookup / count * 1e9 << std::setw(12)
+     << (build + lookup) / count * 1e9 << std::endl;
+  if (found != ids.size() * repeats) os << "missing ids" << std::endl;
+}
+
+CORE_API void tradery::benchmarks::cacheIds(std::ostream& os, size_t symbols,
+                                            size_t depth, size_t repeats) {
+  os << "cache ids - " << symbols << " symbols, expressions " << depth
+     << " deep, " << repeats << " repeats, in nanoseconds per id"
+     << std::endl;
+  os << std::setw(8) << "ids" << std::setw(10) << "count" << std::setw(12)
+     << "avg bytes" << std::setw(12) << "build" << std::setw(12) << "lookup"
+     << std::setw(12) << "total" << std::endl;
+
+  idCost<std::string>(os, "string", symbols, depth, repeats);
+  idCost<Id>(os, "hash", symbols, depth, repeats);
+}
+
+static const struct {
+  const char* name;
+  SeriesKernels::SeriesOp SeriesKernels::*op;
+} _seriesOps[] = {{"add", &SeriesKernels::add},
+                  {"subtract", &SeriesKernels::subtract},
+                  {"multiply", &SeriesKernels::multiply},
+                  {"divide", &SeriesKernels::divide},
+                  {"min", &SeriesKernels::min},
+                  {"max", &SeriesKernels::max}};
+
+static const struct {
+  const char* name;
+  SeriesKernels::ValueOp SeriesKernels::*op;
+} _valueOps[] = {{"add value", &SeriesKernels::addValue},
+                 {"subtract value", &SeriesKernels::subtractValue},
+                 {"multiply value", &SeriesKernels::multiplyByValue},
+                 {"divide value", &SeriesKernels::divideByValue},
+                 {"value subtract", &SeriesKernels::subtractFromValue},
+                 {"value divide", &SeriesKernels::divideValueBy},
+                 {"std dev", &SeriesKernels::stdDevFromVariance}};
+
+// random values in [-100, 100), with some zeros and NaNs if special is true,
+// which the kernels must handle the same way as the scalar code
+static std::vector<double> randomValues(size_t size, unsigned int seed,
+                                        bool special) {
+  std::vector<double> v(size);
+  unsigned int random = seed;
+  for (size_t n = 0; n < size; n++) {
+    random = random * 1103515245 + 12345;
+    v[n] = ((random >> 8) % 20000) / 100.0 - 100;
+    if (special && (random >> 4) % 97 == 0) v[n] = 0;
+    if (special && (random >> 4) % 101 == 0)
+      v[n] = std::numeric_limits<double>::quiet_NaN();
+  }
+  return v;
+}
+
+// the number of values that are not the same, bit for bit
+static size_t differences(const double* x, const double* y, size_t size) {
+  size_t count = 0;
+  for (size_t n = 0; n < size; n++)
+    if (memcmp(x + n, y + n, sizeof(double)) != 0) count++;
+  return count;
+}
+
+// the seconds of the fastest of repeats calls to f
+template <class F>
+static double fastest(size_t repeats, F f) {
+  double best = 0;
+  for (size_t r = 0; r < max2(repeats, (size_t)1); r++) {
+    Clock::time_point start(Clock::now());
+    f();
+    double s = seconds(start);
+    if (r == 0 || s < best) best = s;
+  }
+  return best;
+}
+
+// the calculations the kernels replace, as they were
+static void referenceSma(const double* v, size_t size, unsigned int period,
+                         double* r) {
+  double f = 0;
+  unsigned int n = 0;
+  for (; n < period; n++) f += v[n];
+  r[period - 1] = f / (double)period;
+  for (; n < size; n++)
+    r[n] = r[n - 1] + (v[n] - v[n - period]) / (double)period;
+}
+
+static void referenceEma(const double* v, size_t size, unsigned int period,
+                         double exp, double* r) {
+  double f = 0;
+  unsigned int n = 0;
+  for (; n < period; n++) f += v[n];
+  r[period - 1] = f / (double)period;
+  for (; n < size; n++) r[n] = exp * (v[n] - r[n - 1]) + r[n - 1];
+}
+
+static void referenceWma(const double* v, const double* sma, size_t size,
+                         unsigned int period, double* r) {
+  double f = 0;
+  double sigma = (period + 1) * period / 2;
+  unsigned int n = 0;
+  for (; n < period; n++) f += (n + 1) * v[n];
+  r[period - 1] = f / sigma;
+  for (; n < size; n++)
+    r[n] = r[n - 1] - sma[n - 1] * (float)period / sigma +
+           period * v[n] / sigma;
+}
+
+CORE_API void tradery::benchmarks::seriesKernels(std::ostream& os,
+                                                 size_t size,
+                                                 unsigned int period,
+                                                 size_t repeats) {
+  // the indicators need at least 2 values in their period, and one more value
+  period = max2(period, 2u);
+  size = max2(size, (size_t)period + 1);
+  std::vector<const SeriesKernels*> kernels(SeriesKernels::supported());
+  const double values = (double)size / 1e6;
+
+  os << "series kernels - " << size << " values, best of " << repeats
+     << ", in millions of values per second" << std::endl;
+  os << std::setw(16) << "kernel";
+  for (size_t k = 0; k < kernels.size(); k++)
+    os << std::setw(10) << kernels[k]->name;
+  os << std::setw(14) << "differences" << std::endl;
+
+  const std::vector<double> x(randomValues(size, 12345, true));
+  const std::vector<double> y(randomValues(size, 67890, true));
+  std::vector<double> expected(size);
+  std::vector<double> r(size);
+
+  for (size_t o = 0; o < sizeof(_seriesOps) / sizeof(_seriesOps[0]); o++) {
+    os << std::setw(16) << _seriesOps[o].name << std::fixed
+       << std::setprecision(0);
+    size_t different = 0;
+    for (size_t k = 0; k < kernels.size(); k++) {
+      SeriesKernels::SeriesOp op = kernels[k]->*_seriesOps[o].op;
+      double s = fastest(repeats, [&]() { op(&x[0], &y[0], &r[0], size); });
+      os << std::setw(10) << values / s;
+      // the scalar kernels are first
+      if (k == 0)
+        expected = r;
+      else
+        different += differences(&expected[0], &r[0], size);
+    }
+    os << std::setw(14) << different << std::endl;
+  }
+
+  for (size_t o = 0; o < sizeof(_valueOps) / sizeof(_valueOps[0]); o++) {
+    os << std::setw(16) << _valueOps[o].name << std::fixed
+       << std::setprecision(0);
+    size_t different = 0;
+    for (size_t k = 0; k < kernels.size(); k++) {
+      SeriesKernels::ValueOp op = kernels[k]->*_valueOps[o].op;
+      double s = fastest(repeats, [&]() { op(&x[0], 2.5, &r[0], size); });
+      os << std::setw(10) << values / s;
+      if (k == 0)
+        expected = r;
+      else
+        different += differences(&expected[0], &r[0], size);
+    }
+    os << std::setw(14) << different << std::endl;
+  }
+
+  // the indicators, compared with the calculations they replace, on values
+  // without NaNs, for which rolling min and max are documented to differ
+  const std::vector<double> v(randomValues(size, 13579, false));
+  const double* in = &v[0];
+  std::vector<double> sma(size);
+  SeriesKernels::sma(in, size, period, &sma[0]);
+  const double exp = 2.0 / (period + 1);
+  const size_t first = period - 1;
+  const size_t count = size - first;
+  int begIdx;
+  int nbElement;
+
+  os << std::endl
+     << "indicators - period " << period << ", " << kernels.back()->name
+     << " kernels, in milliseconds" << std::endl;
+  os << std::setw(16) << "indicator" << std::setw(12) << "reference"
+     << std::setw(12) << "kernels" << std::setw(14) << "differences"
+     << std::endl;
+
+  for (int i = 0; i < 6; i++) {
+    std::fill(expected.begin(), expected.end(), 0.0);
+    std::fill(r.begin(), r.end(), 0.0);
+    double* e = &expected[0];
+    double* k = &r[0];
+    const char* name = 0;
+    double reference = 0;
+    double kernel = 0;
+
+    switch (i) {
+      case 0:
+        name = "SMA";
+        reference =
+            fastest(repeats, [&]() { referenceSma(in, size, period, e); });
+        kernel = fastest(repeats,
+                         [&]() { SeriesKernels::sma(in, size, period, k); });
+        break;
+      case 1:
+        name = "EMA";
+        reference = fastest(
+            repeats, [&]() { referenceEma(in, size, period, exp, e); });
+        kernel = fastest(repeats, [&]() {
+          SeriesKernels::ema(in, size, period, exp, k);
+        });
+        break;
+      case 2:
+        name = "WMA";
+        reference = fastest(repeats, [&]() {
+          referenceWma(in, &sma[0], size, period, e);
+        });
+        kernel = fastest(repeats, [&]() {
+          SeriesKernels::wma(in, &sma[0], size, period, k);
+        });
+        break;
+      case 3:
+        name = "min";
+        reference = fastest(repeats, [&]() {
+          TA_MIN(0, (int)size - 1, in, period, &begIdx, &nbElement,
+                 e + first);
+        });
+        kernel = fastest(repeats, [&]() {
+          SeriesKernels::rollingMin(in, size, period, k);
+        });
+        break;
+      case 4:
+        name = "max";
+        reference = fastest(repeats, [&]() {
+          TA_MAX(0, (int)size - 1, in, period, &begIdx, &nbElement,
+                 e + first);
+        });
+        kernel = fastest(repeats, [&]() {
+          SeriesKernels::rollingMax(in, size, period, k);
+        });
+        break;
+      case 5:
+        name = "std dev";
+        reference = fastest(repeats, [&]() {
+          TA_STDDEV(0, (int)size - 1, in, period, 2.0, &begIdx, &nbElement,
+                    e + first);
+        });
+        kernel = fastest(repeats, [&]() {
+          SeriesKernels::stdDev(in, size, period, 2.0, k);
+        });
+        break;
+    }
+
+    os << std::setw(16) << name << std::fixed << std::setprecision(3)
+       << std::setw(12) << reference * 1000 << std::setw(12) << kernel * 1000
+       << std::setw(14) << differences(e + first, k + first, count)
+       << std::endl;
+  }
+}
+
+CORE_API void tradery::benchmarks::compoundOps(std::ostream& os, size_t size,
+                                               size_t repeats) {
+  size = max2(size, (size_t)1);
+  // values in [1, 2), so the repeated operations don't overflow or divide by
+  // 0
+  std::vector<double> initial(size);
+  SeriesImpl a(size, SynchronizerPtr(), Id("benchmark a"));
+  SeriesImpl* bImpl =
+      new SeriesImpl(size, SynchronizerPtr(), Id("benchmark b"));
+  SeriesAbstrPtr b(bImpl);
+  unsigned int random = 12345;
+  for (size_t n = 0; n < size; n++) {
+    random = random * 1103515245 + 12345;
+    initial[n] = 1 + ((random >> 8) % 1000) / 1000.0;
+    bImpl->at(n) = 1 + ((random >> 4) % 997) / 997.0;
+  }
+  double* values = &a.at(0);
+  std::vector<double> expected(size);
+
+  // the operations made a new series through the cache, and copied its
+  // values back
+  auto assign = [values](SeriesAbstrPtr r) {
+    std::copy(r->getVector().begin(), r->getVector().end(), values);
+  };
+
+  os << "compound operations - " << size << " values, best of " << repeats
+     << ", in milliseconds" << std::endl;
+  os << std::setw(12) << "operation" << std::setw(12) << "old"
+     << std::setw(12) << "in place" << std::setw(14) << "differences"
+     << std::endl;
+
+  for (int i = 0; i < 8; i++) {
+    std::function<void()> old;
+    std::function<void()> inPlace;
+    const char* name = 0;
+    switch (i) {
+      case 0:
+        name = "*= series";
+        old = [&]() { assign(a * b); };
+        inPlace = [&]() { a *= b; };
+        break;
+      case 1:
+        name = "+= series";
+        old = [&]() { assign(a + b); };
+        inPlace = [&]() { a += b; };
+        break;
+      case 2:
+        name = "-= series";
+        old = [&]() { assign(a - b); };
+        inPlace = [&]() { a -= b; };
+        break;
+      case 3:
+        name = "/= series";
+        old = [&]() { assign(a / b); };
+        inPlace = [&]() { a /= b; };
+        break;
+      case 4:
+        name = "*= value";
+        old = [&]() { assign(a * 1.5); };
+        inPlace = [&]() { a *= 1.5; };
+        break;
+      case 5:
+        name = "+= value";
+        old = [&]() { assign(a + 1.5); };
+        inPlace = [&]() { a += 1.5; };
+        break;
+      case 6:
+        name = "-= value";
+        old = [&]() { assign(a - 1.5); };
+        inPlace = [&]() { a -= 1.5; };
+        break;
+      case 7:
+        name = "/= value";
+        old = [&]() { assign(a / 1.5); };
+        inPlace = [&]() { a /= 1.5; };
+        break;
+    }
+
+    // one operation from the same values both ways, to compare the results
+    std::copy(initial.begin(), initial.end(), values);
+    old();
+    std::copy(values, values + size, expected.begin());
+    std::copy(initial.begin(), initial.end(), values);
+    inPlace();
+    size_t different = differences(&expected[0], values, size);
+
+    std::copy(initial.begin(), initial.end(), values);
+    double oldSeconds = fastest(repeats, old);
+    std::copy(initial.begin(), initial.end(), values);
+    double inPlaceSeconds = fastest(repeats, inPlace);
+
+    os << std::setw(12) << name << std::fixed << std::setprecision(3)
+       << std::setw(12) << oldSeconds * 1000 << std::setw(12)
+       << inPlaceSeconds * 1000 << std::setw(14) << different << std::endl;
+  }
+}
+
+// a series of random values, shared through the series cache
+class MakeRandomSeries : public CacheableBuilderX {
+ private:
+  const size_t _size;
+  const unsigned int _seed;
+
+ public:
+  MakeRandomSeries(const Id& id, size_t size, unsigned int seed)
+      : CacheableBuilderX(id), _size(size), _seed(seed) {}
+
+  virtual CacheableSeriesPtr make() const {
+    std::vector<double> values(randomValues(_size, _seed, false));
+    std::auto_ptr<SeriesImpl> series(new SeriesImpl(id()));
+    series->append(values);
+    return CacheableSeriesPtr(new IndicatorCacheable(series.release(), id()));
+  }
+};
+
+CORE_API void tradery::benchmarks::expressions(std::ostream& os, size_t size,
+                                               size_t repeats) {
+  size = max2(size, (size_t)1);
+  const SeriesKernels& k = SeriesKernels::get();
+
+  Series s[4];
+  SeriesExpressionPtr leaves[4];
+  const double* v[4];
+  for (unsigned int n = 0; n < 4; n++) {
+    SeriesAbstrPtr series(_cache->findAndAdd(
+        MakeRandomSeries(Id("benchmark expression") << n, size, 1000 + n)));
+    s[n] = Series(series);
+    leaves[n].reset(new SeriesExpression(series));
+    v[n] = s[n].getArray();
+  }
+
+  // (s1 + s2) / (s3 - s4) * 2
+  SeriesExpression expression(
+      multiply_by_value_operation,
+      SeriesExpressionPtr(new SeriesExpression(
+          divide_operation,
+          SeriesExpressionPtr(
+              new SeriesExpression(add_operation, leaves[0], leaves[1])),
+          SeriesExpressionPtr(new SeriesExpression(subtract_operation,
+                                                   leaves[2], leaves[3])))),
+      2.0);
+
+  std::vector<double> fused(size);
+  std::vector<double> separate(size);
+  // each operation makes a new series, as they used to
+  auto oneAtATime = [&]() {
+    std::vector<double> sum(size);
+    std::vector<double> difference(size);
+    std::vector<double> ratio(size);
+    std::vector<double> r(size);
+    k.add(v[0], v[1], &sum[0], size);
+    k.subtract(v[2], v[3], &difference[0], size);
+    k.divide(&sum[0], &difference[0], &ratio[0], size);
+    k.multiplyByValue(&ratio[0], 2.0, &r[0], size);
+    separate.swap(r);
+  };
+  auto allAtOnce = [&]() {
+    std::vector<double> r(size);
+    expression.evaluate(&r[0]);
+    fused.swap(r);
+  };
+
+  os << "expressions - (s1 + s2) / (s3 - s4) * 2 on " << size
+     << " values, best of " << repeats << ", in milliseconds" << std::endl;
+  os << std::setw(16) << "one at a time" << std::setw(12) << "fused"
+     << std::setw(14) << "differences" << std::endl;
+  double separateSeconds = fastest(repeats, oneAtATime);
+  double fusedSeconds = fastest(repeats, allAtOnce);
+  os << std::fixed << std::setprecision(3) << std::setw(16)
+     << separateSeconds * 1000 << std::setw(12) << fusedSeconds * 1000
+     << std::setw(14) << differences(&separate[0], &fused[0], size)
+     << std::endl;
+
+  // the same expression through the Series operators, which defer it as all
+  // the operands are in the cache
+  Series e((s[0] + s[1]) / (s[2] - s[3]) * 2);
+  const ExpressionSeries* deferred =
+      dynamic_cast<const ExpressionSeries*>(&e.getSeries());
+  size_t operators = differences(&separate[0], e.getArray(), size);
+
+  std::vector<double> sum(size);
+  k.add(v[0], v[1], &sum[0], size);
+  std::vector<double> twice(size);
+  k.multiplyByValue(&sum[0], 2.0, &twice[0], size);
+
+  // a series that isn't in the cache, modified after the expression on it is
+  // made, which is calculated from the values it had at the time
+  Series a;
+  std::vector<double> values(v[0], v[0] + size);
+  a.append(values);
+  Series aPlus(a + s[1]);
+  a += 1;
+  size_t operandModified = differences(&sum[0], aPlus.getArray(), size);
+
+  // a calculated expression modified after another expression is made from
+  // it, which leaves the other expression and the cached result alone
+  Series c(s[0] + s[1]);
+  c.getArray();
+  Series d(c * 2);
+  c += 1;
+  size_t resultModified = differences(&twice[0], d.getArray(), size) +
+                          differences(&sum[0], (s[0] + s[1]).getArray(), size);
+
+  os << std::endl
+     << "checks - the number of values different from those calculated one "
+        "operation at a time, should be 0"
+     << std::endl;
+  os << std::setw(40) << std::left << "operators" << std::right
+     << std::setw(10) << operators << (deferred != 0 ? "  deferred" : "")
+     << std::endl;
+  os << std::setw(40) << std::left << "operand modified after the expression"
+     << std::right << std::setw(10) << operandModified << std::endl;
+  os << std::setw(40) << std::left << "result modified after its use"
+     << std::right << std::setw(10) << resultModified << std::endl;
+}
+
+// sums the gains of the positions through their handles
+class SumGains : public PositionHandler {
+ public:
+  double sum;
+
+  SumGains() : sum(0) {}
+
+  virtual void onPosition(Position pos) { sum += pos.getGain(); }
+};
+
+CORE_API void tradery::benchmarks::positions(std::ostream& os, size_t count,
+                                             size_t repeats) {
+  const size_t symbolsCount = 100;
+  std::vector<std::string> symbols;
+  for (size_t n = 0; n < symbolsCount; n++) {
+    std::ostringstream o;
+    o << "SYMBOL" << n;
+    symbols.push_back(o.str());
+  }
+
+  // closed positions, in random order of their entry times and gains
+  std::vector<PositionAbstrPtr> all;
+  all.reserve(count);
+  Clock::time_point start(Clock::now());
+  unsigned int random = 12345;
+  for (size_t n = 0; n < count; n++) {
+    random = random * 1103515245 + 12345;
+    __int64 entry = 946857600 + (random >> 4) % (count * 60 + 1);
+    double price = 10 + ((random >> 8) % 10000) / 100.0;
+    const std::string& symbol = symbols[n % symbolsCount];
+    if (random & 0x100) {
+      LongPosition* p = new LongPosition(
+          market_order, symbol, 100, price, 0, 1, DateTime(entry), n, "buy",
+          ManagedPtr<const std::string>(), false);
+      p->closeLong(market_order, price * 1.01, 0, 1, DateTime(entry + 3600),
+                   n + 1, "sell");
+      all.push_back(PositionAbstrPtr(p));
+    } else {
+      ShortPosition* p = new ShortPosition(
+          market_order, symbol, 100, price, 0, 1, DateTime(entry), n, "short",
+          ManagedPtr<const std::string>(), false);
+      p->closeShort(market_order, price * 0.98, 0, 1, DateTime(entry + 3600),
+                    n + 1, "cover");
+      all.push_back(PositionAbstrPtr(p));
+    }
+  }
+  double created = seconds(start);
+
+  os << "positions - " << count << " closed positions, best of " << repeats
+     << ", created in " << std::fixed << std::setprecision(1)
+     << created * 1000 << " ms, in milliseconds" << std::endl;
+  os << std::setw(16) << "operation" << std::setw(12) << "handles"
+     << std::setw(12) << "columns" << std::endl;
+
+  // each sort starts from the positions in the order they were created: the
+  // old ones sort a list of handles, the new ones sort on the columns
+  for (int gain = 0; gain < 2; gain++) {
+    double handles = 0;
+    double columns = 0;
+    for (size_t r = 0; r < max2(repeats, (size_t)1); r++) {
+      std::list<PositionAbstrPtr> list(all.begin(), all.end());
+      start = Clock::now();
+      if (gain)
+        list.sort(LessGainPredicate());
+      else
+        list.sort(LessEntryTimePredicate());
+      double s = seconds(start);
+      if (r == 0 || s < handles) handles = s;
+
+      PositionsContainerImpl container;
+      for (size_t n = 0; n < all.size(); n++) container.add(all[n]);
+      start = Clock::now();
+      if (gain)
+        container.sortByGain();
+      else
+        container.sortByEntryTime();
+      s = seconds(start);
+      if (r == 0 || s < columns) columns = s;
+    }
+    os << std::setw(16) << (gain ? "sort by gain" : "sort by entry")
+       << std::setprecision(3) << std::setw(12) << handles * 1000
+       << std::setw(12) << columns * 1000 << std::endl;
+  }
+
+  // the sum of the gains, through the handles, and from the columns, built
+  // and then summed
+  PositionsContainerImpl container;
+  for (size_t n = 0; n < all.size(); n++) container.add(all[n]);
+  double handlesSum = 0;
+  double columnsSum = 0;
+  double handles = fastest(repeats, [&]() {
+    SumGains sumGains;
+    container.forEach(sumGains);
+    handlesSum = sumGains.sum;
+  });
+  double build = fastest(repeats, [&]() { container.columns(); });
+  PositionColumns c(container.columns());
+  double sum = fastest(repeats, [&]() {
+    columnsSum = 0;
+    for (size_t n = 0; n < c.size(); n++) columnsSum += c.gains[n];
+  });
+
+  os << std::setw(16) << "build columns" << std::setw(12) << "-"
+     << std::setw(12) << build * 1000 << std::endl;
+  os << std::setw(16) << "sum of gains" << std::setw(12) << handles * 1000
+     << std::setw(12) << sum * 1000 << std::endl;
+  if (handlesSum != columnsSum) os << "different sums" << std::endl;
+}
+
+// a reference count under a lock, the way RefCountable used to count
+class LockedCount {
+ private:
+  mutable Mutex _mutex;
+  mutable int _count;
+
+ public:
+  LockedCount() : _count(1) {}
+
+  void addRef() const {
+    Lock lock(_mutex);
+    _count++;
+  }
+
+  bool release() {
+    Lock lock(_mutex);
+    return --_count == 0;
+  }
+};
+
+CORE_API void tradery::benchmarks::refCounts(std::ostream& os,
+                                             size_t copies) {
+  static const unsigned int counts[] = {1, 8, 32};
+
+  os << "reference counts - " << copies
+     << " copies and destructions by each thread" << std::endl;
+  os << std::setw(8) << "threads" << std::setw(10) << "object"
+     << std::setw(10) << "count" << std::setw(12) << "ns/copy"
+     << std::setw(16) << "copies/s" << std::endl;
+
+  for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+    unsigned int t = counts[c];
+    // all the threads copy the same pointer, as with a series shared by the
+    // runnables of a session, or each one copies its own
+    for (int shared = 1; shared >= 0; shared--) {
+      for (int locked = 0; locked < 2; locked++) {
+        ManagedPtr<int> common(new int(0));
+        LockedCount commonCount;
+
+        double s = runThreads(t, [&](unsigned int) {
+          ManagedPtr<int> own(new int(0));
+          LockedCount ownCount;
+          const ManagedPtr<int>& p(shared ? common : own);
+          LockedCount& count(shared ? commonCount : ownCount);
+
+          for (size_t n = 0; n < copies; n++) {
+            if (locked) {
+              count.addRef();
+              count.release();
+            } else {
+              ManagedPtr<int> copy(p);
+            }
+          }
+        });
+
+        double total = (double)t * copies;
+        os << std::setw(8) << t << std::setw(10)
+           << (shared ? "shared" : "own") << std::setw(10)
+           << (locked ? "locked" : "atomic") << std::fixed
+           << std::setprecision(1) << std::setw(12) << s / copies * 1e9
+           << std::setprecision(0) << std::setw(16) << total / s << std::endl;
+      }
+    }
+  }
+}
+
+// logs a line the way it used to be done: formatted and written with the log
+// lock held, opening and closing the log file for each line
+static void lockedLog(Mutex& mutex, const std::string& fileName, Level level,
+                      const char* function, const std::string& value) {
+  Lock lock(mutex);
+  if (Log::checkLevel(level)) {
+    std::string h = Log::header(level, function);
+    std::ofstream file(fileName.c_str(), std::ios_base::ate |
+                                             std::ios_base::out |
+                                             std::ios_base::app);
+    file << h << value << std::endl;
+  }
+}
+
+CORE_API void tradery::benchmarks::logging(std::ostream& os,
+                                           unsigned int threads,
+                                           size_t lines) {
+  char path[MAX_PATH + 1];
+  std::string fileName(
+      std::string(GetTempPathA(MAX_PATH + 1, path) > 0 ? path : ".\\") +
+      "benchmark.log");
+  std::string logFile(Log::getLogFileName());
+  Level level(Log::level());
+  Log::setLevel(log_info);
+  // the lines logged so far go to the log file, not to the benchmark one
+  Log::flush();
+
+  os << "logging - " << lines << " lines logged by each thread" << std::endl;
+  os << std::setw(8) << "threads" << std::setw(10) << "logger"
+     << std::setw(12) << "seconds" << std::setw(16) << "lines/s"
+     << std::setw(12) << "ns/line" << std::endl;
+
+  std::vector<unsigned int> counts(threadCounts(threads));
+  for (size_t c = 0; c < counts.size(); c++) {
+    unsigned int t = counts[c];
+    for (int locked = 0; locked < 2; locked++) {
+      std::remove(fileName.c_str());
+      Mutex mutex;
+      if (!locked) Log::setLogToFile(fileName);
+
+      double s = runThreads(t, [&](unsigned int thread) {
+        for (size_t n = 0; n < lines; n++) {
+          std::ostringstream o;
+          o << "thread " << thread << ", line " << n;
+          if (locked)
+            lockedLog(mutex, fileName, log_info, "benchmark", o.str());
+          else
+            Log::xlog(log_info, "benchmark", o.str());
+        }
+      });
+
+      if (!locked) {
+        // the lines are only logged once they are on disk
+        Clock::time_point start(Clock::now());
+        Log::flush();
+        s += seconds(start);
+        Log::setLogToFile(logFile);
+      }
+
+      double total = (double)t * lines;
+      os << std::setw(8) << t << std::setw(10)
+         << (locked ? "locked" : "queued") << std::fixed
+         << std::setprecision(3) << std::setw(12) << s
+         << std::setprecision(0) << std::setw(16) << total / s
+         << std::setprecision(1) << std::setw(12) << s / total * 1e9
+         << std::endl;
+    }
+  }
+
+  std::remove(fileName.c_str());
+  Log::setLevel(level);
+}
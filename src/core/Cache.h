@@ -18,11 +18,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
-typedef std::string Id;
+#include "cachepolicy.h"
+#include "id.h"
 
 /**
- * Abstract based class for classes that can have an id. The id is currently
- * implemented as a string
+ * Abstract based class for classes that can have an id. The id is a
+ * structural hash, see Id
  *
  * The cache uses the id to identify the cached objects
  */
@@ -86,6 +87,40 @@ class CacheableBuilder {
   virtual ~CacheableBuilder() {}
 };
 
+/**
+ * Approximate memory used by a cached series - the values vector
+ */
+inline size_t cacheableBytes(const tradery::SeriesAbstr* series) {
+  return series == 0 ? 0 : series->unsyncSize() * sizeof(double);
+}
+
+/**
+ * Approximate memory used by a cached data collection. For bars, these are the
+ * 6 value series, the time series and the extra info series
+ */
+inline size_t cacheableBytes(const tradery::DataCollection* data) {
+  if (data == 0) return 0;
+
+  const tradery::BarsAbstr* bars =
+      dynamic_cast<const tradery::BarsAbstr*>(data);
+  if (bars != 0)
+    return bars->unsyncSize() *
+           (6 * sizeof(double) + sizeof(tradery::DateTime) + sizeof(void*));
+  else
+    return data->size() * sizeof(double);
+}
+
+/**
+ * Called when a series is added to a cache, see SeriesImpl::share
+ */
+void cacheableShared(const tradery::SeriesAbstr* series);
+
+/**
+ * Called when a data collection is added to a cache, shares the series of
+ * bars
+ */
+void cacheableShared(const tradery::DataCollection* data);
+
 /**
  * abstract base class for a cache thread class
  *
@@ -139,21 +174,25 @@ inline void cache_thread_func(void* param) {
  * all pointing to the same object and reference countable. in which case the
  * count is > 0. When they all go out of their respective scope, the count
  * decreases to 0. At this moment the cache knows that the object is no longer
- * in use and may choose to remove it, or keep it (this is still to be
- * determined). This is done in the background thread running in the Cache - it
- * keep looking for objects with reference 0, and it may choose to remove some
- * of them based on how long they have been there, how much memory is being used
- * and other criteria. The two extremes would be to either remove all objects
- * with reference count 0 immediately, or to keep everthing for the life time of
- * the cache object and only delete all of them in the destructor of the cache.
+ * in use and may choose to remove it, or keep it, based on the eviction policy
+ * and the item count and memory budget.
+ *
+ * There is no polling: the cache registers itself as the ReleaseListener of
+ * every cached object, and when the cache is over budget but everything in it
+ * is in use, the release of the last outside reference to an object wakes up
+ * the background thread, which then evicts what it can. Otherwise the
+ * background thread just waits on a condition. Objects that are replaced
+ * because they are no longer consistent are simply dropped from the cache, and
+ * get deleted when their last user releases them.
  *
  * Regarding the Id's, they are calculated by the cached objects themselves -
  * the only requirement is that they be unique for unique objects
  *
  * The currently cached classes, such as Series or DataCollection calculate the
  * id in a recursive fashion. A series can be created as a result of an
- * operation on other series, and all the information regarding its ancestors
- * and how it was calculated is stored in the id.
+ * operation on other series, and its id is a hash of the operation, its
+ * parameters and the ids of the series it was calculated from, so it
+ * identifies all its ancestors in a fixed size.
  *
  *
  * Empty Series, which are created by the user, are given an unique initial id,
@@ -169,32 +208,190 @@ inline void cache_thread_func(void* param) {
  * on the same id at the same time and not find it, and they would all try to
  * add the new item, which could be a problem.
  *
- * The cache is implemented as a block allocated map
+ * The cache is split in a fixed number of shards, selected by the hash of the
+ * id, each with its own map and lock, so threads looking up different ids
+ * don't contend with each other. A cache hit only takes the shard lock in
+ * shared mode, so any number of threads can read the same shard at the same
+ * time.
+ *
+ * Objects are never built while holding a lock: the first thread that misses
+ * on an id registers an "in flight" entry for it and calls make outside of the
+ * lock, and any other thread asking for the same id in the meantime waits on
+ * that entry's future instead of building the object a second time. If make
+ * throws, the exception is passed on to all the waiting threads.
  *
  * The cache is derived from CacheThread - its method run is the background
- * thread
+ * maintenance thread
  *
  * The cache is thread safe
  */
 template <class T>
-class Cache : public CacheThread {
+class Cache : public CacheThread, public ReleaseListener {
   typedef Cacheable<T> CacheableT;
-  typedef std::vector<CacheableT> ParkVector;
 
-  typedef ConstPtrMap<Id, CacheableT> CacheableMap;
+  /**
+   * A cached object along with its eviction bookkeeping
+   */
+  class Entry : public CacheEntryBase {
+   private:
+    const Id _id;
+    const CacheableT* _cacheable;
+
+   public:
+    Entry(const Id& id, const CacheableT* cacheable, double cost,
+          ReleaseListener* listener)
+        : CacheEntryBase(cacheableBytes(cacheable->get()), cost),
+          _id(id),
+          _cacheable(cacheable) {
+      // before the object is published to the other threads
+      cacheableShared(cacheable->get());
+      _cacheable->getRC()->setListener(listener);
+    }
+
+    virtual ~Entry() { delete release(); }
+
+    const Id& id() const { return _id; }
+    const CacheableT& cacheable() const {
+      assert(_cacheable != 0);
+      return *_cacheable;
+    }
+
+    virtual bool isReferred() const {
+      return _cacheable != 0 && _cacheable->isReferred();
+    }
+
+    // releases the cache reference to the object, the entry itself may live
+    // on for a while in the eviction policy
+    const CacheableT* release() {
+      const CacheableT* p = _cacheable;
+      if (p != 0) p->getRC()->setListener(0);
+      _cacheable = 0;
+      setRemoved();
+      return p;
+    }
+  };
+
+  typedef boost::shared_ptr<Entry> EntryPtr;
+  typedef std::map<Id, EntryPtr> EntryMap;
+
+  // the result of a build in progress, shared by all the threads waiting for
+  // the same id
+  typedef std::shared_future<ManagedPtr<T> > InFlightFuture;
+  typedef std::map<Id, InFlightFuture> InFlightMap;
+
+  typedef boost::shared_lock<boost::shared_mutex> ReadLock;
+  typedef boost::unique_lock<boost::shared_mutex> WriteLock;
+
+  // must be a power of 2
+  enum { SHARDS = 32 };
+
+  class Shard {
+   public:
+    mutable boost::shared_mutex _mutex;
+    EntryMap _cache;
+    InFlightMap _inFlight;
+  };
 
  private:
   bool _enable;
+  // only protects the start of the background thread and _enable
   mutable Mutex _mutex;
-  // mutex for background processing
-  mutable Mutex _bpmutex;
-  CacheableMap _cache;
-  ParkVector _park;
+  Shard _shards[SHARDS];
+  // guarded by _maintenanceMutex
   bool _run;
-  bool _running;
+  // set from the start of the background thread until it exits, the
+  // destructor waits on it
+  std::atomic<bool> _running;
   bool _first;
-  bool _doBackgroundProcessing;
-  unsigned int _size;
+  // max number of items, read without any lock by overBudget
+  std::atomic<unsigned int> _size;
+  // max memory used by the cached items, 0 for no limit, read without any lock
+  // by overBudget
+  std::atomic<unsigned __int64> _maxBytes;
+
+  // serializes the access to the eviction policy, always acquired after a
+  // shard lock, never before
+  mutable Mutex _policyMutex;
+  std::auto_ptr<EvictionPolicy> _policy;
+
+  std::atomic<unsigned __int64> _items;
+  std::atomic<unsigned __int64> _bytes;
+  std::atomic<unsigned __int64> _hits;
+  std::atomic<unsigned __int64> _misses;
+  std::atomic<unsigned __int64> _evictions;
+
+  // wakes up the background thread when there is work to do
+  mutable NonRecursiveMutex _maintenanceMutex;
+  mutable Condition _maintenanceCondition;
+  bool _maintenance;
+  // set when the cache is over budget but all its items are in use, so the
+  // next release of an item should trigger an eviction
+  std::atomic<bool> _evictPending;
+  // set when an item is released by its last user, so the eviction policy
+  // can take back the items it set aside because they were in use
+  std::atomic<bool> _released;
+
+ private:
+  Shard& shard(const Id& id) {
+    return _shards[boost::hash<Id>()(id) & (SHARDS - 1)];
+  }
+
+  bool overBudget() const {
+    unsigned __int64 maxBytes = _maxBytes;
+    return _items > _size || (maxBytes > 0 && _bytes > maxBytes);
+  }
+
+  // removes the entry from the shard map, must be called with the shard write
+  // lock held
+  void remove(Shard& s, typename EntryMap::iterator i) {
+    EntryPtr entry = i->second;
+    s._cache.erase(i);
+    _items--;
+    _bytes -= entry->bytes();
+    delete entry->release();
+  }
+
+  // makes the object outside of any lock, then publishes it in the cache and
+  // to the threads that are waiting for it
+  ManagedPtr<T> build(Shard& s, const CacheableBuilder<T>& mc,
+                      std::promise<ManagedPtr<T> >& promise) {
+    const Id& id = mc.id();
+    const CacheableT* p = 0;
+    Timer timer;
+    try {
+      p = mc.make().release();
+    } catch (...) {
+      {
+        WriteLock lock(s._mutex);
+        s._inFlight.erase(id);
+      }
+      promise.set_exception(std::current_exception());
+      throw;
+    }
+
+    EntryPtr entry(new Entry(id, p, timer.elapsed(), this));
+    ManagedPtr<T> result(*p);
+    {
+      WriteLock lock(s._mutex);
+      std::pair<EntryMap::iterator, bool> i =
+          s._cache.insert(EntryMap::value_type(id, entry));
+      // the id was in flight, so nobody else could have inserted it
+      assert(i.second);
+      s._inFlight.erase(id);
+    }
+    _items++;
+    _bytes += entry->bytes();
+    {
+      Lock lock(_policyMutex);
+      _policy->add(entry);
+    }
+    promise.set_value(result);
+
+    // the eviction is done in the background, so the lookup can return
+    // right away
+    if (overBudget()) requestMaintenance();
+    return result;
+  }
 
  public:
   /**
@@ -202,63 +399,122 @@ class Cache : public CacheThread {
    *
    * Initializes the cache
    *
-   * @param T
+   * @param size   max number of cached items
+   * @param enable enables the cache if true
+   * @param maxBytes
+   *               max memory used by the cached items, 0 for no limit
+   * @param policy the eviction policy
    */
-  Cache(unsigned int size, bool enable)
+  Cache(unsigned int size, bool enable, unsigned __int64 maxBytes = 0,
+        tradery::CachePolicy policy = tradery::gdsf_cache_policy)
       : _enable(enable),
         _run(true),
         _running(false),
         _first(true),
         _size(size),
-        _doBackgroundProcessing(false) {}
+        _maxBytes(maxBytes),
+        _policy(EvictionPolicy::make(policy)),
+        _items(0),
+        _bytes(0),
+        _hits(0),
+        _misses(0),
+        _evictions(0),
+        _maintenance(false),
+        _evictPending(false),
+        _released(false) {}
 
   virtual ~Cache() {
-    // tell the background thread to stop
-    _run = false;
+    {
+      // tell the background thread to stop
+      NonRecursiveLock lock(_maintenanceMutex);
+      _run = false;
+      _maintenanceCondition.notify_one();
+    }
     // wait for the background thread to stop
     while (_running) ::Sleep(1);
-  }
 
-  void startBackgroundThread() { _beginthread(cache_thread_func, 0, this); }
-
-  void doBackgroundProcessing() {
-    // lock for background processing
-    //		XLock l( _bpmutex );
-    Lock l(_mutex);
-    // signal that we have done the background processing
-    _doBackgroundProcessing = false;
-
-    // remove the parked elements that have refcount == 1 (which means that they
-    // are only referenced in the current object, but nowhere else and they can
-    // be safely deleted
-    while (!_park.empty()) {
-      // TODO: erase from the end - don't want to move the vector around too
-      // much when there are many elements
-      const CacheableT& p = _park.front();
-      if (!p.isReferred()) _park.erase(_park.begin());
+    // the items may outlive the cache if they are still in use, so make sure
+    // they won't call back into it
+    for (unsigned int k = 0; k < SHARDS; k++) {
+      WriteLock lock(_shards[k]._mutex);
+      for (EntryMap::iterator i = _shards[k]._cache.begin();
+           i != _shards[k]._cache.end(); i++)
+        delete i->second->release();
     }
+  }
 
-    // if cache size > _size (currently number of itmes)
-    // it will erase one random element
-    // TODO: implement some smart scheme, which looks at frequency of access as
-    // well as how recent an element has been accessed
-    static unsigned int crt = 0;
-    if (_cache.size() > _size) {
-      if (crt >= _cache.size()) crt = 0;
-
-      int n = 0;
-      for (CacheableMap::iterator i = _cache.begin(); i != _cache.end();
-           i++, n++) {
-        if (n == crt) {
-          const CacheableT* p = i->second;
-          if (!p->isReferred()) {
-            delete p;
-            _cache.erase(i);
-            break;
-          }
-        }
+  void startBackgroundThread() {
+    // set before the thread starts, so the destructor waits for it even if
+    // the cache is destroyed before the thread gets to run
+    _running = true;
+    if (_beginthread(cache_thread_func, 0, this) == (uintptr_t)-1) _running = false;
+  }
+
+  /**
+   * Evicts unreferenced items, in the order decided by the eviction policy,
+   * until the cache is back within its item count and memory budget, or there
+   * is nothing left that can be evicted
+   */
+  void evict() {
+    // set before looking at the items, so a release that happens during the
+    // pass triggers another one
+    _evictPending = true;
+    while (overBudget()) {
+      CacheEntryPtr victim;
+      {
+        Lock lock(_policyMutex);
+        if (_released.exchange(false)) _policy->released();
+        victim = _policy->victim();
+      }
+      if (!victim) {
+        // everything is in use, try again when something gets released
+        return;
+      }
+
+      Entry& entry = static_cast<Entry&>(*victim);
+      Shard& s = shard(entry.id());
+      WriteLock lock(s._mutex);
+      EntryMap::iterator i = s._cache.find(entry.id());
+      if (entry.isRemoved() || i == s._cache.end() || i->second != victim)
+        continue;
+
+      if (entry.isReferred()) {
+        // got a hit after it was selected, give it back to the policy and stop
+        // here, the next pass will try again
+        Lock policyLock(_policyMutex);
+        _policy->add(victim);
+        return;
       }
-      crt++;
+
+      remove(s, i);
+      _evictions++;
+    }
+    _evictPending = false;
+  }
+
+  /**
+   * Wakes up the background thread to do an eviction pass
+   */
+  void requestMaintenance() {
+    NonRecursiveLock lock(_maintenanceMutex);
+    _maintenance = true;
+    _maintenanceCondition.notify_one();
+  }
+
+  /**
+   * Called by the reference counter of a cached item each time a reference to
+   * it is released. A count of 1 means the cache holds the only reference, so
+   * the item can now be evicted if the cache was waiting for that.
+   *
+   * Defined in the ReleaseListener interface
+   *
+   * @param count  the reference count after the release
+   */
+  virtual void released(int count) {
+    if (count == 1) {
+      // only written when it changes, releases are frequent
+      if (!_released.load(std::memory_order_relaxed)) _released = true;
+      if (_evictPending) requestMaintenance();
     }
   }
 
@@ -274,66 +530,109 @@ class Cache : public CacheThread {
    * The CacheableBuilder has information about the object to be looked up - its
    * id, and if not found, how to create a new instance
    *
-   * @param T      The CacheableBuilder object
-   * @param mc
-   * @param mc
+   * Hits only take the shard lock in shared mode. On a miss, the object is made
+   * without holding any lock, and concurrent requests for the same id wait for
+   * that one build to complete.
+   *
+   * @param mc     The CacheableBuilder object
    * @return A managed pointer to the retrieved or newly created object
    */
   ManagedPtr<T> findAndAdd(const CacheableBuilder<T>& mc) {
-    Lock lock(_mutex);
+    {
+      Lock lock(_mutex);
+      if (_first) {
+        // start the background thread on the first access
+        // this thread does the evictions that can't be done right away
+        startBackgroundThread();
+        _first = false;
+      }
+    }
 
-    if (_first) {
-      // start the background thread on the first access
-      // this thread does garbage collection and in general cache management
-      startBackgroundThread();
-      _first = false;
+    // if the cache is disabled, just return return a ManagedPtr that will
+    // auto destroy the RefCounter and the payload when the reference count
+    // goes to 0 in this case, the ID doesn't count as nothing is stored in
+    // the cache, but calculated on the fly every time
+    if (!_enable) return *mc.make();
+
+    const Id& id = mc.id();
+    Shard& s = shard(id);
+
+    {
+      // fast path - cache hit
+      ReadLock lock(s._mutex);
+      EntryMap::const_iterator i = s._cache.find(id);
+      if (i != s._cache.end() && mc.isConsistent(i->second->cacheable())) {
+        i->second->hit();
+        _hits++;
+        return i->second->cacheable();
+      }
     }
 
-    if (_enable) {
-      // if enabled, do the find and add if not found
-      const Id& id = mc.id();
-      CacheableMap::iterator i = _cache.find(id);
-      if (i != _cache.end()) {
-        // cache hit
-        // check data consistency and if not, get the new data
-        if (mc.isConsistent(*i->second))
-          return *i->second;
-        else {
-          // move the element that's inconsistent to the park vector
-          // where it will be removed at some point by the background cleanup
-          if ((i->second)->isReferred()) {
-            // lock temporarily on the background processing mutex, as we don't
-            // want to end up with an invalid ParkVector
-            //						XLock l( _bpmutex );
-            _park.push_back(*i->second);
-          }
-          delete i->second;
-          _cache.erase(i);
-          // recursively call findAndAdd to get the new element and add it to
-          // the cache
-          return findAndAdd(mc);
-        }
-      } else {
-        // cache miss, create the requested item
-        // insert in the cache
-        std::pair<CacheableMap::iterator, bool> p =
-            _cache.insert(CacheableMap::value_type(id, mc.make().release()));
-        // return a copy of the managed ptr in the cache (which increments the
-        // reference)
-        if (p.second)
-          return *((*p.first).second);
-        else {
-          assert(false);
-          return ManagedPtr<T>();
+    InFlightFuture future;
+    std::promise<ManagedPtr<T> > promise;
+    {
+      WriteLock lock(s._mutex);
+      // the object may have been added since we released the read lock
+      EntryMap::iterator i = s._cache.find(id);
+      if (i != s._cache.end()) {
+        if (mc.isConsistent(i->second->cacheable())) {
+          i->second->hit();
+          _hits++;
+          return i->second->cacheable();
         }
+
+        // drop the element that's inconsistent - if it is still in use, it
+        // will be deleted when its last user releases it
+        remove(s, i);
       }
-    } else {
-      // if the cache is disabled, just return return a ManagedPtr that will
-      // auto destroy the RefCounter and the payload when the reference count
-      // goes to 0 in this case, the ID doesn't count as nothing is stored in
-      // the cache, but calculated on the fly every time
-      return *mc.make();
+
+      InFlightMap::const_iterator f = s._inFlight.find(id);
+      if (f != s._inFlight.end())
+        // another thread is already building it
+        future = f->second;
+      else
+        s._inFlight.insert(
+            InFlightMap::value_type(id, promise.get_future().share()));
+    }
+
+    _misses++;
+    // wait for the other thread's build (rethrows its exception, if any)
+    if (future.valid()) return future.get();
+
+    return build(s, mc, promise);
+  }
+
+  /**
+   * Adds an object that was made along with another one, such as one of the
+   * other outputs of a calculation with several outputs, so asking for it
+   * next is a hit. Nothing is added if the cache is disabled, or if the id is
+   * already in the cache or being built.
+   *
+   * @param id        the id of the object
+   * @param cacheable the object, deleted if it is not added
+   * @param cost      the time it took to make the object
+   */
+  void offer(const Id& id, std::auto_ptr<CacheableT> cacheable, double cost) {
+    if (!_enable) return;
+
+    Shard& s = shard(id);
+    EntryPtr entry;
+    {
+      WriteLock lock(s._mutex);
+      if (s._cache.find(id) != s._cache.end() ||
+          s._inFlight.find(id) != s._inFlight.end())
+        return;
+
+      entry.reset(new Entry(id, cacheable.release(), cost, this));
+      s._cache.insert(EntryMap::value_type(id, entry));
+    }
+    _items++;
+    _bytes += entry->bytes();
+    {
+      Lock lock(_policyMutex);
+      _policy->add(entry);
     }
+    if (overBudget()) requestMaintenance();
   }
 
  public:
@@ -350,13 +649,31 @@ class Cache : public CacheThread {
     _enable = enable;
   }
 
-  void setSize(unsigned int size) {
+  bool enabled() const {
     Lock lock(_mutex);
-    _size = size;
+    return _enable;
+  }
+
+  void setSize(unsigned int size) { _size = size; }
+
+  void setMaxBytes(unsigned __int64 maxBytes) { _maxBytes = maxBytes; }
+
+  tradery::CacheStats stats() const {
+    tradery::CacheStats stats;
+    stats.hits = _hits;
+    stats.misses = _misses;
+    stats.evictions = _evictions;
+    stats.items = _items;
+    stats.bytes = _bytes;
+    return stats;
   }
 
   /**
-   * background cache management thread,
+   * background cache management thread
+   *
+   * Sleeps until an eviction pass is requested, either because an insertion
+   * put the cache over budget, or because an item was released while the
+   * cache was waiting to evict something. Doesn't use any CPU while idle.
    *
    * Defined in the CacheThread abstract base class
    *
@@ -364,14 +681,20 @@ class Cache : public CacheThread {
    * @see CacheThread
    */
   void run() {
-    // signal it's running
-    _running = true;
-    // run while allowed
-    while (_run) {
-      // every 10 seconds signal that background processing must be done
-      ::Sleep(10);
-      _doBackgroundProcessing = true;
-      doBackgroundProcessing();
+    {
+      NonRecursiveLock lock(_maintenanceMutex);
+      // run while allowed
+      while (_run) {
+        if (!_maintenance) {
+          _maintenanceCondition.wait(lock);
+          continue;
+        }
+        _maintenance = false;
+
+        lock.unlock();
+        evict();
+        lock.lock();
+      }
     }
     // signal that it has stopped running
     _running = false;
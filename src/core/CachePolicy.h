@@ -0,0 +1,309 @@
+/*
+Copyright (C) 2018 Adrian Michel
+http://www.amichel.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+
+/**
+ * Bookkeeping information kept by the cache for each cached object
+ *
+ * An entry is shared between the cache map that owns the object and the
+ * eviction policy, which only sees this base class. The access counter is
+ * updated by the cache on every hit, without any lock, and the policies read
+ * it lazily when looking for an object to evict, so a cache hit never has to
+ * touch the policy data structures.
+ *
+ * When the cache removes an object for any other reason than eviction (for
+ * example because it is no longer consistent with its data source), it marks
+ * the entry as removed and the policy drops it the next time it runs into it.
+ */
+class CacheEntryBase {
+ private:
+  const size_t _bytes;
+  const double _cost;
+  std::atomic<unsigned long> _hits;
+  std::atomic<bool> _removed;
+
+ public:
+  // private to the eviction policy that holds the entry
+  unsigned long _policyHits;
+  unsigned int _policyBucket;
+  double _policyPriority;
+
+ public:
+  /**
+   * @param bytes  approximate memory used by the cached object
+   * @param cost   time it took to build the object, in seconds
+   */
+  CacheEntryBase(size_t bytes, double cost)
+      : _bytes(bytes),
+        _cost(cost),
+        _hits(0),
+        _removed(false),
+        _policyHits(0),
+        _policyBucket(0),
+        _policyPriority(0) {}
+
+  virtual ~CacheEntryBase() {}
+
+  size_t bytes() const { return _bytes; }
+  double cost() const { return _cost; }
+
+  void hit() { _hits.fetch_add(1, std::memory_order_relaxed); }
+  unsigned long hits() const { return _hits.load(std::memory_order_relaxed); }
+
+  void setRemoved() { _removed = true; }
+  bool isRemoved() const { return _removed; }
+
+  // true if the cached object is in use outside of the cache, in which case
+  // it can't be evicted
+  virtual bool isReferred() const = 0;
+};
+
+typedef boost::shared_ptr<CacheEntryBase> CacheEntryPtr;
+
+/**
+ * Abstract base class for the cache eviction policies
+ *
+ * The policy decides the order in which unreferenced objects are removed from
+ * the cache when it goes over its memory budget. Policies are not thread safe,
+ * the cache serializes the calls to add and victim.
+ *
+ * All policies evict in amortized constant time (logarithmic for the cost
+ * aware policy): entries that have been accessed or are still in use when
+ * they come up for eviction are moved back in the queue instead of being
+ * reordered on every access. The cost aware policy sets the entries in use
+ * aside instead, until released is called.
+ */
+class EvictionPolicy {
+ public:
+  virtual ~EvictionPolicy() {}
+
+  /**
+   * Starts tracking a newly cached entry
+   */
+  virtual void add(CacheEntryPtr entry) = 0;
+
+  /**
+   * Stops tracking and returns the next entry to be evicted
+   *
+   * @return the entry, or an empty pointer if all entries are in use
+   */
+  virtual CacheEntryPtr victim() = 0;
+
+  /**
+   * Called before looking for a victim if references to cached objects have
+   * been released since the last call, so the entries that were set aside
+   * because they were in use can be evicted again
+   */
+  virtual void released() {}
+
+  virtual size_t size() const = 0;
+
+  static EvictionPolicy* make(tradery::CachePolicy policy);
+};
+
+/**
+ * Least recently used
+ *
+ * Implemented as a FIFO queue with a second chance: an entry that was hit
+ * since it was queued goes back to the end of the queue.
+ */
+class LRUEvictionPolicy : public EvictionPolicy {
+ private:
+  std::list<CacheEntryPtr> _queue;
+
+  void queue(CacheEntryPtr entry) {
+    entry->_policyHits = entry->hits();
+    _queue.push_back(entry);
+  }
+
+ public:
+  virtual void add(CacheEntryPtr entry) { queue(entry); }
+
+  virtual CacheEntryPtr victim() {
+    for (size_t n = _queue.size(); n > 0; n--) {
+      CacheEntryPtr entry = _queue.front();
+      _queue.pop_front();
+
+      if (entry->isRemoved()) continue;
+
+      if (entry->hits() != entry->_policyHits || entry->isReferred())
+        queue(entry);
+      else
+        return entry;
+    }
+    return CacheEntryPtr();
+  }
+
+  virtual size_t size() const { return _queue.size(); }
+};
+
+/**
+ * Least frequently used
+ *
+ * Entries are kept in buckets by the order of magnitude of their hit count
+ * (0, 1, 2-3, 4-7 ...), and the oldest entry in the lowest bucket is evicted
+ * first. Entries are only moved to their new bucket when they come up for
+ * eviction.
+ */
+class LFUEvictionPolicy : public EvictionPolicy {
+ private:
+  enum { BUCKETS = sizeof(unsigned long) * 8 + 1 };
+
+  std::list<CacheEntryPtr> _buckets[BUCKETS];
+  size_t _size;
+
+  static unsigned int bucket(unsigned long hits) {
+    unsigned int b = 0;
+    for (; hits != 0; hits >>= 1) b++;
+    return b;
+  }
+
+  void queue(CacheEntryPtr entry) {
+    entry->_policyBucket = bucket(entry->hits());
+    _buckets[entry->_policyBucket].push_back(entry);
+    _size++;
+  }
+
+ public:
+  LFUEvictionPolicy() : _size(0) {}
+
+  virtual void add(CacheEntryPtr entry) { queue(entry); }
+
+  virtual CacheEntryPtr victim() {
+    unsigned int b = 0;
+    for (size_t n = _size; n > 0; n--) {
+      while (_buckets[b].empty()) b++;
+
+      CacheEntryPtr entry = _buckets[b].front();
+      _buckets[b].pop_front();
+      _size--;
+
+      if (entry->isRemoved()) continue;
+
+      if (bucket(entry->hits()) != entry->_policyBucket || entry->isReferred())
+        queue(entry);
+      else
+        return entry;
+    }
+    return CacheEntryPtr();
+  }
+
+  virtual size_t size() const { return _size; }
+};
+
+/**
+ * Greedy dual size frequency
+ *
+ * The priority of an entry is L + frequency * cost / size, where cost is the
+ * time it took to build the entry and L is the priority of the last evicted
+ * entry, which ages the entries that are no longer used. Cheap to rebuild and
+ * large entries go first.
+ *
+ * The entries that are in use when they come up for eviction are kept out of
+ * the heap, and put back with their priority once they are released, so
+ * looking for a victim doesn't go through them again each time.
+ */
+class GDSFEvictionPolicy : public EvictionPolicy {
+ private:
+  class Greater {
+   public:
+    bool operator()(const CacheEntryPtr& e1, const CacheEntryPtr& e2) const {
+      return e1->_policyPriority > e2->_policyPriority;
+    }
+  };
+
+  std::vector<CacheEntryPtr> _heap;
+  // the entries that were in use when they came up for eviction
+  std::list<CacheEntryPtr> _referred;
+  double _inflation;
+
+  void push(CacheEntryPtr entry) {
+    _heap.push_back(entry);
+    std::push_heap(_heap.begin(), _heap.end(), Greater());
+  }
+
+  void queue(CacheEntryPtr entry) {
+    entry->_policyHits = entry->hits();
+    entry->_policyPriority =
+        _inflation + (entry->_policyHits + 1) * entry->cost() /
+                         (double)max2<size_t>(entry->bytes(), 1);
+    push(entry);
+  }
+
+ public:
+  GDSFEvictionPolicy() : _inflation(0) {}
+
+  virtual void add(CacheEntryPtr entry) { queue(entry); }
+
+  virtual CacheEntryPtr victim() {
+    while (!_heap.empty()) {
+      std::pop_heap(_heap.begin(), _heap.end(), Greater());
+      CacheEntryPtr entry = _heap.back();
+      _heap.pop_back();
+
+      if (entry->isRemoved()) continue;
+
+      if (entry->hits() != entry->_policyHits)
+        queue(entry);
+      else if (entry->isReferred())
+        // kept out of the heap until it is released
+        _referred.push_back(entry);
+      else {
+        _inflation = entry->_policyPriority;
+        return entry;
+      }
+    }
+    return CacheEntryPtr();
+  }
+
+  virtual void released() {
+    for (std::list<CacheEntryPtr>::iterator i = _referred.begin();
+         i != _referred.end();) {
+      CacheEntryPtr entry = *i;
+      if (entry->isRemoved())
+        i = _referred.erase(i);
+      else if (entry->isReferred())
+        ++i;
+      else {
+        i = _referred.erase(i);
+        // entries in use keep their priority, unless they got hits
+        if (entry->hits() != entry->_policyHits)
+          queue(entry);
+        else
+          push(entry);
+      }
+    }
+  }
+
+  virtual size_t size() const { return _heap.size() + _referred.size(); }
+};
+
+inline EvictionPolicy* EvictionPolicy::make(tradery::CachePolicy policy) {
+  switch (policy) {
+    case tradery::lru_cache_policy:
+      return new LRUEvictionPolicy();
+    case tradery::lfu_cache_policy:
+      return new LFUEvictionPolicy();
+    case tradery::gdsf_cache_policy:
+    default:
+      return new GDSFEvictionPolicy();
+  }
+}
@@ -51,7 +51,9 @@ class DataManager : public DataRequester {
    *
    * @return Pointer to a newly created DataManager
    */
-  static DataManager* create(unsigned int cacheSize);
+  static DataManager* create(unsigned int cacheSize,
+                             unsigned __int64 cacheMemory = 0,
+                             CachePolicy cachePolicy = gdsf_cache_policy);
   virtual ~DataManager() {}
   /**
    * Adds a new data source to the DataManager.
@@ -72,6 +74,7 @@ class DataManager : public DataRequester {
    */
   virtual void enableCaching(bool enable) = 0;
   virtual void setCacheSize(unsigned int size) = 0;
+  virtual CacheStats cacheStats() const = 0;
 };
 
 /**
@@ -108,8 +111,10 @@ class DataManagerImpl : public DataManager {
   DSMap _dataSources;
 
  public:
-  DataManagerImpl::DataManagerImpl(unsigned int cacheSize)
-      : _cache(cacheSize, true) {}
+  DataManagerImpl::DataManagerImpl(unsigned int cacheSize,
+                                   unsigned __int64 cacheMemory = 0,
+                                   CachePolicy cachePolicy = gdsf_cache_policy)
+      : _cache(cacheSize, true, cacheMemory, cachePolicy) {}
 
   virtual DataManagerImpl::~DataManagerImpl() {
     // make sure we have unregistered as many as we have registered
@@ -186,8 +191,9 @@ class DataManagerImpl : public DataManager {
 
    private:
     static Id calculateId(const DataInfo* dataInfo, DateTimeRangePtr range) {
-      Id id = dataInfo->id();
-      if (range) id += range->getId();
+      Id id("data");
+      id << dataInfo->id();
+      if (range) id << range->getId();
       return id;
     }
 
@@ -262,4 +268,6 @@ class DataManagerImpl : public DataManager {
   }
 
   virtual void setCacheSize(unsigned int size) { _cache.setSize(size); }
+
+  virtual CacheStats cacheStats() const { return _cache.stats(); }
 };
\ No newline at end of file
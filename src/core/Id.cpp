@@ -0,0 +1,101 @@
+/*
+Copyright (C) 2018 Adrian Michel
+http://www.amichel.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "id.h"
+
+#ifdef _DEBUG
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#define new DEBUG_NEW
+#endif
+
+bool Id::_describe = false;
+
+// the descriptions of the ids, only filled when descriptions are enabled
+typedef std::map<Id, std::string> IdDescriptions;
+static IdDescriptions _descriptions;
+static Mutex _descriptionsMutex;
+
+void Id::mix(const char* s, size_t size) {
+  for (size_t n = 0; n < size; n += sizeof(unsigned __int64)) {
+    unsigned __int64 v = 0;
+    memcpy(&v, s + n, min2<size_t>(sizeof(unsigned __int64), size - n));
+    mix(v);
+  }
+  // so that "ab" followed by "c" is not the same as "a" followed by "bc"
+  mix(size);
+}
+
+Id::Id(const char* s) : _h1(0), _h2(0) {
+  mix(s, strlen(s));
+  if (_describe) intern(s);
+}
+
+Id::Id(const std::string& s) : _h1(0), _h2(0) {
+  mix(s.data(), s.size());
+  if (_describe) intern(s);
+}
+
+Id& Id::operator<<(const Id& id) {
+  Id previous(*this);
+  mix(id._h1);
+  mix(id._h2);
+  if (_describe) describe(previous, "(" + id.toString() + ")");
+  return *this;
+}
+
+Id& Id::operator<<(const char* s) {
+  Id previous(*this);
+  mix(s, strlen(s));
+  if (_describe) describe(previous, std::string(s));
+  return *this;
+}
+
+Id& Id::operator<<(const std::string& s) {
+  Id previous(*this);
+  mix(s.data(), s.size());
+  if (_describe) describe(previous, s);
+  return *this;
+}
+
+void Id::describe(const Id& previous, const std::string& part) {
+  intern(previous.toString() + " - " + part);
+}
+
+void Id::intern(const std::string& description) {
+  Lock lock(_descriptionsMutex);
+  std::pair<IdDescriptions::iterator, bool> i =
+      _descriptions.insert(IdDescriptions::value_type(*this, description));
+  if (!i.second && i.first->second != description)
+    LOG(log_error, "Id collision between \"" << i.first->second << "\" and \""
+                                             << description << "\"");
+}
+
+std::string Id::toString() const {
+  if (_describe) {
+    Lock lock(_descriptionsMutex);
+    IdDescriptions::const_iterator i = _descriptions.find(*this);
+    if (i != _descriptions.end()) return i->second;
+  }
+
+  std::ostringstream o;
+  o << std::hex << std::setfill('0') << std::setw(16) << _h1 << std::setw(16)
+    << _h2;
+  return o.str();
+}
@@ -0,0 +1,143 @@
+/*
+Copyright (C) 2018 Adrian Michel
+http://www.amichel.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+/**
+ * Identity of a cacheable object
+ *
+ * An id is a 128 bit structural hash of how the object was calculated: the
+ * tag of the operation, followed by the ids of the objects it was calculated
+ * from and its parameters, in order:
+ *
+ *   Id("EMA") << series.getId() << period << exp
+ *
+ * Building an id only mixes a few integers, however deep the expression that
+ * produced the object, and comparing two ids is two integer comparisons, so
+ * the ids are cheap to build and to look up, unlike the strings made of the
+ * ids of all the ancestors that they replace.
+ *
+ * A readable description of the ids is kept only when enabled with
+ * setDescribe, for debugging. In that mode, the descriptions are interned in a
+ * process wide table by id, which is also used to report hash collisions.
+ */
+class Id {
+ private:
+  unsigned __int64 _h1;
+  unsigned __int64 _h2;
+
+  static bool _describe;
+
+ private:
+  // murmur3 64 bit finalizer
+  static unsigned __int64 fmix(unsigned __int64 k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+  }
+
+  // the two halves are mixed with different constants, so they are
+  // independent of each other
+  void mix(unsigned __int64 v) {
+    _h1 = fmix((_h1 ^ v) * 0x87c37b91114253d5ULL + 0x52dce729);
+    _h2 = fmix((_h2 + v) * 0x4cf5ad432745937fULL ^ 0x38495ab5);
+  }
+
+  void mix(const char* s, size_t size);
+
+  template <class T>
+  Id& value(T t) {
+    Id previous(*this);
+    mix((unsigned __int64)t);
+    if (_describe) describe(previous, t);
+    return *this;
+  }
+
+  template <class T>
+  void describe(const Id& previous, const T& t) {
+    std::ostringstream o;
+    o << t;
+    describe(previous, o.str());
+  }
+
+  void describe(const Id& previous, const std::string& part);
+  void intern(const std::string& description);
+
+ public:
+  // the empty id
+  Id() : _h1(0), _h2(0) {}
+
+  /**
+   * Leaf id, or the tag of the operation that calculates the object
+   *
+   * @param s      the name
+   */
+  Id(const char* s);
+  Id(const std::string& s);
+
+  Id& operator<<(const Id& id);
+  Id& operator<<(const char* s);
+  Id& operator<<(const std::string& s);
+  Id& operator<<(int i) { return value(i); }
+  Id& operator<<(unsigned int i) { return value(i); }
+  Id& operator<<(long l) { return value(l); }
+  Id& operator<<(unsigned long l) { return value(l); }
+  Id& operator<<(__int64 l) { return value(l); }
+  Id& operator<<(unsigned __int64 l) { return value(l); }
+  Id& operator<<(bool b) { return value(b); }
+  Id& operator<<(double d) {
+    // the bits of the value, so values that are printed the same are still
+    // different ids
+    unsigned __int64 bits;
+    memcpy(&bits, &d, sizeof(bits));
+    Id previous(*this);
+    mix(bits);
+    if (_describe) describe(previous, d);
+    return *this;
+  }
+
+  bool operator==(const Id& id) const {
+    return _h1 == id._h1 && _h2 == id._h2;
+  }
+  bool operator!=(const Id& id) const { return !(*this == id); }
+  bool operator<(const Id& id) const {
+    return _h1 < id._h1 || (_h1 == id._h1 && _h2 < id._h2);
+  }
+
+  friend size_t hash_value(const Id& id) { return (size_t)id._h1; }
+
+  /**
+   * Returns the description of the id if descriptions are enabled, or the
+   * hash as a hex string otherwise
+   */
+  std::string toString() const;
+
+  /**
+   * Enables the descriptions of the ids created after the call. Only meant
+   * for debugging, as it makes building an id as expensive as the string ids
+   * were.
+   */
+  static void setDescribe(bool describe) { _describe = describe; }
+};
+
+inline std::ostream& operator<<(std::ostream& os, const Id& id) {
+  return os << id.toString();
+}
@@ -0,0 +1,211 @@
+/*
+Copyright (C) 2018 Adrian Michel
+http://www.amichel.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "seriesimpl.h"
+#include "bars.h"
+#include "indicators.h"
+#include "positions.h"
+#include "system.h"
+#include "datamanager.h"
+#include "scheduler.h"
+
+#ifdef _DEBUG
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#define new DEBUG_NEW
+#endif
+
+/**
+ * The requests, and the source of the tasks that calculate them for the
+ * thread pool
+ */
+class IndicatorRequests::Requests : public TaskSource {
+ private:
+  typedef std::function<void()> Task;
+  typedef boost::shared_ptr<MakeMultiOutputSeries> MakeMultiOutputSeriesPtr;
+
+  // the requests for the outputs of one calculation with several outputs
+  class Group {
+   public:
+    // holds on to the series the builder calculates from
+    const Series _series;
+    const MakeMultiOutputSeriesPtr _builder;
+    // the index of the output and the series that receives it
+    std::vector<std::pair<unsigned int, Series*> > _results;
+
+    Group(const Series& series, MakeMultiOutputSeriesPtr builder)
+        : _series(series), _builder(builder) {}
+  };
+
+  typedef boost::shared_ptr<Group> GroupPtr;
+
+ private:
+  // the groups, by the id of the output that created them
+  std::map<Id, GroupPtr> _groups;
+  std::vector<Task> _tasks;
+
+  mutable NonRecursiveMutex _mutex;
+  Condition _condition;
+  size_t _next;
+  size_t _completed;
+  std::exception_ptr _exception;
+
+ private:
+  static const SeriesImpl& seriesImpl(const Series& series) {
+    return dynamic_cast<const SeriesImpl&>(series.getSeries());
+  }
+
+ public:
+  Requests() : _next(0), _completed(0) {}
+
+  void add(Series& result, const Series& series,
+           MakeMultiOutputSeriesPtr builder, unsigned int output) {
+    GroupPtr& group = _groups[builder->id()];
+    if (!group) group.reset(new Group(series, builder));
+    group->_results.push_back(std::make_pair(output, &result));
+  }
+
+  void add(Series& result, const Calculation& calculation) {
+    _tasks.push_back([&result, calculation]() { result = calculation(); });
+  }
+
+  void addBBand(Series& result, const Series& series, BBandOutput output,
+                unsigned int period, double stdDev) {
+    // the builders of all the outputs have the id of the first one, which
+    // groups the requests for the same calculation
+    add(result, series,
+        MakeMultiOutputSeriesPtr(new MakeBBandSeries(
+            seriesImpl(series), bband_upper, period, stdDev)),
+        output);
+  }
+
+  void addMACD(Series& result, const Series& series, MACDOutput output,
+               unsigned int fastPeriod, unsigned int slowPeriod,
+               unsigned int signalPeriod) {
+    add(result, series,
+        MakeMultiOutputSeriesPtr(
+            new MakeMACDSeries(seriesImpl(series), macd_macd, fastPeriod,
+                               slowPeriod, signalPeriod)),
+        output);
+  }
+
+  virtual bool runTask(size_t thread) {
+    Task task;
+    {
+      NonRecursiveLock lock(_mutex);
+      if (_next == _tasks.size()) return false;
+      task = _tasks[_next++];
+    }
+
+    try {
+      task();
+    } catch (...) {
+      NonRecursiveLock lock(_mutex);
+      if (!_exception) _exception = std::current_exception();
+    }
+
+    NonRecursiveLock lock(_mutex);
+    if (++_completed == _tasks.size()) _condition.notify_all();
+    return true;
+  }
+
+  void calculate() {
+    for (std::map<Id, GroupPtr>::const_iterator i = _groups.begin();
+         i != _groups.end(); i++) {
+      GroupPtr group = i->second;
+      // the series a builder calculates from must be calculated before the
+      // tasks start, as series that are not in the cache are not thread safe
+      group->_series.getArray();
+      _tasks.push_back([group]() {
+        std::vector<SeriesAbstrPtr> outputs(group->_builder->findAll());
+        for (size_t n = 0; n < group->_results.size(); n++)
+          *group->_results[n].second =
+              Series(outputs[group->_results[n].first]);
+      });
+    }
+    _groups.clear();
+
+    // the calling thread runs tasks as well, so it doesn't just wait. Other
+    // threads are only asked for help if there is more than one task
+    ThreadPool* pool = ThreadPool::current();
+    if (pool == 0) pool = _threadPool;
+    bool shared = pool != 0 && _tasks.size() > 1;
+    if (shared) pool->add(this, 1);
+
+    while (runTask(0))
+      ;
+    {
+      NonRecursiveLock lock(_mutex);
+      while (_completed < _tasks.size()) _condition.wait(lock);
+    }
+    if (shared) pool->remove(this);
+
+    _tasks.clear();
+    _next = 0;
+    _completed = 0;
+    if (_exception) {
+      std::exception_ptr exception = _exception;
+      _exception = std::exception_ptr();
+      std::rethrow_exception(exception);
+    }
+  }
+};
+
+IndicatorRequests::IndicatorRequests() : _requests(new Requests()) {}
+
+IndicatorRequests::~IndicatorRequests() { delete _requests; }
+
+void IndicatorRequests::BBandUpper(Series& result, const Series& series,
+                                   unsigned int period, double stdDev) {
+  _requests->addBBand(result, series, bband_upper, period, stdDev);
+}
+
+void IndicatorRequests::BBandLower(Series& result, const Series& series,
+                                   unsigned int period, double stdDev) {
+  _requests->addBBand(result, series, bband_lower, period, stdDev);
+}
+
+void IndicatorRequests::MACD(Series& result, const Series& series,
+                             unsigned int fastPeriod, unsigned int slowPeriod,
+                             unsigned int signalPeriod) {
+  _requests->addMACD(result, series, macd_macd, fastPeriod, slowPeriod,
+                     signalPeriod);
+}
+
+void IndicatorRequests::MACDSignal(Series& result, const Series& series,
+                                   unsigned int fastPeriod,
+                                   unsigned int slowPeriod,
+                                   unsigned int signalPeriod) {
+  _requests->addMACD(result, series, macd_signal, fastPeriod, slowPeriod,
+                     signalPeriod);
+}
+
+void IndicatorRequests::MACDHist(Series& result, const Series& series,
+                                 unsigned int fastPeriod,
+                                 unsigned int slowPeriod,
+                                 unsigned int signalPeriod) {
+  _requests->addMACD(result, series, macd_hist, fastPeriod, slowPeriod,
+                     signalPeriod);
+}
+
+void IndicatorRequests::add(Series& result, const Calculation& calculation) {
+  _requests->add(result, calculation);
+}
+
+void IndicatorRequests::calculate() { _requests->calculate(); }
@@ -18,6 +18,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include "serieskernels.h"
+
 typedef Cacheable<SeriesAbstr> CacheableSeries;
 typedef std::auto_ptr<CacheableSeries> CacheableSeriesPtr;
 
@@ -68,10 +70,7 @@ class MakeFromSeriesWithOnePeriod : public MakeFromSeries {
  protected:
   const Id calculateId(const SeriesImpl& series, unsigned int period,
                        const std::string& name) {
-    std::ostringstream o;
-    o << series.getId() << " - " << name << " - " << period;
-
-    return Id(o.str());
+    return Id(name) << series.getId() << period;
   }
 
   unsigned int getPeriod() const { return _period; }
@@ -100,15 +99,98 @@ class MakeFromBarsWithOnePeriod : public MakeFromBars {
  protected:
   const Id calculateId(const BarsImpl& bars, unsigned int period,
                        const std::string& name) {
-    std::ostringstream o;
-    o << bars.getId() << " - " << name << " - " << period;
-
-    return Id(o.str());
+    return Id(name) << bars.getId() << period;
   }
 
   unsigned int getPeriod() const { return _period; }
 };
 
+extern SeriesCache* _cache;
+
+// builder of one of the outputs of a calculation with several outputs, such
+// as a TA-Lib function. The calculation is done once for all the outputs, and
+// the ones that were not asked for are offered to the cache, so asking for
+// them next is a hit
+class MakeMultiOutputSeries : public MakeFromSeries {
+ private:
+  // forwards to the builder of another output
+  class MakeOutput : public CacheableBuilderX {
+   private:
+    const MakeMultiOutputSeries& _builder;
+    const unsigned int _output;
+
+   public:
+    MakeOutput(const MakeMultiOutputSeries& builder, unsigned int output)
+        : CacheableBuilderX(builder.outputId(output)),
+          _builder(builder),
+          _output(output) {}
+
+    virtual CacheableSeriesPtr make() const { return _builder.make(_output); }
+  };
+
+ private:
+  const unsigned int _outputs;
+  const unsigned int _output;
+
+ private:
+  // calculates all the outputs, owned by the caller
+  std::vector<SeriesImpl*> calculateAll() const {
+    const SeriesImpl& series = getSeries();
+    std::vector<SeriesImpl*> outputs(_outputs);
+    for (unsigned int n = 0; n < _outputs; n++)
+      outputs[n] = new SeriesImpl(series.unsyncSize(), series.synchronizer(),
+                                  outputId(n));
+    calculate(&outputs[0]);
+    return outputs;
+  }
+
+ protected:
+  MakeMultiOutputSeries(const SeriesImpl& series, unsigned int outputs,
+                        unsigned int output, const Id& id)
+      : MakeFromSeries(series, id), _outputs(outputs), _output(output) {}
+
+  virtual const Id outputId(unsigned int output) const = 0;
+  // fills the outputs, which have the size of the series and are set to 0
+  virtual void calculate(SeriesImpl* const* outputs) const = 0;
+
+ public:
+  // makes one output, and offers the other ones to the cache
+  CacheableSeriesPtr make(unsigned int output) const {
+    Timer timer;
+    std::vector<SeriesImpl*> outputs(calculateAll());
+    double cost = timer.elapsed();
+    for (unsigned int n = 0; n < _outputs; n++) {
+      if (n != output)
+        _cache->offer(outputs[n]->getId(),
+                      CacheableSeriesPtr(new IndicatorCacheable(
+                          outputs[n], outputs[n]->getId())),
+                      cost);
+    }
+    return CacheableSeriesPtr(
+        new IndicatorCacheable(outputs[output], outputs[output]->getId()));
+  }
+
+  virtual CacheableSeriesPtr make() const { return make(_output); }
+
+  /**
+   * Returns all the outputs, in order, calculated together unless they are
+   * already in the cache
+   */
+  std::vector<SeriesAbstrPtr> findAll() const {
+    std::vector<SeriesAbstrPtr> outputs;
+    if (_cache->enabled()) {
+      for (unsigned int n = 0; n < _outputs; n++)
+        outputs.push_back(_cache->findAndAdd(MakeOutput(*this, n)));
+    } else {
+      std::vector<SeriesImpl*> series(calculateAll());
+      for (unsigned int n = 0; n < _outputs; n++)
+        outputs.push_back(*CacheableSeriesPtr(
+            new IndicatorCacheable(series[n], series[n]->getId())));
+    }
+    return outputs;
+  }
+};
+
 typedef int (*TA_LOOKBACK_INT)(int);
 typedef TA_RetCode (*TA_FUNC1)(int, int, const double[], int, int*, int*,
                                double[]);
@@ -249,98 +331,79 @@ typedef MakeSeriesTAFunc1Int<TA_MAXINDEX_Lookback, TA_MAXINDEX>
 typedef MakeSeriesTAFunc1Int<TA_MININDEX_Lookback, TA_MININDEX>
     MakeMinIndexSeries;
 
-class MakeBBandUpperSeries : public MakeFromSeries {
+typedef void (*ROLLING_KERNEL)(const double*, size_t, unsigned int, double*);
+
+// same as MakeSeriesTAFunc1 for TA_MIN and TA_MAX, with the same ids, but
+// calculated with the series kernels
+template <TA_FUNC1 TA_FUNC, ROLLING_KERNEL KERNEL>
+class MakeRollingSeries : public MakeFromSeriesWithOnePeriod {
  private:
-  class BBandUpperSeries : public SeriesImpl {
+  class XSeries : public SeriesImpl {
    public:
-    // TODO: enforce that T is of type series using function_requires
-    BBandUpperSeries(const SeriesImpl& series, unsigned int period,
-                     double stdDev, const Id& id)
+    XSeries(const SeriesImpl& series, unsigned int period, const Id& id)
         : SeriesImpl(series.unsyncSize(), series.synchronizer(), id) {
-      int begIdx;
-      int nbElement;
-      SeriesImpl median(unsyncSize(), SynchronizerPtr());
-      SeriesImpl lower(unsyncSize(), SynchronizerPtr());
-      unsigned int k = (unsigned int)TA_BBANDS_Lookback(period, stdDev, stdDev,
-                                                        TA_MAType_SMA);
-      if (unsyncSize() > k)
-        TA_BBANDS(0, unsyncSize() - 1, series.getArray(), period, stdDev,
-                  stdDev, TA_MAType_SMA, &begIdx, &nbElement, &at(k),
-                  &median.at(k), &lower.at(k));
+      // TA-Lib rejects periods under 2, which leaves the series at 0
+      if (period > 1 && period <= unsyncSize())
+        KERNEL(series.getArray(), unsyncSize(), period, &_v[0]);
     }
   };
 
- private:
-  const unsigned int _period;
-  const double _stdDev;
-
- private:
-  static const Id calculateId(const SeriesImpl& series, unsigned int period,
-                              double stdDev) {
-    std::ostringstream o;
-    o << series.getId() << " - BBand upper - " << period << ", " << stdDev;
-
-    return Id(o.str());
-  }
-
  public:
-  MakeBBandUpperSeries(const SeriesImpl& series, unsigned int period,
-                       double stdDev)
-      : MakeFromSeries(series, calculateId(series, period, stdDev)),
-        _period(period),
-        _stdDev(stdDev) {}
+  MakeRollingSeries(const SeriesImpl& series, unsigned int period)
+      : MakeFromSeriesWithOnePeriod(series, period,
+                                    TAFunc1Constants<TA_FUNC>::_id) {}
 
   virtual CacheableSeriesPtr make() const {
     return CacheableSeriesPtr(new IndicatorCacheable(
-        new BBandUpperSeries(getSeries(), _period, _stdDev, id()), id()));
+        new XSeries(getSeries(), getPeriod(), id()), id()));
   }
 };
 
-class MakeBBandLowerSeries : public MakeFromSeries {
- private:
-  class BBandLowerSeries : public SeriesImpl {
-   public:
-    // TODO: enforce that T is of type series using function_requires
-    BBandLowerSeries(const SeriesImpl& series, unsigned int period,
-                     double stdDev, const Id& id)
-        : SeriesImpl(series.unsyncSize(), series.synchronizer(), id) {
-      int begIdx;
-      int nbElement;
-      SeriesImpl median(unsyncSize(), SynchronizerPtr());
-      SeriesImpl upper(unsyncSize(), SynchronizerPtr());
-      unsigned int k = (unsigned int)TA_BBANDS_Lookback(period, stdDev, stdDev,
-                                                        TA_MAType_SMA);
-      if (unsyncSize() > k)
-        TA_BBANDS(0, unsyncSize() - 1, series.getArray(), period, stdDev,
-                  stdDev, TA_MAType_SMA, &begIdx, &nbElement, &upper.at(k),
-                  &median.at(k), &at(k));
-    }
-  };
+typedef MakeRollingSeries<TA_MAX, SeriesKernels::rollingMax> MakeMaxSeries;
+typedef MakeRollingSeries<TA_MIN, SeriesKernels::rollingMin> MakeMinSeries;
+
+enum BBandOutput { bband_upper, bband_lower, bband_outputs };
 
+// upper or lower Bollinger band, both calculated by one TA_BBANDS call
+class MakeBBandSeries : public MakeMultiOutputSeries {
  private:
   const unsigned int _period;
   const double _stdDev;
 
- private:
-  static const Id calculateId(const SeriesImpl& series, unsigned int period,
-                              double stdDev) {
-    std::ostringstream o;
-    o << series.getId() << " - BBand lower - " << period << ", " << stdDev;
+ protected:
+  virtual const Id outputId(unsigned int output) const {
+    return calculateId(getSeries(), (BBandOutput)output, _period, _stdDev);
+  }
+
+  virtual void calculate(SeriesImpl* const* outputs) const {
+    const SeriesImpl& series = getSeries();
+    unsigned int k = (unsigned int)TA_BBANDS_Lookback(_period, _stdDev,
+                                                      _stdDev, TA_MAType_SMA);
+    if (series.unsyncSize() > k) {
+      int begIdx;
+      int nbElement;
+      SeriesImpl median(series.unsyncSize(), SynchronizerPtr());
+      TA_BBANDS(0, series.unsyncSize() - 1, series.getArray(), _period,
+                _stdDev, _stdDev, TA_MAType_SMA, &begIdx, &nbElement,
+                &outputs[bband_upper]->at(k), &median.at(k),
+                &outputs[bband_lower]->at(k));
+    }
+  }
 
-    return Id(o.str());
+ private:
+  static const Id calculateId(const SeriesImpl& series, BBandOutput output,
+                              unsigned int period, double stdDev) {
+    return Id(output == bband_upper ? "BBand upper" : "BBand lower")
+           << series.getId() << period << stdDev;
   }
 
  public:
-  MakeBBandLowerSeries(const SeriesImpl& series, unsigned int period,
-                       double stdDev)
-      : MakeFromSeries(series, calculateId(series, period, stdDev)),
+  MakeBBandSeries(const SeriesImpl& series, BBandOutput output,
+                  unsigned int period, double stdDev)
+      : MakeMultiOutputSeries(series, bband_outputs, output,
+                              calculateId(series, output, period, stdDev)),
         _period(period),
         _stdDev(stdDev) {}
-
-  virtual CacheableSeriesPtr make() const {
-    return CacheableSeriesPtr(new IndicatorCacheable(
-        new BBandLowerSeries(getSeries(), _period, _stdDev, id()), Id()));
-  }
 };
 
 class MakeEMASeries : public MakeFromSeries {
@@ -357,22 +420,9 @@ class MakeEMASeries : public MakeFromSeries {
         : SeriesImpl(series.unsyncSize(), series.synchronizer(), id) {
       // function_requires< SeriesImpl< T > >();
 
-      if (period < unsyncSize()) {
-        double f = 0;
-
-        const std::vector<double>& v(series.getVector());
-
-        // TODO: use std::accumulate
-        unsigned int n = 0;
-        for (; n < period; n++) f += v[n];
-
-        at(period - 1) = f / (double)period;
-
-        for (; n < unsyncSize(); n++) {
-          double x = exp * (v[n] - at(n - 1)) + at(n - 1);
-          at(n) = x;
-        }
-      }
+      if (period > 0 && period < unsyncSize())
+        SeriesKernels::ema(series.getArray(), unsyncSize(), period, exp,
+                           &_v[0]);
     }
   };
 
@@ -383,10 +433,7 @@ class MakeEMASeries : public MakeFromSeries {
  private:
   static const Id calculateId(const SeriesImpl& series, unsigned int period,
                               double exp) {
-    std::ostringstream o;
-    o << series.getId() << " - EMA - " << period << ", " << exp;
-
-    return Id(o.str());
+    return Id("EMA") << series.getId() << period << exp;
   }
 
  public:
@@ -425,7 +472,7 @@ class MakeHTTrendlineSeries : public MakeFromSeries {
 
  private:
   static const Id calculateId(const SeriesImpl& series) {
-    return Id(series.getId() + " - HTTrendline");
+    return Id("HTTrendline") << series.getId();
   }
 
  public:
@@ -467,10 +514,7 @@ class MakeMAMASeries : public MakeFromSeries {
  private:
   static const Id calculateId(const SeriesImpl& series, double fastLimit,
                               double slowLimit) {
-    std::ostringstream o;
-    o << series.getId() << " - MAMA - " << fastLimit << ", " << slowLimit;
-
-    return Id(o.str());
+    return Id("MAMA") << series.getId() << fastLimit << slowLimit;
   }
 
  public:
@@ -513,10 +557,7 @@ class MakeFAMASeries : public MakeFromSeries {
  private:
   static const Id calculateId(const SeriesImpl& series, double fastLimit,
                               double slowLimit) {
-    std::ostringstream o;
-    o << series.getId() << " - FAMA - " << fastLimit << ", " << slowLimit;
-
-    return Id(o.str());
+    return Id("FAMA") << series.getId() << fastLimit << slowLimit;
   }
 
  public:
@@ -633,10 +674,7 @@ class MakeSARSeries : public MakeFromBars {
  private:
   static const Id calculateId(const BarsImpl& bars, double acceleration,
                               double maximum) {
-    std::ostringstream o;
-    o << bars.getId() << " - SAR - " << acceleration << ", " << maximum;
-
-    return Id(o.str());
+    return Id("SAR") << bars.getId() << acceleration << maximum;
   }
 
  public:
@@ -663,20 +701,8 @@ class MakeSMASeries : public MakeFromSeriesWithOnePeriod {
         : SeriesImpl(series.unsyncSize(), series.synchronizer(), id) {
       // function_requires< SeriesImpl< T > >();
 
-      if (period < unsyncSize()) {
-        double f = 0;
-
-        const std::vector<double>& v(series.getVector());
-
-        // TODO: use std::accumulate
-        unsigned int n = 0;
-        for (; n < period; n++) f += v[n];
-
-        at(period - 1) = f / (double)period;
-
-        for (; n < unsyncSize(); n++)
-          at(n) = at(n - 1) + (v[n] - v[n - period]) / (double)period;
-      }
+      if (period > 0 && period < unsyncSize())
+        SeriesKernels::sma(series.getArray(), unsyncSize(), period, &_v[0]);
     }
   };
 
@@ -714,10 +740,7 @@ class MakeT3Series : public MakeFromSeries {
  private:
   static const Id calculateId(const SeriesImpl& series, unsigned int period,
                               double vFactor) {
-    std::ostringstream o;
-    o << series.getId() << " - T3 - " << period << ", " << vFactor;
-
-    return Id(o.str());
+    return Id("T3") << series.getId() << period << vFactor;
   }
 
  public:
@@ -746,26 +769,11 @@ class MakeWMASeries : public MakeFromSeries {
 
       assert(sma);
 
-      if (period < unsyncSize()) {
-        double f = 0;
-
-        const std::vector<double>& v(series.getVector());
-        const std::vector<double>& vsma(sma->getVector());
-
-        assert(v.size() == vsma.size() && v.size() == series.unsyncSize());
-
-        // TODO: use std::accumulate
-        double sigma = (period + 1) * period / 2;
-        unsigned int n = 0;
-        for (; n < period; n++) f += (n + 1) * v[n];
-
-        at(period - 1) = f / sigma;
+      if (period > 0 && period < unsyncSize()) {
+        assert(sma->unsyncSize() == series.unsyncSize());
 
-        for (; n < unsyncSize(); n++) {
-          double x = at(n - 1) - vsma[n - 1] * (float)period / sigma +
-                     period * v[n] / sigma;
-          at(n) = x;
-        }
+        SeriesKernels::wma(series.getArray(), sma->getArray(), unsyncSize(),
+                           period, &_v[0]);
       }
     }
   };
@@ -776,10 +784,7 @@ class MakeWMASeries : public MakeFromSeries {
 
  private:
   static const Id calculateId(const SeriesImpl& series, unsigned int period) {
-    std::ostringstream o;
-    o << series.getId() << " - WMA - " << period;
-
-    return Id(o.str());
+    return Id("WMA") << series.getId() << period;
   }
 
  public:
@@ -849,7 +854,7 @@ class MakeTRSeries : public MakeFromBars {
 
  private:
   static const Id calculateId(const BarsImpl& bars) {
-    return Id(bars.getId() + " - True Range");
+    return Id("TRANGE") << bars.getId();
   }
 
  public:
@@ -889,11 +894,7 @@ class MakeAPOSeries : public MakeFromSeries {
  private:
   static const Id calculateId(const SeriesImpl& series, unsigned int fastPeriod,
                               unsigned int slowPeriod, MAType maType) {
-    std::ostringstream o;
-    o << series.getId() << " - APO - " << fastPeriod << ", " << slowPeriod
-      << ", " << maType;
-
-    return Id(o.str());
+    return Id("APO") << series.getId() << fastPeriod << slowPeriod << maType;
   }
 
  public:
@@ -993,182 +994,57 @@ public:
 };
 */
 
-class MakeMACDSeries : public MakeFromSeries {
- private:
-  // MACD - moving average convergence/divergence
-  // TODO: use the cache to calculate these only once
-  class MACDSeries : public SeriesImpl {
-   public:
-    // TODO: enforce that T is of type series using function_requires
-    MACDSeries(const SeriesImpl& series, unsigned int fastPeriod,
-               unsigned int slowPeriod, unsigned int signalPeriod, const Id& id)
-        : SeriesImpl(series.unsyncSize(), series.synchronizer(), id) {
-      int begIdx;
-      int nbElement;
-      SeriesImpl macdSignal(unsyncSize(), SynchronizerPtr());
-      SeriesImpl macdHist(unsyncSize(), SynchronizerPtr());
-
-      unsigned int k =
-          (unsigned int)TA_MACD_Lookback(fastPeriod, slowPeriod, signalPeriod);
-
-      if (unsyncSize() > k)
-        TA_MACD(0, unsyncSize() - 1, series.getArray(), fastPeriod, slowPeriod,
-                signalPeriod, &begIdx, &nbElement, &at(k), &(macdSignal.at(k)),
-                &(macdHist.at(k)));
-    }
-  };
+enum MACDOutput { macd_macd, macd_signal, macd_hist, macd_outputs };
 
+// MACD - moving average convergence/divergence, its signal or its histogram,
+// all calculated by one TA_MACD call
+class MakeMACDSeries : public MakeMultiOutputSeries {
  private:
   const unsigned int _fastPeriod;
   const unsigned int _slowPeriod;
   const unsigned int _signalPeriod;
 
- private:
-  static const Id calculateId(const SeriesImpl& series, unsigned int fastPeriod,
-                              unsigned int slowPeriod,
-                              unsigned int signalPeriod) {
-    std::ostringstream o;
-    o << series.getId() << " - MACD - " << fastPeriod << ", " << slowPeriod
-      << ", " << signalPeriod;
-
-    return Id(o.str());
-  }
-
- public:
-  MakeMACDSeries(const SeriesImpl& series, unsigned int fastPeriod,
-                 unsigned int slowPeriod, unsigned int signalPeriod)
-      : MakeFromSeries(
-            series, calculateId(series, fastPeriod, slowPeriod, signalPeriod)),
-        _fastPeriod(fastPeriod),
-        _slowPeriod(slowPeriod),
-        _signalPeriod(signalPeriod) {}
-
-  CacheableSeriesPtr make() const {
-    return CacheableSeriesPtr(
-        new IndicatorCacheable(new MACDSeries(getSeries(), _fastPeriod,
-                                              _slowPeriod, _signalPeriod, id()),
-                               id()));
+ protected:
+  virtual const Id outputId(unsigned int output) const {
+    return calculateId(getSeries(), (MACDOutput)output, _fastPeriod,
+                       _slowPeriod, _signalPeriod);
   }
-};
 
-class MakeMACDSignalSeries : public MakeFromSeries {
- private:
-  // MACD - moving average convergence/divergence signal
-  // TODO: what is this?
-  // TODO: use the cache to calculate these only once
-  class MACDSignalSeries : public SeriesImpl {
-   public:
-    // TODO: enforce that T is of type series using function_requires
-    MACDSignalSeries(const SeriesImpl& series, unsigned int fastPeriod,
-                     unsigned int slowPeriod, unsigned int signalPeriod,
-                     const Id& id)
-        : SeriesImpl(series.unsyncSize(), series.synchronizer(), id) {
+  virtual void calculate(SeriesImpl* const* outputs) const {
+    const SeriesImpl& series = getSeries();
+    unsigned int k = (unsigned int)TA_MACD_Lookback(_fastPeriod, _slowPeriod,
+                                                    _signalPeriod);
+    if (series.unsyncSize() > k) {
       int begIdx;
       int nbElement;
-      SeriesImpl macd(unsyncSize(), SynchronizerPtr());
-      SeriesImpl macdHist(unsyncSize(), SynchronizerPtr());
-
-      unsigned int k =
-          (unsigned int)TA_MACD_Lookback(fastPeriod, slowPeriod, signalPeriod);
-
-      if (unsyncSize() > k)
-        TA_MACD(0, unsyncSize() - 1, series.getArray(), fastPeriod, slowPeriod,
-                signalPeriod, &begIdx, &nbElement, &(macd.at(k)), &at(k),
-                &(macdHist.at(k)));
+      TA_MACD(0, series.unsyncSize() - 1, series.getArray(), _fastPeriod,
+              _slowPeriod, _signalPeriod, &begIdx, &nbElement,
+              &outputs[macd_macd]->at(k), &outputs[macd_signal]->at(k),
+              &outputs[macd_hist]->at(k));
     }
-  };
-
- private:
-  const unsigned int _fastPeriod;
-  const unsigned int _slowPeriod;
-  const unsigned int _signalPeriod;
-
- private:
-  static const Id calculateId(const SeriesImpl& series, unsigned int fastPeriod,
-                              unsigned int slowPeriod,
-                              unsigned int signalPeriod) {
-    std::ostringstream o;
-    o << series.getId() << " - MACD Signal - " << fastPeriod << ", "
-      << slowPeriod << ", " << signalPeriod;
-
-    return Id(o.str());
-  }
-
- public:
-  MakeMACDSignalSeries(const SeriesImpl& series, unsigned int fastPeriod,
-                       unsigned int slowPeriod, unsigned int signalPeriod)
-      : MakeFromSeries(
-            series, calculateId(series, fastPeriod, slowPeriod, signalPeriod)),
-        _fastPeriod(fastPeriod),
-        _slowPeriod(slowPeriod),
-        _signalPeriod(signalPeriod) {}
-
-  CacheableSeriesPtr make() const {
-    return CacheableSeriesPtr(new IndicatorCacheable(
-        new MACDSignalSeries(getSeries(), _fastPeriod, _slowPeriod,
-                             _signalPeriod, id()),
-        id()));
   }
-};
-
-class MakeMACDHistSeries : public MakeFromSeries {
- private:
-  // MACD hist - moving average convergence/divergence hist
-  // TODO: is this histogram?
-  // TODO: use the cache to calculate these only once
-  class MACDHistSeries : public SeriesImpl {
-   public:
-    // TODO: enforce that T is of type series using function_requires
-    MACDHistSeries(const SeriesImpl& series, unsigned int fastPeriod,
-                   unsigned int slowPeriod, unsigned int signalPeriod,
-                   const Id& id)
-        : SeriesImpl(series.unsyncSize(), series.synchronizer(), id) {
-      int begIdx;
-      int nbElement;
-      SeriesImpl macd(unsyncSize(), SynchronizerPtr());
-      SeriesImpl macdSignal(unsyncSize(), SynchronizerPtr());
-
-      unsigned int k =
-          (unsigned int)TA_MACD_Lookback(fastPeriod, slowPeriod, signalPeriod);
-
-      if (unsyncSize() > k)
-        TA_MACD(0, unsyncSize() - 1, series.getArray(), fastPeriod, slowPeriod,
-                signalPeriod, &begIdx, &nbElement, &(macd.at(k)),
-                &(macdSignal.at(k)), &at(k));
-    }
-  };
-
- private:
-  const unsigned int _fastPeriod;
-  const unsigned int _slowPeriod;
-  const unsigned int _signalPeriod;
 
  private:
-  static const Id calculateId(const SeriesImpl& series, unsigned int fastPeriod,
+  static const Id calculateId(const SeriesImpl& series, MACDOutput output,
+                              unsigned int fastPeriod,
                               unsigned int slowPeriod,
                               unsigned int signalPeriod) {
-    std::ostringstream o;
-    o << series.getId() << " - MACD Hist - " << fastPeriod << ", " << slowPeriod
-      << ", " << signalPeriod;
-
-    return Id(o.str());
+    static const char* names[macd_outputs] = {"MACD", "MACD Signal",
+                                              "MACD Hist"};
+    return Id(names[output]) << series.getId() << fastPeriod << slowPeriod
+                             << signalPeriod;
   }
 
  public:
-  MakeMACDHistSeries(const SeriesImpl& series, unsigned int fastPeriod,
-                     unsigned int slowPeriod, unsigned int signalPeriod)
-      : MakeFromSeries(
-            series, calculateId(series, fastPeriod, slowPeriod, signalPeriod)),
+  MakeMACDSeries(const SeriesImpl& series, MACDOutput output,
+                 unsigned int fastPeriod, unsigned int slowPeriod,
+                 unsigned int signalPeriod)
+      : MakeMultiOutputSeries(series, macd_outputs, output,
+                              calculateId(series, output, fastPeriod,
+                                          slowPeriod, signalPeriod)),
         _fastPeriod(fastPeriod),
         _slowPeriod(slowPeriod),
         _signalPeriod(signalPeriod) {}
-
-  CacheableSeriesPtr make() const {
-    return CacheableSeriesPtr(new IndicatorCacheable(
-        new MACDHistSeries(getSeries(), _fastPeriod, _slowPeriod, _signalPeriod,
-                           id()),
-        id()));
-  }
 };
 
 class MakeMACDExtSeries : public MakeFromSeries {
@@ -1212,12 +1088,9 @@ class MakeMACDExtSeries : public MakeFromSeries {
                               MAType fastMAType, unsigned int slowPeriod,
                               MAType slowMAType, unsigned int signalPeriod,
                               MAType signalMAType) {
-    std::ostringstream o;
-    o << series.getId() << " - MACD Ext- " << fastPeriod << ", " << fastMAType
-      << ", " << slowPeriod << ", " << slowMAType << ", " << signalPeriod
-      << ", " << signalMAType;
-
-    return Id(o.str());
+    return Id("MACD Ext") << series.getId() << fastPeriod << fastMAType
+                          << slowPeriod << slowMAType << signalPeriod
+                          << signalMAType;
   }
 
  public:
@@ -1287,12 +1160,9 @@ class MakeMACDSignalExtSeries : public MakeFromSeries {
                               MAType fastMAType, unsigned int slowPeriod,
                               MAType slowMAType, unsigned int signalPeriod,
                               MAType signalMAType) {
-    std::ostringstream o;
-    o << series.getId() << " - MACD Signal Ext - " << fastPeriod << ", "
-      << fastMAType << ", " << slowPeriod << ", " << slowMAType << ", "
-      << signalPeriod << ", " << signalMAType;
-
-    return Id(o.str());
+    return Id("MACD Signal Ext") << series.getId() << fastPeriod << fastMAType
+                                 << slowPeriod << slowMAType << signalPeriod
+                                 << signalMAType;
   }
 
  public:
@@ -1361,12 +1231,9 @@ class MakeMACDHistExtSeries : public MakeFromSeries {
                               MAType fastMAType, unsigned int slowPeriod,
                               MAType slowMAType, unsigned int signalPeriod,
                               MAType signalMAType) {
-    std::ostringstream o;
-    o << series.getId() << " - MACD Hist Ext- " << fastPeriod << ", "
-      << fastMAType << ", " << slowPeriod << ", " << slowMAType << ", "
-      << signalPeriod << ", " << signalMAType;
-
-    return Id(o.str());
+    return Id("MACD Hist Ext") << series.getId() << fastPeriod << fastMAType
+                               << slowPeriod << slowMAType << signalPeriod
+                               << signalMAType;
   }
 
  public:
@@ -1550,11 +1417,7 @@ class MakePPOSeries : public MakeFromSeries {
  private:
   static const Id calculateId(const SeriesImpl& series, unsigned int fastPeriod,
                               unsigned int slowPeriod, MAType maType) {
-    std::ostringstream o;
-    o << series.getId() << " - PPO - " << fastPeriod << ", " << slowPeriod
-      << ", " << maType;
-
-    return Id(o.str());
+    return Id("PPO") << series.getId() << fastPeriod << slowPeriod << maType;
   }
 
  public:
@@ -1591,7 +1454,7 @@ class MakeHTDCPeriodSeries : public MakeFromSeries {
 
  private:
   static const Id calculateId(const SeriesImpl& series) {
-    return Id(series.getId() + " - HT DC Period");
+    return Id("HT DC Period") << series.getId();
   }
 
  public:
@@ -1622,7 +1485,7 @@ class MakeHTDCPhaseSeries : public MakeFromSeries {
 
  private:
   static const Id calculateId(const SeriesImpl& series) {
-    return Id(series.getId() + " - HT DC Phase");
+    return Id("HT DC Phase") << series.getId();
   }
 
  public:
@@ -1655,7 +1518,7 @@ class MakeHTPhasorPhaseSeries : public MakeFromSeries {
 
  private:
   static const Id calculateId(const SeriesImpl& series) {
-    return Id(series.getId() + " - HT Phasor Phase");
+    return Id("HT Phasor Phase") << series.getId();
   }
 
  public:
@@ -1688,7 +1551,7 @@ class MakeHTPhasorQuadratureSeries : public MakeFromSeries {
 
  private:
   static const Id calculateId(const SeriesImpl& series) {
-    return Id(series.getId() + " - HT Phasor quadrature");
+    return Id("HT Phasor quadrature") << series.getId();
   }
 
  public:
@@ -1721,7 +1584,7 @@ class MakeHTSineSeries : public MakeFromSeries {
 
  private:
   static const Id calculateId(const SeriesImpl& series) {
-    return Id(series.getId() + " - HT Sine");
+    return Id("HT Sine") << series.getId();
   }
 
  public:
@@ -1754,7 +1617,7 @@ class MakeHTLeadSineSeries : public MakeFromSeries {
 
  private:
   static const Id calculateId(const SeriesImpl& series) {
-    return Id(series.getId() + " - HT Lead sine");
+    return Id("HT Lead sine") << series.getId();
   }
 
  public:
@@ -1792,7 +1655,7 @@ class MakeHTTrendModeSeries : public MakeFromSeries {
 
  private:
   static const Id calculateId(const SeriesImpl& series) {
-    return Id(series.getId() + " - HT Trend Mode");
+    return Id("HT Trend Mode") << series.getId();
   }
 
  public:
@@ -1828,7 +1691,7 @@ class MakeChaikinADSeries : public MakeFromBars {
 
  private:
   static const Id calculateId(const BarsImpl& bars) {
-    return Id(bars.getId() + " - Chaikin A/D");
+    return Id("Chaikin A/D") << bars.getId();
   }
 
  public:
@@ -1872,11 +1735,8 @@ class MakeChaikinADOscillatorSeries : public MakeFromBars {
  private:
   static const Id calculateId(const BarsImpl& bars, unsigned int fastPeriod,
                               unsigned int slowPeriod) {
-    std::ostringstream o;
-
-    o << bars.getId() << " - Chaikin A/D Oscillator - " << fastPeriod << ", "
-      << slowPeriod;
-    return Id(o.str());
+    return Id("Chaikin A/D Oscillator") << bars.getId() << fastPeriod
+                                        << slowPeriod;
   }
 
  public:
@@ -1921,10 +1781,7 @@ class MakeOBVSeries : public MakeFromBars {
 
  private:
   static const Id calculateId(const BarsImpl& bars, const SeriesImpl& series) {
-    std::ostringstream o;
-
-    o << bars.getId() << ", " << series.getId() << " - OBV";
-    return Id(o.str());
+    return Id("OBV") << bars.getId() << series.getId();
   }
 
  public:
@@ -1947,7 +1804,11 @@ class MakeStdDevSeries : public MakeFromSeries {
     StdDevSeries(const SeriesImpl& series, unsigned int period, double nbDev,
                  const Id& id)
         : SeriesImpl(series.unsyncSize(), series.synchronizer(), id) {
-      if (unsyncSize() > (unsigned int)TA_STDDEV_Lookback(period, nbDev)) {
+      if (period > 1 && period <= unsyncSize())
+        SeriesKernels::stdDev(series.getArray(), unsyncSize(), period, nbDev,
+                              &_v[0]);
+      else if (unsyncSize() >
+               (unsigned int)TA_STDDEV_Lookback(period, nbDev)) {
         int begIdx;
         int nbElement;
         TA_STDDEV(0, unsyncSize() - 1, series.getArray(), period, nbDev,
@@ -1963,11 +1824,7 @@ class MakeStdDevSeries : public MakeFromSeries {
  private:
   static const Id calculateId(const SeriesImpl& series, unsigned int period,
                               double nbDev) {
-    std::ostringstream o;
-    o << series.getId() << " - Standard deviation - " << period << ", "
-      << nbDev;
-
-    return Id(o.str());
+    return Id("Standard deviation") << series.getId() << period << nbDev;
   }
 
  public:
@@ -2006,10 +1863,7 @@ class MakeVarianceSeries : public MakeFromSeries {
  private:
   static const Id calculateId(const SeriesImpl& series, unsigned int period,
                               double nbDev) {
-    std::ostringstream o;
-    o << series.getId() << " - Variance - " << period << ", " << nbDev;
-
-    return Id(o.str());
+    return Id("Variance") << series.getId() << period << nbDev;
   }
 
  public:
@@ -2047,10 +1901,7 @@ class MakeAvgPriceSeries : public MakeFromBars {
 
  private:
   static const Id calculateId(const BarsImpl& bars) {
-    std::ostringstream o;
-
-    o << bars.getId() << " - Average Price";
-    return Id(o.str());
+    return Id("Average Price") << bars.getId();
   }
 
  public:
@@ -2083,10 +1934,7 @@ class MakeMedPriceSeries : public MakeFromBars {
 
  private:
   static const Id calculateId(const BarsImpl& bars) {
-    std::ostringstream o;
-
-    o << bars.getId() << " - Median Price";
-    return Id(o.str());
+    return Id("Median Price") << bars.getId();
   }
 
  public:
@@ -2120,10 +1968,7 @@ class MakeTypPriceSeries : public MakeFromBars {
 
  private:
   static const Id calculateId(const BarsImpl& bars) {
-    std::ostringstream o;
-
-    o << bars.getId() << " - Typical Price";
-    return Id(o.str());
+    return Id("Typical Price") << bars.getId();
   }
 
  public:
@@ -2158,10 +2003,7 @@ class MakeWclPriceSeries : public MakeFromBars {
 
  private:
   static const Id calculateId(const BarsImpl& bars) {
-    std::ostringstream o;
-
-    o << bars.getId() << " - Wighted Close Price";
-    return Id(o.str());
+    return Id("Wighted Close Price") << bars.getId();
   }
 
  public:
@@ -2203,7 +2045,7 @@ class MakeAccumDistSeries : public MakeFromBars {
 
  private:
   static const Id calculateId(const BarsImpl& bars) {
-    return Id(bars.getId() + "- Accum/Dist");
+    return Id("Accum/Dist") << bars.getId();
   }
 
  public:
@@ -2243,7 +2085,7 @@ class MakeTrueRangeSeries : public MakeFromBars {
 
  private:
   static const Id calculateId(const BarsImpl& bars) {
-    return Id(bars.getId() + "- True Range");
+    return Id("True Range") << bars.getId();
   }
 
  public:
@@ -2507,7 +2349,7 @@ class MakeCandle : public MakeFromBars {
 
  private:
   static const Id calculateId(const BarsImpl& bars) {
-    return Id(bars.getId() + " - ") + CandleConstants<T>::_id;
+    return Id(CandleConstants<T>::_id) << bars.getId();
   }
 
  public:
@@ -2550,10 +2392,8 @@ class MakeCandlePenetration : public MakeFromBars {
 
  private:
   static const Id calculateId(const BarsImpl& bars, double penetration) {
-    std::ostringstream o;
-
-    o << penetration;
-    return Id(bars.getId() + CandleConstantsPenetration<T>::_id + o.str());
+    return Id(CandleConstantsPenetration<T>::_id) << bars.getId()
+                                                  << penetration;
   }
 
  public:
@@ -2567,8 +2407,6 @@ class MakeCandlePenetration : public MakeFromBars {
   }
 };
 
-typedef MakeSeriesTAFunc1<TA_MAX_Lookback, TA_MAX> MakeMaxSeries;
-typedef MakeSeriesTAFunc1<TA_MIN_Lookback, TA_MIN> MakeMinSeries;
 typedef MakeSeriesTAFunc1<TA_DEMA_Lookback, TA_DEMA> MakeDEMASeries;
 typedef MakeSeriesTAFunc1<TA_KAMA_Lookback, TA_KAMA> MakeKAMASeries;
 typedef MakeSeriesTAFunc1<TA_MIDPOINT_Lookback, TA_MIDPOINT> MakeMidPointSeries;
@@ -2843,12 +2681,9 @@ class MakeStochSlowKSeries : public MakeFromBars {
   static const Id calculateId(const BarsImpl& bars, int fastKPeriod,
                               int slowKPeriod, MAType slowKMAType,
                               int slowDPeriod, MAType slowDMAType) {
-    std::ostringstream o;
-
-    o << bars.getId() << ", " << fastKPeriod << ", " << slowKPeriod << ", "
-      << slowKMAType << ", " << slowDPeriod << ", " << slowDMAType
-      << " - Stochastic Slow K";
-    return Id(o.str());
+    return Id("Stochastic Slow K") << bars.getId() << fastKPeriod
+                                   << slowKPeriod << slowKMAType << slowDPeriod
+                                   << slowDMAType;
   }
 
  public:
@@ -2895,11 +2730,7 @@ class MakeBOPSeries : public MakeFromBars {
 
  private:
   static const Id calculateId(const BarsImpl& bars) {
-    std::ostringstream o;
-
-    o << bars.getId() << ", "
-      << " - BOP";
-    return Id(o.str());
+    return Id("BOP") << bars.getId();
   }
 
  public:
@@ -2951,12 +2782,9 @@ class MakeStochSlowDSeries : public MakeFromBars {
   static const Id calculateId(const BarsImpl& bars, int fastKPeriod,
                               int slowKPeriod, MAType slowKMAType,
                               int slowDPeriod, MAType slowDMAType) {
-    std::ostringstream o;
-
-    o << bars.getId() << ", " << fastKPeriod << ", " << slowKPeriod << ", "
-      << slowKMAType << ", " << slowDPeriod << ", " << slowDMAType
-      << " - Stochastic Slow D";
-    return Id(o.str());
+    return Id("Stochastic Slow D") << bars.getId() << fastKPeriod
+                                   << slowKPeriod << slowKMAType << slowDPeriod
+                                   << slowDMAType;
   }
 
  public:
@@ -3012,11 +2840,8 @@ class MakeStochFastDSeries : public MakeFromBars {
  private:
   static const Id calculateId(const BarsImpl& bars, int fastKPeriod,
                               int fastDPeriod, MAType fastDMAType) {
-    std::ostringstream o;
-
-    o << bars.getId() << ", " << fastKPeriod << ", " << fastDPeriod << ", "
-      << fastDMAType << " - Stochastic Fast D";
-    return Id(o.str());
+    return Id("Stochastic Fast D") << bars.getId() << fastKPeriod
+                                   << fastDPeriod << fastDMAType;
   }
 
  public:
@@ -3070,11 +2895,8 @@ class MakeStochFastKSeries : public MakeFromBars {
  private:
   static const Id calculateId(const BarsImpl& bars, int fastKPeriod,
                               int fastDPeriod, MAType fastDMAType) {
-    std::ostringstream o;
-
-    o << bars.getId() << ", " << fastKPeriod << ", " << fastDPeriod << ", "
-      << fastDMAType << " - Stochastic Fast K";
-    return Id(o.str());
+    return Id("Stochastic Fast K") << bars.getId() << fastKPeriod
+                                   << fastDPeriod << fastDMAType;
   }
 
  public:
@@ -3127,11 +2949,9 @@ class MakeStochRSIFastKSeries : public MakeFromSeries {
   static const Id calculateId(const SeriesImpl& series, unsigned int period,
                               int fastKPeriod, int fastDPeriod,
                               MAType fastDMAType) {
-    std::ostringstream o;
-    o << series.getId() << ", " << period << ", " << fastKPeriod << ", "
-      << fastDPeriod << ", " << fastDMAType << " - Stochastic RSI Fast K";
-
-    return Id(o.str());
+    return Id("Stochastic RSI Fast K") << series.getId() << period
+                                       << fastKPeriod << fastDPeriod
+                                       << fastDMAType;
   }
 
  public:
@@ -3185,11 +3005,9 @@ class MakeStochRSIFastDSeries : public MakeFromSeries {
   static const Id calculateId(const SeriesImpl& series, unsigned int period,
                               int fastKPeriod, int fastDPeriod,
                               MAType fastDMAType) {
-    std::ostringstream o;
-    o << series.getId() << ", " << period << ", " << fastKPeriod << ", "
-      << fastDPeriod << ", " << fastDMAType << " - Stochastic RSI Fast K";
-
-    return Id(o.str());
+    return Id("Stochastic RSI Fast D") << series.getId() << period
+                                       << fastKPeriod << fastDPeriod
+                                       << fastDMAType;
   }
 
  public:
@@ -3221,17 +3039,18 @@ class Op2SeriesBase : public CacheableBuilderX {
   virtual SeriesImpl* makeSyncSeries(const SeriesAbstr& series1,
                                      const SeriesAbstr& series2) const = 0;
 
-  static const Id calculateId(const SeriesAbstr& series1,
+  static const Id calculateId(const char* op, const SeriesAbstr& series1,
                               const SeriesAbstr& series2) {
-    return Id();
+    return Id(op) << dynamic_cast<const SeriesImpl&>(series1).getId()
+                  << dynamic_cast<const SeriesImpl&>(series2).getId();
   }
 
  public:
-  Op2SeriesBase(const SeriesAbstr& series1,
+  Op2SeriesBase(const char* op, const SeriesAbstr& series1,
                 const SeriesAbstr& series2) throw(std::bad_cast)
       : _series1(series1),
         _series2(series2),
-        CacheableBuilderX(calculateId(series1, series2)) {}
+        CacheableBuilderX(calculateId(op, series1, series2)) {}
 
   virtual CacheableSeriesPtr make() const {
     if (_series1.size() != _series2.size())
@@ -3256,7 +3075,7 @@ class Op2SeriesBase : public CacheableBuilderX {
   }
 };
 
-#define MAKE_OP_2SERIES(CLASS_NAME, OPERATOR)                                  \
+#define MAKE_OP_2SERIES(CLASS_NAME, OPERATOR, KERNEL)                          \
   class CLASS_NAME : public Op2SeriesBase \
 {                                   \
     \
@@ -3266,18 +3085,23 @@ private : class Op : public SeriesImpl {                                       \
       /* unsynchronized */                                                     \
       Op(const SeriesAbstr& series1, const SeriesAbstr& series2, const Id& id) \
           : SeriesImpl(series1.size(), SynchronizerPtr(), id) {                \
-        for (size_t n = 0; n < series1.size(); n++)                            \
-          _v.at(n) = series1[n] OPERATOR series2[n];                           \
+        if (!series1.isSynchronized() && !series2.isSynchronized()) {          \
+          if (!_v.empty())                                                     \
+            SeriesKernels::get().KERNEL(series1.getArray(),                    \
+                                        series2.getArray(), &_v[0],            \
+                                        _v.size());                            \
+        } else                                                                 \
+          for (size_t n = 0; n < series1.size(); n++)                          \
+            _v.at(n) = series1[n] OPERATOR series2[n];                         \
       }                                                                        \
       /* generates a synced series*/                                           \
                                                                                \
       Op(const SeriesAbstr& series1, const SeriesAbstr& series2,               \
          SynchronizerPtr synchronizer, const Id& id)                           \
           : SeriesImpl(series1.unsyncSize(), synchronizer, id) {               \
-        const double* s1 = series1.getArray();                                 \
-        const double* s2 = series2.getArray();                                 \
-        for (size_t n = 0; n < series1.unsyncSize(); n++)                      \
-          _v.at(n) = s1[n] OPERATOR s2[n];                                     \
+        if (!_v.empty())                                                       \
+          SeriesKernels::get().KERNEL(series1.getArray(), series2.getArray(),  \
+                                      &_v[0], _v.size());                      \
       }                                                                        \
     };                                                                         \
                                                                                \
@@ -3292,14 +3116,14 @@ private : class Op : public SeriesImpl {                                       \
     \
 public : CLASS_NAME(const SeriesAbstr& series1,                                \
                     const SeriesAbstr& series2) throw(std::bad_cast)           \
-        : Op2SeriesBase(series1, series2) {}                                   \
+        : Op2SeriesBase(#OPERATOR, series1, series2) {}                        \
   \
 };
 
-MAKE_OP_2SERIES(MakeMultiplySeries, *)
-MAKE_OP_2SERIES(MakeAddSeries, +)
-MAKE_OP_2SERIES(MakeDivideSeries, /)
-MAKE_OP_2SERIES(MakeSubtractSeries, -)
+MAKE_OP_2SERIES(MakeMultiplySeries, *, multiply)
+MAKE_OP_2SERIES(MakeAddSeries, +, add)
+MAKE_OP_2SERIES(MakeDivideSeries, /, divide)
+MAKE_OP_2SERIES(MakeSubtractSeries, -, subtract)
 
 typedef TA_RetCode (*TA_FUNC2)(int, int, const double[], const double[], int,
                                int*, int*, double[]);
@@ -3383,7 +3207,8 @@ class MakeShiftRightSeries : public CacheableBuilderX {
 
  public:
   static const Id calculateId(const SeriesAbstr& series, unsigned int n) {
-    return Id();
+    return Id("shift right") << dynamic_cast<const SeriesImpl&>(series).getId()
+                             << n;
   }
 
   MakeShiftRightSeries(const SeriesAbstr& series, unsigned int n)
@@ -3415,7 +3240,8 @@ class MakeShiftLeftSeries : public CacheableBuilderX {
 
  public:
   static const Id calculateId(const SeriesAbstr& series, unsigned int n) {
-    return Id();
+    return Id("shift left") << dynamic_cast<const SeriesImpl&>(series).getId()
+                            << n;
   }
 
   MakeShiftLeftSeries(const SeriesAbstr& series, unsigned int n)
@@ -3427,7 +3253,7 @@ class MakeShiftLeftSeries : public CacheableBuilderX {
   }
 };
 
-#define MAKE_OP_SERIES_TO_VALUE(CLASS_NAME, BIND_FUNCTION, OP, ID_STRING)    \
+#define MAKE_OP_SERIES_TO_VALUE(CLASS_NAME, KERNEL, ID_STRING)                \
   class CLASS_NAME : public CacheableBuilderX \
 {                             \
     \
@@ -3439,14 +3265,13 @@ private : class OpValue : public SeriesImpl {                                \
      public:                                                                 \
       OpValue(const SeriesAbstr& series, double value, const Id& id)         \
           : SeriesImpl(series.unsyncSize(), series.synchronizer(), id) {     \
-        std::transform(series.getVector().begin(), series.getVector().end(), \
-                       _v.begin(), BIND_FUNCTION(OP<double>(), (value)));    \
+        if (!_v.empty())                                                     \
+          SeriesKernels::get().KERNEL(series.getArray(), value, &_v[0],      \
+                                      _v.size());                            \
       }                                                                      \
     };                                                                       \
     static const Id calculateId(const SeriesImpl& series, double value) {    \
-      std::ostringstream o;                                                  \
-      o << value;                                                            \
-      return Id(series.getId() + ID_STRING + o.str());                       \
+      return Id(ID_STRING) << series.getId() << value;                       \
     }                                                                        \
     \
 \
@@ -3464,18 +3289,17 @@ public : CLASS_NAME(const SeriesImpl& series,                                \
   \
 };
 
-MAKE_OP_SERIES_TO_VALUE(MakeAddSeriesToValue, std::bind2nd, std::plus,
-                        " - add value - ")
-MAKE_OP_SERIES_TO_VALUE(MakeSubtractValueFromSeries, std::bind2nd, std::minus,
-                        " - subtract value - ")
-MAKE_OP_SERIES_TO_VALUE(MakeDivideSeriesByValue, std::bind2nd, std::divides,
-                        " - divide by value - ")
-MAKE_OP_SERIES_TO_VALUE(MakeDivideValueBySeries, std::bind1st, std::divides,
-                        " - divide value by - ")
-MAKE_OP_SERIES_TO_VALUE(MakeSubtractSeriesFromValue, std::bind1st, std::minus,
-                        " - subtract from value - ")
-MAKE_OP_SERIES_TO_VALUE(MakeMultiplySeriesByValue, std::bind2nd,
-                        std::multiplies, " - multiply by value - ")
+MAKE_OP_SERIES_TO_VALUE(MakeAddSeriesToValue, addValue, "add value")
+MAKE_OP_SERIES_TO_VALUE(MakeSubtractValueFromSeries, subtractValue,
+                        "subtract value")
+MAKE_OP_SERIES_TO_VALUE(MakeDivideSeriesByValue, divideByValue,
+                        "divide by value")
+MAKE_OP_SERIES_TO_VALUE(MakeDivideValueBySeries, divideValueBy,
+                        "divide value by")
+MAKE_OP_SERIES_TO_VALUE(MakeSubtractSeriesFromValue, subtractFromValue,
+                        "subtract from value")
+MAKE_OP_SERIES_TO_VALUE(MakeMultiplySeriesByValue, multiplyByValue,
+                        "multiply by value")
 
 // TODO: mark this as not cacheable, and mark the series created from them, so
 // they could be removed from the
@@ -3487,11 +3311,7 @@ class EmptySeries : public SeriesImpl {
 
   static const Id calculateId() {
     Lock lock(_mutex);
-    std::ostringstream o;
-
-    o << _l++;
-
-    return o.str();
+    return Id("empty series") << _l++;
   }
 
  public:
@@ -0,0 +1,187 @@
+/*
+Copyright (C) 2018 Adrian Michel
+http://www.amichel.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "seriesimpl.h"
+#include "bars.h"
+#include "panel.h"
+#include <boost/weak_ptr.hpp>
+#include <atomic>
+#include <future>
+#include <thread>
+
+#ifdef _DEBUG
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#define new DEBUG_NEW
+#endif
+
+// calls f(n) for each n in [0, count), spread over the processors
+template <class F>
+static void forEachParallel(size_t count, F f) {
+  size_t threads = min2<size_t>(std::thread::hardware_concurrency(), count);
+  if (threads <= 1) {
+    for (size_t n = 0; n < count; n++) f(n);
+    return;
+  }
+
+  std::atomic<size_t> next(0);
+  std::vector<std::future<void> > futures;
+  futures.reserve(threads);
+  for (size_t t = 0; t < threads; t++)
+    futures.push_back(std::async(std::launch::async, [&next, count, &f]() {
+      for (size_t n = next++; n < count; n = next++) f(n);
+    }));
+  // waits for all of them before rethrowing the first exception, if any
+  for (size_t t = 0; t < threads; t++) futures[t].wait();
+  for (size_t t = 0; t < threads; t++) futures[t].get();
+}
+
+Panel::Panel(const std::vector<std::string>& symbols,
+             const std::vector<BarsPtr>& data)
+    : _symbols(symbols), _data(data) {
+  std::vector<Bars> bars;
+  bars.reserve(data.size());
+  for (size_t n = 0; n < data.size(); n++)
+    bars.push_back(Bars(dynamic_cast<const BarsAbstr*>(data[n].get())));
+  _aligned = AlignedBars::make(bars);
+
+  size_t dates = dateCount();
+  size_t count = symbolCount();
+  _barIndexes.resize(dates * count, -1);
+  for (size_t f = 0; f < panel_fields; f++)
+    _fields[f].resize(dates * count, std::numeric_limits<double>::quiet_NaN());
+
+  // each symbol fills its own column
+  forEachParallel(count, [this, dates, count](size_t s) {
+    const Bars& b(_aligned.bars(s));
+    const Series series[panel_fields] = {b.openSeries(), b.highSeries(),
+                                         b.lowSeries(), b.closeSeries(),
+                                         b.volumeSeries()};
+    const double* values[panel_fields];
+    for (size_t f = 0; f < panel_fields; f++) values[f] = series[f].getArray();
+
+    // the aligned indexes are those of the last bar at or before each date, so
+    // a symbol only has a bar at the dates where its index changes
+    const std::vector<int>& indexes(_aligned.indexes(s));
+    int last = -1;
+    for (size_t d = 0; d < dates; d++) {
+      int bar = indexes[d];
+      if (bar == last) continue;
+      last = bar;
+
+      size_t c = d * count + s;
+      _barIndexes[c] = bar;
+      for (size_t f = 0; f < panel_fields; f++) _fields[f][c] = values[f][bar];
+    }
+  });
+}
+
+// the panels in use, by the ids of their data, so the systems running on the
+// same session data share one panel
+typedef std::map<Id, boost::weak_ptr<const Panel> > Panels;
+// the panels being made, which the other systems asking for them wait for
+typedef std::shared_future<PanelPtr> PanelFuture;
+typedef std::map<Id, PanelFuture> PanelsInFlight;
+
+// only held to look up and update the maps, the panels are made without it
+static NonRecursiveMutex _panelsMutex;
+static Panels _panels;
+static PanelsInFlight _panelsInFlight;
+
+CORE_API PanelPtr Panel::make(const PluginConfiguration& config) {
+  SymbolsIterator* si = config.symbolsIterator();
+  assert(si != 0);
+  // the session iterator is shared with the other systems, so its position
+  // is left alone
+  const std::vector<SymbolConstPtr> all(si->getAll());
+
+  // the data of the symbols is loaded concurrently, the data source and the
+  // cache are thread safe
+  std::vector<BarsPtr> allData(all.size());
+  forEachParallel(all.size(), [&config, &all, &allData](size_t n) {
+    allData[n] = config.getData(all[n]->symbol());
+  });
+
+  std::vector<std::string> symbols;
+  std::vector<BarsPtr> data;
+  Id id("panel");
+  bool shared = true;
+
+  for (size_t n = 0; n < all.size(); n++) {
+    const BarsAbstr* b = dynamic_cast<const BarsAbstr*>(allData[n].get());
+    if (b == 0 || b->unsyncSize() == 0) continue;
+
+    symbols.push_back(all[n]->symbol());
+    data.push_back(allData[n]);
+    const Ideable* ideable = dynamic_cast<const Ideable*>(b);
+    if (ideable != 0)
+      id << ideable->getId();
+    else
+      shared = false;
+  }
+
+  // data without an id can't be told apart, so its panel is not shared
+  if (!shared) return PanelPtr(new Panel(symbols, data));
+
+  PanelFuture future;
+  std::promise<PanelPtr> promise;
+  {
+    NonRecursiveLock lock(_panelsMutex);
+    Panels::iterator i = _panels.find(id);
+    if (i != _panels.end()) {
+      PanelPtr panel(i->second.lock());
+      if (panel) return panel;
+    }
+
+    PanelsInFlight::const_iterator f = _panelsInFlight.find(id);
+    if (f != _panelsInFlight.end())
+      // another system is already making it
+      future = f->second;
+    else
+      _panelsInFlight.insert(
+          PanelsInFlight::value_type(id, promise.get_future().share()));
+  }
+
+  // wait for the other system's panel (rethrows its exception, if any)
+  if (future.valid()) return future.get();
+
+  try {
+    PanelPtr panel(new Panel(symbols, data));
+    {
+      NonRecursiveLock lock(_panelsMutex);
+      for (Panels::iterator i = _panels.begin(); i != _panels.end();) {
+        if (i->second.expired())
+          i = _panels.erase(i);
+        else
+          ++i;
+      }
+      _panels[id] = panel;
+      _panelsInFlight.erase(id);
+    }
+    promise.set_value(panel);
+    return panel;
+  } catch (...) {
+    {
+      NonRecursiveLock lock(_panelsMutex);
+      _panelsInFlight.erase(id);
+    }
+    promise.set_exception(std::current_exception());
+    throw;
+  }
+}
@@ -42,12 +42,34 @@ class Settable2Double : public Settable<pair<double, double> > {
   double getValue2() const { return getValue().second; }
 };
 
+/**
+ * The names of the position legs, which are few and repeated over many
+ * positions, so the legs only point to a single copy of each
+ */
+class LegNames {
+ private:
+  static Mutex _mutex;
+  // the elements of a set never move, so the pointers stay valid
+  static std::set<std::string> _names;
+
+ public:
+  static const std::string* intern(const std::string& name) {
+    // consecutive positions of a thread usually have the same name
+    static thread_local const std::string* last = 0;
+    if (last != 0 && *last == name) return last;
+
+    Lock lock(_mutex);
+    last = &*_names.insert(name).first;
+    return last;
+  }
+};
+
 /**
  * One position leg, open or close.
  */
 class PositionLeg {
  private:
-  std::string _name;
+  const std::string* _name;
   double _price;
   // TODO: should slippage be in the position?
   double _slippage;
@@ -68,19 +90,29 @@ class PositionLeg {
         _commission(commission),
         _time(time),
         _barIndex(barIndex),
-        _name(name) {
+        _name(LegNames::intern(name)) {
     if (price == 0) {
       //			throw PositionZeroPriceException();
     }
   }
-  virtual ~PositionLeg() {}
+  // a close leg that is not set yet
+  PositionLeg()
+      : _orderType(market_order),
+        _price(0),
+        _slippage(0),
+        _commission(0),
+        _barIndex(0),
+        _name(0) {}
 
  public:
-  OrderType getType() { return _orderType; }
+  OrderType getType() const { return _orderType; }
 
   size_t getBarIndex() const { return _barIndex; }
   double getPrice() const { return _price; }
-  const std::string& getName() const { return _name; }
+  const std::string& getName() const {
+    assert(_name != 0);
+    return *_name;
+  }
 
   const DateTime& getTime() const { return _time; }
 
@@ -92,7 +124,7 @@ class PositionLeg {
     std::ostringstream o;
     o << "\t" << _time.to_simple_string() << " " << _barIndex << "\t$"
       << std::fixed << std::setprecision(2) << _price << "\ts: " << _slippage
-      << "\tc: " << _commission << "\tname: \"" << _name << "\"";
+      << "\tc: " << _commission << "\tname: \"" << getName() << "\"";
     return sprint(o, os);
   }
 
@@ -106,8 +138,6 @@ class PositionLeg {
   }
 };
 
-typedef std::auto_ptr<PositionLeg> PositionLegPtr;
-
 /**
  * PositionExtraInfo - has extra info per position, used for
  * handling that requires holding a staus info in time, for
@@ -164,9 +194,10 @@ class PositionExtraInfo  // : ObjCount
 
 class PositionImpl : public PositionAbstr {
  private:
-  // this is the id for all positions, will get incremented after a position is
-  // created
-  static PositionId _uniqueId;
+  // the next block of ids. Each thread gets the ids of its positions in
+  // blocks, so creating a position doesn't need a lock
+  static std::atomic<PositionId> _uniqueId;
+  enum { ID_BLOCK = 4096 };
   const PositionUserData* _data;
   std::string _symbol;
   // number of shares before position sizing
@@ -176,22 +207,26 @@ class PositionImpl : public PositionAbstr {
 
   const ManagedPtr<const std::string> _userString;
 
-  PositionLegPtr _openLeg;
-  PositionLegPtr _closeLeg;
+  // the legs are part of the position, so a position is a single allocation
+  PositionLeg _openLeg;
+  PositionLeg _closeLeg;
+  bool _closed;
 
   PositionExtraInfo _extraInfo;
   // each position has an unique id
   const PositionId _id;
 
-  static Mutex _mx;
-
   const bool _applyPositionSizing;
 
  private:
   static PositionId getNewId() {
-    Lock lock(_mx);
-
-    return _uniqueId++;
+    static thread_local PositionId next = 0;
+    static thread_local PositionId end = 0;
+    if (next == end) {
+      next = _uniqueId.fetch_add(ID_BLOCK);
+      end = next + ID_BLOCK;
+    }
+    return next++;
   }
 
  public:
@@ -256,86 +291,79 @@ class PositionImpl : public PositionAbstr {
                          const std::string& name) = 0;
 
   const std::string& getSymbol() const { return _symbol; }
-  const bool isOpen() const { return _closeLeg.get() == 0; }
+  const bool isOpen() const { return !_closed; }
 
   const bool isClosed() const { return !isOpen(); }
 
   virtual OrderType getEntryOrderType() const {
-    assert(_openLeg.get() != 0);
-    return _openLeg->getType();
+    return _openLeg.getType();
   }
   virtual OrderType getExitOrderType() const {
     if (!isClosed())
       throw PositionCloseOperationOnOpenPositionException("getExitType");
-    assert(_closeLeg.get() != 0);
-    return _closeLeg->getType();
+    return _closeLeg.getType();
   }
 
-  const DateTime getEntryTime() const { return _openLeg->getTime(); }
+  const DateTime getEntryTime() const { return _openLeg.getTime(); }
 
   const DateTime getCloseTime() const
       throw(PositionCloseOperationOnOpenPositionException) {
     if (!isClosed())
       throw PositionCloseOperationOnOpenPositionException("getCloseTime");
-    return _closeLeg->getTime();
+    return _closeLeg.getTime();
   }
 
   size_t getEntryBar() const {
-    assert(_openLeg.get() != 0);
-    return _openLeg->getBarIndex();
+    return _openLeg.getBarIndex();
   }
 
   size_t getCloseBar() const
       throw(PositionCloseOperationOnOpenPositionException) {
     if (!isClosed())
       throw PositionCloseOperationOnOpenPositionException("getCloseBar");
-    return _closeLeg->getBarIndex();
+    return _closeLeg.getBarIndex();
   }
 
   double getClosePrice() const
       throw(PositionCloseOperationOnOpenPositionException) {
     if (!isClosed())
       throw PositionCloseOperationOnOpenPositionException("getClosePrice");
-    return _closeLeg->getPrice();
+    return _closeLeg.getPrice();
   }
 
   double getEntryPrice() const {
-    assert(_openLeg.get() != 0);
-    return _openLeg->getPrice();
+    return _openLeg.getPrice();
   }
   virtual double getEntrySlippage() const {
-    assert(_openLeg.get() != 0);
-    return _openLeg->getSlippage();
+    return _openLeg.getSlippage();
   }
 
   virtual double getEntryCommission() const {
-    assert(_openLeg.get() != 0);
-    return _openLeg->getCommission();
+    return _openLeg.getCommission();
   }
 
   virtual double getCloseSlippage() const
       throw(PositionCloseOperationOnOpenPositionException) {
     if (!isClosed())
       throw PositionCloseOperationOnOpenPositionException("getCloseSlippage");
-    return _closeLeg->getSlippage();
+    return _closeLeg.getSlippage();
   }
   virtual double getCloseCommission() const
       throw(PositionCloseOperationOnOpenPositionException) {
     if (!isClosed())
       throw PositionCloseOperationOnOpenPositionException("getCloseCommission");
-    return _closeLeg->getCommission();
+    return _closeLeg.getCommission();
   }
 
   virtual const std::string& getEntryName() const {
-    assert(_openLeg.get() != 0);
-    return _openLeg->getName();
+    return _openLeg.getName();
   }
 
   virtual const std::string& getCloseName() const
       throw(PositionCloseOperationOnOpenPositionException) {
     if (!isClosed())
       throw PositionCloseOperationOnOpenPositionException("getCloseName");
-    return _closeLeg->getName();
+    return _closeLeg.getName();
   }
 
   virtual double getPctGain() const
@@ -359,9 +387,9 @@ class PositionImpl : public PositionAbstr {
       o << _symbol << ", " << _shares << " sh, ";
       sprint(o, os);
     }
-    _openLeg->dump(os);
+    _openLeg.dump(os);
 
-    if (_closeLeg.get() == 0) {
+    if (!_closed) {
       std::ostringstream o;
       o << "\t-\t- - - - - - - - - - - - - - - - - -";
       sprint(o, os);
@@ -369,7 +397,7 @@ class PositionImpl : public PositionAbstr {
       std::ostringstream o;
       o << "\t- ";
       sprint(o, os);
-      _closeLeg->dump(os);
+      _closeLeg.dump(os);
     }
 
     return os;
@@ -380,10 +408,10 @@ class PositionImpl : public PositionAbstr {
       std::ostringstream o;
       o << _symbol << ", " << _shares << " sh, ";
       sprint(o, os);
-      _openLeg->dumpMin(os);
+      _openLeg.dumpMin(os);
     }
 
-    if (_closeLeg.get() == 0) {
+    if (!_closed) {
       std::ostringstream o;
       o << "\t-\t- - - - - - - - - - - - - - - - - -";
       sprint(o, os);
@@ -392,7 +420,7 @@ class PositionImpl : public PositionAbstr {
         std::ostringstream o;
         o << "\t- ";
         sprint(o, os);
-        _closeLeg->dumpMin(os);
+        _closeLeg.dumpMin(os);
       }
       {
         std::ostringstream o;
@@ -413,8 +441,8 @@ class PositionImpl : public PositionAbstr {
       : _symbol(symbol),
         _shares(shares),
         _initialShares(shares),
-        _openLeg(new PositionLeg(orderType, price, slippage, commission, time,
-                                 bar, name)),
+        _openLeg(orderType, price, slippage, commission, time, bar, name),
+        _closed(false),
         _id(id > 0 ? id : getNewId()),
         _userString(userString),
         _applyPositionSizing(applyPositionSizing) {
@@ -431,8 +459,9 @@ class PositionImpl : public PositionAbstr {
     // be thrown or not
     // make sure we are closing an open position
     if (!isOpen()) throw ClosingAlreadyClosedPositionException();
-    _closeLeg = PositionLegPtr(new PositionLeg(orderType, price, slippage,
-                                               commission, time, bar, name));
+    _closeLeg =
+        PositionLeg(orderType, price, slippage, commission, time, bar, name);
+    _closed = true;
   }
 
  public:
@@ -19,79 +19,107 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "stdafx.h"
 #include "positions.h"
 
-class Exits {
+/**
+ * The entries and exits of the enabled positions of a container, in entry time
+ * order, with their times replaced by their ranks among all the times, so they
+ * can be swept without comparing date/times
+ */
+class SizingEvents {
  private:
-  typedef std::multimap<DateTime, tradery::Position> DatePosMap;
+  // the exit rank of the positions still open at the end, which are never
+  // closed
+  static const unsigned __int64 NEVER = ~0ULL >> 1;
+
+  // the positions, with the order type and time rank of their entry, and the
+  // key of their exit, which is twice the time rank, plus 1 if the position
+  // doesn't exit at market, so the exits at market come first when the times
+  // are equal
+  std::vector<tradery::Position> _positions;
+  std::vector<OrderType> _entryTypes;
+  std::vector<unsigned __int64> _entries;
+  std::vector<unsigned __int64> _exits;
 
-  DatePosMap _map;
+ private:
+  class AddPosition : public PositionHandler {
+   private:
+    SizingEvents& _events;
+    std::vector<DateTime>& _times;
+
+   public:
+    AddPosition(SizingEvents& events, std::vector<DateTime>& times)
+        : _events(events), _times(times) {}
+
+    virtual void onPosition(tradery::Position pos) {
+      _events._positions.push_back(pos);
+      _events._entryTypes.push_back(pos.getEntryOrderType());
+      _times.push_back(pos.getEntryTime());
+      if (pos.isClosed()) _times.push_back(pos.getCloseTime());
+    }
+  };
 
  public:
-  unsigned __int64 openPosCount() const { return _map.size(); }
-
-  void closePositions(DateTime dt, tradery::OrderType type) {
-    for (DatePosMap::iterator i = _map.begin(); i != _map.end();) {
-      if (i->first < dt)
-        _map.erase(i++);
-      else if (i->first == dt) {
-        // fine tuning of the algorithm if the 2 positions are on the same bar
-        OrderType exitOrderType = i->second.getExitOrderType();
-        // if the position is exiting at market
-        // or the position entrying is at close,
-        // then it's safe to close the exiting position, because they won't
-        // overlap
-        if (exitOrderType == market_order || type == close_order)
-          _map.erase(i++);
-        else
-          i++;
-        // other combinations are unsafe, we don't know which occurred first, so
-        // we can't close or they may overlap
-      } else
-        break;
+  // the positions must be sorted by entry time
+  SizingEvents(PositionsContainer& pc) {
+    std::vector<DateTime> times;
+    AddPosition addPosition(*this, times);
+    pc.forEach(addPosition);
+
+    std::sort(times.begin(), times.end());
+    times.erase(std::unique(times.begin(), times.end()), times.end());
+
+    _entries.reserve(_positions.size());
+    _exits.reserve(_positions.size());
+    for (size_t n = 0; n < _positions.size(); n++) {
+      const tradery::Position& pos = _positions[n];
+      _entries.push_back(rank(times, pos.getEntryTime()));
+      if (pos.isOpen())
+        _exits.push_back(NEVER * 2);
+      else
+        _exits.push_back(rank(times, pos.getCloseTime()) * 2 +
+                         (pos.getExitOrderType() == market_order ? 0 : 1));
     }
   }
 
-  void addPosition(tradery::Position pos) {
-    // if the position is open, it means it will never be closed, so simulate
-    // this by setting the associated time to + infinity
-    //    std::cout << _T( "in pos sizing, addPosition" ) << std::endl;
-    if (pos.isOpen())
-      _map.insert(DatePosMap::value_type(PosInfinityDateTime(), pos));
-    else
-      _map.insert(DatePosMap::value_type(pos.getCloseTime(), pos));
+  static unsigned __int64 rank(const std::vector<DateTime>& times,
+                               const DateTime& time) {
+    return std::lower_bound(times.begin(), times.end(), time) - times.begin();
   }
-};
 
-class PosSizingHandler : public PositionHandler {
- private:
-  unsigned __int64 _maxOpenPos;
-  PositionsContainerImpl& _pci;
-  Exits _exits;
-
- public:
-  PosSizingHandler(PositionsContainer& pc, unsigned __int64 maxOpenPos)
-      : _maxOpenPos(maxOpenPos),
-        _pci(dynamic_cast<PositionsContainerImpl&>(pc)) {}
-
-  // called on each position
-  virtual void onPosition(tradery::Position pos) {
-    assert(_exits.openPosCount() <= _maxOpenPos);
-
-    // entry time stamp
-    const DateTime entry(pos.getEntryTime());
-
-    // adjust the collection of still open positions at the date/time of entry
-    // of the current position
-    _exits.closePositions(entry, pos.getEntryOrderType());
-
-    //      std::cout << _T( "in pos sizing handler, onPosition before test2" )
-    //      << std::endl;
-    if (_exits.openPosCount() == _maxOpenPos) {
-      //        std::cout << _T( "in pos sizing handler, onPosition in test2" )
-      //        << std::endl;
-      pos.disable();
-    } else if (_exits.openPosCount() < _maxOpenPos) {
-      _exits.addPosition(pos);
+  size_t size() const { return _positions.size(); }
+  tradery::Position position(size_t n) const { return _positions[n]; }
+
+  /**
+   * Sweeps the entries in order, with the exits of the positions taken in a
+   * min-heap, so the ones that have happened by the time of an entry are
+   * removed from the top
+   */
+  size_t evaluate(unsigned __int64 maxOpenPos, std::vector<bool>& taken) const {
+    std::priority_queue<unsigned __int64, std::vector<unsigned __int64>,
+                        std::greater<unsigned __int64> >
+        exits;
+    size_t count = 0;
+
+    taken.assign(_positions.size(), false);
+    for (size_t n = 0; n < _positions.size(); n++) {
+      unsigned __int64 entry = _entries[n];
+      // the positions that exit at the entry time can only be considered
+      // closed if they exit at market, or if the new position enters at
+      // close, otherwise we don't know which occurred first, so they may
+      // overlap
+      while (!exits.empty() &&
+             (exits.top() / 2 < entry ||
+              (exits.top() / 2 == entry &&
+               (exits.top() % 2 == 0 || _entryTypes[n] == close_order))))
+        exits.pop();
+
+      assert(exits.size() <= maxOpenPos);
+      if (exits.size() < maxOpenPos) {
+        exits.push(_exits[n]);
+        taken[n] = true;
+        ++count;
+      }
     }
+    return count;
   }
 };
 
@@ -107,10 +135,13 @@ void PositionSizing::apply() {
   _pc.sortByEntryTime();
   LOG(log_debug, "in pos sizing, apply before test unlimited pos");
   if (!_psp.maxOpenPos().unlimited()) {
-    LOG(log_debug, "in pos sizing, before pos handler");
+    LOG(log_debug, "in pos sizing, before sweep");
     // if not unlimited number of positions, do the position sizing
     // now go through the positions
-    PosSizingHandler psh(_pc, _psp.maxOpenPos().get());
-    _pc.forEach(psh);
+    SizingEvents e(_pc);
+    std::vector<bool> taken;
+    e.evaluate(_psp.maxOpenPos().get(), taken);
+    for (size_t n = 0; n < e.size(); n++)
+      if (!taken[n]) e.position(n).disable();
   }
 }
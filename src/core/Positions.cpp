@@ -28,8 +28,9 @@ static char THIS_FILE[]=__FILE__;
 #endif
 */
 
-PositionId PositionImpl::_uniqueId = 1;
-Mutex PositionImpl::_mx;
+std::atomic<PositionId> PositionImpl::_uniqueId(1);
+Mutex LegNames::_mutex;
+std::set<std::string> LegNames::_names;
 
 //////////////////////////////////////////////////////////////////////
 // Construction/Destruction
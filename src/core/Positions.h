@@ -218,18 +218,239 @@ class OpenPositionsIteratorImpl : public OpenPositionsIteratorAbstr {
 
 class PositionsIteratorImpl;
 
-typedef std::map<PositionId, PositionAbstrPtr> PositionIdToPositionMap;
+/**
+ * Positions by id, in a vector sorted by id. Each thread creates its positions
+ * with increasing ids, so they are usually added in order, and the vector only
+ * needs to be sorted again when they are not
+ */
+class PositionIdIndex {
+ private:
+  typedef std::pair<PositionId, PositionAbstrPtr> Entry;
+
+  mutable std::vector<Entry> _entries;
+  mutable bool _sorted;
+
+ private:
+  static bool lessId(const Entry& entry1, const Entry& entry2) {
+    return entry1.first < entry2.first;
+  }
+
+ public:
+  PositionIdIndex() : _sorted(true) {}
+
+  void add(PositionAbstrPtr pos) {
+    if (!_entries.empty() && _entries.back().first >= pos->getId())
+      _sorted = false;
+    _entries.push_back(Entry(pos->getId(), pos));
+  }
+
+  // moves the positions of another index to this one
+  void append(PositionIdIndex& index) {
+    if (index._entries.empty()) return;
+
+    if (!index._sorted ||
+        (!_entries.empty() &&
+         _entries.back().first >= index._entries.front().first))
+      _sorted = false;
+    _entries.insert(_entries.end(), index._entries.begin(),
+                    index._entries.end());
+    index.clear();
+  }
+
+  void clear() {
+    _entries.clear();
+    _sorted = true;
+  }
+
+  // the position with the id, or 0 if there is none
+  const PositionAbstrPtr* find(PositionId id) const {
+    if (!_sorted) {
+      std::sort(_entries.begin(), _entries.end(), lessId);
+      _sorted = true;
+    }
+
+    std::vector<Entry>::const_iterator i =
+        std::lower_bound(_entries.begin(), _entries.end(),
+                         Entry(id, PositionAbstrPtr()), lessId);
+    return i != _entries.end() && i->first == id ? &i->second : 0;
+  }
+};
+
+/**
+ * The values of positions, one array per value, in the order of the
+ * positions. Built in one pass over the positions, so the loops that only need
+ * a few of the values, such as sorts or statistics, go over contiguous arrays
+ * instead of calling the accessors of each position. The values of the open
+ * positions that only exist for closed ones are 0.
+ */
+class PositionColumns {
+ public:
+  // the positions, which must outlive the columns
+  std::vector<const PositionAbstr*> positions;
+  std::vector<const std::string*> symbols;
+  std::vector<char> isLong;
+  std::vector<char> isOpen;
+  std::vector<size_t> shares;
+  std::vector<OrderType> entryOrderTypes;
+  std::vector<OrderType> exitOrderTypes;
+  std::vector<DateTime> entryTimes;
+  std::vector<DateTime> closeTimes;
+  std::vector<size_t> entryBars;
+  std::vector<size_t> closeBars;
+  std::vector<double> entryPrices;
+  std::vector<double> closePrices;
+  std::vector<double> entrySlippages;
+  std::vector<double> closeSlippages;
+  std::vector<double> entryCommissions;
+  std::vector<double> closeCommissions;
+  std::vector<double> gains;
+
+ public:
+  size_t size() const { return positions.size(); }
+
+  void reserve(size_t count) {
+    positions.reserve(count);
+    symbols.reserve(count);
+    isLong.reserve(count);
+    isOpen.reserve(count);
+    shares.reserve(count);
+    entryOrderTypes.reserve(count);
+    exitOrderTypes.reserve(count);
+    entryTimes.reserve(count);
+    closeTimes.reserve(count);
+    entryBars.reserve(count);
+    closeBars.reserve(count);
+    entryPrices.reserve(count);
+    closePrices.reserve(count);
+    entrySlippages.reserve(count);
+    closeSlippages.reserve(count);
+    entryCommissions.reserve(count);
+    closeCommissions.reserve(count);
+    gains.reserve(count);
+  }
+
+  void add(const PositionAbstr& pos) {
+    bool open = pos.isOpen();
+    positions.push_back(&pos);
+    symbols.push_back(&pos.getSymbol());
+    isLong.push_back(pos.isLong());
+    isOpen.push_back(open);
+    shares.push_back(pos.getShares());
+    entryOrderTypes.push_back(pos.getEntryOrderType());
+    exitOrderTypes.push_back(open ? market_order : pos.getExitOrderType());
+    entryTimes.push_back(pos.getEntryTime());
+    closeTimes.push_back(open ? DateTime() : pos.getCloseTime());
+    entryBars.push_back(pos.getEntryBar());
+    closeBars.push_back(open ? 0 : pos.getCloseBar());
+    entryPrices.push_back(pos.getEntryPrice());
+    closePrices.push_back(open ? 0 : pos.getClosePrice());
+    entrySlippages.push_back(pos.getEntrySlippage());
+    closeSlippages.push_back(open ? 0 : pos.getCloseSlippage());
+    entryCommissions.push_back(pos.getEntryCommission());
+    closeCommissions.push_back(open ? 0 : pos.getCloseCommission());
+    gains.push_back(open ? 0 : pos.getGain());
+  }
+};
+
+// the orders of the predefined sorts, on the columns of the positions, same
+// as LessEntryTimePredicate, LessCloseTimePredicate and LessGainPredicate,
+// except that the open positions are all equivalent to each other
+class LessEntryTimeColumns {
+ private:
+  const PositionColumns& _c;
+
+ public:
+  LessEntryTimeColumns(const PositionColumns& c) : _c(c) {}
+
+  bool operator()(size_t n, size_t m) const {
+    if (_c.entryTimes[n] != _c.entryTimes[m])
+      return _c.entryTimes[n] < _c.entryTimes[m];
+    else if (_c.entryOrderTypes[n] != _c.entryOrderTypes[m])
+      return PositionAbstr::orderTypeLower(_c.entryOrderTypes[n],
+                                           _c.entryOrderTypes[m]);
+    else if (*_c.symbols[n] != *_c.symbols[m])
+      return *_c.symbols[n] < *_c.symbols[m];
+    else
+      return _c.positions[n] < _c.positions[m];
+  }
+};
+
+class LessCloseTimeColumns {
+ private:
+  const PositionColumns& _c;
+
+ public:
+  LessCloseTimeColumns(const PositionColumns& c) : _c(c) {}
+
+  bool operator()(size_t n, size_t m) const {
+    if (_c.isOpen[n] || _c.isOpen[m])
+      return _c.isOpen[n] && !_c.isOpen[m];
+    else if (_c.closeTimes[n] != _c.closeTimes[m])
+      return _c.closeTimes[n] < _c.closeTimes[m];
+    else
+      return PositionAbstr::orderTypeLower(_c.exitOrderTypes[n],
+                                           _c.exitOrderTypes[m]);
+  }
+};
+
+class LessGainColumns {
+ private:
+  const PositionColumns& _c;
+
+ public:
+  LessGainColumns(const PositionColumns& c) : _c(c) {}
+
+  bool operator()(size_t n, size_t m) const {
+    if (_c.isOpen[n] || _c.isOpen[m])
+      return _c.isOpen[n] && !_c.isOpen[m];
+    else
+      return _c.gains[n] < _c.gains[m];
+  }
+};
+
+// reverses an order, for the descending sorts
+template <class Less>
+class ReverseOrder {
+ private:
+  const Less _less;
+
+ public:
+  ReverseOrder(const Less& less) : _less(less) {}
+
+  bool operator()(size_t n, size_t m) const { return _less(m, n); }
+};
 
 // class PositionsPtrList : private PosPtrList, public PositionsContainer
 class PositionsContainerImpl : private BaseContainer,
                                public PositionsContainer {
   friend PositionsIteratorImpl;
 
+ private:
+  // sorts the indexes of the positions with an order on their columns, then
+  // moves the nodes of the list in that order, so the positions are not copied
+  template <class Less>
+  void sortByColumns(const Less& less, bool ascending) {
+    std::vector<BaseContainer::iterator> nodes;
+    nodes.reserve(BaseContainer::size());
+    for (BaseContainer::iterator i = BaseContainer::begin();
+         i != BaseContainer::end(); i++)
+      nodes.push_back(i);
+
+    std::vector<size_t> order(nodes.size());
+    for (size_t n = 0; n < order.size(); n++) order[n] = n;
+    if (ascending)
+      std::stable_sort(order.begin(), order.end(), less);
+    else
+      std::stable_sort(order.begin(), order.end(), ReverseOrder<Less>(less));
+
+    for (size_t n = 0; n < order.size(); n++)
+      BaseContainer::splice(BaseContainer::end(), *this, nodes[order[n]]);
+  }
+
  private:
   mutable OpenPositions _openPositions;
 
-  // todo: make this an on demand map
-  PositionIdToPositionMap _idsToPositions;
+  PositionIdIndex _idsToPositions;
 
  public:
   virtual ~PositionsContainerImpl() {}
@@ -251,10 +472,10 @@ class PositionsContainerImpl : private BaseContainer,
   }
 
   virtual tradery::Position getPosition(PositionId id) {
-    PositionIdToPositionMap::iterator i = _idsToPositions.find(id);
+    const PositionAbstrPtr* pos = _idsToPositions.find(id);
 
-    if (i != _idsToPositions.end())
-      return (*i).second;
+    if (pos != 0)
+      return *pos;
     else
       return 0;
   }
@@ -272,16 +493,7 @@ class PositionsContainerImpl : private BaseContainer,
     assert(pos);
     BaseContainer::push_back(pos);
     if (pos->isOpen()) _openPositions.add(pos);
-    // make sure the id is unique
-    // todo: assert
-    //
-    //    std::cout << _T( "adding position with id: " ) << pos->getId() <<
-    //    std::endl;
-    bool b = _idsToPositions
-                 .insert(PositionIdToPositionMap::value_type(pos->getId(), pos))
-                 .second;
-
-    assert(b);
+    _idsToPositions.add(pos);
   }
 
   virtual void append(PositionsContainer* posContainer) {
@@ -294,10 +506,7 @@ class PositionsContainerImpl : private BaseContainer,
       // and erase the original map
       // todo: make this more efficient
 
-      _idsToPositions.insert(p->_idsToPositions.begin(),
-                             p->_idsToPositions.end());
-      p->_idsToPositions.erase(p->_idsToPositions.begin(),
-                               p->_idsToPositions.end());
+      _idsToPositions.append(p->_idsToPositions);
 
       _openPositions.append(p->_openPositions);
       BaseContainer::splice(end(), *p);
@@ -363,6 +572,21 @@ class PositionsContainerImpl : private BaseContainer,
   virtual void clear() {
     BaseContainer::clear();
     _openPositions.clear();
+    _idsToPositions.clear();
+  }
+
+  /**
+   * Returns the values of the positions, in their current order. The columns
+   * point to the positions, so they must not be used after the positions are
+   * removed.
+   */
+  PositionColumns columns() const {
+    PositionColumns c;
+    c.reserve(BaseContainer::size());
+    for (BaseContainer::const_iterator i = BaseContainer::begin();
+         i != BaseContainer::end(); i++)
+      c.add(**i);
+    return c;
   }
 
   /**
@@ -374,10 +598,8 @@ class PositionsContainerImpl : private BaseContainer,
    */
   void sortByEntryTime(bool ascending = true) {
     LOG(log_info, "Sorting positions by entry time");
-    if (ascending)
-      BaseContainer::sort(LessEntryTimePredicate());
-    else
-      BaseContainer::sort(std::not2(LessEntryTimePredicate()));
+    PositionColumns c(columns());
+    sortByColumns(LessEntryTimeColumns(c), ascending);
   }
   /**
    * Predefined sort, sorting by position exit time
@@ -387,10 +609,8 @@ class PositionsContainerImpl : private BaseContainer,
    * @see sort
    */
   void sortByExitTime(bool ascending = true) {
-    if (ascending)
-      BaseContainer::sort(LessCloseTimePredicate());
-    else
-      BaseContainer::sort(std::not2(LessCloseTimePredicate()));
+    PositionColumns c(columns());
+    sortByColumns(LessCloseTimeColumns(c), ascending);
   }
   /**
    * Predefined sort, sorting by position gain (exit price - entry price)
@@ -401,10 +621,8 @@ class PositionsContainerImpl : private BaseContainer,
    * @see sort
    */
   virtual void sortByGain(bool ascending = true) {
-    if (ascending)
-      BaseContainer::sort(LessGainPredicate());
-    else
-      BaseContainer::sort(std::not2(LessGainPredicate()));
+    PositionColumns c(columns());
+    sortByColumns(LessGainColumns(c), ascending);
   }
   /**
    * Reverses the order of all positions in the list.
@@ -435,7 +653,7 @@ class PositionsContainerImpl : private BaseContainer,
   virtual void forEach(PositionHandler& op) {
     for (BaseContainer::iterator i = BaseContainer::begin();
          i != BaseContainer::end(); i++) {
-      PositionAbstrPtr pos = *i;
+      const PositionAbstrPtr& pos = *i;
       if (!pos->isDisabled()) op.onPosition(pos);
     }
   }
@@ -444,7 +662,7 @@ class PositionsContainerImpl : private BaseContainer,
                        const PositionEqualPredicate& pred) {
     for (BaseContainer::iterator i = BaseContainer::begin();
          i != BaseContainer::end(); i++) {
-      PositionAbstrPtr pos = *i;
+      const PositionAbstrPtr& pos = *i;
       if (pred == pos && !pos->isDisabled()) op.onPosition(pos);
     }
   }
@@ -453,7 +671,7 @@ class PositionsContainerImpl : private BaseContainer,
                           const PositionEqualPredicate& pred) {
     for (BaseContainer::iterator i = BaseContainer::begin();
          i != BaseContainer::end(); i++) {
-      PositionAbstrPtr pos = *i;
+      const PositionAbstrPtr& pos = *i;
       if (pred != pos && !pos->isDisabled()) op.onPosition(pos);
     }
   }
@@ -461,7 +679,7 @@ class PositionsContainerImpl : private BaseContainer,
   virtual void forEach(PositionEqualPredHandler& predHandler) {
     for (BaseContainer::iterator i = BaseContainer::begin();
          i != BaseContainer::end(); i++) {
-      PositionAbstrPtr pos = *i;
+      const PositionAbstrPtr& pos = *i;
       if (predHandler == pos && !pos->isDisabled()) predHandler.onPosition(pos);
     }
   }
@@ -469,7 +687,7 @@ class PositionsContainerImpl : private BaseContainer,
   virtual void forEachNot(PositionEqualPredHandler& predHandler) {
     for (BaseContainer::iterator i = BaseContainer::begin();
          i != BaseContainer::end(); i++) {
-      PositionAbstrPtr pos = *i;
+      const PositionAbstrPtr& pos = *i;
       if (predHandler != pos && !pos->isDisabled()) predHandler.onPosition(pos);
     }
   }
@@ -478,7 +696,7 @@ class PositionsContainerImpl : private BaseContainer,
                          std::vector<PositionEqualPredicate*> predicates) {
     for (BaseContainer::iterator i = BaseContainer::begin();
          i != BaseContainer::end(); i++) {
-      PositionAbstrPtr pos = *i;
+      const PositionAbstrPtr& pos = *i;
       if (!pos->isDisabled()) {
         for (size_t n = 0; n < predicates.size(); n++) {
           if ((*predicates[n]) == pos) {
@@ -494,7 +712,7 @@ class PositionsContainerImpl : private BaseContainer,
                           std::vector<PositionEqualPredicate*> predicates) {
     for (BaseContainer::iterator i = BaseContainer::begin();
          i != BaseContainer::end(); i++) {
-      PositionAbstrPtr pos = *i;
+      const PositionAbstrPtr& pos = *i;
       if (!pos->isDisabled()) {
         bool b = true;
         for (size_t n = 0; n < predicates.size(); n++) {
@@ -511,7 +729,7 @@ class PositionsContainerImpl : private BaseContainer,
   virtual void forEachConst(PositionHandler& op) const {
     for (BaseContainer::const_iterator i = BaseContainer::begin();
          i != BaseContainer::end(); i++) {
-      PositionAbstrPtr pos = *i;
+      const PositionAbstrPtr& pos = *i;
       if (!pos->isDisabled()) op.onPositionConst(pos);
     }
   }
@@ -520,7 +738,7 @@ class PositionsContainerImpl : private BaseContainer,
                             const PositionEqualPredicate& pred) const {
     for (BaseContainer::const_iterator i = BaseContainer::begin();
          i != BaseContainer::end(); i++) {
-      PositionAbstrPtr pos = *i;
+      const PositionAbstrPtr& pos = *i;
       if (pred == pos && !pos->isDisabled()) op.onPositionConst(pos);
     }
   }
@@ -551,7 +769,7 @@ class PositionsContainerImpl : private BaseContainer,
   virtual void forEachClosed(PositionHandler& op) {
     for (BaseContainer::iterator i = BaseContainer::begin();
          i != BaseContainer::end(); i++) {
-      PositionAbstrPtr pos = *i;
+      const PositionAbstrPtr& pos = *i;
       if (pos->isClosed() && !pos->isDisabled()) op.onPosition(pos);
     }
   }
@@ -559,7 +777,7 @@ class PositionsContainerImpl : private BaseContainer,
   virtual void forEachClosedConst(PositionHandler& op) const {
     for (BaseContainer::const_iterator i = BaseContainer::begin();
          i != BaseContainer::end(); i++) {
-      PositionAbstrPtr pos = *i;
+      const PositionAbstrPtr& pos = *i;
       if (pos->isClosed() && !pos->isDisabled()) op.onPositionConst(pos);
     }
   }
@@ -34,6 +34,11 @@ static char THIS_FILE[] = __FILE__;
 //////////////////////////////////////////////////////////////////////
 
 DataManager* _dataManager;
+// data prefetching is disabled unless enabled by setDataPrefetch
+size_t _prefetchWindow = 0;
+unsigned int _prefetchThreads = 0;
+// each run creates its own threads unless startThreadPool is called
+ThreadPool* _threadPool = 0;
 
 void thread_func(void* param) {
   AsynchRunInfo* p = reinterpret_cast<AsynchRunInfo*>(param);
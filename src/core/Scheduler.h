@@ -21,11 +21,16 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "structuredexception.h"
 #include "moremiscwin.h"
 #include <log.h>
+#include <atomic>
 
 /** @file
  *  \brief Contains all scheduler related classes
  */
 extern DataManager* _dataManager;
+extern size_t _prefetchWindow;
+extern unsigned int _prefetchThreads;
+class ThreadPool;
+extern ThreadPool* _threadPool;
 
 class SynchronizedFlag {
  private:
@@ -50,6 +55,237 @@ class SynchronizedFlag {
   }
 };
 
+/**
+ * Loads the data for symbols ahead of the threads that run them
+ *
+ * Without prefetching, a runnable thread loads the data for a symbol right
+ * before running the runnable on it, so each thread alternates between waiting
+ * for the data source and running the system. With prefetching, each runnable
+ * thread requests the data for the next few tasks in its queue, and a separate
+ * pool of I/O threads loads it while the runnable thread is busy running the
+ * current task.
+ *
+ * A request that hasn't been picked up by an I/O thread by the time its data
+ * is needed is loaded by the requesting thread, so a runnable thread never
+ * waits behind other requests.
+ *
+ * There is a queue of requests and a set of I/O threads for each NUMA node
+ * used by the thread pool. The I/O threads of a node are restricted to its
+ * processors and each runnable thread requests the data on its own node, so
+ * the data is allocated in memory local to the thread that runs the system.
+ *
+ * Errors thrown while loading the data are stored with the request and
+ * rethrown in the runnable thread, so they are reported exactly as when the
+ * data is loaded synchronously.
+ */
+class DataPrefetcher {
+ public:
+  class Item {
+    friend class DataPrefetcher;
+
+   private:
+    DataInfoConstPtr _info;
+    BarsPtr _data;
+    std::exception_ptr _error;
+    bool _ready;
+    // still in the queue, not picked up by an I/O thread yet
+    bool _queued;
+    const size_t _node;
+
+    void set(BarsPtr data, std::exception_ptr error) {
+      _data = data;
+      _error = error;
+      _ready = true;
+    }
+
+   public:
+    Item(DataInfoConstPtr info, size_t node)
+        : _info(info), _ready(false), _queued(true), _node(node) {}
+
+    DataInfoConstPtr info() const { return _info; }
+  };
+
+  typedef boost::shared_ptr<Item> ItemPtr;
+
+ private:
+  class IOThread {
+   private:
+    DataPrefetcher& _prefetcher;
+    const size_t _node;
+
+   public:
+    IOThread(DataPrefetcher& prefetcher, size_t node)
+        : _prefetcher(prefetcher), _node(node) {}
+
+    void operator()() { _prefetcher.ioThread(_node); }
+  };
+
+ private:
+  const unsigned int _threadCount;
+  // processors of each node, 0 if the threads are not restricted
+  const std::vector<unsigned __int64> _nodeMasks;
+  const SynchronizedFlag& _cancelState;
+  DateTimeRangePtr _range;
+  ThreadInitializer* _threadInitializer;
+
+  // requests for each node
+  std::vector<std::list<ItemPtr> > _queues;
+  bool _stop;
+
+  mutable NonRecursiveMutex _mutex;
+  mutable Condition _condition;
+  boost::thread_group _threads;
+
+ private:
+  bool canceled() const { return _stop || _cancelState.get(); }
+
+  BarsPtr load(DataInfoConstPtr si, std::exception_ptr& error) const {
+    try {
+      return si->dataSource()->getData(si.get(), _range)->getDataCollection();
+    } catch (...) {
+      error = std::current_exception();
+      return BarsPtr();
+    }
+  }
+
+  void ioThread(size_t node) {
+    if (_nodeMasks[node] != 0) setCurrentThreadAffinity(_nodeMasks[node]);
+    if (_threadInitializer != 0) _threadInitializer->init();
+    StructuredException::install();
+
+    std::list<ItemPtr>& queue = _queues[node];
+    NonRecursiveLock lock(_mutex);
+    while (!canceled()) {
+      if (queue.empty()) {
+        _condition.wait(lock);
+        continue;
+      }
+
+      ItemPtr item = queue.front();
+      queue.pop_front();
+      item->_queued = false;
+      lock.unlock();
+
+      std::exception_ptr error;
+      BarsPtr data = load(item->info(), error);
+
+      lock.lock();
+      item->set(data, error);
+      _condition.notify_all();
+    }
+    lock.unlock();
+
+    if (_threadInitializer != 0) _threadInitializer->uninit();
+  }
+
+ public:
+  /**
+   * @param threads number of I/O threads for each node
+   * @param nodeMasks
+   *                the processors of each node, 0 for a node whose threads
+   * are not restricted to any processors
+   * @param cancelState
+   *                the scheduler cancel flag, checked by the I/O threads
+   * before loading each symbol
+   * @param range   the range of data to load
+   * @param threadInitializer
+   *                used to initialize the I/O threads, same as the runnable
+   * threads, as the data sources may need it
+   */
+  DataPrefetcher(unsigned int threads,
+                 const std::vector<unsigned __int64>& nodeMasks,
+                 const SynchronizedFlag& cancelState, DateTimeRangePtr range,
+                 ThreadInitializer* threadInitializer)
+      : _threadCount(max2<unsigned int>(threads, 1)),
+        _nodeMasks(nodeMasks),
+        _cancelState(cancelState),
+        _range(range),
+        _threadInitializer(threadInitializer),
+        _queues(nodeMasks.size()),
+        _stop(false) {
+    assert(!nodeMasks.empty());
+  }
+
+  ~DataPrefetcher() {
+    cancel();
+    _threads.join_all();
+  }
+
+  void start() {
+    for (size_t node = 0; node < _nodeMasks.size(); node++)
+      for (unsigned int n = 0; n < _threadCount; n++)
+        _threads.create_thread(IOThread(*this, node));
+  }
+
+  /**
+   * Stops the I/O threads. Requests that have not been picked up by an I/O
+   * thread will be loaded by the threads that need them
+   */
+  void cancel() {
+    NonRecursiveLock lock(_mutex);
+    _stop = true;
+    _condition.notify_all();
+  }
+
+  /**
+   * Queues the loading of the data for a symbol
+   *
+   * @param info   the symbol
+   * @param node   the node of the requesting thread
+   * @return the request, to be passed to get
+   */
+  ItemPtr request(DataInfoConstPtr info, size_t node) {
+    ItemPtr item(new Item(info, node % _queues.size()));
+
+    NonRecursiveLock lock(_mutex);
+    _queues[item->_node].push_back(item);
+    _condition.notify_all();
+    return item;
+  }
+
+  /**
+   * Returns the data for a request, waiting for it if it is being loaded
+   *
+   * @param item   the request
+   * @return the data
+   * @exception rethrows the exception thrown while loading the data, if any
+   */
+  BarsPtr get(ItemPtr item) {
+    NonRecursiveLock lock(_mutex);
+    if (item->_queued) {
+      _queues[item->_node].remove(item);
+      item->_queued = false;
+      lock.unlock();
+
+      std::exception_ptr error;
+      BarsPtr data = load(item->info(), error);
+
+      lock.lock();
+      item->set(data, error);
+    }
+
+    // an item that has been picked up by an I/O thread is always loaded, even
+    // if the run is canceled in the meantime
+    while (!item->_ready) _condition.wait(lock);
+
+    if (item->_error) std::rethrow_exception(item->_error);
+    return item->_data;
+  }
+};
+
+/**
+ * Counters of a runnable thread, reported with the status of each run
+ */
+class TaskCounters {
+ public:
+  // tasks run by the thread
+  unsigned long executed;
+  // tasks taken from the queues of other threads
+  unsigned long stolen;
+
+  TaskCounters() : executed(0), stolen(0) {}
+};
+
 /**
  * This class contains all the information needed to run a Runnable:
  * - the runnable itself
@@ -88,7 +324,6 @@ class RunnableInfo {
    * symbols
    */
   PositionsVector& _pos;
-  size_t _crtSymbol;
   ErrorEventSink* _es;
   Slippage* _slippage;
   Commission* _commission;
@@ -178,8 +413,32 @@ class RunnableInfo {
 
   virtual ~RunnableInfo() {}
 
+  DataInfoIterator* symbols() const { return _symbols; }
+
   /**
-   * runs the Runnable on a range of the available data
+   * Called before the first symbol of each pass over the symbols, to signal
+   * that a new simulation session is starting
+   *
+   * @return false if the runnable is not to be run
+   */
+  bool begin() { return _runnable->begin(); }
+
+  /**
+   * Called after the last symbol of a pass over the symbols
+   *
+   * @return true if the runnable is to be run again on all symbols
+   */
+  bool again() { return _runnable->again(); }
+
+  void addDataInfoError() {
+    ErrorEvent ee(ErrorEvent::Types::DATA_INFO_ERROR,
+                  ErrorEvent::Category::error, getRunnableName(),
+                  "Data info invalid, possibly a null symbol", "");
+    addErrorEvent(ee);
+  }
+
+  /**
+   * runs the Runnable on one symbol
    * If first initializes it with all the information such as the collection
    * of data elements on which to run it, the positions collection etc.
    *
@@ -190,403 +449,388 @@ class RunnableInfo {
    * This method also captures all runtime errors triggered by the Runnable and
    * sends them to the ErrroEventSink
    *
-   * The cancelStat is reference to a flag that indicates whether the Runnable
-   * should cancel its run. This flag is set if a cancel command is given by the
-   * user code
-   *
-   * @param cancelState
-   *               reference to flag indicating whether the Runnable should
-   * abort
+   * @param threadName the name of the calling thread
+   * @param si     the symbol
+   * @param prefetcher
+   * @param item   if not empty, the data is taken from the prefetcher instead
+   * of being loaded by this thread
    * @param range  The range of data on which to run the Runnable
-   * @return
+   * @param counters
+   *               the counters of the calling thread, reported with the
+   * status of the run
+   * @return false if the runnable has called exit, in which case it is not to
+   * be run on any other symbol
    * @exception DataSourceException
    */
-  bool run(const std::string& threadName, const SynchronizedFlag& cancelState,
-           DateTimeRangePtr range,
-           DateTime startTradesDateTime) throw(DataSourceException) {
+  bool run(const std::string& threadName, DataInfoConstPtr si,
+           DataPrefetcher* prefetcher, DataPrefetcher::ItemPtr item,
+           DateTimeRangePtr range, DateTime startTradesDateTime,
+           const TaskCounters& counters) throw(DataSourceException) {
     bool exitCall = false;
-    do {
-      // called before the first symbol, to signal that a new simulation session
-      // is starting if false, then stop running this runnable
-      if (!_runnable->begin()) break;
+    Timer t;
+    chart::Chart* chart = 0;
 
-      try {
-        for (DataInfoConstPtr si = _symbols->getNext(); si.get() != 0;
-             si = _symbols->getNext()) {
-          Timer t;
-          chart::Chart* chart = 0;
-
-          //        std::auto_ptr< const SymbolInfo > psi( si );
-          // creating an empty  local list of positions, which will contain
-          // positions for the current run of the runnable.
-          PositionsContainer* pc = _pos.getNewPositionsContainer();
-          // creating a positions object, which will be passed to the runnable.
-          // This positions object contains a pointer to the positions list
-          // object
-          PositionsManagerImpl pos(pc, startTradesDateTime,
-                                   PosInfinityDateTime(), _slippage,
-                                   _commission);
+    //        std::auto_ptr< const SymbolInfo > psi( si );
+    // creating an empty  local list of positions, which will contain
+    // positions for the current run of the runnable.
+    PositionsContainer* pc = _pos.getNewPositionsContainer();
+    // creating a positions object, which will be passed to the runnable.
+    // This positions object contains a pointer to the positions list
+    // object
+    PositionsManagerImpl pos(pc, startTradesDateTime, PosInfinityDateTime(),
+                             _slippage, _commission);
 
-          pos.registerSignalHandlers(_signalHandlers);
+    pos.registerSignalHandlers(_signalHandlers);
 
-          // get the pointer to the bars object
+    // get the pointer to the bars object
 
-          try {
-            double dataDuration = 0;
-            double runnableDuration = 0;
-            unsigned __int64 dataSize = 0;
-            try {
-              // TODO:
-              // this is a hack - normally data should be handled the same way,
-              // regardless of where it's coming from. the problem is that when
-              // it's requested from the DataManager, it comes as ManagedPtr,
-              // which has a RefCountable used by the cache, when data comes
-              // directly from the SymbolInfo, it comes as a pointer. Unify
-              // these two!!!!
-              /*          if( si->hasData() )
+    try {
+      double dataDuration = 0;
+      double runnableDuration = 0;
+      unsigned __int64 dataSize = 0;
+      try {
+        // TODO:
+        // this is a hack - normally data should be handled the same way,
+        // regardless of where it's coming from. the problem is that when
+        // it's requested from the DataManager, it comes as ManagedPtr,
+        // which has a RefCountable used by the cache, when data comes
+        // directly from the SymbolInfo, it comes as a pointer. Unify
+        // these two!!!!
+        /*          if( si->hasData() )
+                          {
+                                _runnable -> init( si->getData(), &pos );
+                                // call the preRun method - give the
+           runnable a chance to stop before it starts if ( _runnable ->
+           init( psi->symbol() ) )
                                 {
-                                      _runnable -> init( si->getData(), &pos );
-                                      // call the preRun method - give the
-                 runnable a chance to stop before it starts if ( _runnable ->
-                 init( psi->symbol() ) )
-                                      {
-                                        // run the runnable
-                                        _runnable ->run();
-                                        _runnable->cleanup();
-                                      }
+                                  // run the runnable
+                                  _runnable ->run();
+                                  _runnable->cleanup();
                                 }
-                                else
-        */
-              {
-                Timer dataTimer;
-                BarsPtr data = si->dataSource()
-                                   ->getData(si.get(), range)
-                                   ->getDataCollection();
-                if (data.get() != 0) dataSize = data->size();
-
-                if (data->hasInvalidData()) {
-                  // we got here because we are in data warning mode (otherwise
-                  // there would have been an exception)
-                  ErrorEvent ee(
-                      ErrorEvent::Types::INVALID_DATA,
-                      ErrorEvent::Category::warning, getRunnableName(),
-                      data->getInvalidDataAsString(), si->symbol().symbol());
-                  addErrorEvent(ee);
-                }
-
-                if (_explicitTrades != 0) {
-                  // now process explicit trades that are before the
-                  // startTradesDateTime The way things work: if a
-                  // startTradesDate is specified, all explicit trades before
-                  // that date are automatically generated, and the system
-                  // generates trades after that date We use a new position
-                  // manager with no start date set, as the date will be
-                  // controlled from within the toPositions todo: change this,
-                  // everything should be controlled from the manager, so this
-                  // manager would have a different range
-                  PositionsManagerImpl pos1(pc, NegInfinityDateTime(),
-                                            startTradesDateTime);
-                  pos1.setSystemName("explicit trade");
-
-                  _explicitTrades->toPositions(Positions(&pos1), si->symbol(),
-                                               data, NegInfinityDateTime(),
-                                               startTradesDateTime);
-                }
-
-                dataDuration = dataTimer.elapsed();
-
-                if (false) {
-                  LOG(log_info, threadName << " : " << _runnable->name()
-                                           << " on \""
-                                           << si->symbol().symbol());
-                }
-                Timer runnableTimer;
-                bool wasCleanup = false;
-                try {
-                  chart = _chartManager->getChart(si->symbol().symbol());
-                  if (chart == 0) {
-                    LOG(log_info, "RunnableInfo::run - chartHandler is 0");
-                  }
-                  // if the symbol must not be charted, a NullChartHandler is
-                  // returned, so it will never return 0
-                  assert(chart != 0);
-                  // init the chart handler
-                  // new - adding a chart handler, so user code can generate
-                  // charts
-                  chart->init(data, pc);
-
-                  pos.setSystemName(_runnable->name());
-                  pos.setSystemId(_runnable->getUserString());
-
-                  // init the runnable - set the default bars, positions, data
-                  // manager and series manager
-                  //  todo: if chartHandler is 0, pass a default chart handler
-                  //  that doesn't do anything
-                  _runnable->init(data.get(), &pos, chart, _explicitTrades);
-                  // call the preRun method - give the runnable a chance to stop
-                  // before it starts
-                  if (_runnable->init(si->symbol().symbol())) {
-                    // run the runnable
-                    _runnable->run();
-                    // mark that we are entering cleanup, in case exceptions are
-                    // thrown there
-                    wasCleanup = true;
-                    _runnable->cleanup();
-                  }
-                } catch (...) {
-                  // catching all exceptions so we can do cleanup first
-                  // this test is so we don't get into an infinite loop when
-                  // cleanup itself is throwing an exception
-                  if (!wasCleanup) {
-                    // mark that we are calling cleanup
-                    wasCleanup = true;
-                    _runnable->cleanup();
-                  }
-                  // now rethrow to handle the actual exception
-                  throw;
-                }
-                runnableDuration = runnableTimer.elapsed();
-              }
-              // we are here because there are no errors, so send the status
-              if (_runnableRunInfoHandler != 0)
-                // there were no errors
-                _runnableRunInfoHandler->status(RunnableRunInfo(
-                    _runnable->name(), si->symbol().symbol(), dataDuration,
-                    runnableDuration, dataSize, false, threadName));
-            } catch (const ExitRunnableException&) {
-              exitCall = true;
-              throw;
-            } catch (...) {
-              LOG(log_info, "Runtime error \"" << _runnable->name()
-                                               << "\" on \""
-                                               << si->symbol().symbol());
-              // first catch all exceptions to signal the status, and diable the
-              // chart
-              if (_runnableRunInfoHandler != 0)
-                // there were errors
-                _runnableRunInfoHandler->status(RunnableRunInfo(
-                    _runnable->name(), si->symbol().symbol(), dataDuration,
-                    runnableDuration, dataSize, true, threadName));
-
-              // only stop charting if there were real errors, if it's an exit,
-              // then still chart
-              if (chart != 0 && !exitCall)
-                chart->setError(
-                    "Trading system runtime error - no chart has been "
-                    "generated for this symbol");
-              // then re-throw for handling
-              throw;
-            }
-          } catch (const BarException& e) {
-            LOG(log_error, " - caught BarException, creating event");
-            ErrorEvent ee(ErrorEvent::Types::INVALID_DATA,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
-            LOG(log_debug, " - adding event");
-            addErrorEvent(ee);
-            LOG(log_debug, " - added event");
-          } catch (const DataSourceException& e) {
-            // TODO: there are a multitude of data source exceptions - fix this
-            std::wostringstream o;
-            //          o << _T( "Datasource \"" ) << e.getDataSourceName() <<
-            //          _T( "\" error: " ) << e.message();
-            ErrorEvent ee(ErrorEvent::Types::DATA_SOURCE_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
-            addErrorEvent(ee);
-          } catch (const GeneralSystemException& e) {
-            ErrorEvent ee(ErrorEvent::Types::GENERAL_SYSTEM_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
-            addErrorEvent(ee);
-          } catch (const PositionIdNotFoundException& e) {
-            ErrorEvent ee(ErrorEvent::Types::POSITION_ID_NOT_FOUND_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
-            addErrorEvent(ee);
-          } catch (const SystemException& e) {
-            ErrorEvent ee(ErrorEvent::Types::SYSTEM_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
-            addErrorEvent(ee);
-          } catch (const BarIndexOutOfRangeException& e) {
-            ErrorEvent ee(ErrorEvent::Types::BAR_INDEX_OUT_OF_RANGE_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
-            addErrorEvent(ee);
-          } catch (const InvalidLimitPriceException& e) {
-            ErrorEvent ee(ErrorEvent::Types::INVALID_LIMIT_PRICE_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
-            addErrorEvent(ee);
-          } catch (const InvalidStopPriceException& e) {
-            ErrorEvent ee(ErrorEvent::Types::INVALID_STOP_PRICE_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
-            addErrorEvent(ee);
-          } catch (const SeriesIndexOutOfRangeException& e) {
-            ErrorEvent ee(ErrorEvent::Types::SERIES_INDEX_OUT_OF_RANGE_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
-            addErrorEvent(ee);
-          } catch (const TimeSeriesIndexOutOfRangeException& e) {
-            ErrorEvent ee(
-                ErrorEvent::Types::TIME_SERIES_INDEX_OUT_OF_RANGE_ERROR,
-                ErrorEvent::Category::error, getRunnableName(), e.message(),
-                si->symbol().symbol());
-            addErrorEvent(ee);
-          } catch (const SynchronizedSeriesIndexOutOfRangeException& e) {
-            ErrorEvent ee(
-                ErrorEvent::Types::SYNCHRONIZED_SERIES_INDEX_OUT_OF_RANGE_ERROR,
-                ErrorEvent::Category::error, getRunnableName(), e.message(),
-                si->symbol().symbol());
-            addErrorEvent(ee);
-          } catch (const CoveringLongPositionException& e) {
-            ErrorEvent ee(ErrorEvent::Types::COVERING_LONG_POSITION_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
-            addErrorEvent(ee);
-          } catch (const SellingShortPositionException& e) {
-            ErrorEvent ee(ErrorEvent::Types::SELLING_SHORT_POSITION_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
-            addErrorEvent(ee);
-          } catch (const ClosingAlreadyClosedPositionException& e) {
-            ErrorEvent ee(
-                ErrorEvent::Types::CLOSING_ALREADY_CLOSED_POSITION_ERROR,
-                ErrorEvent::Category::error, getRunnableName(), e.message(),
-                si->symbol().symbol());
-            addErrorEvent(ee);
-          } catch (const OperationOnUnequalSizeSeriesException& e) {
+                          }
+                          else
+  */
+        {
+          Timer dataTimer;
+          BarsPtr data = item ? prefetcher->get(item)
+                              : si->dataSource()
+                                    ->getData(si.get(), range)
+                                    ->getDataCollection();
+          if (data.get() != 0) dataSize = data->size();
+
+          if (data->hasInvalidData()) {
+            // we got here because we are in data warning mode (otherwise
+            // there would have been an exception)
             ErrorEvent ee(
-                ErrorEvent::Types::OPERATION_ON_UNEQUAL_SIZE_SERIES_ERROR,
-                ErrorEvent::Category::error, getRunnableName(), e.message(),
-                si->symbol().symbol());
-            addErrorEvent(ee);
-          } catch (const DivideByZeroException& e) {
-            // dummy division which will result in a NaN (not a number) result.
-            double x = 100.0 / 50.0;
-            ErrorEvent ee(ErrorEvent::Types::FLOATING_POINT_DIVIDE_BY_0_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
-            addErrorEvent(ee);
-          } catch (const AccessViolationException& e) {
-            ErrorEvent ee(ErrorEvent::Types::ACCESS_VIOLATION_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
-            addErrorEvent(ee);
-          } catch (const SignalHandlerException& e) {
-            ErrorEvent ee(ErrorEvent::Types::SIGNAL_HANDLER_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.name() + ": " + e.message(), "");
-
-            addErrorEvent(ee);
-          } catch (const InvalidIndexForOperationException& e) {
-            ErrorEvent ee(
-                ErrorEvent::Types::INVALID_INDEX_FOR_OPERATION_EXCEPTION,
-                ErrorEvent::Category::error, getRunnableName(), e.message(),
-                si->symbol().symbol());
-
-            addErrorEvent(ee);
-          } catch (const SeriesSynchronizerException& e) {
-            ErrorEvent ee(ErrorEvent::Types::SERIES_SYNCHRONIZER_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
-
-            addErrorEvent(ee);
-          } catch (const chart::ChartException& e) {
-            ErrorEvent ee(ErrorEvent::Types::CHART_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
-
-            addErrorEvent(ee);
-          } catch (const OperationOnSeriesSyncedToDifferentSynchronizers& e) {
-            ErrorEvent ee(
-                ErrorEvent::Types::
-                    OPERATION_ON_SERIES_SYNCED_TO_DIFFERENT_SYNCHRONIZERS_ERROR,
-                ErrorEvent::Category::error, getRunnableName(), e.message(),
-                si->symbol().symbol());
-
-            addErrorEvent(ee);
-          } catch (const PositionCloseOperationOnOpenPositionException& e) {
-            ErrorEvent ee(ErrorEvent::Types::
-                              POSITION_CLOSE_OPERATION_ON_OPEN_POSITION_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
-
-            addErrorEvent(ee);
-          } catch (const PositionZeroPriceException& e) {
-            ErrorEvent ee(ErrorEvent::Types::POSITION_ZERO_PRICE_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
-
-            addErrorEvent(ee);
-          } catch (const OperationNotAllowedOnSynchronizedseries& e) {
-            ErrorEvent ee(
-                ErrorEvent::Types::
-                    OPERATION_NOT_ALLOWED_ON_SYNCHRONIZED_SERIES_ERROR,
-                ErrorEvent::Category::error, getRunnableName(), e.message(),
-                si->symbol().symbol());
-
-            addErrorEvent(ee);
-          } catch (const ExitRunnableException& e) {
-            ErrorEvent ee(ErrorEvent::Types::EXIT_STATMENT_CALL,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
-
+                ErrorEvent::Types::INVALID_DATA,
+                ErrorEvent::Category::warning, getRunnableName(),
+                data->getInvalidDataAsString(), si->symbol().symbol());
             addErrorEvent(ee);
-            return false;
-          } catch (const InvalidBarsCollectionException& e) {
-            ErrorEvent ee(ErrorEvent::Types::INVALID_BARS_COLLECTION_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
-
-            addErrorEvent(ee);
-          } catch (const ArrayIndexNotFoundException& e) {
-            ErrorEvent ee(ErrorEvent::Types::ARRAY_INDEX_NOT_FOUND_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
-
-            addErrorEvent(ee);
-          } catch (const DictionaryKeyNotFoundException& e) {
-            ErrorEvent ee(ErrorEvent::Types::DICTIONARY_KEY_NOT_FOUND_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
+          }
 
-            addErrorEvent(ee);
-          } catch (const InvalidPositionException& e) {
-            ErrorEvent ee(ErrorEvent::Types::INVALID_POSITION_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          e.message(), si->symbol().symbol());
+          if (_explicitTrades != 0) {
+            // now process explicit trades that are before the
+            // startTradesDateTime The way things work: if a
+            // startTradesDate is specified, all explicit trades before
+            // that date are automatically generated, and the system
+            // generates trades after that date We use a new position
+            // manager with no start date set, as the date will be
+            // controlled from within the toPositions todo: change this,
+            // everything should be controlled from the manager, so this
+            // manager would have a different range
+            PositionsManagerImpl pos1(pc, NegInfinityDateTime(),
+                                      startTradesDateTime);
+            pos1.setSystemName("explicit trade");
+
+            _explicitTrades->toPositions(Positions(&pos1), si->symbol(),
+                                         data, NegInfinityDateTime(),
+                                         startTradesDateTime);
+          }
 
-            addErrorEvent(ee);
-          } catch (const ClosingPostionOnDifferentSymbolException& e) {
-            ErrorEvent ee(
-                ErrorEvent::Types::CLOSING_POSITION_ON_DIFFERENT_SYMBOL_ERROR,
-                ErrorEvent::Category::error, getRunnableName(), e.message(),
-                si->symbol().symbol());
+          dataDuration = dataTimer.elapsed();
 
-            addErrorEvent(ee);
+          if (false) {
+            LOG(log_info, threadName << " : " << _runnable->name()
+                                     << " on \""
+                                     << si->symbol().symbol());
+          }
+          Timer runnableTimer;
+          bool wasCleanup = false;
+          try {
+            chart = _chartManager->getChart(si->symbol().symbol());
+            if (chart == 0) {
+              LOG(log_info, "RunnableInfo::run - chartHandler is 0");
+            }
+            // if the symbol must not be charted, a NullChartHandler is
+            // returned, so it will never return 0
+            assert(chart != 0);
+            // init the chart handler
+            // new - adding a chart handler, so user code can generate
+            // charts
+            chart->init(data, pc);
+
+            pos.setSystemName(_runnable->name());
+            pos.setSystemId(_runnable->getUserString());
+
+            // init the runnable - set the default bars, positions, data
+            // manager and series manager
+            //  todo: if chartHandler is 0, pass a default chart handler
+            //  that doesn't do anything
+            _runnable->init(data.get(), &pos, chart, _explicitTrades);
+            // call the preRun method - give the runnable a chance to stop
+            // before it starts
+            if (_runnable->init(si->symbol().symbol())) {
+              // run the runnable
+              _runnable->run();
+              // mark that we are entering cleanup, in case exceptions are
+              // thrown there
+              wasCleanup = true;
+              _runnable->cleanup();
+            }
           } catch (...) {
-            // catch any other unhandled exceptions
-            ErrorEvent ee(ErrorEvent::Types::UNKNOWN_APPLICATION_ERROR,
-                          ErrorEvent::Category::error, getRunnableName(),
-                          "Unknown error", si->symbol().symbol());
-            //          tsprint( ee.toString() + _T( "\n" ), std::cout );
-            addErrorEvent(ee);
+            // catching all exceptions so we can do cleanup first
+            // this test is so we don't get into an infinite loop when
+            // cleanup itself is throwing an exception
+            if (!wasCleanup) {
+              // mark that we are calling cleanup
+              wasCleanup = true;
+              _runnable->cleanup();
+            }
+            // now rethrow to handle the actual exception
+            throw;
           }
-          // exit if cancel signaled
-          if (cancelState.get()) return false;
+          runnableDuration = runnableTimer.elapsed();
         }
-      } catch (const DataInfoException&) {
-        ErrorEvent ee(ErrorEvent::Types::DATA_INFO_ERROR,
-                      ErrorEvent::Category::error, getRunnableName(),
-                      "Data info invalid, possibly a null symbol", "");
+        // we are here because there are no errors, so send the status
+        if (_runnableRunInfoHandler != 0)
+          // there were no errors
+          _runnableRunInfoHandler->status(RunnableRunInfo(
+              _runnable->name(), si->symbol().symbol(), dataDuration,
+              runnableDuration, dataSize, false, threadName, counters.executed,
+              counters.stolen));
+      } catch (const ExitRunnableException&) {
+        exitCall = true;
+        throw;
+      } catch (...) {
+        LOG(log_info, "Runtime error \"" << _runnable->name()
+                                         << "\" on \""
+                                         << si->symbol().symbol());
+        // first catch all exceptions to signal the status, and diable the
+        // chart
+        if (_runnableRunInfoHandler != 0)
+          // there were errors
+          _runnableRunInfoHandler->status(RunnableRunInfo(
+              _runnable->name(), si->symbol().symbol(), dataDuration,
+              runnableDuration, dataSize, true, threadName, counters.executed,
+              counters.stolen));
+
+        // only stop charting if there were real errors, if it's an exit,
+        // then still chart
+        if (chart != 0 && !exitCall)
+          chart->setError(
+              "Trading system runtime error - no chart has been "
+              "generated for this symbol");
+        // then re-throw for handling
+        throw;
       }
+    } catch (const BarException& e) {
+      LOG(log_error, " - caught BarException, creating event");
+      ErrorEvent ee(ErrorEvent::Types::INVALID_DATA,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+      LOG(log_debug, " - adding event");
+      addErrorEvent(ee);
+      LOG(log_debug, " - added event");
+    } catch (const DataSourceException& e) {
+      // TODO: there are a multitude of data source exceptions - fix this
+      std::wostringstream o;
+      //          o << _T( "Datasource \"" ) << e.getDataSourceName() <<
+      //          _T( "\" error: " ) << e.message();
+      ErrorEvent ee(ErrorEvent::Types::DATA_SOURCE_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+      addErrorEvent(ee);
+    } catch (const GeneralSystemException& e) {
+      ErrorEvent ee(ErrorEvent::Types::GENERAL_SYSTEM_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+      addErrorEvent(ee);
+    } catch (const PositionIdNotFoundException& e) {
+      ErrorEvent ee(ErrorEvent::Types::POSITION_ID_NOT_FOUND_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+      addErrorEvent(ee);
+    } catch (const SystemException& e) {
+      ErrorEvent ee(ErrorEvent::Types::SYSTEM_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+      addErrorEvent(ee);
+    } catch (const BarIndexOutOfRangeException& e) {
+      ErrorEvent ee(ErrorEvent::Types::BAR_INDEX_OUT_OF_RANGE_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+      addErrorEvent(ee);
+    } catch (const InvalidLimitPriceException& e) {
+      ErrorEvent ee(ErrorEvent::Types::INVALID_LIMIT_PRICE_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+      addErrorEvent(ee);
+    } catch (const InvalidStopPriceException& e) {
+      ErrorEvent ee(ErrorEvent::Types::INVALID_STOP_PRICE_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+      addErrorEvent(ee);
+    } catch (const SeriesIndexOutOfRangeException& e) {
+      ErrorEvent ee(ErrorEvent::Types::SERIES_INDEX_OUT_OF_RANGE_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+      addErrorEvent(ee);
+    } catch (const TimeSeriesIndexOutOfRangeException& e) {
+      ErrorEvent ee(
+          ErrorEvent::Types::TIME_SERIES_INDEX_OUT_OF_RANGE_ERROR,
+          ErrorEvent::Category::error, getRunnableName(), e.message(),
+          si->symbol().symbol());
+      addErrorEvent(ee);
+    } catch (const SynchronizedSeriesIndexOutOfRangeException& e) {
+      ErrorEvent ee(
+          ErrorEvent::Types::SYNCHRONIZED_SERIES_INDEX_OUT_OF_RANGE_ERROR,
+          ErrorEvent::Category::error, getRunnableName(), e.message(),
+          si->symbol().symbol());
+      addErrorEvent(ee);
+    } catch (const CoveringLongPositionException& e) {
+      ErrorEvent ee(ErrorEvent::Types::COVERING_LONG_POSITION_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+      addErrorEvent(ee);
+    } catch (const SellingShortPositionException& e) {
+      ErrorEvent ee(ErrorEvent::Types::SELLING_SHORT_POSITION_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+      addErrorEvent(ee);
+    } catch (const ClosingAlreadyClosedPositionException& e) {
+      ErrorEvent ee(
+          ErrorEvent::Types::CLOSING_ALREADY_CLOSED_POSITION_ERROR,
+          ErrorEvent::Category::error, getRunnableName(), e.message(),
+          si->symbol().symbol());
+      addErrorEvent(ee);
+    } catch (const OperationOnUnequalSizeSeriesException& e) {
+      ErrorEvent ee(
+          ErrorEvent::Types::OPERATION_ON_UNEQUAL_SIZE_SERIES_ERROR,
+          ErrorEvent::Category::error, getRunnableName(), e.message(),
+          si->symbol().symbol());
+      addErrorEvent(ee);
+    } catch (const DivideByZeroException& e) {
+      // dummy division which will result in a NaN (not a number) result.
+      double x = 100.0 / 50.0;
+      ErrorEvent ee(ErrorEvent::Types::FLOATING_POINT_DIVIDE_BY_0_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+      addErrorEvent(ee);
+    } catch (const AccessViolationException& e) {
+      ErrorEvent ee(ErrorEvent::Types::ACCESS_VIOLATION_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+      addErrorEvent(ee);
+    } catch (const SignalHandlerException& e) {
+      ErrorEvent ee(ErrorEvent::Types::SIGNAL_HANDLER_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.name() + ": " + e.message(), "");
+
+      addErrorEvent(ee);
+    } catch (const InvalidIndexForOperationException& e) {
+      ErrorEvent ee(
+          ErrorEvent::Types::INVALID_INDEX_FOR_OPERATION_EXCEPTION,
+          ErrorEvent::Category::error, getRunnableName(), e.message(),
+          si->symbol().symbol());
+
+      addErrorEvent(ee);
+    } catch (const SeriesSynchronizerException& e) {
+      ErrorEvent ee(ErrorEvent::Types::SERIES_SYNCHRONIZER_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+
+      addErrorEvent(ee);
+    } catch (const chart::ChartException& e) {
+      ErrorEvent ee(ErrorEvent::Types::CHART_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+
+      addErrorEvent(ee);
+    } catch (const OperationOnSeriesSyncedToDifferentSynchronizers& e) {
+      ErrorEvent ee(
+          ErrorEvent::Types::
+              OPERATION_ON_SERIES_SYNCED_TO_DIFFERENT_SYNCHRONIZERS_ERROR,
+          ErrorEvent::Category::error, getRunnableName(), e.message(),
+          si->symbol().symbol());
+
+      addErrorEvent(ee);
+    } catch (const PositionCloseOperationOnOpenPositionException& e) {
+      ErrorEvent ee(ErrorEvent::Types::
+                        POSITION_CLOSE_OPERATION_ON_OPEN_POSITION_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+
+      addErrorEvent(ee);
+    } catch (const PositionZeroPriceException& e) {
+      ErrorEvent ee(ErrorEvent::Types::POSITION_ZERO_PRICE_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+
+      addErrorEvent(ee);
+    } catch (const OperationNotAllowedOnSynchronizedseries& e) {
+      ErrorEvent ee(
+          ErrorEvent::Types::
+              OPERATION_NOT_ALLOWED_ON_SYNCHRONIZED_SERIES_ERROR,
+          ErrorEvent::Category::error, getRunnableName(), e.message(),
+          si->symbol().symbol());
+
+      addErrorEvent(ee);
+    } catch (const ExitRunnableException& e) {
+      ErrorEvent ee(ErrorEvent::Types::EXIT_STATMENT_CALL,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+
+      addErrorEvent(ee);
+      return false;
+    } catch (const InvalidBarsCollectionException& e) {
+      ErrorEvent ee(ErrorEvent::Types::INVALID_BARS_COLLECTION_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+
+      addErrorEvent(ee);
+    } catch (const ArrayIndexNotFoundException& e) {
+      ErrorEvent ee(ErrorEvent::Types::ARRAY_INDEX_NOT_FOUND_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+
+      addErrorEvent(ee);
+    } catch (const DictionaryKeyNotFoundException& e) {
+      ErrorEvent ee(ErrorEvent::Types::DICTIONARY_KEY_NOT_FOUND_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+
+      addErrorEvent(ee);
+    } catch (const InvalidPositionException& e) {
+      ErrorEvent ee(ErrorEvent::Types::INVALID_POSITION_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    e.message(), si->symbol().symbol());
+
+      addErrorEvent(ee);
+    } catch (const ClosingPostionOnDifferentSymbolException& e) {
+      ErrorEvent ee(
+          ErrorEvent::Types::CLOSING_POSITION_ON_DIFFERENT_SYMBOL_ERROR,
+          ErrorEvent::Category::error, getRunnableName(), e.message(),
+          si->symbol().symbol());
+
+      addErrorEvent(ee);
+    } catch (...) {
+      // catch any other unhandled exceptions
+      ErrorEvent ee(ErrorEvent::Types::UNKNOWN_APPLICATION_ERROR,
+                    ErrorEvent::Category::error, getRunnableName(),
+                    "Unknown error", si->symbol().symbol());
+      //          tsprint( ee.toString() + _T( "\n" ), std::cout );
+      addErrorEvent(ee);
     }
-    // repeats the loop until the runnable returns true, indicating that it has
-    // finished its work
-    while (_runnable->again());
     return true;
   }
 };
@@ -596,171 +840,802 @@ class RunnableInfo {
  * RunnableInfo instances
  *
  * This is used by the Scheduler to store RunnableInfo instances created when
- * the user code adds new Runnable instances to the Scheduler
- *
- * A RunnableInfoList stores a reference to a "current" RunnableInfo, and has
- * a getNext method, both of which are used to iterate through the list
- * of all RunnableInfo instances and run the associated Runnable.
- *
- * This class is thread safe, in that different threads can call its methods
- * simultaneously and the access to data will be safely serialized. This is
- * necessary as each thread will have to call into this class to get the next
- * RunnableInfo that has the info for the Runnable to be run.
+ * the user code adds new Runnable instances to the Scheduler. At the start of
+ * a run, the TaskScheduler splits the runnables into tasks.
  *
  * @see PVector
  * @see RunnableInfo
+ * @see TaskScheduler
  * @see Scheduler
  */
 class RunnableInfoList : public PtrVector<RunnableInfo> {
   OBJ_COUNTER(RunnableInfoList)
  private:
-  unsigned int _crt;
-  mutable Mutex _mutex;
   const std::string _name;
 
  public:
   /**
    * Constructor - takes the name
    *
-   * Also resets the "current" value to point to the first element in the list
-   *
    * @param name   The name
    */
-  RunnableInfoList(const std::string& name) : _crt(0), _name(name) {}
+  RunnableInfoList(const std::string& name) : _name(name) {}
+};
 
-  void reset() {
-    Lock lock(_mutex);
-    _crt = 0;
-    ;
+class RunnableGroup;
+
+/**
+ * A unit of work for the scheduler: running a runnable on one symbol
+ */
+class RunnableTask {
+ public:
+  RunnableGroup* const _group;
+  const DataInfoConstPtr _info;
+  // estimate of the size of the data, larger tasks are run first
+  const unsigned __int64 _size;
+  // set once the data has been requested from the prefetcher
+  DataPrefetcher::ItemPtr _item;
+
+ public:
+  RunnableTask(RunnableGroup* group, DataInfoConstPtr info,
+               unsigned __int64 size)
+      : _group(group), _info(info), _size(size) {}
+};
+
+typedef boost::shared_ptr<RunnableTask> RunnableTaskPtr;
+typedef std::vector<RunnableTaskPtr> RunnableTaskVector;
+
+/**
+ * The runnables that share the same DataInfoIterator
+ *
+ * Instances of the same system share an iterator, so they split the symbols
+ * between them. A runnable is not thread safe, so each task checks out an idle
+ * instance for the duration of its run, and a group can't run more tasks at
+ * the same time than it has instances.
+ *
+ * A group goes over the symbols in passes, the same way a runnable does when
+ * it runs on its own: begin is called on each instance before the first
+ * symbol, again after the last one, and the instances that return true from
+ * again are run on a new pass.
+ *
+ * The group has its own lock, so the threads taking tasks of different groups
+ * don't wait for each other. startPass is only called when none of the
+ * group's tasks are queued or running.
+ */
+class RunnableGroup {
+ private:
+  DataInfoIterator* const _symbols;
+  // the position of the group in the TaskScheduler
+  const size_t _index;
+  mutable NonRecursiveMutex _mutex;
+  // the instances that are still running
+  std::vector<RunnableInfo*> _instances;
+  std::vector<RunnableInfo*> _idle;
+  // tasks of the current pass that are not completed
+  size_t _pending;
+
+ public:
+  RunnableGroup(DataInfoIterator* symbols, size_t index)
+      : _symbols(symbols), _index(index), _pending(0) {}
+
+  DataInfoIterator* symbols() const { return _symbols; }
+  size_t index() const { return _index; }
+
+  void add(RunnableInfo* instance) { _instances.push_back(instance); }
+
+  /**
+   * Starts a pass over the symbols, and creates its tasks
+   *
+   * @param first  true for the first pass, in which case again is not called
+   * @param tasks  receives the tasks
+   */
+  void startPass(bool first, RunnableTaskVector& tasks) {
+    std::vector<RunnableInfo*> instances;
+    for (size_t n = 0; n < _instances.size(); n++) {
+      RunnableInfo* instance = _instances[n];
+      if ((first || instance->again()) && instance->begin())
+        instances.push_back(instance);
+    }
+
+    size_t count = tasks.size();
+    if (!instances.empty()) {
+      try {
+        for (DataInfoConstPtr si = _symbols->getNext(); si.get() != 0;
+             si = _symbols->getNext())
+          tasks.push_back(RunnableTaskPtr(new RunnableTask(
+              this, si, si->dataSource()->dataSizeHint(si.get()))));
+      } catch (const DataInfoException&) {
+        instances.front()->addDataInfoError();
+      }
+    }
+
+    NonRecursiveLock lock(_mutex);
+    _instances = instances;
+    _idle = instances;
+    _pending = tasks.size() - count;
+  }
+
+  // true if all instances have stopped, the remaining tasks are dropped
+  bool stopped() const {
+    NonRecursiveLock lock(_mutex);
+    return _instances.empty();
   }
 
   /**
-   * Returns the next available RunnableInfo and increments the "current" value
-   * to point to the following one.
+   * Checks out an idle instance
    *
-   * if there are no more RunnableInfo in the collection, return null.
+   * @param stopped set to true if all the instances have stopped
+   * @return the instance, or 0 if all instances are busy or have stopped
+   */
+  RunnableInfo* checkout(bool& stopped) {
+    NonRecursiveLock lock(_mutex);
+    stopped = _instances.empty();
+    if (_idle.empty()) return 0;
+
+    RunnableInfo* instance = _idle.back();
+    _idle.pop_back();
+    return instance;
+  }
+
+  /**
+   * @param instance the instance returned by checkout
+   * @param stop     true if the instance is not to be run anymore
+   */
+  void release(RunnableInfo* instance, bool stop) {
+    NonRecursiveLock lock(_mutex);
+    if (stop)
+      _instances.erase(
+          std::find(_instances.begin(), _instances.end(), instance));
+    else
+      _idle.push_back(instance);
+  }
+
+  // returns true if it was the last task of the pass
+  bool complete() {
+    NonRecursiveLock lock(_mutex);
+    return --_pending == 0;
+  }
+};
+
+/**
+ * Interface of the users of the thread pool
+ */
+class TaskSource {
+ public:
+  virtual ~TaskSource() {}
+
+  /**
+   * Runs one task in the calling pool thread
    *
-   * @return A pointer to a RunnableInfo or 0 if no more available
+   * @param thread the index of the pool thread, from 0 to the number of pool
+   * threads - 1
+   * @return false if there was no task ready to run
    */
-  RunnableInfo* getNext() {
-    Lock lock(_mutex);
+  virtual bool runTask(size_t thread) = 0;
+};
+
+/**
+ * Pool of threads running the tasks of scheduler runs
+ *
+ * The tradery service creates one pool for the whole process (see
+ * startThreadPool), so the threads are not created again for each session,
+ * and sessions that run at the same time share the processors instead of
+ * each creating its own threads.
+ *
+ * Each run adds itself to the pool as a task source for its duration. The
+ * threads go over the sources in weighted round robin order: a thread runs
+ * up to "weight" tasks from a source before moving on to the next one, so each
+ * session gets a share of the threads that is proportional to its weight,
+ * however many tasks it has.
+ *
+ * A source that can't run a task right now (for example because all its
+ * runnables are busy) is skipped. When none of the sources can run a task,
+ * the threads wait until one of them signals a change.
+ *
+ * The threads are placed on the processors according to a ThreadPlacement.
+ * With a pinned placement, each thread belongs to a NUMA node, which the
+ * sources use to keep the work and the data of a task on the same node.
+ */
+class ThreadPool {
+ private:
+  class Source {
+   public:
+    TaskSource* const _source;
+    const unsigned int _weight;
+    // tasks left in the current round
+    unsigned int _credit;
+    // number of threads running a task from this source
+    unsigned int _running;
+
+    Source(TaskSource* source, unsigned int weight)
+        : _source(source),
+          _weight(max2<unsigned int>(weight, 1)),
+          _credit(_weight),
+          _running(0) {}
+  };
+
+  typedef boost::shared_ptr<Source> SourcePtr;
+
+  class PoolThread {
+   private:
+    ThreadPool& _pool;
+    const size_t _index;
+
+   public:
+    PoolThread(ThreadPool& pool, size_t index) : _pool(pool), _index(index) {}
+
+    void operator()() { _pool.poolThread(_index); }
+  };
+
+ private:
+  const size_t _threadCount;
+  const ThreadPlacement _placement;
+  // affinity of each thread, 0 if the thread is not restricted
+  std::vector<unsigned __int64> _threadMasks;
+  // node of each thread, from 0 to the number of nodes - 1
+  std::vector<size_t> _threadNodes;
+  // processors of each node used by the pool, 0 if the threads are not
+  // restricted
+  std::vector<unsigned __int64> _nodeMasks;
+
+  std::vector<SourcePtr> _sources;
+  size_t _crtSource;
+  // changes every time a source may have a new task to run, so a thread can't
+  // miss it between looking for a task and waiting
+  unsigned __int64 _version;
+  bool _stop;
+
+  mutable NonRecursiveMutex _mutex;
+  mutable Condition _condition;
+  boost::thread_group _threads;
+
+ private:
+  SourcePtr next() {
+    if (_sources.empty()) return SourcePtr();
+    if (_crtSource >= _sources.size()) _crtSource = 0;
+
+    SourcePtr source = _sources[_crtSource];
+    if (--source->_credit == 0) endRound(source);
+    return source;
+  }
+
+  // moves on to the next source, if source is the current one
+  void endRound(SourcePtr source) {
+    if (_crtSource < _sources.size() && _sources[_crtSource] == source) {
+      source->_credit = source->_weight;
+      _crtSource++;
+    }
+  }
+
+  // orders the processors of a node so that the first hyperthread of each
+  // core comes before the second hyperthread of any core
+  static LogicalProcessors spread(const LogicalProcessors& node) {
+    std::vector<LogicalProcessors> ranks;
+    size_t rank = 0;
+    for (size_t n = 0; n < node.size(); n++) {
+      rank = n > 0 && node[n].core == node[n - 1].core ? rank + 1 : 0;
+      if (rank == ranks.size()) ranks.push_back(LogicalProcessors());
+      ranks[rank].push_back(node[n]);
+    }
+
+    LogicalProcessors processors;
+    for (size_t n = 0; n < ranks.size(); n++)
+      processors.insert(processors.end(), ranks[n].begin(), ranks[n].end());
+    return processors;
+  }
+
+  // sets the affinity and node of each thread
+  void place() {
+    _threadMasks.assign(_threadCount, 0);
+    _threadNodes.assign(_threadCount, 0);
+    _nodeMasks.assign(1, 0);
+
+    if (_placement != compact_placement && _placement != scatter_placement &&
+        _placement != node_placement)
+      return;
+
+    // topology is ordered by node and core
+    LogicalProcessors topology(getProcessorTopology());
+    if (topology.empty()) return;
+
+    std::vector<LogicalProcessors> nodes;
+    for (size_t n = 0; n < topology.size(); n++) {
+      if (n == 0 || topology[n].node != topology[n - 1].node)
+        nodes.push_back(LogicalProcessors());
+      nodes.back().push_back(topology[n]);
+    }
+
+    _nodeMasks.assign(nodes.size(), 0);
+    for (size_t node = 0; node < nodes.size(); node++)
+      for (size_t n = 0; n < nodes[node].size(); n++)
+        _nodeMasks[node] |= (unsigned __int64)1 << nodes[node][n].processor;
+
+    if (_placement == compact_placement) {
+      for (size_t n = 0; n < _threadCount; n++) {
+        const LogicalProcessor& p = topology[n % topology.size()];
+        for (size_t node = 0; node < nodes.size(); node++)
+          if (nodes[node][0].node == p.node) _threadNodes[n] = node;
+        _threadMasks[n] = (unsigned __int64)1 << p.processor;
+      }
+    } else {
+      for (size_t node = 0; node < nodes.size(); node++)
+        nodes[node] = spread(nodes[node]);
+
+      for (size_t n = 0; n < _threadCount; n++) {
+        size_t node = n % nodes.size();
+        _threadNodes[n] = node;
+        if (_placement == node_placement)
+          _threadMasks[n] = _nodeMasks[node];
+        else {
+          const LogicalProcessors& processors = nodes[node];
+          size_t index = (n / nodes.size()) % processors.size();
+          _threadMasks[n] = (unsigned __int64)1 << processors[index].processor;
+        }
+      }
+    }
+
+    // the nodes are used in order, so the nodes without threads are at the end
+    _nodeMasks.resize(
+        *std::max_element(_threadNodes.begin(), _threadNodes.end()) + 1);
+  }
+
+  void poolThread(size_t index) {
+    current() = this;
+    if (_placement == ideal_processor_placement)
+      setCurrentThreadIdealProcessor(index);
+    else if (_threadMasks[index] != 0)
+      setCurrentThreadAffinity(_threadMasks[index]);
+    StructuredException::install();
+
+    NonRecursiveLock lock(_mutex);
+    while (!_stop) {
+      unsigned __int64 version = _version;
+
+      bool ran = false;
+      for (size_t n = _sources.size(); n > 0 && !ran && !_stop; n--) {
+        SourcePtr source = next();
+        if (!source) break;
+
+        source->_running++;
+        lock.unlock();
+        ran = source->_source->runTask(index);
+        lock.lock();
+        source->_running--;
+
+        if (!ran) endRound(source);
+        // remove may be waiting for the source to be idle
+        if (source->_running == 0) _condition.notify_all();
+      }
+
+      if (!ran && !_stop && _version == version) _condition.wait(lock);
+    }
+  }
+
+ public:
+  /**
+   * @param threads   number of threads, 0 for one per processor
+   * @param placement placement of the threads on the processors
+   */
+  ThreadPool(size_t threads, ThreadPlacement placement = no_placement)
+      : _threadCount(threads > 0
+                         ? threads
+                         : max2<size_t>(boost::thread::hardware_concurrency(),
+                                        1)),
+        _placement(placement),
+        _crtSource(0),
+        _version(0),
+        _stop(false) {
+    place();
+    for (size_t n = 0; n < _threadCount; n++)
+      _threads.create_thread(PoolThread(*this, n));
+  }
+
+  ~ThreadPool() {
+    {
+      NonRecursiveLock lock(_mutex);
+      _stop = true;
+      _condition.notify_all();
+    }
+    _threads.join_all();
+  }
+
+  /**
+   * Returns the pool of the calling thread, or 0 if it is not a pool thread
+   */
+  static ThreadPool*& current() {
+    static thread_local ThreadPool* pool = 0;
+    return pool;
+  }
+
+  size_t threads() const { return _threadCount; }
+
+  // number of NUMA nodes the threads are on, 1 if they are not pinned
+  size_t nodes() const { return _nodeMasks.size(); }
+
+  size_t node(size_t thread) const { return _threadNodes[thread]; }
+
+  /**
+   * Returns the processors of a node, to restrict other threads working for
+   * the pool threads of the node, or 0 if the pool threads are not restricted
+   */
+  unsigned __int64 nodeMask(size_t node) const { return _nodeMasks[node]; }
+
+  /**
+   * @param source the source, which must stay valid until it is removed
+   * @param weight number of consecutive tasks run from this source before
+   * moving on to the next one
+   */
+  void add(TaskSource* source, unsigned int weight) {
+    NonRecursiveLock lock(_mutex);
+    _sources.push_back(SourcePtr(new Source(source, weight)));
+    _version++;
+    _condition.notify_all();
+  }
+
+  /**
+   * Removes a source, waiting for the threads that are running its tasks
+   */
+  void remove(TaskSource* source) {
+    NonRecursiveLock lock(_mutex);
+    for (size_t n = 0; n < _sources.size(); n++) {
+      if (_sources[n]->_source == source) {
+        SourcePtr s = _sources[n];
+        while (s->_running > 0) _condition.wait(lock);
+
+        // the index may have changed while waiting
+        std::vector<SourcePtr>::iterator i =
+            std::find(_sources.begin(), _sources.end(), s);
+        if (i - _sources.begin() < (ptrdiff_t)_crtSource) _crtSource--;
+        _sources.erase(i);
+        return;
+      }
+    }
+  }
 
-    RunnableInfo* p = _crt < size() ? at(_crt++) : 0;
-    return p;
+  /**
+   * Called by a source when it may have new tasks to run
+   */
+  void changed() {
+    NonRecursiveLock lock(_mutex);
+    _version++;
+    _condition.notify_all();
   }
 };
 
 /**
- * This implements a thread of execution for Runnable instances.
+ * Work stealing scheduler for the runnable tasks of a run
  *
- * Each new thread created by the Scheduler will have a RunnableThread object
- * associated
+ * The tasks are run by the threads of a ThreadPool. There is a queue of tasks
+ * for each pool thread, with a deque for each group of runnables. A thread
+ * takes the tasks in its own queue from the front and, when none of them can
+ * run, takes tasks from the back of the other queues, so no thread stays idle
+ * while there are tasks that can run.
  *
- * The thread runs in the operator() method of this object.
+ * Taking a task only locks the queue it is taken from and the group of the
+ * task, and only looks at one end of each deque: all the tasks of a deque
+ * can run if one of them can, as they belong to the same group.
  *
- * A RunnableThread has
- * - a reference to a RunnableInfoList where it will get the next
- * RunnableInfo to run.
- * - the name of the thread
- * - the range on which to run all Runnable instances in the current thread
- * - a ThreadInitializer, used to do a one time thread initialization.
+ * The tasks of the first pass are sorted by the estimated size of their data
+ * and dealt to the queues in that order, so the largest tasks run first and
+ * the end of the run is made of small tasks, which the threads share by
+ * stealing. The tasks of the following passes of a group go to the queue of
+ * the thread that completed the previous pass.
  *
- * @see Scheduler
- * @see RunnableInfoList
- * @see SynchronizedFlag
- * @see Range
+ * If data prefetching is enabled, each thread requests the data for the first
+ * tasks in its queue before running a task.
+ *
+ * When the pool threads are on several NUMA nodes, a thread steals from the
+ * threads on its own node before the threads on other nodes, and the data it
+ * prefetches is loaded on its node.
+ *
+ * The thread initializer is called before and after each task, as the pool
+ * threads are shared with other runs, which may have different initializers.
  */
-class RunnableThread {
+class TaskScheduler : public TaskSource {
  private:
-  RunnableInfoList& _runnables;
-  const unsigned int _index;
-  const std::string _name;
+  class TaskQueue {
+   public:
+    NonRecursiveMutex _mutex;
+    // the tasks of each group, by group index
+    std::vector<std::deque<RunnableTaskPtr> > _tasks;
+    // the group to look at first, so the groups take turns
+    size_t _crtGroup;
+    TaskCounters _counters;
+    std::string _name;
+    size_t _node;
+    // the queues to take tasks from, starting with this one, then the queues
+    // on the same node
+    std::vector<size_t> _order;
+
+    TaskQueue() : _crtGroup(0) {}
+  };
+
+  class Greater {
+   public:
+    bool operator()(const RunnableTaskPtr& t1,
+                    const RunnableTaskPtr& t2) const {
+      return t1->_size > t2->_size;
+    }
+  };
+
+ private:
+  ThreadPool& _pool;
+  PtrVector<TaskQueue> _queues;
+  PtrVector<RunnableGroup> _groups;
+  const size_t _window;
+  std::auto_ptr<DataPrefetcher> _prefetcher;
   const SynchronizedFlag& _cancelState;
   DateTimeRangePtr _range;
   const DateTime _startTradesDateTime;
   ThreadInitializer* _threadInitializer;
-  const bool _cpuAffinity;
+
+  // tasks not completed yet
+  size_t _remaining;
+  // tasks being run, only decreased with _mutex locked
+  std::atomic<size_t> _running;
+  bool _stop;
+
+  mutable NonRecursiveMutex _mutex;
+  mutable Condition _condition;
+
+ private:
+  bool canceled() const { return _stop || _cancelState.get(); }
+
+  bool done() const {
+    return _remaining == 0 || (canceled() && _running == 0);
+  }
+
+  // looks for a task that can run, from the front of the queue for its own
+  // queue and from the back for the others. A task whose group has stopped
+  // is returned without an instance, so it can be dropped
+  RunnableTaskPtr find(TaskQueue& queue, bool own, RunnableInfo*& instance) {
+    NonRecursiveLock queueLock(queue._mutex);
+
+    size_t groups = queue._tasks.size();
+    for (size_t n = 0; n < groups; n++) {
+      size_t g = (queue._crtGroup + n) % groups;
+      std::deque<RunnableTaskPtr>& tasks = queue._tasks[g];
+      if (tasks.empty()) continue;
+
+      bool stopped;
+      instance = _groups[g]->checkout(stopped);
+      if (instance == 0 && !stopped) continue;
+
+      RunnableTaskPtr task;
+      if (own) {
+        task = tasks.front();
+        tasks.pop_front();
+      } else {
+        task = tasks.back();
+        tasks.pop_back();
+      }
+      queue._crtGroup = g + 1;
+      _running++;
+      return task;
+    }
+    return RunnableTaskPtr();
+  }
+
+  RunnableTaskPtr take(size_t index, RunnableInfo*& instance, bool& stolen) {
+    const std::vector<size_t>& order = _queues[index]->_order;
+    instance = 0;
+    for (size_t n = 0; n < order.size(); n++) {
+      RunnableTaskPtr task = find(*_queues[order[n]], n == 0, instance);
+      if (task) {
+        stolen = n > 0;
+        return task;
+      }
+    }
+    return RunnableTaskPtr();
+  }
+
+  // requests the data for the first tasks in a queue
+  void prefetch(TaskQueue& queue) {
+    if (_prefetcher.get() == 0) return;
+
+    NonRecursiveLock queueLock(queue._mutex);
+    for (size_t g = 0; g < queue._tasks.size(); g++) {
+      const std::deque<RunnableTaskPtr>& tasks = queue._tasks[g];
+      for (size_t n = 0; n < min2(_window, tasks.size()); n++) {
+        RunnableTaskPtr task = tasks[n];
+        if (!task->_item)
+          task->_item = _prefetcher->request(task->_info, queue._node);
+      }
+    }
+  }
+
+  // the tasks are all of the same group
+  void push(TaskQueue& queue, RunnableTaskVector& tasks) {
+    if (tasks.empty()) return;
+    std::stable_sort(tasks.begin(), tasks.end(), Greater());
+
+    NonRecursiveLock queueLock(queue._mutex);
+    std::deque<RunnableTaskPtr>& groupTasks =
+        queue._tasks[tasks.front()->_group->index()];
+    groupTasks.insert(groupTasks.end(), tasks.begin(), tasks.end());
+  }
+
+  // called when a task is done. If it was the last task of its group's pass,
+  // starts the next pass
+  void complete(TaskQueue& queue, RunnableTaskPtr task, RunnableInfo* instance,
+                bool stop) {
+    RunnableGroup* group = task->_group;
+    RunnableTaskVector tasks;
+    if (instance != 0) group->release(instance, stop);
+    bool last = group->complete();
+
+    // the task is only accounted for after the next pass is queued, so the
+    // run doesn't look done in the meantime
+    if (last && !canceled()) {
+      do
+        group->startPass(false, tasks);
+      while (tasks.empty() && !group->stopped());
+      push(queue, tasks);
+    }
+
+    {
+      NonRecursiveLock lock(_mutex);
+      _remaining += tasks.size();
+      _remaining--;
+      _running--;
+      if (done()) _condition.notify_all();
+    }
+    // an instance was released or new tasks were queued
+    _pool.changed();
+  }
 
  public:
   /**
-   * Constructor - takes all parameters needed to intialize the object as
-   * parameters
+   * Groups the runnables by iterator and creates the tasks of their first
+   * pass, which calls begin on all runnables
    *
-   * @param systems Reference to the RunnableInfoList object
-   * @param name    The name of the thread
-   * @param cancelState
-   *                Reference to the cancelState flag indicating whether to
-   * abort or not
-   * @param range   Pointer to a range object
-   * @param threadInitializer
-   *                pointer to a thread initializer
-   * @see ThreadInitializer
-   * @see Range
-   * @see SynchronizedFlag
-   * @see RunnableInfoList
+   * @param pool       the pool that will run the tasks
+   * @param runnables  the runnables
+   * @param window     number of tasks whose data each thread requests ahead,
+   * 0 to disable prefetching
+   * @param prefetchThreads
+   *                   number of threads loading the prefetched data, on each
+   * node of the pool
    */
-  RunnableThread(RunnableInfoList& systems, unsigned int index,
-                 const std::string& name, const SynchronizedFlag& cancelState,
-                 DateTimeRangePtr range, ThreadInitializer* threadInitializer,
-                 bool cpuAffinity, DateTime startTradesDateTime)
-      : _runnables(systems),
-        _index(index),
-        _name(name),
+  TaskScheduler(ThreadPool& pool, const RunnableInfoList& runnables,
+                size_t window, unsigned int prefetchThreads,
+                const SynchronizedFlag& cancelState, DateTimeRangePtr range,
+                DateTime startTradesDateTime,
+                ThreadInitializer* threadInitializer)
+      : _pool(pool),
+        _window(window),
         _cancelState(cancelState),
         _range(range),
+        _startTradesDateTime(startTradesDateTime),
         _threadInitializer(threadInitializer),
-        _cpuAffinity(cpuAffinity),
-        _startTradesDateTime(startTradesDateTime) {}
+        _remaining(0),
+        _running(0),
+        _stop(false) {
+    for (size_t n = 0; n < pool.threads(); n++) {
+      TaskQueue* queue = new TaskQueue();
+      std::ostringstream o;
+      o << n;
+      queue->_name = o.str();
+      queue->_node = pool.node(n);
+      _queues.push_back(queue);
+    }
 
-  virtual ~RunnableThread() {}
+    for (size_t n = 0; n < _queues.size(); n++) {
+      for (size_t m = 0; m < _queues.size(); m++) {
+        size_t index = (n + m) % _queues.size();
+        if (_queues[index]->_node == _queues[n]->_node)
+          _queues[n]->_order.push_back(index);
+      }
+      for (size_t m = 0; m < _queues.size(); m++) {
+        size_t index = (n + m) % _queues.size();
+        if (_queues[index]->_node != _queues[n]->_node)
+          _queues[n]->_order.push_back(index);
+      }
+    }
+
+    for (size_t n = 0; n < runnables.size(); n++) {
+      RunnableGroup* group = 0;
+      for (size_t m = 0; m < _groups.size() && group == 0; m++)
+        if (_groups[m]->symbols() == runnables[n]->symbols())
+          group = _groups[m];
+
+      if (group == 0) {
+        group = new RunnableGroup(runnables[n]->symbols(), _groups.size());
+        _groups.push_back(group);
+      }
+      group->add(runnables[n]);
+    }
+    for (size_t n = 0; n < _queues.size(); n++)
+      _queues[n]->_tasks.resize(_groups.size());
+
+    // a pass without symbols still ends with a call to again
+    RunnableTaskVector tasks;
+    for (size_t n = 0; n < _groups.size(); n++) {
+      size_t count = tasks.size();
+      bool first = true;
+      do {
+        _groups[n]->startPass(first, tasks);
+        first = false;
+      } while (tasks.size() == count && !_groups[n]->stopped());
+    }
+
+    std::stable_sort(tasks.begin(), tasks.end(), Greater());
+    for (size_t n = 0; n < tasks.size(); n++)
+      _queues[n % _queues.size()]->_tasks[tasks[n]->_group->index()].push_back(
+          tasks[n]);
+    _remaining = tasks.size();
+
+    if (_window > 0 && !tasks.empty()) {
+      std::vector<unsigned __int64> nodeMasks;
+      for (size_t n = 0; n < pool.nodes(); n++)
+        nodeMasks.push_back(pool.nodeMask(n));
+
+      _prefetcher.reset(new DataPrefetcher(prefetchThreads, nodeMasks,
+                                           cancelState, range,
+                                           threadInitializer));
+      _prefetcher->start();
+    }
+  }
+
+  ~TaskScheduler() {
+    for (size_t n = 0; n < _queues.size(); n++) {
+      const TaskCounters& counters = _queues[n]->_counters;
+      if (counters.executed > 0)
+        LOG(log_debug, "thread " << _queues[n]->_name << ": "
+                                 << counters.executed << " tasks, "
+                                 << counters.stolen << " stolen");
+    }
+  }
+
+  virtual bool runTask(size_t thread) {
+    if (canceled()) return false;
+
+    TaskQueue& queue = *_queues[thread % _queues.size()];
+    RunnableInfo* instance;
+    bool stolen;
+    RunnableTaskPtr task = take(thread % _queues.size(), instance, stolen);
+    if (!task) return false;
 
-  /**
-   * operator() - called when the new thread starts/
-   *
-   * This function gets called when the thread starts. It will iterate through
-   * the list of RunnableInfo until the iterator points to the end of the list.
-   *
-   * For each RunnableInfo in the list it will run the associated Runnable.
-   *
-   * Multiple threads will iterate through the same list, so each thread will
-   * get to run only a subset of all the RunnableInfo instances in the list.
-   *
-   * Because of this algorithm, all threads created by a Scheduler will be busy
-   * until the itertor points to the end of the list, meaning that all the
-   * Runnable have been run.
-   *
-   * In order to run one runnable in multiple threads, create multiple instances
-   * of the same runnable and use one symbols list iterator for all of them
-   *
-   * @see The thread function.
-   * @see This operator gets called when the thread starts. It will iterate
-   * through the
-   * @see list of RunnableInfo and for each RunnableInfo will run the associated
-   * Runnable.
-   * @see Multiple threads will iterate through the same lists
-   */
-  void operator()() {
-    if (_cpuAffinity) setCurrentThreadIdealProcessor(_index);
-    if (_threadInitializer != 0) _threadInitializer->init();
-    StructuredException::install();
     bool f = true;
+    if (instance != 0) {
+      queue._counters.executed++;
+      if (stolen) queue._counters.stolen++;
 
-    for (RunnableInfo* si = _runnables.getNext(); si != 0 && f;
-         si = _runnables.getNext()) {
-      f = si->run(_name, _cancelState, _range, _startTradesDateTime);
+      prefetch(queue);
+
+      if (_threadInitializer != 0) _threadInitializer->init();
+      f = instance->run(queue._name, task->_info, _prefetcher.get(),
+                        task->_item, _range, _startTradesDateTime,
+                        queue._counters);
+      if (_threadInitializer != 0) _threadInitializer->uninit();
     }
+    complete(queue, task, instance, !f);
+    return true;
+  }
 
-    if (_threadInitializer != 0) _threadInitializer->uninit();
+  /**
+   * Waits until all tasks are done, or the run is canceled and the tasks that
+   * were running are done
+   */
+  void wait() {
+    NonRecursiveLock lock(_mutex);
+    while (!done()) _condition.wait(lock);
+  }
+
+  /**
+   * Wakes up the thread waiting for the run to end, so it can see the cancel
+   * state, and stops the prefetching
+   */
+  void cancel() {
+    {
+      NonRecursiveLock lock(_mutex);
+      _stop = true;
+      _condition.notify_all();
+    }
+    if (_prefetcher.get() != 0) _prefetcher->cancel();
   }
 };
 
-/**
- * Definition of a ThreadVector
- *
- * @see RunnableThread
- * @see PtrVector
- */
-typedef PtrVector<RunnableThread> ThreadVector;
 /**
  * Prototype for the actual thread function that will be called when the
  * Runnable are run in asyncronous mode
@@ -861,6 +1736,11 @@ class SchedulerImpl : public Scheduler {
   ThreadInitializer* _threadInitializer;
   RunEventHandler* _runEventHandler;
 
+  // the tasks of the current run, if any, so the threads can be woken up on
+  // cancel
+  TaskScheduler* _tasks;
+  mutable Mutex _tasksMutex;
+
   // a set of all signal handlers for the session. There are no duplicates here,
   // so if each runnable sends signals to the same signal handler, there will
   // only be one in this set. This is used by the scheduler to signal the start
@@ -886,7 +1766,8 @@ class SchedulerImpl : public Scheduler {
   SchedulerImpl(RunEventHandler* runEventHandler = 0)
       : _runnables("Systems"),
         _threadInitializer(0),
-        _runEventHandler(runEventHandler) {}
+        _runEventHandler(runEventHandler),
+        _tasks(0) {}
 
   virtual ~SchedulerImpl() {}
 
@@ -1023,6 +1904,7 @@ class SchedulerImpl : public Scheduler {
   virtual void cancelSync() {
     NonRecursiveLock lock(_mutex2);
     _cancelState.set(true);
+    cancelTasks();
     if (_runEventHandler != 0) _runEventHandler->runCanceled();
 
     while (isRunning()) _condition2.wait(lock);
@@ -1034,9 +1916,15 @@ class SchedulerImpl : public Scheduler {
    */
   virtual void cancelAsync() {
     _cancelState.set(true);
+    cancelTasks();
     if (_runEventHandler != 0) _runEventHandler->runCanceled();
   }
 
+  void cancelTasks() {
+    Lock lock(_tasksMutex);
+    if (_tasks != 0) _tasks->cancel();
+  }
+
   void run(unsigned long threads, bool cpuAffinity, DateTimeRangePtr range,
            DateTime startTradesDateTime) {
     // synchronous run relative to the calling function
@@ -1066,20 +1954,38 @@ class SchedulerImpl : public Scheduler {
     // only run if there are no errors
     if (!errors) {
       _running.set(true);
-      _runnables.reset();
-      boost::thread_group _threads;
-      ThreadVector _threadVector;
-
-      for (unsigned int n = 0; n < threads; n++) {
-        std::ostringstream o;
-        o << n;
-        RunnableThread* p = new RunnableThread(
-            _runnables, n, o.str(), _cancelState, range, _threadInitializer,
-            cpuAffinity, startTradesDateTime);
-        _threadVector.push_back(p);
-        _threads.create_thread(*p);
+
+      // runs on the process wide pool if there is one, or on threads created
+      // for this run otherwise
+      std::auto_ptr<ThreadPool> ownPool;
+      ThreadPool* pool = _threadPool;
+      if (pool == 0) {
+        ownPool.reset(new ThreadPool(
+            threads, cpuAffinity ? ideal_processor_placement : no_placement));
+        pool = ownPool.get();
+      }
+
+      // creating the tasks calls begin on all the runnables
+      std::auto_ptr<TaskScheduler> tasks(new TaskScheduler(
+          *pool, _runnables, _prefetchWindow, _prefetchThreads, _cancelState,
+          range, startTradesDateTime, _threadInitializer));
+      {
+        Lock lock(_tasksMutex);
+        _tasks = tasks.get();
+      }
+
+      // the number of threads requested for the run is its share of the pool
+      pool->add(tasks.get(), threads);
+      tasks->wait();
+      pool->remove(tasks.get());
+
+      {
+        Lock lock(_tasksMutex);
+        _tasks = 0;
       }
-      _threads.join_all();
+      // stops the prefetching threads, and discards the tasks left if the run
+      // was canceled
+      tasks.reset();
 
       _running.set(false);
       _cancelState.set(false);
@@ -0,0 +1,317 @@
+/*
+Copyright (C) 2018 Adrian Michel
+http://www.amichel.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "seriesimpl.h"
+#include "bars.h"
+#include "indicators.h"
+#include "seriesexpression.h"
+
+#ifdef _DEBUG
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#define new DEBUG_NEW
+#endif
+
+extern SeriesCache* _cache;
+
+// the same ids as the series calculated by MAKE_OP_2SERIES and
+// MAKE_OP_SERIES_TO_VALUE, so the cache doesn't care how a result was
+// calculated
+static const char* tag(SeriesOperation op) {
+  switch (op) {
+    case add_operation:
+      return "+";
+    case subtract_operation:
+      return "-";
+    case multiply_operation:
+      return "*";
+    case divide_operation:
+      return "/";
+    case add_value_operation:
+      return "add value";
+    case subtract_value_operation:
+      return "subtract value";
+    case multiply_by_value_operation:
+      return "multiply by value";
+    case divide_by_value_operation:
+      return "divide by value";
+    case subtract_from_value_operation:
+      return "subtract from value";
+    case divide_value_by_operation:
+      return "divide value by";
+    default:
+      assert(false);
+      return "";
+  }
+}
+
+class MakeExpressionSeries : public CacheableBuilderX {
+ private:
+  class EvaluatedSeries : public SeriesImpl {
+   public:
+    EvaluatedSeries(const SeriesExpression& expression,
+                    SynchronizerPtr synchronizer, const Id& id)
+        : SeriesImpl(expression.size(), synchronizer, id) {
+      if (!_v.empty()) expression.evaluate(&_v[0]);
+    }
+  };
+
+ private:
+  const SeriesExpression& _expression;
+  SynchronizerPtr _synchronizer;
+
+ public:
+  MakeExpressionSeries(const SeriesExpression& expression,
+                       SynchronizerPtr synchronizer, const Id& id)
+      : CacheableBuilderX(id),
+        _expression(expression),
+        _synchronizer(synchronizer) {}
+
+  CacheableSeriesPtr make() const {
+    return CacheableSeriesPtr(new IndicatorCacheable(
+        new EvaluatedSeries(_expression, _synchronizer, id()), id()));
+  }
+};
+
+SeriesExpression::SeriesExpression(SeriesAbstrPtr series)
+    : _op(add_operation),
+      _series(series),
+      _value(0),
+      _size(series->unsyncSize()),
+      _operations(0),
+      _buffers(0) {}
+
+SeriesExpression::SeriesExpression(SeriesOperation op, SeriesExpressionPtr left,
+                                   SeriesExpressionPtr right)
+    : _op(op),
+      _left(left),
+      _right(right),
+      _value(0),
+      _size(left->size()),
+      _operations(left->_operations + right->_operations + 1),
+      // the left operand is calculated in the result, the right one in a
+      // scratch buffer
+      _buffers(max2(left->_buffers, right->_buffers + 1)) {
+  assert(left->size() == right->size());
+}
+
+SeriesExpression::SeriesExpression(SeriesOperation op, SeriesExpressionPtr left,
+                                   double value)
+    : _op(op),
+      _left(left),
+      _value(value),
+      _size(left->size()),
+      _operations(left->_operations + 1),
+      _buffers(left->_buffers) {}
+
+const double* SeriesExpression::evaluate(size_t start, size_t count, double* r,
+                                         double* scratch) const {
+  if (!_left) return _series->getArray() + start;
+
+  const SeriesKernels& k = SeriesKernels::get();
+  const double* x = _left->evaluate(start, count, r, scratch);
+  if (_right) {
+    const double* y =
+        _right->evaluate(start, count, scratch, scratch + BLOCK);
+    switch (_op) {
+      case add_operation:
+        k.add(x, y, r, count);
+        break;
+      case subtract_operation:
+        k.subtract(x, y, r, count);
+        break;
+      case multiply_operation:
+        k.multiply(x, y, r, count);
+        break;
+      case divide_operation:
+        k.divide(x, y, r, count);
+        break;
+      default:
+        assert(false);
+    }
+  } else {
+    switch (_op) {
+      case add_value_operation:
+        k.addValue(x, _value, r, count);
+        break;
+      case subtract_value_operation:
+        k.subtractValue(x, _value, r, count);
+        break;
+      case multiply_by_value_operation:
+        k.multiplyByValue(x, _value, r, count);
+        break;
+      case divide_by_value_operation:
+        k.divideByValue(x, _value, r, count);
+        break;
+      case subtract_from_value_operation:
+        k.subtractFromValue(x, _value, r, count);
+        break;
+      case divide_value_by_operation:
+        k.divideValueBy(x, _value, r, count);
+        break;
+      default:
+        assert(false);
+    }
+  }
+  return r;
+}
+
+void SeriesExpression::evaluate(double* r) const {
+  std::vector<double> scratch(max2<size_t>(_buffers, 1) * BLOCK);
+
+  for (size_t start = 0; start < _size; start += BLOCK) {
+    size_t count = min2<size_t>(BLOCK, _size - start);
+    const double* x = evaluate(start, count, r + start, &scratch[0]);
+    if (x != r + start) std::copy(x, x + count, r + start);
+  }
+}
+
+// the expression of a series not calculated yet, to be fused with the new
+// operation, or a leaf with the values of a series shared through the cache.
+// 0 for the other series, which may be modified before the expression is
+// calculated
+static SeriesExpressionPtr operand(SeriesAbstrPtr series,
+                                   unsigned int maxOperations) {
+  const ExpressionSeries* e =
+      dynamic_cast<const ExpressionSeries*>(series.get());
+  if (e != 0) {
+    SeriesExpressionPtr expression(e->expression());
+    if (expression && expression->operations() <= maxOperations)
+      return expression;
+    // the cached values, rather than the expression series, which may be
+    // modified later
+    series = e->result();
+  }
+
+  const SeriesImpl* s = dynamic_cast<const SeriesImpl*>(series.get());
+  return s != 0 && s->isShared()
+             ? SeriesExpressionPtr(new SeriesExpression(series))
+             : SeriesExpressionPtr();
+}
+
+// calculates the result right away, with the builders of the operations
+static SeriesAbstrPtr calculate(SeriesOperation op, const SeriesImpl& s1,
+                                SeriesAbstrPtr series2)
+    throw(OperationOnUnequalSizeSeriesException) {
+  switch (op) {
+    case add_operation:
+      return s1.add(series2);
+    case subtract_operation:
+      return s1.subtract(series2);
+    case multiply_operation:
+      return s1.multiply(series2);
+    case divide_operation:
+      return s1.divide(series2);
+    default:
+      assert(false);
+      return SeriesAbstrPtr();
+  }
+}
+
+static SeriesAbstrPtr calculate(SeriesOperation op, const SeriesImpl& s,
+                                double value) {
+  switch (op) {
+    case add_value_operation:
+      return s.add(value);
+    case subtract_value_operation:
+      return s.subtract(value);
+    case multiply_by_value_operation:
+      return s.multiply(value);
+    case divide_by_value_operation:
+      return s.divide(value);
+    case subtract_from_value_operation:
+      return s.subtractFrom(value);
+    case divide_value_by_operation:
+      return s.divideBy(value);
+    default:
+      assert(false);
+      return SeriesAbstrPtr();
+  }
+}
+
+SeriesAbstrPtr SeriesExpression::make(SeriesOperation op,
+                                      SeriesAbstrPtr series1,
+                                      SeriesAbstrPtr series2)
+    throw(OperationOnUnequalSizeSeriesException) {
+  const SeriesImpl& s1 = dynamic_cast<const SeriesImpl&>(*series1);
+  const SeriesImpl& s2 = dynamic_cast<const SeriesImpl&>(*series2);
+
+  // the cases in which Op2SeriesBase calculates the result on the
+  // unsynchronized values - the others, including the errors, are left to it
+  bool elementwise =
+      s1.unsyncSize() == s2.unsyncSize() &&
+      (s1.isSynchronized()
+           ? s2.isSynchronized() && *s1.synchronizer() == *s2.synchronizer()
+           : !s2.isSynchronized());
+  if (!elementwise) return calculate(op, s1, series2);
+
+  SeriesExpressionPtr left(operand(series1, MAX_OPERATIONS - 1));
+  SeriesExpressionPtr right(
+      left ? operand(series2, MAX_OPERATIONS - 1 - left->operations())
+           : SeriesExpressionPtr());
+  if (!left || !right) return calculate(op, s1, series2);
+
+  Id id(tag(op));
+  id << s1.getId() << s2.getId();
+
+  return SeriesAbstrPtr(new ExpressionSeries(
+      SeriesExpressionPtr(new SeriesExpression(op, left, right)),
+      s1.synchronizer(), id));
+}
+
+SeriesAbstrPtr SeriesExpression::make(SeriesOperation op,
+                                      SeriesAbstrPtr series, double value) {
+  const SeriesImpl& s = dynamic_cast<const SeriesImpl&>(*series);
+
+  SeriesExpressionPtr left(operand(series, MAX_OPERATIONS - 1));
+  if (!left) return calculate(op, s, value);
+
+  Id id(tag(op));
+  id << s.getId() << value;
+
+  return SeriesAbstrPtr(new ExpressionSeries(
+      SeriesExpressionPtr(new SeriesExpression(op, left, value)),
+      s.synchronizer(), id));
+}
+
+SeriesImpl& ExpressionSeries::values() const {
+  if (_expression) {
+    _result = _cache->findAndAdd(
+        MakeExpressionSeries(*_expression, synchronizer(), getId()));
+    _values = &dynamic_cast<SeriesImpl&>(*_result);
+    // releases the operands
+    _expression.reset();
+  }
+  return *_values;
+}
+
+SeriesImpl& ExpressionSeries::modifiableValues() {
+  values();
+  if (_values->isShared()) {
+    // the series of the cache is left alone, the copy keeps its synchronizer
+    _values = new SeriesImpl(*_values);
+    _result = SeriesAbstrPtr(_values);
+  }
+  return *_values;
+}
+
+void ExpressionSeries::synchronize(SynchronizerPtr synchronizer) {
+  SeriesImpl::synchronize(synchronizer);
+  if (!_expression) _values->synchronize(synchronizer);
+}
@@ -0,0 +1,219 @@
+/*
+Copyright (C) 2018 Adrian Michel
+http://www.amichel.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "seriesimpl.h"
+
+class SeriesExpression;
+typedef boost::shared_ptr<const SeriesExpression> SeriesExpressionPtr;
+
+/**
+ * Node of an arithmetic expression on series that hasn't been calculated yet
+ *
+ * The leaves are series with values, the other nodes are elementwise
+ * operations on the values of their operands. The expression is calculated in
+ * blocks small enough for the intermediate results to stay in the L1 cache:
+ * for each block, the nodes are calculated bottom up with the series kernels,
+ * into a few scratch buffers reused from block to block, and only the root
+ * writes to the result. This gives the same values, bit for bit, as
+ * calculating the nodes one series at a time.
+ */
+class SeriesExpression {
+ private:
+  enum {
+    // number of values per block
+    BLOCK = 512,
+    // the expressions are capped at this many operations, larger ones are
+    // split by calculating the operands
+    MAX_OPERATIONS = 16
+  };
+
+  // the operation, unused for leaves
+  const SeriesOperation _op;
+  // the series of a leaf
+  const SeriesAbstrPtr _series;
+  const SeriesExpressionPtr _left;
+  // only for operations on two series
+  const SeriesExpressionPtr _right;
+  // only for operations on a series and a value
+  const double _value;
+  const size_t _size;
+  const unsigned int _operations;
+  // the number of scratch buffers needed to calculate the node
+  const unsigned int _buffers;
+
+ private:
+  // calculates the values from start to start + count, into r, and returns
+  // where they are, which is r, or the values of the series for a leaf
+  const double* evaluate(size_t start, size_t count, double* r,
+                         double* scratch) const;
+
+ public:
+  // a leaf
+  SeriesExpression(SeriesAbstrPtr series);
+  // an operation on two series
+  SeriesExpression(SeriesOperation op, SeriesExpressionPtr left,
+                   SeriesExpressionPtr right);
+  // an operation on a series and a value
+  SeriesExpression(SeriesOperation op, SeriesExpressionPtr left, double value);
+
+  size_t size() const { return _size; }
+  unsigned int operations() const { return _operations; }
+
+  /**
+   * Calculates all the values, into r
+   *
+   * @param r      the result, of size() values
+   */
+  void evaluate(double* r) const;
+
+  /**
+   * Returns the series resulting from an operation, which is only calculated
+   * when needed if all the series it is calculated from are shared through
+   * the cache, see SeriesImpl::share, or are themselves not calculated yet.
+   *
+   * It is calculated right away if the operands don't allow it to be
+   * calculated elementwise on their unsynchronized values, or if one of them
+   * may be modified before the result is calculated, so the result is always
+   * that of the values of the operands at the time of the operation.
+   */
+  static SeriesAbstrPtr make(SeriesOperation op, SeriesAbstrPtr series1,
+                             SeriesAbstrPtr series2)
+      throw(OperationOnUnequalSizeSeriesException);
+  static SeriesAbstrPtr make(SeriesOperation op, SeriesAbstrPtr series,
+                             double value);
+};
+
+/**
+ * Series resulting from an expression, calculated the first time its values
+ * are accessed
+ *
+ * Until then, it only holds the expression, and operations on it are added to
+ * the expression instead of being calculated. Once calculated, all the value
+ * accessors forward to the calculated series, which comes from the series
+ * cache.
+ *
+ * The methods that modify the values all go through modifiableValues, which
+ * calculates them, and first copies them if they are those of the cache, so
+ * the cached series, which other series and expressions may be using, is
+ * never modified.
+ *
+ * <B>Not thread safe</B> before it is calculated, as the other series that are
+ * not in the cache
+ */
+class ExpressionSeries : public SeriesImpl {
+ private:
+  mutable SeriesExpressionPtr _expression;
+  mutable SeriesAbstrPtr _result;
+  mutable SeriesImpl* _values;
+
+ private:
+  SeriesImpl& values() const;
+  SeriesImpl& modifiableValues();
+
+ public:
+  ExpressionSeries(SeriesExpressionPtr expression,
+                   SynchronizerPtr synchronizer, const Id& id)
+      : SeriesImpl(0, synchronizer, id),
+        _expression(expression),
+        _values(0) {}
+
+  // the expression, or 0 if the series has been calculated
+  SeriesExpressionPtr expression() const { return _expression; }
+
+  // the calculated values, which are shared if they are still those of the
+  // cache
+  SeriesAbstrPtr result() const {
+    values();
+    return _result;
+  }
+
+  virtual void synchronize(SynchronizerPtr synchronizer);
+
+  virtual double& at(size_t index) { return modifiableValues().at(index); }
+  virtual void push_back(double value) { modifiableValues().push_back(value); }
+  virtual void append(std::vector<double>& values) {
+    modifiableValues().append(values);
+  }
+  virtual double setValue(size_t barIndex,
+                          double value) throw(SeriesIndexOutOfRangeException) {
+    return modifiableValues().setValue(barIndex, value);
+  }
+  virtual double& getRef(size_t ix) throw(SeriesIndexOutOfRangeException) {
+    return modifiableValues().getRef(ix);
+  }
+  virtual double getValue(size_t ix) const
+      throw(SeriesIndexOutOfRangeException) {
+    return values().getValue(ix);
+  }
+  virtual size_t size() const {
+    return _expression ? (isSynchronized() ? synchronizer()->size()
+                                           : _expression->size())
+                       : _values->size();
+  }
+  virtual size_t unsyncSize() const {
+    return _expression ? _expression->size() : _values->unsyncSize();
+  }
+  virtual const double* getArray() const { return values().getArray(); }
+  virtual const vector<double>& getVector() const {
+    return values().getVector();
+  }
+
+  virtual SeriesAbstr& operator=(SeriesAbstrPtr series) throw(
+      OperationOnUnequalSizeSeriesException) {
+    modifiableValues() = series;
+    return *this;
+  }
+  virtual SeriesAbstr& operator*=(SeriesAbstrPtr series) throw(
+      OperationOnUnequalSizeSeriesException) {
+    modifiableValues() *= series;
+    return *this;
+  }
+  virtual SeriesAbstr& operator*=(double value) {
+    modifiableValues() *= value;
+    return *this;
+  }
+  virtual SeriesAbstr& operator+=(SeriesAbstrPtr series) throw(
+      OperationOnUnequalSizeSeriesException) {
+    modifiableValues() += series;
+    return *this;
+  }
+  virtual SeriesAbstr& operator+=(double value) {
+    modifiableValues() += value;
+    return *this;
+  }
+  virtual SeriesAbstr& operator-=(SeriesAbstrPtr series) throw(
+      OperationOnUnequalSizeSeriesException) {
+    modifiableValues() -= series;
+    return *this;
+  }
+  virtual SeriesAbstr& operator-=(double value) {
+    modifiableValues() -= value;
+    return *this;
+  }
+  virtual SeriesAbstr& operator/=(SeriesAbstrPtr series) throw(
+      OperationOnUnequalSizeSeriesException, DivideByZeroException) {
+    modifiableValues() /= series;
+    return *this;
+  }
+  virtual SeriesAbstr& operator/=(double value) throw(DivideByZeroException) {
+    modifiableValues() /= value;
+    return *this;
+  }
+};
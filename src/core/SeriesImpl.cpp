@@ -21,6 +21,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "seriesimpl.h"
 #include "bars.h"
 #include "indicators.h"
+#include "seriesexpression.h"
 
 /*
 #ifdef _DEBUG
@@ -35,9 +36,43 @@ static char THIS_FILE[]=__FILE__;
 
 SeriesCache* _cache;
 
+void cacheableShared(const tradery::SeriesAbstr* series) {
+  const SeriesImpl* s = dynamic_cast<const SeriesImpl*>(series);
+  if (s != 0) s->share();
+}
+
 unsigned long EmptySeries::_l = 0;
 Mutex EmptySeries::_mutex;
 
+void SeriesImpl::apply(SeriesKernels::SeriesOp op, SeriesAbstrPtr series) throw(
+    OperationOnUnequalSizeSeriesException,
+    OperationOnSeriesSyncedToDifferentSynchronizers) {
+  if (size() != series->size())
+    throw OperationOnUnequalSizeSeriesException(size(), series->size());
+  if (isSynchronized() && series->isSynchronized() &&
+      *_synchronizer != *series->synchronizer())
+    throw OperationOnSeriesSyncedToDifferentSynchronizers();
+
+  if (isSynchronized() == series->isSynchronized() &&
+      _v.size() == series->unsyncSize()) {
+    // the unsynchronized values are aligned, which is the usual case
+    if (!_v.empty()) op(&_v[0], series->getArray(), &_v[0], _v.size());
+  } else {
+    // the value at each synchronized index is combined with the value of
+    // the other series at the same index. A value of the current series that
+    // is mapped to several indexes is only changed once, by the first one.
+    int last = -1;
+    for (size_t n = 0; n < size(); n++) {
+      int ix = getIndex(n);
+      if (ix < 0 || ix == last) continue;
+
+      double value = series->getValue(n);
+      op(&_v.at(ix), &value, &_v.at(ix), 1);
+      last = ix;
+    }
+  }
+}
+
 SeriesAbstrPtr SeriesImpl::shiftRight(unsigned int n) const {
   return _cache->findAndAdd(MakeShiftRightSeries(*this, n));
 }
@@ -138,12 +173,14 @@ SeriesAbstrPtr SeriesImpl::ROC(unsigned int period) const {
 */
 SeriesAbstrPtr SeriesImpl::BBandUpper(unsigned int period,
                                       double stdDev) const {
-  return _cache->findAndAdd(MakeBBandUpperSeries(*this, period, stdDev));
+  return _cache->findAndAdd(
+      MakeBBandSeries(*this, bband_upper, period, stdDev));
 }
 
 SeriesAbstrPtr SeriesImpl::BBandLower(unsigned int period,
                                       double stdDev) const {
-  return _cache->findAndAdd(MakeBBandLowerSeries(*this, period, stdDev));
+  return _cache->findAndAdd(
+      MakeBBandSeries(*this, bband_lower, period, stdDev));
 }
 
 SeriesAbstrPtr SeriesImpl::DEMA(unsigned int period) const {
@@ -288,22 +325,22 @@ SeriesAbstrPtr SeriesImpl::Momentum(unsigned int period) const {
 SeriesAbstrPtr SeriesImpl::MACD(unsigned int fastPeriod,
                                 unsigned int slowPeriod,
                                 unsigned int signalPeriod) const {
-  return _cache->findAndAdd(
-      MakeMACDSeries(*this, fastPeriod, slowPeriod, signalPeriod));
+  return _cache->findAndAdd(MakeMACDSeries(*this, macd_macd, fastPeriod,
+                                           slowPeriod, signalPeriod));
 }
 
 SeriesAbstrPtr SeriesImpl::MACDSignal(unsigned int fastPeriod,
                                       unsigned int slowPeriod,
                                       unsigned int signalPeriod) const {
-  return _cache->findAndAdd(
-      MakeMACDSignalSeries(*this, fastPeriod, slowPeriod, signalPeriod));
+  return _cache->findAndAdd(MakeMACDSeries(*this, macd_signal, fastPeriod,
+                                           slowPeriod, signalPeriod));
 }
 
 SeriesAbstrPtr SeriesImpl::MACDHist(unsigned int fastPeriod,
                                     unsigned int slowPeriod,
                                     unsigned int signalPeriod) const {
-  return _cache->findAndAdd(
-      MakeMACDHistSeries(*this, fastPeriod, slowPeriod, signalPeriod));
+  return _cache->findAndAdd(MakeMACDSeries(*this, macd_hist, fastPeriod,
+                                           slowPeriod, signalPeriod));
 }
 
 SeriesAbstrPtr SeriesImpl::MACDExt(unsigned int fastPeriod, MAType fastMAType,
@@ -428,28 +465,37 @@ tradery::SeriesAbstrPtr SeriesAbstr::create(size_t size) {
   return SeriesAbstrPtr(new EmptySeries(size));
 }
 
+CORE_API SeriesAbstrPtr Series::operation(SeriesOperation op,
+                                          const Series& series1,
+                                          const Series& series2)
+    throw(OperationOnUnequalSizeSeriesException) {
+  return SeriesExpression::make(op, series1._series, series2._series);
+}
+
+CORE_API SeriesAbstrPtr Series::operation(SeriesOperation op,
+                                          const Series& series, double value) {
+  return SeriesExpression::make(op, series._series, value);
+}
+
 // global operators allowing using a constant as the first operand in an
-// operation ( value + series etc)
-#define OPERATOR_VALUE_SERIES(OP)                                             \
-  CORE_API Series tradery::operator OP(double value, const Series& series) \
-{ \
-    std::auto_ptr<SeriesImpl> si(new SeriesImpl());                           \
-                                                                              \
-    const std::vector<double>& v = series.getVector();                        \
-                                                                              \
-    for (size_t n = 0; n < series.unsyncSize(); n++)                          \
-      si->push_back(value OP v[n]);                                           \
-                                                                              \
-    si->synchronize(series.synchronizer());                                   \
-                                                                              \
-    return Series(si.release());                                              \
-  \
-}
-
-OPERATOR_VALUE_SERIES(+)
-OPERATOR_VALUE_SERIES(-)
-OPERATOR_VALUE_SERIES(/)
-OPERATOR_VALUE_SERIES(*)
+// operation ( value + series etc). Addition and multiplication give the same
+// values with the operands in any order
+CORE_API Series tradery::operator+(double value, const Series& series) {
+  return Series(Series::operation(add_value_operation, series, value));
+}
+
+CORE_API Series tradery::operator-(double value, const Series& series) {
+  return Series(
+      Series::operation(subtract_from_value_operation, series, value));
+}
+
+CORE_API Series tradery::operator/(double value, const Series& series) {
+  return Series(Series::operation(divide_value_by_operation, series, value));
+}
+
+CORE_API Series tradery::operator*(double value, const Series& series) {
+  return Series(Series::operation(multiply_by_value_operation, series, value));
+}
 
 CORE_API std::ostream& Series::dump(std::ostream& os, size_t k) const {
   std::ostringstream o;
@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include "cache.h"
+#include "serieskernels.h"
 
 using std::vector;
 
@@ -38,11 +39,22 @@ class SeriesImpl : public tradery::SeriesAbstr, public Ideable {
 
  private:
   SynchronizerPtr _synchronizer;
+  // set once the series is held by a cache, see share
+  mutable bool _shared;
 
   int getIndex(size_t ix) const {
     return isSynchronized() ? _synchronizer->index(ix) : ix;
   }
 
+  // this = this op series, in place
+  void apply(SeriesKernels::SeriesOp op, SeriesAbstrPtr series) throw(
+      OperationOnUnequalSizeSeriesException,
+      OperationOnSeriesSyncedToDifferentSynchronizers);
+  // this = this op value, in place
+  void apply(SeriesKernels::ValueOp op, double value) {
+    if (!_v.empty()) op(&_v[0], value, &_v[0], _v.size());
+  }
+
  public:
   // copy constructor
   /*  SeriesImpl( const SeriesImpl& series, const Id& id = Id() )
@@ -52,17 +64,30 @@ class SeriesImpl : public tradery::SeriesAbstr, public Ideable {
     }
   */
   SeriesImpl(size_t size, SynchronizerPtr synchronizer, const Id& id = Id())
-      : _v(size), Ideable(id), _synchronizer(synchronizer) {}
+      : _v(size), Ideable(id), _synchronizer(synchronizer), _shared(false) {}
 
-  SeriesImpl(const Id& id = Id()) : Ideable(id) {}
+  SeriesImpl(const Id& id = Id()) : Ideable(id), _shared(false) {}
 
+  // the copy is not shared, whether the series is or not
   SeriesImpl(const SeriesImpl& series)
       : _v(series.getVector()),
         Ideable(Id()),
-        _synchronizer(series.synchronizer()) {}
+        _synchronizer(series.synchronizer()),
+        _shared(false) {}
 
   virtual ~SeriesImpl() {}
 
+  /**
+   * Marks the series as held by a cache, called by the cache when it adds the
+   * series, or the bars it belongs to
+   *
+   * A shared series is seen by all the users of the cache, so its values are
+   * not modified once it is made, which lets the expressions on it be
+   * calculated later, see SeriesExpression
+   */
+  void share() const { _shared = true; }
+  bool isShared() const { return _shared; }
+
  public:
   virtual void synchronize(SynchronizerPtr synchronizer) {
     _synchronizer = synchronizer;
@@ -81,6 +106,13 @@ class SeriesImpl : public tradery::SeriesAbstr, public Ideable {
     _v.push_back(value);
   }
 
+  virtual void append(std::vector<double>& values) {
+    if (_v.empty())
+      _v.swap(values);
+    else
+      _v.insert(_v.end(), values.begin(), values.end());
+  }
+
   virtual double setValue(size_t barIndex,
                           double value) throw(SeriesIndexOutOfRangeException) {
     try {
@@ -136,11 +168,11 @@ class SeriesImpl : public tradery::SeriesAbstr, public Ideable {
   }
   virtual SeriesAbstr& operator*=(SeriesAbstrPtr series) throw(
       OperationOnUnequalSizeSeriesException) {
-    _v = ((*this) * series)->getVector();
+    apply(SeriesKernels::get().multiply, series);
     return *this;
   }
   virtual SeriesAbstr& operator*=(double value) {
-    _v = ((*this) * value)->getVector();
+    apply(SeriesKernels::get().multiplyByValue, value);
     return *this;
   }
 
@@ -150,13 +182,13 @@ class SeriesImpl : public tradery::SeriesAbstr, public Ideable {
   }
   virtual SeriesAbstr& operator+=(SeriesAbstrPtr series) throw(
       OperationOnUnequalSizeSeriesException) {
-    _v = ((*this) + series)->getVector();
+    apply(SeriesKernels::get().add, series);
     return *this;
   }
 
   virtual SeriesAbstrPtr operator+(double value) const { return add(value); }
   virtual SeriesAbstr& operator+=(double value) {
-    _v = ((*this) + value)->getVector();
+    apply(SeriesKernels::get().addValue, value);
     return *this;
   }
 
@@ -166,7 +198,7 @@ class SeriesImpl : public tradery::SeriesAbstr, public Ideable {
   }
   virtual SeriesAbstr& operator-=(SeriesAbstrPtr series) throw(
       OperationOnUnequalSizeSeriesException) {
-    _v = ((*this) - series)->getVector();
+    apply(SeriesKernels::get().subtract, series);
     return *this;
   }
 
@@ -174,7 +206,7 @@ class SeriesImpl : public tradery::SeriesAbstr, public Ideable {
     return subtract(value);
   }
   virtual SeriesAbstr& operator-=(double value) {
-    _v = ((*this) - value)->getVector();
+    apply(SeriesKernels::get().subtractValue, value);
     return *this;
   }
 
@@ -184,7 +216,7 @@ class SeriesImpl : public tradery::SeriesAbstr, public Ideable {
   }
   virtual SeriesAbstr& operator/=(SeriesAbstrPtr series) throw(
       OperationOnUnequalSizeSeriesException, DivideByZeroException) {
-    _v = ((*this) / series)->getVector();
+    apply(SeriesKernels::get().divide, series);
     return *this;
   }
 
@@ -193,7 +225,7 @@ class SeriesImpl : public tradery::SeriesAbstr, public Ideable {
     return divide(value);
   }
   virtual SeriesAbstr& operator/=(double value) throw(DivideByZeroException) {
-    _v = ((*this) / value)->getVector();
+    apply(SeriesKernels::get().divideByValue, value);
     return *this;
   }
 
@@ -283,13 +315,14 @@ class SeriesImpl : public tradery::SeriesAbstr, public Ideable {
     assert(start < size());
     assert(length > 0);
 
-    double _max = _v.at(start);
+    const vector<double>& v(getVector());
+    double _max = v.at(start);
     size_t maxIndex = start;
 
     // TODO: use std algorithm
     for (size_t n = start + 1; n < min2(start + length, size()); n++) {
-      if (_v.at(n) > _max) {
-        _max = _v.at(n);
+      if (v.at(n) > _max) {
+        _max = v.at(n);
         maxIndex = n;
       }
     }
@@ -303,13 +336,14 @@ class SeriesImpl : public tradery::SeriesAbstr, public Ideable {
     assert(start < size());
     assert(length > 0);
 
-    double _min = _v.at(start);
+    const vector<double>& v(getVector());
+    double _min = v.at(start);
     size_t minIndex = start;
 
     // TODO: use std algorithm
     for (size_t n = start + 1; n < start + length; n++) {
-      if (_v.at(n) < _min) {
-        _min = _v.at(n);
+      if (v.at(n) < _min) {
+        _min = v.at(n);
         minIndex = n;
       }
     }
@@ -0,0 +1,374 @@
+/*
+Copyright (C) 2018 Adrian Michel
+http://www.amichel.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "serieskernels.h"
+#include <intrin.h>
+#include <immintrin.h>
+
+#ifdef _DEBUG
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#define new DEBUG_NEW
+#endif
+
+// the AVX-512 intrinsics are only available from VS2017 15.3
+#if _MSC_VER >= 1911
+#define SERIES_KERNELS_AVX512
+#endif
+
+// same threshold as TA_IS_ZERO_OR_NEG in TA-Lib
+#define ZERO_OR_NEG 0.00000001
+
+/**
+ * The operations, in a scalar and vector version. The vector versions must do
+ * the exact same IEEE operations as the scalar one
+ */
+class AddOp {
+ public:
+  static double scalar(double x, double y) { return x + y; }
+  static __m256d avx2(__m256d x, __m256d y) { return _mm256_add_pd(x, y); }
+#ifdef SERIES_KERNELS_AVX512
+  static __m512d avx512(__m512d x, __m512d y) { return _mm512_add_pd(x, y); }
+#endif
+};
+
+class SubtractOp {
+ public:
+  static double scalar(double x, double y) { return x - y; }
+  static __m256d avx2(__m256d x, __m256d y) { return _mm256_sub_pd(x, y); }
+#ifdef SERIES_KERNELS_AVX512
+  static __m512d avx512(__m512d x, __m512d y) { return _mm512_sub_pd(x, y); }
+#endif
+};
+
+class MultiplyOp {
+ public:
+  static double scalar(double x, double y) { return x * y; }
+  static __m256d avx2(__m256d x, __m256d y) { return _mm256_mul_pd(x, y); }
+#ifdef SERIES_KERNELS_AVX512
+  static __m512d avx512(__m512d x, __m512d y) { return _mm512_mul_pd(x, y); }
+#endif
+};
+
+class DivideOp {
+ public:
+  static double scalar(double x, double y) { return x / y; }
+  static __m256d avx2(__m256d x, __m256d y) { return _mm256_div_pd(x, y); }
+#ifdef SERIES_KERNELS_AVX512
+  static __m512d avx512(__m512d x, __m512d y) { return _mm512_div_pd(x, y); }
+#endif
+};
+
+class ReverseSubtractOp {
+ public:
+  static double scalar(double x, double y) { return y - x; }
+  static __m256d avx2(__m256d x, __m256d y) { return _mm256_sub_pd(y, x); }
+#ifdef SERIES_KERNELS_AVX512
+  static __m512d avx512(__m512d x, __m512d y) { return _mm512_sub_pd(y, x); }
+#endif
+};
+
+class ReverseDivideOp {
+ public:
+  static double scalar(double x, double y) { return y / x; }
+  static __m256d avx2(__m256d x, __m256d y) { return _mm256_div_pd(y, x); }
+#ifdef SERIES_KERNELS_AVX512
+  static __m512d avx512(__m512d x, __m512d y) { return _mm512_div_pd(y, x); }
+#endif
+};
+
+// same semantics as the minpd and maxpd instructions: the second operand is
+// returned if the values are equal or either one is a NaN
+class MinOp {
+ public:
+  static double scalar(double x, double y) { return x < y ? x : y; }
+  static __m256d avx2(__m256d x, __m256d y) { return _mm256_min_pd(x, y); }
+#ifdef SERIES_KERNELS_AVX512
+  static __m512d avx512(__m512d x, __m512d y) { return _mm512_min_pd(x, y); }
+#endif
+};
+
+class MaxOp {
+ public:
+  static double scalar(double x, double y) { return x > y ? x : y; }
+  static __m256d avx2(__m256d x, __m256d y) { return _mm256_max_pd(x, y); }
+#ifdef SERIES_KERNELS_AVX512
+  static __m512d avx512(__m512d x, __m512d y) { return _mm512_max_pd(x, y); }
+#endif
+};
+
+class StdDevOp {
+ public:
+  static double scalar(double x, double nbDev) {
+    return x < ZERO_OR_NEG ? 0.0 : sqrt(x) * nbDev;
+  }
+  static __m256d avx2(__m256d x, __m256d nbDev) {
+    __m256d zero = _mm256_cmp_pd(x, _mm256_set1_pd(ZERO_OR_NEG), _CMP_LT_OQ);
+    return _mm256_andnot_pd(zero, _mm256_mul_pd(_mm256_sqrt_pd(x), nbDev));
+  }
+#ifdef SERIES_KERNELS_AVX512
+  static __m512d avx512(__m512d x, __m512d nbDev) {
+    __mmask8 zero =
+        _mm512_cmp_pd_mask(x, _mm512_set1_pd(ZERO_OR_NEG), _CMP_LT_OQ);
+    return _mm512_maskz_mul_pd(~zero, _mm512_sqrt_pd(x), nbDev);
+  }
+#endif
+};
+
+template <class Op>
+void scalarSeriesOp(const double* x, const double* y, double* r, size_t size) {
+  for (size_t n = 0; n < size; n++) r[n] = Op::scalar(x[n], y[n]);
+}
+
+template <class Op>
+void scalarValueOp(const double* x, double value, double* r, size_t size) {
+  for (size_t n = 0; n < size; n++) r[n] = Op::scalar(x[n], value);
+}
+
+template <class Op>
+void avx2SeriesOp(const double* x, const double* y, double* r, size_t size) {
+  size_t n = 0;
+  for (; n + 4 <= size; n += 4)
+    _mm256_storeu_pd(
+        r + n, Op::avx2(_mm256_loadu_pd(x + n), _mm256_loadu_pd(y + n)));
+  // avoids the penalty of going back to SSE code with the upper halves of the
+  // registers in use
+  _mm256_zeroupper();
+  for (; n < size; n++) r[n] = Op::scalar(x[n], y[n]);
+}
+
+template <class Op>
+void avx2ValueOp(const double* x, double value, double* r, size_t size) {
+  __m256d v = _mm256_set1_pd(value);
+  size_t n = 0;
+  for (; n + 4 <= size; n += 4)
+    _mm256_storeu_pd(r + n, Op::avx2(_mm256_loadu_pd(x + n), v));
+  _mm256_zeroupper();
+  for (; n < size; n++) r[n] = Op::scalar(x[n], value);
+}
+
+#ifdef SERIES_KERNELS_AVX512
+template <class Op>
+void avx512SeriesOp(const double* x, const double* y, double* r, size_t size) {
+  size_t n = 0;
+  for (; n + 8 <= size; n += 8)
+    _mm512_storeu_pd(
+        r + n, Op::avx512(_mm512_loadu_pd(x + n), _mm512_loadu_pd(y + n)));
+  _mm256_zeroupper();
+  for (; n < size; n++) r[n] = Op::scalar(x[n], y[n]);
+}
+
+template <class Op>
+void avx512ValueOp(const double* x, double value, double* r, size_t size) {
+  __m512d v = _mm512_set1_pd(value);
+  size_t n = 0;
+  for (; n + 8 <= size; n += 8)
+    _mm512_storeu_pd(r + n, Op::avx512(_mm512_loadu_pd(x + n), v));
+  _mm256_zeroupper();
+  for (; n < size; n++) r[n] = Op::scalar(x[n], value);
+}
+#endif
+
+#define SERIES_KERNELS(NAME, SERIES_OP, VALUE_OP)                    \
+  {                                                                  \
+    NAME, SERIES_OP<AddOp>, SERIES_OP<SubtractOp>,                   \
+        SERIES_OP<MultiplyOp>, SERIES_OP<DivideOp>, SERIES_OP<MinOp>, \
+        SERIES_OP<MaxOp>, VALUE_OP<AddOp>, VALUE_OP<SubtractOp>,     \
+        VALUE_OP<MultiplyOp>, VALUE_OP<DivideOp>,                    \
+        VALUE_OP<ReverseSubtractOp>, VALUE_OP<ReverseDivideOp>,      \
+        VALUE_OP<StdDevOp>                                           \
+  }
+
+static const SeriesKernels _scalarKernels =
+    SERIES_KERNELS("scalar", scalarSeriesOp, scalarValueOp);
+static const SeriesKernels _avx2Kernels =
+    SERIES_KERNELS("AVX2", avx2SeriesOp, avx2ValueOp);
+#ifdef SERIES_KERNELS_AVX512
+static const SeriesKernels _avx512Kernels =
+    SERIES_KERNELS("AVX-512", avx512SeriesOp, avx512ValueOp);
+#endif
+
+// true if the processor supports the instructions and the operating system
+// saves the registers they use
+static bool supports(int leaf7Ebx, unsigned __int64 xcr0) {
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) return false;
+
+  __cpuid(info, 1);
+  // OSXSAVE and AVX
+  const int osxsaveAvx = (1 << 27) | (1 << 28);
+  if ((info[2] & osxsaveAvx) != osxsaveAvx) return false;
+  if ((_xgetbv(0) & xcr0) != xcr0) return false;
+
+  __cpuidex(info, 7, 0);
+  return (info[1] & leaf7Ebx) == leaf7Ebx;
+}
+
+static const SeriesKernels& select() {
+  const SeriesKernels* kernels = &_scalarKernels;
+  // AVX2, and the SSE/AVX state
+  if (supports(1 << 5, 0x6)) kernels = &_avx2Kernels;
+#ifdef SERIES_KERNELS_AVX512
+  // AVX-512F, and the opmask, ZMM and SSE/AVX state
+  if (supports(1 << 16, 0xe6)) kernels = &_avx512Kernels;
+#endif
+
+  LOG(log_info, "Series kernels: " << kernels->name);
+  return *kernels;
+}
+
+const SeriesKernels& SeriesKernels::get() {
+  static const SeriesKernels& kernels = select();
+  return kernels;
+}
+
+std::vector<const SeriesKernels*> SeriesKernels::supported() {
+  std::vector<const SeriesKernels*> kernels(1, &_scalarKernels);
+  if (supports(1 << 5, 0x6)) kernels.push_back(&_avx2Kernels);
+#ifdef SERIES_KERNELS_AVX512
+  if (supports(1 << 16, 0xe6)) kernels.push_back(&_avx512Kernels);
+#endif
+  return kernels;
+}
+
+void SeriesKernels::sma(const double* v, size_t size, unsigned int period,
+                        double* r) {
+  assert(period > 0 && period < size);
+
+  double f = 0;
+  for (unsigned int n = 0; n < period; n++) f += v[n];
+  r[period - 1] = f / (double)period;
+
+  // the changes are independent of each other, only their running sum is
+  // serial
+  const SeriesKernels& k = get();
+  k.subtract(v + period, v, r + period, size - period);
+  k.divideByValue(r + period, (double)period, r + period, size - period);
+  for (size_t n = period; n < size; n++) r[n] = r[n - 1] + r[n];
+}
+
+void SeriesKernels::ema(const double* v, size_t size, unsigned int period,
+                        double exp, double* r) {
+  assert(period > 0 && period < size);
+
+  double f = 0;
+  for (unsigned int n = 0; n < period; n++) f += v[n];
+  r[period - 1] = f / (double)period;
+
+  // each value depends on the previous one, so there is nothing to vectorize
+  for (size_t n = period; n < size; n++)
+    r[n] = exp * (v[n] - r[n - 1]) + r[n - 1];
+}
+
+void SeriesKernels::wma(const double* v, const double* sma, size_t size,
+                        unsigned int period, double* r) {
+  assert(period > 0 && period < size);
+
+  // integer arithmetic, as the original calculation
+  double sigma = (period + 1) * period / 2;
+  double f = 0;
+  for (unsigned int n = 0; n < period; n++) f += (n + 1) * v[n];
+  r[period - 1] = f / sigma;
+
+  // r[n] = r[n - 1] - sma[n - 1] * period / sigma + period * v[n] / sigma,
+  // where only the sum is serial
+  const size_t count = size - period;
+  const SeriesKernels& k = get();
+  std::vector<double> out(count);
+  k.multiplyByValue(sma + period - 1, (float)period, &out[0], count);
+  k.divideByValue(&out[0], sigma, &out[0], count);
+  k.multiplyByValue(v + period, (double)period, r + period, count);
+  k.divideByValue(r + period, sigma, r + period, count);
+  for (size_t n = period; n < size; n++)
+    r[n] = r[n - 1] - out[n - period] + r[n];
+}
+
+// van Herk/Gil-Werman: with the values split in blocks of period values, the
+// window ending at n is made of the end of the block of its first value and
+// the start of the block of n, so its min is the min of the suffix min and the
+// prefix min of the two blocks
+template <class Op>
+void rolling(const double* v, size_t size, unsigned int period,
+             SeriesKernels::SeriesOp SeriesKernels::*kernel, double* r) {
+  assert(period > 1 && period <= size);
+
+  std::vector<double> prefix(size);
+  std::vector<double> suffix(size);
+  for (size_t start = 0; start < size; start += period) {
+    size_t end = min2<size_t>(start + period, size);
+
+    prefix[start] = v[start];
+    for (size_t n = start + 1; n < end; n++)
+      prefix[n] = Op::scalar(v[n], prefix[n - 1]);
+
+    suffix[end - 1] = v[end - 1];
+    for (size_t n = end - 1; n > start; n--)
+      suffix[n - 1] = Op::scalar(v[n - 1], suffix[n]);
+  }
+
+  const SeriesKernels& k = SeriesKernels::get();
+  (k.*kernel)(&suffix[0], &prefix[period - 1], r + period - 1,
+                  size - period + 1);
+}
+
+void SeriesKernels::rollingMin(const double* v, size_t size,
+                               unsigned int period, double* r) {
+  rolling<MinOp>(v, size, period, &SeriesKernels::min, r);
+}
+
+void SeriesKernels::rollingMax(const double* v, size_t size,
+                               unsigned int period, double* r) {
+  rolling<MaxOp>(v, size, period, &SeriesKernels::max, r);
+}
+
+// same summation order as TA_INT_VAR, which TA_STDDEV is built on
+void SeriesKernels::stdDev(const double* v, size_t size, unsigned int period,
+                           double nbDev, double* r) {
+  assert(period > 1 && period <= size);
+
+  const size_t count = size - period + 1;
+  std::vector<double> total1(count);
+  std::vector<double> total2(count);
+
+  double periodTotal1 = 0;
+  double periodTotal2 = 0;
+  for (unsigned int n = 0; n < period - 1; n++) {
+    periodTotal1 += v[n];
+    periodTotal2 += v[n] * v[n];
+  }
+  for (size_t n = 0; n < count; n++) {
+    double x = v[n + period - 1];
+    periodTotal1 += x;
+    periodTotal2 += x * x;
+    total1[n] = periodTotal1;
+    total2[n] = periodTotal2;
+    periodTotal1 -= v[n];
+    periodTotal2 -= v[n] * v[n];
+  }
+
+  // variance = mean2 - mean1 * mean1
+  const SeriesKernels& k = get();
+  double* out = r + period - 1;
+  k.divideByValue(&total1[0], (double)period, &total1[0], count);
+  k.divideByValue(&total2[0], (double)period, &total2[0], count);
+  k.multiply(&total1[0], &total1[0], &total1[0], count);
+  k.subtract(&total2[0], &total1[0], out, count);
+  k.stdDevFromVariance(out, nbDev, out, count);
+}
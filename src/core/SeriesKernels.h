@@ -0,0 +1,115 @@
+/*
+Copyright (C) 2018 Adrian Michel
+http://www.amichel.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+/**
+ * Vectorized loops over the values of series
+ *
+ * The elementwise kernels have an AVX-512, an AVX2 and a plain C++ version,
+ * and the best one supported by the processor and the operating system is
+ * selected the first time the kernels are used. All versions give the exact
+ * same results, as each element goes through the same IEEE operations, only
+ * several elements at a time.
+ *
+ * The moving averages and rolling statistics are split in a serial part, the
+ * running sums, which can't be reordered without changing the rounding, and
+ * elementwise parts done with the kernels. They give the same results, bit
+ * for bit, as the loops and TA-Lib functions they replace, with these
+ * documented exceptions:
+ * - rollingMin and rollingMax may return -0.0 instead of 0.0, or the reverse,
+ * when both are in the window, and return a different value than TA_MIN and
+ * TA_MAX when the window contains a NaN
+ *
+ * All the functions work on the values of unsynchronized series. The output of
+ * the elementwise kernels may be the same array as one of their inputs.
+ */
+class SeriesKernels {
+ public:
+  // r[n] = x[n] op y[n]
+  typedef void (*SeriesOp)(const double* x, const double* y, double* r,
+                           size_t size);
+  // r[n] = x[n] op value
+  typedef void (*ValueOp)(const double* x, double value, double* r,
+                          size_t size);
+
+  // the instruction set of the selected kernels
+  const char* name;
+
+  SeriesOp add;
+  SeriesOp subtract;
+  SeriesOp multiply;
+  SeriesOp divide;
+  SeriesOp min;
+  SeriesOp max;
+
+  ValueOp addValue;
+  ValueOp subtractValue;
+  ValueOp multiplyByValue;
+  ValueOp divideByValue;
+  // r[n] = value - x[n]
+  ValueOp subtractFromValue;
+  // r[n] = value / x[n]
+  ValueOp divideValueBy;
+  // r[n] = sqrt(x[n]) * value, or 0 if x[n] is 0 or negative, as TA_STDDEV
+  ValueOp stdDevFromVariance;
+
+ public:
+  /**
+   * Returns the kernels for the instruction sets supported by the processor
+   */
+  static const SeriesKernels& get();
+  /**
+   * Returns all the kernels supported by the processor, from the plain C++
+   * ones to those returned by get, to compare them with each other
+   */
+  static std::vector<const SeriesKernels*> supported();
+
+  /**
+   * Simple moving average, from index period - 1. Requires
+   * 0 < period < size
+   */
+  static void sma(const double* v, size_t size, unsigned int period,
+                  double* r);
+  /**
+   * Exponential moving average, starting with the simple moving average at
+   * index period - 1. Requires 0 < period < size
+   */
+  static void ema(const double* v, size_t size, unsigned int period,
+                  double exp, double* r);
+  /**
+   * Weighted moving average, from index period - 1, updated from the simple
+   * moving average of the same period. Requires 0 < period < size
+   */
+  static void wma(const double* v, const double* sma, size_t size,
+                  unsigned int period, double* r);
+  /**
+   * Rolling min and max, from index period - 1, same as TA_MIN and TA_MAX.
+   * Requires 1 < period <= size
+   */
+  static void rollingMin(const double* v, size_t size, unsigned int period,
+                         double* r);
+  static void rollingMax(const double* v, size_t size, unsigned int period,
+                         double* r);
+  /**
+   * Rolling standard deviation, from index period - 1, same as TA_STDDEV.
+   * Requires 1 < period <= size
+   */
+  static void stdDev(const double* v, size_t size, unsigned int period,
+                     double nbDev, double* r);
+};
@@ -118,12 +118,54 @@ void StatsCalculator::calculate(
     const PositionEqualPredicate& positionPredicate) {
   reset();
   positions.forEach(*this, positionPredicate);
+  sumAllPosStats();
 }
 
 void StatsCalculator::calculateAll(PositionsContainer& positions) {
   //  COUT << std::endl;
   reset();
   positions.forEach(*this);
+  sumAllPosStats();
+}
+
+namespace tradery {
+// sends each position to the stats of all the positions, and to the stats of
+// the long or of the short ones
+class StatsGroupsHandler : public PositionHandler {
+ private:
+  StatsCalculator& _allStats;
+  StatsCalculator& _longStats;
+  StatsCalculator& _shortStats;
+
+ public:
+  StatsGroupsHandler(StatsCalculator& allStats, StatsCalculator& longStats,
+                     StatsCalculator& shortStats)
+      : _allStats(allStats), _longStats(longStats), _shortStats(shortStats) {}
+
+  virtual void onPosition(tradery::Position pos) {
+    _allStats.onPosition(pos);
+    if (pos.isLong())
+      _longStats.onPosition(pos);
+    else
+      _shortStats.onPosition(pos);
+  }
+};
+}  // namespace tradery
+
+void StatsCalculator::calculateGroups(PositionsContainer& positions,
+                                      StatsCalculator& allStats,
+                                      StatsCalculator& longStats,
+                                      StatsCalculator& shortStats) {
+  allStats.reset();
+  longStats.reset();
+  shortStats.reset();
+
+  StatsGroupsHandler handler(allStats, longStats, shortStats);
+  positions.forEach(handler);
+
+  allStats.sumAllPosStats();
+  longStats.sumAllPosStats();
+  shortStats.sumAllPosStats();
 }
 
 void StatsCalculator::calculateLong(PositionsContainer& positions) {
@@ -139,7 +181,9 @@ void StatsCalculator::onPosition(tradery::Position pos) {
     _closedPosStats.onPosition(pos);
   else
     _openPosStats.onPosition(pos, _cpr);
+}
 
+void StatsCalculator::sumAllPosStats() {
   _allPosStats = _openPosStats + _closedPosStats;
 }
 
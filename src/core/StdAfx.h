@@ -43,6 +43,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <vector>
 #include <string>
 #include <list>
+#include <deque>
 #include <queue>
 #include <assert.h>
 #include <set>
@@ -57,6 +58,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <functional>
 #include <float.h>
 #include <math.h>
+#include <future>
+#include <atomic>
 
 // C includes
 #include <assert.h>
@@ -65,6 +68,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma warning(disable : 4275)
 #include <boost/thread.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/functional/hash.hpp>
 #pragma warning(default : 4275)
 
 // TA-LIB includes
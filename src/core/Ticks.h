@@ -32,10 +32,10 @@ class TicksImpl : public Ticks, public Ideable {
   TicksImpl(const std::string& dataSourceName, const std::string& symbol,
             const Range* range)
       : Ticks(symbol),
-        Ideable(dataSourceName + " - ticks - " + symbol +
-                (range == 0 ? "" : " - range: " + range->getId())),
-        _price(new SeriesImpl(getId() + " - tick price - ")),
-        _size(new SeriesImpl(getId() + " - tick size - ")),
+        Ideable(Id("ticks") << dataSourceName << symbol
+                            << (range == 0 ? std::string() : range->getId())),
+        _price(new SeriesImpl(Id("tick price") << getId())),
+        _size(new SeriesImpl(Id("tick size") << getId())),
         _type(new TickTypeSeries()),
         _exchange(new ExchangeSeries()) {}
 
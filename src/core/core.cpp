@@ -81,8 +81,10 @@ PositionsContainer* create(const PositionsContainer* pc) {
   return new PositionsContainerImpl(pc);
 }
 
-DataManager* DataManager::create(unsigned int cacheSize) {
-  return new DataManagerImpl(cacheSize);
+DataManager* DataManager::create(unsigned int cacheSize,
+                                 unsigned __int64 cacheMemory,
+                                 CachePolicy cachePolicy) {
+  return new DataManagerImpl(cacheSize, cacheMemory, cachePolicy);
 }
 
 BarsPtr tradery::createBars(const std::string& dataSourceName,
@@ -207,15 +209,46 @@ const char* Signal::signalTypeAsString(SignalType type) {
 
 extern SeriesCache* _cache;
 
-CORE_API void tradery::init(unsigned int cacheSize) {
-  // the data cache is disabled for now
-  _cache = new SeriesCache(100, false);
-  _dataManager = new DataManagerImpl(cacheSize);
+CORE_API void tradery::init(unsigned int cacheSize,
+                            unsigned __int64 cacheMemory,
+                            CachePolicy cachePolicy, bool seriesCache) {
+  _cache = new SeriesCache(100, seriesCache, cacheMemory, cachePolicy);
+  _dataManager = new DataManagerImpl(cacheSize, cacheMemory, cachePolicy);
 }
 
 CORE_API void tradery::uninit() {
+  CacheStats series = _cache->stats();
+  CacheStats data = _dataManager->cacheStats();
+  LOG(log_info, "series cache - hits: " << series.hits << ", misses: "
+                                        << series.misses << ", evictions: "
+                                        << series.evictions);
+  LOG(log_info, "data cache - hits: " << data.hits << ", misses: "
+                                      << data.misses << ", evictions: "
+                                      << data.evictions);
   delete _cache;
   delete _dataManager;
+  delete _threadPool;
+  _threadPool = 0;
+  Log::shutdown();
+}
+
+CORE_API void tradery::startThreadPool(unsigned int threads,
+                                       ThreadPlacement placement) {
+  assert(_threadPool == 0);
+  _threadPool = new ThreadPool(threads, placement);
+  LOG(log_info, "thread pool started with "
+                    << _threadPool->threads() << " threads on "
+                    << _threadPool->nodes() << " nodes");
+}
+
+CORE_API void tradery::setDataPrefetch(size_t window, unsigned int threads) {
+  _prefetchWindow = window;
+  _prefetchThreads = threads;
+}
+
+CORE_API CacheStats tradery::getSeriesCacheStats() {
+  assert(_cache != 0);
+  return _cache->stats();
 }
 
 extern DataManager* _dataManager;
@@ -241,6 +274,11 @@ CORE_API void tradery::setDataCacheSize(unsigned int cacheSize) {
   _dataManager->setCacheSize(cacheSize);
 }
 
+CORE_API CacheStats tradery::getDataCacheStats() {
+  assert(_dataManager != 0);
+  return _dataManager->cacheStats();
+}
+
 CORE_API void Session::run(bool asynch, unsigned int threads, bool cpuAffinity,
                            DateTimeRangePtr range,
                            DateTime startTradesDateTime) {
@@ -81,8 +81,25 @@ class SymbolsIteratorImpl : public tradery::SymbolsIterator {
     Lock lock(_mutex);
     return _i != _end;
   }
+
+  virtual std::vector<SymbolConstPtr> getAll() {
+    Lock lock(_mutex);
+    std::vector<SymbolConstPtr> symbols;
+    symbols.reserve(_sls.size());
+    for (SymbolsSource::const_iterator i = _sls.begin(); i != _end; ++i)
+      symbols.push_back(_sls.makeSymbol(i));
+    return symbols;
+  }
 };
 
+std::vector<SymbolConstPtr> tradery::SymbolsIterator::getAll() {
+  std::vector<SymbolConstPtr> symbols;
+  for (SymbolConstPtr symbol(getFirst()); symbol; symbol = getNext())
+    symbols.push_back(symbol);
+  reset();
+  return symbols;
+}
+
 tradery::SymbolsIterator* tradery::SymbolsSource::makeIterator() {
   SymbolsIterator* i = new SymbolsIteratorImpl(*this);
   _iterators.push_back(i);
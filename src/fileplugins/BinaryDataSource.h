@@ -0,0 +1,448 @@
+/*
+Copyright (C) 2018 Adrian Michel
+http://www.amichel.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <functional>
+#include "datasource.h"
+
+#define BINARY_BARS_EXTENSION "tbars"
+#define BINARY_BARS_MAGIC "TRDBARS"
+#define BINARY_BARS_VERSION 1
+// number of bars in each block of the date index
+#define BINARY_BARS_BLOCK_SIZE 1024
+// number of mutexes the symbols are spread over during conversion
+#define BINARY_BARS_CONVERSION_MUTEXES 64
+
+/**
+ * Header of a binary bars file
+ *
+ * A binary bars file holds all the bars of one symbol in columns, so they can
+ * be loaded without any parsing. The file is laid out as:
+ * - the header
+ * - the date index: the time of the first bar of each block of blockSize bars
+ * - the time column, in seconds since the epoch
+ * - the open, high, low and close columns, as doubles
+ * - the volume and open interest columns, as 32 bit unsigned integers
+ *
+ * The values are stored in the native (little endian) format, and the header
+ * and the 64 bit columns keep their natural alignment.
+ */
+class BinaryBarsHeader {
+ public:
+  char magic[8];
+  unsigned __int32 version;
+  unsigned __int32 blockSize;
+  unsigned __int64 count;
+  unsigned __int64 blockCount;
+
+ public:
+  BinaryBarsHeader(unsigned __int64 count = 0,
+                   unsigned __int32 blockSize = BINARY_BARS_BLOCK_SIZE)
+      : version(BINARY_BARS_VERSION),
+        blockSize(blockSize),
+        count(count),
+        blockCount((count + blockSize - 1) / blockSize) {
+    memset(magic, 0, sizeof(magic));
+    strcpy(magic, BINARY_BARS_MAGIC);
+  }
+
+  /**
+   * The size of a file with this header
+   */
+  unsigned __int64 fileSize() const {
+    return sizeof(BinaryBarsHeader) + blockCount * sizeof(__int64) +
+           count * (sizeof(__int64) + 4 * sizeof(double) +
+                    2 * sizeof(unsigned __int32));
+  }
+
+  bool isValid(unsigned __int64 size) const {
+    return strncmp(magic, BINARY_BARS_MAGIC, sizeof(magic)) == 0 &&
+           version == BINARY_BARS_VERSION && blockSize > 0 &&
+           blockCount == (count + blockSize - 1) / blockSize &&
+           fileSize() == size;
+  }
+};
+
+class BinaryBarsException {
+ private:
+  const std::string _message;
+
+ public:
+  BinaryBarsException(const std::string& message) : _message(message) {}
+
+  const std::string& message() const { return _message; }
+};
+
+/**
+ * A binary bars file, mapped in memory
+ *
+ * The columns are accessed in place, and bars for a date range are located
+ * with the date index, without looking at the other bars
+ */
+class BinaryBarsFile {
+ private:
+  MappedFile _file;
+  const BinaryBarsHeader* _header;
+  const __int64* _index;
+  const __int64* _time;
+  const double* _open;
+  const double* _high;
+  const double* _low;
+  const double* _close;
+  const unsigned __int32* _volume;
+  const unsigned __int32* _openInterest;
+
+ public:
+  BinaryBarsFile(const std::string& fileName)
+      : _file(fileName),
+        _header(0),
+        _index(0),
+        _time(0),
+        _open(0),
+        _high(0),
+        _low(0),
+        _close(0),
+        _volume(0),
+        _openInterest(0) {
+    if (!_file || _file.size() < sizeof(BinaryBarsHeader))
+      throw BinaryBarsException("Could not open binary bars file " + fileName);
+
+    const BinaryBarsHeader* header =
+        reinterpret_cast<const BinaryBarsHeader*>(_file.begin());
+    if (!header->isValid(_file.size()))
+      throw BinaryBarsException("Invalid binary bars file " + fileName);
+
+    size_t count = (size_t)header->count;
+    _header = header;
+    _index = reinterpret_cast<const __int64*>(header + 1);
+    _time = _index + header->blockCount;
+    _open = reinterpret_cast<const double*>(_time + count);
+    _high = _open + count;
+    _low = _high + count;
+    _close = _low + count;
+    _volume = reinterpret_cast<const unsigned __int32*>(_close + count);
+    _openInterest = _volume + count;
+  }
+
+  size_t size() const { return (size_t)_header->count; }
+
+  /**
+   * Finds the first bar at or after a time
+   *
+   * @param time   time in seconds since the epoch
+   * @return the index of the bar, or size() if all the bars are before time
+   */
+  size_t lowerBound(__int64 time) const {
+    // the last block that starts at or before time
+    const __int64* block =
+        std::upper_bound(_index, _index + _header->blockCount, time);
+    size_t first = block == _index ? 0
+                                   : (size_t)(block - _index - 1) *
+                                         _header->blockSize;
+    size_t last = min2<size_t>(first + _header->blockSize, size());
+
+    return std::lower_bound(_time + first, _time + last, time) - _time;
+  }
+
+  __int64 time(size_t index) const { return _time[index]; }
+
+  const Bar bar(size_t index) const {
+    return Bar(DateTime(_time[index]), _open[index], _high[index], _low[index],
+               _close[index], _volume[index], _openInterest[index]);
+  }
+
+  /**
+   * Copies the bars from first up to, but not including, last, to columns
+   */
+  void columns(size_t first, size_t last, BarColumns& columns) const {
+    assert(first <= last && last <= size());
+    columns.time.reserve(last - first);
+    for (size_t n = first; n < last; n++)
+      columns.time.push_back(DateTime(_time[n]));
+    columns.open.assign(_open + first, _open + last);
+    columns.high.assign(_high + first, _high + last);
+    columns.low.assign(_low + first, _low + last);
+    columns.close.assign(_close + first, _close + last);
+    columns.volume.assign(_volume + first, _volume + last);
+    columns.openInterest.assign(_openInterest + first, _openInterest + last);
+  }
+};
+
+/**
+ * Writes bars to a binary bars file
+ *
+ * The file is written under a temporary name, unique to the process and
+ * thread, and then renamed, so readers never see a partial file, and writers
+ * in other processes don't write over each other's files
+ *
+ * @param fileName the binary file name
+ * @param bars     the bars to write
+ */
+inline void writeBinaryBars(const std::string& fileName,
+                            const BarsBase& bars) throw(BinaryBarsException) {
+  size_t count = bars.size();
+  BinaryBarsHeader header(count);
+
+  std::vector<__int64> time(count);
+  for (size_t n = 0; n < count; n++) time[n] = bars.time(n).to_epoch_time();
+
+  std::vector<__int64> index((size_t)header.blockCount);
+  for (size_t n = 0; n < index.size(); n++)
+    index[n] = time[n * header.blockSize];
+
+  std::vector<double> values(count);
+  std::vector<unsigned __int32> ints(count);
+
+  std::ostringstream tmp;
+  tmp << fileName << "." << GetCurrentProcessId() << "." << GetCurrentThreadId()
+      << ".tmp";
+  std::string tmpFileName(tmp.str());
+  {
+    std::ofstream file(tmpFileName.c_str(), ios_base::out | ios_base::binary |
+                                                ios_base::trunc);
+    if (!file)
+      throw BinaryBarsException("Could not create binary bars file " +
+                                tmpFileName);
+
+    file.write((const char*)&header, sizeof(header));
+    if (count > 0) {
+      file.write((const char*)&index[0], index.size() * sizeof(__int64));
+      file.write((const char*)&time[0], count * sizeof(__int64));
+
+      for (size_t n = 0; n < count; n++) values[n] = bars.open(n);
+      file.write((const char*)&values[0], count * sizeof(double));
+      for (size_t n = 0; n < count; n++) values[n] = bars.high(n);
+      file.write((const char*)&values[0], count * sizeof(double));
+      for (size_t n = 0; n < count; n++) values[n] = bars.low(n);
+      file.write((const char*)&values[0], count * sizeof(double));
+      for (size_t n = 0; n < count; n++) values[n] = bars.close(n);
+      file.write((const char*)&values[0], count * sizeof(double));
+
+      for (size_t n = 0; n < count; n++) ints[n] = bars.volume(n);
+      file.write((const char*)&ints[0], count * sizeof(unsigned __int32));
+      for (size_t n = 0; n < count; n++) ints[n] = bars.openInterest(n);
+      file.write((const char*)&ints[0], count * sizeof(unsigned __int32));
+    }
+
+    if (!file) {
+      file.close();
+      DeleteFile(s2ws(tmpFileName).c_str());
+      throw BinaryBarsException("Could not write binary bars file " +
+                                tmpFileName);
+    }
+  }
+
+  if (!MoveFileEx(s2ws(tmpFileName).c_str(), s2ws(fileName).c_str(),
+                  MOVEFILE_REPLACE_EXISTING)) {
+    DeleteFile(s2ws(tmpFileName).c_str());
+    throw BinaryBarsException("Could not rename binary bars file " +
+                              tmpFileName);
+  }
+}
+
+// gets the last write time of a file, returns false if the file doesn't
+// exist
+inline bool getLastWriteTime(const std::string& fileName, FILETIME& time) {
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  if (!GetFileAttributesEx(s2ws(fileName).c_str(), GetFileExInfoStandard,
+                           &data))
+    return false;
+
+  time = data.ftLastWriteTime;
+  return true;
+}
+
+/**
+ * Binary data source - loads bars from binary bars files
+ *
+ * Each symbol has its own binary file, in the same location as the text data
+ * file for that symbol, with the extension BINARY_BARS_EXTENSION. The binary
+ * files are made from the text files with a FileDataSource the first time a
+ * symbol is requested, and again whenever the text file changes, so the text
+ * is only parsed once.
+ *
+ * @see FileDataSource
+ * @see BinaryBarsHeader
+ */
+class BinaryDataSource : public tradery::DataSource {
+ private:
+  const std::string _path;
+  const bool _flatData;
+  const ErrorHandlingMode _errorHandlingMode;
+  // converts the text data files
+  std::auto_ptr<FileDataSource> _textDataSource;
+
+  // a symbol is converted by one thread at a time. The symbols are spread
+  // over a fixed number of mutexes, so there is nothing to clean up
+  mutable Mutex _conversionMutexes[BINARY_BARS_CONVERSION_MUTEXES];
+
+ private:
+  std::string binaryFileName(const std::string& symbol) const {
+    return FileName(_flatData).makePath(
+        _path, symbol, addExtension(symbol, BINARY_BARS_EXTENSION));
+  }
+
+  std::string textFileName(const std::string& symbol) const {
+    return FileName(_flatData).makePath(
+        _path, symbol, addExtension(symbol, _textDataSource->extension()));
+  }
+
+  // true if the binary file is missing, or older than the text file
+  bool isStale(const std::string& symbol) const {
+    FILETIME binaryTime;
+    FILETIME textTime;
+
+    if (!getLastWriteTime(binaryFileName(symbol), binaryTime)) return true;
+
+    return getLastWriteTime(textFileName(symbol), textTime) &&
+           CompareFileTime(&textTime, &binaryTime) > 0;
+  }
+
+  std::string getFileStamp(const std::string& fileName) const {
+    FILETIME time;
+    if (!getLastWriteTime(fileName, time)) return std::string();
+
+    std::ostringstream o;
+    o << time.dwHighDateTime << time.dwLowDateTime;
+    return o.str();
+  }
+
+  Mutex& conversionMutex(const std::string& symbol) const {
+    return _conversionMutexes[std::hash<std::string>()(symbol) %
+                              BINARY_BARS_CONVERSION_MUTEXES];
+  }
+
+  // (re)makes the binary file from the text file
+  void convert(const DataInfo* dataInfo) const throw(DataSourceException) {
+    const std::string& symbol(dataInfo->symbol().symbol());
+    DataXPtr data(_textDataSource->getData(dataInfo, DateTimeRangePtr()));
+    assert(data);
+
+    try {
+      writeBinaryBars(binaryFileName(symbol), *data->getDataCollection());
+    } catch (const BinaryBarsException& e) {
+      throw DataSourceException(DATA_SOURCE_ERROR, e.message(), name());
+    }
+  }
+
+ public:
+  /**
+   * @param info   data source info
+   * @param path   the data path, same as for the text data source
+   * @param textDataSource
+   *               the text data source used to make the binary files, the
+   *               binary data source takes ownership of it
+   * @param flatData
+   *               true if all the data files are in the path directory
+   * @param errorHandlingMode
+   */
+  BinaryDataSource(const Info& info, const std::string& path,
+                   FileDataSource* textDataSource, bool flatData = true,
+                   ErrorHandlingMode errorHandlingMode = fatal)
+      : DataSource(info),
+        _path(path),
+        _flatData(flatData),
+        _errorHandlingMode(errorHandlingMode),
+        _textDataSource(textDataSource) {
+    assert(textDataSource != 0);
+  }
+
+  virtual ~BinaryDataSource() {}
+
+  /**
+   * Makes the binary file of a symbol from its text file, if the binary file
+   * is missing or older than the text file
+   *
+   * @param dataInfo the symbol
+   * @return true if the binary file was made
+   * @exception DataSourceException
+   *                   if the text file can't be loaded or the binary file
+   *                   can't be written
+   */
+  bool update(const DataInfo* dataInfo) const throw(DataSourceException) {
+    assert(dataInfo != 0);
+
+    const std::string& symbol(dataInfo->symbol().symbol());
+    if (!isStale(symbol)) return false;
+
+    Lock lock(conversionMutex(symbol));
+    // another thread may have converted it while this one was waiting
+    if (!isStale(symbol)) return false;
+
+    convert(dataInfo);
+    return true;
+  }
+
+  virtual DataXPtr getData(const DataInfo* dataInfo,
+                           DateTimeRangePtr range) const
+      throw(DataSourceException) {
+    assert(dataInfo != 0);
+
+    const std::string& symbol(dataInfo->symbol().symbol());
+    update(dataInfo);
+
+    std::string fileName(binaryFileName(symbol));
+    try {
+      BinaryBarsFile file(fileName);
+
+      BarsPtr bars = tradery::createBars(name(), symbol,
+                                         tradery::BarsAbstr::Type::stock,
+                                         24 * 3600, range, _errorHandlingMode);
+
+      size_t start = 0;
+      if (range && !range->from().isNegInfinity())
+        start = file.lowerBound(range->from().to_epoch_time());
+
+      // the first bar after the range
+      size_t end = file.size();
+      if (range && !range->to().isPosInfinity())
+        end = max2(start, file.lowerBound(range->to().to_epoch_time() + 1));
+
+      BarColumns columns;
+      file.columns(start, end, columns);
+      BarColumnsAddable* addable = dynamic_cast<BarColumnsAddable*>(bars.get());
+      if (addable != 0)
+        addable->addColumns(columns);
+      else
+        for (size_t n = 0; n < columns.size(); n++) bars->add(columns.bar(n));
+
+      return DataXPtr(new DataX(bars, getFileStamp(fileName)));
+    } catch (const BinaryBarsException& e) {
+      throw DataSourceException(DATA_SOURCE_ERROR, e.message(), name());
+    } catch (const BarException&) {
+      // retthrow bar exception, it will be caught in scheduler
+      throw;
+    } catch (...) {
+      throw DataSourceException(DATA_SOURCE_FORMAT_ERROR, symbol, name());
+    }
+  }
+
+  virtual bool isConsistent(const std::string& stamp, const Symbol& symbol,
+                            DateTimeRangePtr range) const
+      throw(DataSourceException) {
+    return !isStale(symbol.symbol()) &&
+           getFileStamp(binaryFileName(symbol.symbol())) == stamp;
+  }
+
+  virtual unsigned __int64 dataSizeHint(const DataInfo* dataInfo) const {
+    return _textDataSource->dataSizeHint(dataInfo);
+  }
+
+  const std::string& dataPath() const { return _path; }
+};
@@ -44,6 +44,310 @@ class TimeException {
 
 class DataFileException {};
 
+/**
+ * Scans the fields of a data file line in place
+ *
+ * Fields are separated by any number of separator characters, as with
+ * Tokenizer, and blanks around the fields are ignored. The numbers are parsed
+ * straight from the line, which doesn't have to be null terminated, so the
+ * fields are never copied into strings.
+ */
+class FieldScanner {
+ private:
+  const char* _p;
+  const char* const _begin;
+  const char* const _end;
+  const char* const _separators;
+
+  bool isSeparator(char c) const {
+    return c != 0 && strchr(_separators, c) != 0;
+  }
+
+  static bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+  static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+  // falls back on strtod for the numbers that can't be parsed exactly by
+  // getDouble, such as the ones with exponents or many digits
+  double slowDouble(const char* start) {
+    skipField();
+    char buf[64];
+    size_t n = min2<size_t>(_p - start, sizeof(buf) - 1);
+    memcpy(buf, start, n);
+    buf[n] = 0;
+    char* p;
+    return strtod(buf, &p);
+  }
+
+ public:
+  FieldScanner(const char* begin, const char* end, const char* separators)
+      : _p(begin), _begin(begin), _end(end), _separators(separators) {}
+
+  /**
+   * Skips to the start of the next field
+   */
+  void next() {
+    while (_p < _end && (isSeparator(*_p) || isBlank(*_p))) _p++;
+  }
+
+  /**
+   * Skips whatever is left of the current field
+   */
+  void skipField() {
+    while (_p < _end && !isSeparator(*_p) && !isBlank(*_p)) _p++;
+  }
+
+  const char* position() const { return _p; }
+
+  /**
+   * Comment lines start with $, # or //, same as in
+   * FileDataSource::isCommentLine
+   */
+  bool isEmptyOrComment() const {
+    if (_begin == _end || *_begin == '$' || *_begin == '#' ||
+        (_end - _begin > 1 && _begin[0] == '/' && _begin[1] == '/'))
+      return true;
+
+    for (const char* p = _begin; p < _end; p++)
+      if (!isBlank(*p)) return false;
+    return true;
+  }
+
+  /**
+   * Parses an unsigned integer at the current position
+   *
+   * @param value  the parsed value
+   * @param maxDigits
+   *               stops after this number of digits
+   * @return the number of digits parsed, 0 if there is no number at the
+   *         current position
+   */
+  size_t parseUInt(unsigned int& value, size_t maxDigits = 9) {
+    size_t n = 0;
+    for (value = 0; n < maxDigits && _p < _end && isDigit(*_p); _p++, n++)
+      value = value * 10 + (*_p - '0');
+    return n;
+  }
+
+  /**
+   * Consumes the character at the current position, if it is one of chars
+   */
+  bool accept(const char* chars) {
+    if (_p < _end && *_p != 0 && strchr(chars, *_p) != 0) {
+      _p++;
+      return true;
+    } else
+      return false;
+  }
+
+  /**
+   * Parses the next field as a double, with the same result as strtod
+   *
+   * Numbers with up to 15 significant digits and no exponent, which covers
+   * prices in data files, are parsed exactly without calling strtod.
+   * Anything after the number in the field is ignored, and a field that
+   * doesn't start with a number is 0, same as with strtod.
+   */
+  double getDouble() {
+    static const double pow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                   1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                   1e18, 1e19, 1e20, 1e21, 1e22};
+
+    next();
+    const char* start = _p;
+
+    bool negative = false;
+    if (_p < _end && (*_p == '-' || *_p == '+')) negative = *_p++ == '-';
+
+    unsigned __int64 mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+
+    for (; _p < _end && isDigit(*_p); _p++) {
+      mantissa = mantissa * 10 + (*_p - '0');
+      if (mantissa > 0 && ++digits > 15) return slowDouble(start);
+    }
+
+    if (_p < _end && *_p == '.') {
+      for (_p++; _p < _end && isDigit(*_p); _p++, exponent--) {
+        mantissa = mantissa * 10 + (*_p - '0');
+        if (mantissa > 0 && ++digits > 15) return slowDouble(start);
+      }
+    }
+
+    if ((_p < _end && (*_p == 'e' || *_p == 'E')) || exponent < -22)
+      return slowDouble(start);
+
+    skipField();
+    // both the mantissa and the power of 10 are exact, so the division is
+    // correctly rounded
+    double value = mantissa / pow10[-exponent];
+    return negative ? -value : value;
+  }
+
+  /**
+   * Parses the next field as an integer, with the same result as atol
+   */
+  unsigned long getULong() {
+    next();
+    bool negative = false;
+    if (_p < _end && (*_p == '-' || *_p == '+')) negative = *_p++ == '-';
+
+    long value = 0;
+    for (; _p < _end && isDigit(*_p); _p++) value = value * 10 + (*_p - '0');
+
+    skipField();
+    return negative ? -value : value;
+  }
+
+  /**
+   * The text from start to the current position, used in error messages
+   */
+  std::string text(const char* start) const { return std::string(start, _p); }
+};
+
+/**
+ * The fields of a bar, as parsed from a data file line
+ */
+class BarFields {
+ public:
+  DateTime time;
+  double open;
+  double high;
+  double low;
+  double close;
+  unsigned long volume;
+
+  BarFields() : open(0), high(0), low(0), close(0), volume(0) {}
+};
+
+/**
+ * A date, as parsed from a data file line
+ */
+class DateFields {
+ public:
+  unsigned int year;
+  unsigned int month;
+  unsigned int day;
+
+  DateFields(unsigned int year, unsigned int month, unsigned int day)
+      : year(year), month(month), day(day) {}
+
+  /**
+   * The time at hours:mins:secs on the date, made directly from the parts
+   */
+  DateTime time(unsigned int hours = 0, unsigned int mins = 0,
+                unsigned int secs = 0) const {
+    return DateTime::fromParts(year, month, day, hours, mins, secs);
+  }
+};
+
+/**
+ * Makes a date from its 3 numeric parts, in the order given by the format
+ *
+ * Same rules and errors as the Date constructor that parses a string. The
+ * text is only copied for the error messages
+ *
+ * @param begin  the start of the date as it appears in the file
+ * @param end    the end of the date as it appears in the file
+ */
+inline DateFields makeDate(DateFormat format, unsigned int first,
+                           unsigned int second, unsigned int third,
+                           const char* begin,
+                           const char* end) throw(DateException) {
+  static const unsigned int days[] = {31, 28, 31, 30, 31, 30,
+                                      31, 31, 30, 31, 30, 31};
+  unsigned int year;
+  unsigned int month;
+  unsigned int day;
+
+  switch (format) {
+    case us:
+      year = third;
+      month = first;
+      day = second;
+      break;
+    case european:
+      year = third;
+      month = second;
+      day = first;
+      break;
+    case iso:
+      year = first;
+      month = second;
+      day = third;
+      break;
+    default:
+      throw DateException(std::string(begin, end), "Unknown format type");
+      break;
+  }
+
+  year = year < 50 ? year + 2000 : (year < 100 ? year + 1900 : year);
+
+  if (year < 1800 || year > 2100)
+    throw DateException(
+        std::string(begin, end),
+        "Year must be an integer value between 1800 and 2100");
+
+  if (month < 1 || month > 12)
+    throw DateException(std::string(begin, end),
+                        "Month must be an integer value between 1 and 12");
+
+  if (day < 1 || day > 31)
+    throw DateException(std::string(begin, end),
+                        "Day must be an integer value between 1 and 31");
+
+  bool leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+  if (day > days[month - 1] + (month == 2 && leap ? 1 : 0))
+    throw DateException(std::string(begin, end),
+                        "Day must exist in the month");
+
+  return DateFields(year, month, day);
+}
+
+/**
+ * Parses the next field as a date, either with its 3 parts separated by / or
+ * -, or packed as 6 (yymmdd...) or 8 (yyyymmdd, mmddyyyy...) digits
+ */
+inline DateFields scanDate(FieldScanner& fields,
+                           DateFormat format) throw(DateException) {
+  fields.next();
+  const char* start = fields.position();
+
+  unsigned int first;
+  unsigned int second;
+  unsigned int third;
+
+  size_t n = fields.parseUInt(first);
+  if (n > 0 && fields.accept(DEF_DATE_SEP)) {
+    if (fields.parseUInt(second) == 0 || !fields.accept(DEF_DATE_SEP) ||
+        fields.parseUInt(third) == 0)
+      throw DateException(fields.text(start),
+                          tradery::format("Invalid date: \"%1%\"",
+                                          fields.text(start)));
+  } else if (n == 6 || (n == 8 && format == iso)) {
+    unsigned int packed = first;
+    first = packed / 10000;
+    second = packed / 100 % 100;
+    third = packed % 100;
+  } else if (n == 8) {
+    unsigned int packed = first;
+    first = packed / 1000000;
+    second = packed / 10000 % 100;
+    third = packed % 10000;
+  } else {
+    fields.skipField();
+    throw DateException(fields.text(start),
+                        tradery::format("Invalid date: \"%1%\"",
+                                        fields.text(start)));
+  }
+
+  DateFields date(
+      makeDate(format, first, second, third, start, fields.position()));
+  fields.skipField();
+  return date;
+}
+
 inline bool is_nl(std::ifstream::char_type c) {
   return c == TCHAR('\n') || c == TCHAR('\r');
 }
@@ -53,6 +357,16 @@ inline __int64 fileSize(std::istream& file) {
   return file.tellg();
 }
 
+// returns 0 if the file doesn't exist
+inline unsigned __int64 fileSize(const std::string& fileName) {
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  if (!GetFileAttributesEx(s2ws(fileName).c_str(), GetFileExInfoStandard,
+                           &data))
+    return 0;
+
+  return ((unsigned __int64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+}
+
 // get the position in the file of the beginning of a line which contains pos
 
 class PosLine {
@@ -273,6 +587,133 @@ class FilePositionInfo : public FilePositionInfoBase {
 
 typedef ManagedPtr<FilePositionInfo> FilePositionInfoPtr;
 
+#define DATE_INDEX_EXTENSION ".idx"
+#define DATE_INDEX_MAGIC "TRDIDX1"
+// number of lines between two date index entries
+#define DATE_INDEX_STEP 256
+
+/**
+ * Sparse date index of a data file
+ *
+ * Has the time and position of one bar every DATE_INDEX_STEP lines, so a
+ * range load can seek close to its first bar and scan forward from there,
+ * instead of searching the whole file.
+ *
+ * The index is saved in a sidecar file next to the data file, along with the
+ * stamp of the data file it was made from, and is ignored when the data file
+ * stamp changes.
+ */
+class DateIndex {
+ private:
+  const std::string _stamp;
+  std::vector<__int64> _times;
+  std::vector<__int64> _positions;
+
+ public:
+  DateIndex(const std::string& stamp) : _stamp(stamp) {}
+
+  const std::string& stamp() const { return _stamp; }
+
+  void add(__int64 time, __int64 pos) {
+    assert(_times.empty() || _times.back() <= time);
+    _times.push_back(time);
+    _positions.push_back(pos);
+  }
+
+  /**
+   * Returns the position of a line from which a forward scan will find the
+   * first bar at or after time
+   *
+   * @param time   time in seconds since the epoch
+   */
+  __int64 seek(__int64 time) const {
+    // the last entry before time - all the bars up to it are before time too
+    std::vector<__int64>::const_iterator i =
+        std::lower_bound(_times.begin(), _times.end(), time);
+    return i == _times.begin() ? 0 : _positions[i - _times.begin() - 1];
+  }
+
+  /**
+   * Loads the index from a sidecar file
+   *
+   * @return the index, or an empty pointer if the file doesn't exist, can't
+   *         be read, or was made from a data file with a different stamp
+   */
+  static boost::shared_ptr<DateIndex> load(const std::string& fileName,
+                                           const std::string& stamp) {
+    std::ifstream file(fileName.c_str(), ios_base::in | ios_base::binary);
+    if (!file) return boost::shared_ptr<DateIndex>();
+
+    char magic[8] = {0};
+    unsigned __int32 stampSize = 0;
+    file.read(magic, sizeof(magic));
+    file.read((char*)&stampSize, sizeof(stampSize));
+    if (!file || strncmp(magic, DATE_INDEX_MAGIC, sizeof(magic)) != 0 ||
+        stampSize != stamp.size())
+      return boost::shared_ptr<DateIndex>();
+
+    std::string fileStamp(stampSize, 0);
+    unsigned __int64 count = 0;
+    if (stampSize > 0) file.read(&fileStamp[0], stampSize);
+    file.read((char*)&count, sizeof(count));
+    if (!file || fileStamp != stamp) return boost::shared_ptr<DateIndex>();
+
+    boost::shared_ptr<DateIndex> index(new DateIndex(stamp));
+    index->_times.resize((size_t)count);
+    index->_positions.resize((size_t)count);
+    if (count > 0) {
+      file.read((char*)&index->_times[0], count * sizeof(__int64));
+      file.read((char*)&index->_positions[0], count * sizeof(__int64));
+    }
+    return file ? index : boost::shared_ptr<DateIndex>();
+  }
+
+  /**
+   * Saves the index to a sidecar file
+   *
+   * The index is written under a temporary name, unique to the process and
+   * thread, and then renamed, so concurrent readers never see a partial file,
+   * and writers in other processes don't write over each other's files.
+   * Errors are ignored, as the index can always be rebuilt.
+   */
+  void save(const std::string& fileName) const {
+    std::ostringstream tmp;
+    tmp << fileName << "." << GetCurrentProcessId() << "."
+        << GetCurrentThreadId() << ".tmp";
+    std::string tmpFileName(tmp.str());
+    {
+      std::ofstream file(tmpFileName.c_str(),
+                         ios_base::out | ios_base::binary | ios_base::trunc);
+      if (!file) return;
+
+      char magic[8] = {0};
+      strcpy(magic, DATE_INDEX_MAGIC);
+      unsigned __int32 stampSize = (unsigned __int32)_stamp.size();
+      unsigned __int64 count = _times.size();
+
+      file.write(magic, sizeof(magic));
+      file.write((const char*)&stampSize, sizeof(stampSize));
+      file.write(_stamp.data(), stampSize);
+      file.write((const char*)&count, sizeof(count));
+      if (count > 0) {
+        file.write((const char*)&_times[0], count * sizeof(__int64));
+        file.write((const char*)&_positions[0], count * sizeof(__int64));
+      }
+      if (!file) {
+        file.close();
+        DeleteFile(s2ws(tmpFileName).c_str());
+        return;
+      }
+    }
+
+    if (!MoveFileEx(s2ws(tmpFileName).c_str(), s2ws(fileName).c_str(),
+                    MOVEFILE_REPLACE_EXISTING))
+      DeleteFile(s2ws(tmpFileName).c_str());
+  }
+};
+
+typedef boost::shared_ptr<DateIndex> DateIndexPtr;
+
 class Header : public Tokenizer {
  public:
   Header(const std::string& line) : Tokenizer(line, ", \t") {}
@@ -350,6 +791,7 @@ class FileDataSource : public tradery::DataSource {
 #endif
   }
 
+ protected:
   // returns -1 if td > end time in the file
   __int64 findStart(const DateTime td, std::istream& file) const {
     //  	DebugBreak();
@@ -463,7 +905,8 @@ class FileDataSource : public tradery::DataSource {
    */
   inline FilePositionInfo FileDataSource::parseBars(
       tradery::Addable<Bar>* bars, std::istream& _file, DateTimeRangePtr range,
-      const std::string& symbol) const throw(BarException) {
+      const std::string& symbol, const DateIndex* index = 0) const
+      throw(BarException) {
     std::string str;
 
     __int64 startPos = 0;
@@ -473,7 +916,10 @@ class FileDataSource : public tradery::DataSource {
 
     if (range) {
       // todo - this shouldn't be a dynamic cast, should work for all ranges
-      startPos = findStart(range->from(), _file);
+      // with an index, the start is only approximate, the bars before the
+      // range are skipped below
+      startPos = index != 0 ? seek(*index, range->from())
+                            : findStart(range->from(), _file);
 
       //    __int64 pos = 0;
 
@@ -484,10 +930,13 @@ class FileDataSource : public tradery::DataSource {
       if (startPos < 0)
         return FilePositionInfo();
       else {
-        assert(timeStamp(startPos, _file) >= range->from());
+        assert(index != 0 || timeStamp(startPos, _file) >= range->from());
         _file.clear();
         _file.seekg(startPos);
 
+        // the position of the first bar added, which is where the range
+        // starts, as startPos is only approximate with an index
+        __int64 firstPos = -1;
         do {
           endPos = _file.tellg();
           std::getline(_file, str);
@@ -498,10 +947,13 @@ class FileDataSource : public tradery::DataSource {
               continue;
             else if (*range < *pBar)
               break;
-            else
+            else {
+              if (firstPos < 0) firstPos = endPos;
               bars->add(*pBar);
+            }
           }
         } while (!_file.eof());
+        if (firstPos >= 0) startPos = firstPos;
 
         // we only need to get if it's not eof - if it's eof, we alreay have
         // that value from the top of the function and besides, tellg returns -1
@@ -524,19 +976,228 @@ class FileDataSource : public tradery::DataSource {
            str.length() > 1 && str.at(0) == '/' && str.at(1) == '/';
   }
 
+  /**
+   * Parse the mapped file and populate the BarsIAddable with bars
+   *
+   * Same as the stream version, but the lines are scanned in place into
+   * columns of values, which are then added to the collection all at once,
+   * without any per line allocation
+   *
+   * @param bars
+   * @param file
+   * @param range
+   * @param index  optional date index of the file
+   * @exception BarException
+   * @exception DataFileException
+   *                   if a range is requested and the file has no bars
+   */
+  FilePositionInfo parseBars(tradery::Addable<Bar>* bars,
+                             const MappedFile& file, DateTimeRangePtr range,
+                             const DateIndex* index = 0) const
+      throw(BarException, DataFileException) {
+    const char* begin = file.begin();
+    const char* end = file.end();
+    const char* start = begin;
+
+    if (range) {
+      // same as the stream version: no line with a valid date means the data
+      // is probably in the wrong format
+      DateTime first;
+      const char* next;
+      if (nextBarLine(begin, end, first, next) == end)
+        throw DataFileException();
+
+      // with an index, the start is only approximate, the bars before the
+      // range are skipped below
+      start = index != 0 ? begin + seek(*index, range->from())
+                         : findStart(range->from(), begin, end);
+      if (start == end) return FilePositionInfo();
+    }
+
+    const DateTime from(range ? range->from() : DateTime());
+    const DateTime to(range ? range->to() : DateTime());
+
+    BarColumns columns;
+    BarFields fields;
+    // the first bar added, which is where the range starts, as start is only
+    // approximate with an index
+    const char* firstBar = 0;
+    const char* line = start;
+    for (const char* next; line < end; line = next) {
+      const char* eol = (const char*)memchr(line, '\n', end - line);
+      next = eol == 0 ? end : eol + 1;
+
+      if (scanBarLine(line, eol == 0 ? end : eol, fields)) {
+        if (range) {
+          if (fields.time < from)
+            continue;
+          else if (fields.time > to)
+            break;
+        }
+        if (firstBar == 0) firstBar = line;
+        columns.add(fields.time, fields.open, fields.high, fields.low,
+                    fields.close, fields.volume);
+      }
+    }
+    if (range && firstBar != 0) start = firstBar;
+
+    BarColumnsAddable* addable = dynamic_cast<BarColumnsAddable*>(bars);
+    if (addable != 0)
+      addable->addColumns(columns);
+    else
+      for (size_t n = 0; n < columns.size(); n++) bars->add(columns.bar(n));
+
+    return FilePositionInfo(start - begin, line - start);
+  }
+
+  static __int64 seek(const DateIndex& index, const DateTime& td) {
+    return td.isSpecial() ? 0 : index.seek(td.to_epoch_time());
+  }
+
+  // makes a date index of the mapped file, with the times of the first bar
+  // at or after every DATE_INDEX_STEP lines
+  DateIndexPtr makeDateIndex(const MappedFile& file,
+                             const std::string& stamp) const {
+    DateIndexPtr index(new DateIndex(stamp));
+    const char* begin = file.begin();
+    const char* end = file.end();
+
+    for (const char* line = begin; line < end;) {
+      DateTime time;
+      const char* next;
+      const char* bar = nextBarLine(line, end, time, next);
+      if (bar == end) break;
+
+      index->add(time.to_epoch_time(), bar - begin);
+
+      line = next;
+      for (unsigned int n = 1; n < DATE_INDEX_STEP && line < end; n++) {
+        const char* eol = (const char*)memchr(line, '\n', end - line);
+        line = eol == 0 ? end : eol + 1;
+      }
+    }
+    return index;
+  }
+
+  /**
+   * Gets the date index of a data file
+   *
+   * The index is kept in memory and in a sidecar file. If neither is
+   * current, it is made from the mapped file if there is one.
+   *
+   * @return the index, or an empty pointer if not available
+   */
+  DateIndexPtr getDateIndex(const std::string& fileName,
+                            const std::string& stamp,
+                            const MappedFile* file) const {
+    if (!_useDateIndex || stamp.empty()) return DateIndexPtr();
+
+    {
+      Lock lock(_dateIndexMutex);
+      DateIndexMap::const_iterator i = _dateIndexes.find(fileName);
+      if (i != _dateIndexes.end() && i->second->stamp() == stamp)
+        return i->second;
+    }
+
+    std::string indexFileName(fileName + DATE_INDEX_EXTENSION);
+    DateIndexPtr index(DateIndex::load(indexFileName, stamp));
+    if (!index && file != 0) {
+      index = makeDateIndex(*file, stamp);
+      index->save(indexFileName);
+    }
+
+    if (index) {
+      Lock lock(_dateIndexMutex);
+      _dateIndexes[fileName] = index;
+    }
+    return index;
+  }
+
+  // the start of the line that contains pos, but not before begin
+  static const char* lineStart(const char* pos, const char* begin) {
+    while (pos > begin && pos[-1] != '\n') pos--;
+    return pos;
+  }
+
+  // returns the start of the first line in [line, end) that contains a bar,
+  // along with the bar time and the start of the line that follows it, or end
+  // if there is no such line
+  const char* nextBarLine(const char* line, const char* end, DateTime& time,
+                          const char*& next) const {
+    BarFields fields;
+    for (; line < end; line = next) {
+      const char* eol = (const char*)memchr(line, '\n', end - line);
+      next = eol == 0 ? end : eol + 1;
+      try {
+        if (scanBarLine(line, eol == 0 ? end : eol, fields)) {
+          time = fields.time;
+          return line;
+        }
+      } catch (...) {
+        // same as in timeStamp - the line doesn't have data
+      }
+    }
+    return end;
+  }
+
+  // binary search in the mapped file for the first line with a bar at or
+  // after td, returns end if there isn't one
+  const char* findStart(const DateTime& td, const char* begin,
+                        const char* end) const {
+    // all the bars before lo are < td, all the bars starting at hi are >= td
+    const char* lo = begin;
+    const char* hi = end;
+    while (lo < hi) {
+      const char* line = lineStart(lo + (hi - lo) / 2, lo);
+      DateTime time;
+      const char* next;
+      const char* bar = nextBarLine(line, hi, time, next);
+
+      if (bar == hi)
+        // no bars between line and hi
+        hi = line;
+      else if (time < td)
+        lo = next;
+      else
+        hi = bar;
+    }
+    return lo;
+  }
+
  private:
+  /**
+   * Parse one line in place
+   *
+   * Each line contains a bar
+   *
+   * @param begin  the first char of the line
+   * @param end    the end of the line
+   * @param bar    receives the bar fields
+   * @return false if the line is empty or a comment
+   * @exception DataSourceException
+   */
+  virtual bool scanBarLine(const char* begin, const char* end,
+                           BarFields& bar) const
+      throw(DataSourceException, BarException, DateException,
+            TimeException) = 0;
+
   /**
    * Parse one line
    *
    * Each line contains a bar
    *
    * @param str
-   * @param lineCount
-   * @return
+   * @return the bar, or 0 if the line is empty or a comment
    * @exception DataSourceException
    */
-  virtual const tradery::Bar* parseBarLine(const std::string& str) const
-      throw(DataSourceException, BarException) = 0;
+  const tradery::Bar* parseBarLine(const std::string& str) const
+      throw(DataSourceException, BarException) {
+    BarFields bar;
+    return scanBarLine(str.data(), str.data() + str.size(), bar)
+               ? new Bar(bar.time, bar.open, bar.high, bar.low, bar.close,
+                         bar.volume)
+               : 0;
+  }
 
  private:
   // the root to which we add the relative path
@@ -545,6 +1206,11 @@ class FileDataSource : public tradery::DataSource {
   Format _format;
   bool _flatData;
 
+  typedef std::map<std::string, DateIndexPtr> DateIndexMap;
+  bool _useDateIndex;
+  mutable Mutex _dateIndexMutex;
+  mutable DateIndexMap _dateIndexes;
+
  protected:
   // flat data is when all the data is in the path directory,
   // if flat is false, data is in a hierarchy of dirs under path (the rules are
@@ -558,7 +1224,8 @@ class FileDataSource : public tradery::DataSource {
         _ext(ext),
         _format(format),
         _flatData(flatData),
-        _errorHandlingMode(errorHandlingMode) {}
+        _errorHandlingMode(errorHandlingMode),
+        _useDateIndex(true) {}
 
  public:
   static FileDataSource* make(
@@ -585,9 +1252,24 @@ class FileDataSource : public tradery::DataSource {
            stamp;
   }
 
+  // the size of the data file, the number of bars is roughly proportional
+  virtual unsigned __int64 dataSizeHint(const DataInfo* dataInfo) const {
+    assert(dataInfo != 0);
+
+    return fileSize(FileName(_flatData).makePath(
+        _path, dataInfo->symbol().symbol(),
+        addExtension(dataInfo->symbol().symbol(), _ext)));
+  }
+
   const std::string& dataPath() const { return _path; }
   const std::string& extension() const { return _ext; }
   Format format() const { return _format; }
+
+  /**
+   * Enables or disables the date index sidecar files used to locate the
+   * start of range loads. Enabled by default.
+   */
+  void useDateIndex(bool use) { _useDateIndex = use; }
 };
 
 // base for file data sources which have 7 fields: "date, time, open, high, low,
@@ -601,10 +1283,11 @@ class FileDataSourceFormat7FieldsBase : public FileDataSource {
       : FileDataSource(info, path, ext, format, flatData, errorHandlingMode) {}
 
  protected:
-  virtual DateTime parseDate(const std::string& date,
-                             const std::string& time) const = 0;
-  virtual const tradery::Bar* parseBarLine(const std::string& str) const
-      throw(DataSourceException, BarException);
+  // parses the date and time fields
+  virtual DateTime parseDate(FieldScanner& fields) const = 0;
+  virtual bool scanBarLine(const char* begin, const char* end,
+                           BarFields& bar) const
+      throw(DataSourceException, BarException, DateException, TimeException);
 };
 
 // format 1 has 7 fields, date, time: m/d/y, h:m:s
@@ -618,7 +1301,7 @@ class FileDataSourceFormat1 : public FileDataSourceFormat7FieldsBase {
                                         errorHandlingMode) {}
 
  protected:
-  DateTime parseDate(const std::string& date, const std::string& time) const;
+  DateTime parseDate(FieldScanner& fields) const;
 };
 
 // format 2 has 7 fields, date, time: yymmdd, hhmm
@@ -632,7 +1315,7 @@ class FileDataSourceFormat2 : public FileDataSourceFormat7FieldsBase {
                                         errorHandlingMode) {}
 
  protected:
-  DateTime parseDate(const std::string& date, const std::string& time) const;
+  DateTime parseDate(FieldScanner& fields) const;
 };
 
 // base for file data sources which have 6 fields: "date, open, high, low,
@@ -647,9 +1330,11 @@ class FileDataSourceFormat6FieldsBase : public FileDataSource {
       : FileDataSource(info, path, ext, format, flatData, errorHandlingMode) {}
 
  protected:
-  virtual DateTime parseDate(const std::string& date) const = 0;
-  virtual const tradery::Bar* parseBarLine(const std::string& str) const
-      throw(DataSourceException, BarException);
+  // parses the date field
+  virtual DateTime parseDate(FieldScanner& fields) const = 0;
+  virtual bool scanBarLine(const char* begin, const char* end,
+                           BarFields& bar) const
+      throw(DataSourceException, BarException, DateException, TimeException);
 };
 
 // format has 5 fields, and data is: m/d/y, time is implied to be 0:0:0
@@ -663,7 +1348,7 @@ class FileDataSourceFormat3 : public FileDataSourceFormat6FieldsBase {
                                         errorHandlingMode) {}
 
  protected:
-  virtual DateTime parseDate(const std::string& date) const;
+  virtual DateTime parseDate(FieldScanner& fields) const;
 };
 
 class FileDataSourceFormat4 : public FileDataSourceFormat6FieldsBase {
@@ -676,7 +1361,7 @@ class FileDataSourceFormat4 : public FileDataSourceFormat6FieldsBase {
                                         errorHandlingMode) {}
 
  protected:
-  virtual DateTime parseDate(const std::string& date) const;
+  virtual DateTime parseDate(FieldScanner& fields) const;
 };
 
 inline FileDataSource* FileDataSource::make(
@@ -707,121 +1392,100 @@ inline FileDataSource* FileDataSource::make(
   }
 }
 
-inline DateTime FileDataSourceFormat1::parseDate(
-    const std::string& date, const std::string& time) const {
-  Tokenizer tokens(time, ":");
-  Tokenizer::iterator i = tokens.begin();
-  i = tokens.begin();
+inline DateTime FileDataSourceFormat1::parseDate(FieldScanner& fields) const {
+  DateFields date(scanDate(fields, us));
+
+  // h:m:s
+  fields.next();
+  const char* start = fields.position();
+  unsigned int hour = 0;
+  unsigned int min = 0;
+  unsigned int sec = 0;
 
-  unsigned int hour = atoi((*i++).c_str());
-  unsigned int min = atoi((*i++).c_str());
-  unsigned int sec = atoi((*i++).c_str());
+  if (fields.parseUInt(hour) > 0 && fields.accept(":") &&
+      fields.parseUInt(min) > 0 && fields.accept(":"))
+    fields.parseUInt(sec);
+  fields.skipField();
 
-  if ((hour > 23) || (min > 59) || (sec > 59)) throw TimeException(time);
+  if ((hour > 23) || (min > 59) || (sec > 59))
+    throw TimeException(fields.text(start));
 
-  return DateTime(Date(date, us), TimeDuration(hour, min, sec, 0));
+  return date.time(hour, min, sec);
 }
 
-inline DateTime FileDataSourceFormat2::parseDate(
-    const std::string& date, const std::string& time) const {
-  // TODO - check data format, throw exception if wrong
+inline DateTime FileDataSourceFormat2::parseDate(FieldScanner& fields) const {
+  DateFields date(scanDate(fields, iso));
 
-  unsigned int hour = atoi(time.substr(0, 2).c_str());
-  unsigned int min = atoi(time.substr(2, 2).c_str());
+  // hhmm
+  fields.next();
+  const char* start = fields.position();
+  unsigned int hour = 0;
+  unsigned int min = 0;
   unsigned int sec = 0;
 
-  if ((hour > 23) || (min > 59) || (sec > 59)) throw TimeException(time);
+  fields.parseUInt(hour, 2);
+  fields.parseUInt(min, 2);
+  fields.skipField();
 
-  return DateTime(Date(date, iso, false), TimeDuration(hour, min, sec, 0));
+  if ((hour > 23) || (min > 59) || (sec > 59))
+    throw TimeException(fields.text(start));
+
+  return date.time(hour, min, sec);
 }
 
 /**
- * Parse one line
+ * Parse one line in place
  *
  * Each line contains a bar
  *
- * @param str
- * @param lineCount
+ * @param begin
+ * @param end
+ * @param bar
  * @return
  * @exception DataSourceException
  */
-inline const tradery::Bar* FileDataSourceFormat7FieldsBase::parseBarLine(
-    const std::string& str) const throw(DataSourceException, BarException) {
-  if (str.empty()) return 0;
+inline bool FileDataSourceFormat7FieldsBase::scanBarLine(
+    const char* begin, const char* end, BarFields& bar) const
+    throw(DataSourceException, BarException, DateException, TimeException) {
+  FieldScanner fields(begin, end, ", \t");
   // comment line starts with // or # or $
-  if (isCommentLine(str)) return 0;
-
-  //	tradery::tsprint_debug( str );
-  //	tradery::tsprint_debug( "\n" );
-
-  // TODO - check data format
+  if (fields.isEmptyOrComment()) return false;
 
-  Tokenizer tokens(str, ", \t");
-
-  int n = 0;
-  std::vector<std::string> vs;
-
-  std::wostringstream o;
-  for (Tokenizer::iterator tok_iter = tokens.begin(); tok_iter != tokens.end();
-       ++tok_iter, n++) {
-    vs.push_back(*tok_iter);
-    std::string s(*tok_iter);
-    //      o << s << ", ";
-  }
-  o << std::endl;
-
-  // TODO: check that is valid
   // TODO: prepare for futures (more fields - open interest)
-  if (vs.size() != 6) {
-    //    throw DataSourceException();
-  }
-  char* p;
-
-  return new Bar(parseDate(vs[0], vs[1]), strtod(vs[2].c_str(), &p),
-                 strtod(vs[3].c_str(), &p), strtod(vs[4].c_str(), &p),
-                 strtod(vs[5].c_str(), &p), atol(vs[6].c_str()));
+  bar.time = parseDate(fields);
+  bar.open = fields.getDouble();
+  bar.high = fields.getDouble();
+  bar.low = fields.getDouble();
+  bar.close = fields.getDouble();
+  bar.volume = fields.getULong();
+  return true;
 }
 
-inline const tradery::Bar* FileDataSourceFormat6FieldsBase::parseBarLine(
-    const std::string& str) const throw(DataSourceException, BarException) {
-  if (str.empty()) return 0;
+inline bool FileDataSourceFormat6FieldsBase::scanBarLine(
+    const char* begin, const char* end, BarFields& bar) const
+    throw(DataSourceException, BarException, DateException, TimeException) {
+  FieldScanner fields(begin, end, ",");
   // comment line starts with // or #
-  if (isCommentLine(str)) return 0;
-
-  // TODO - check data format
-  Tokenizer tokens(str, ",");
+  if (fields.isEmptyOrComment()) return false;
 
-  int n = 0;
-  std::vector<std::string> vs;
-
-  std::wostringstream o;
-  for (Tokenizer::iterator tok_iter = tokens.begin(); tok_iter != tokens.end();
-       ++tok_iter, n++) {
-    vs.push_back(*tok_iter);
-    std::string s(*tok_iter);
-    //      o << s << ", ";
-  }
-  o << std::endl;
-
-  // TODO: check that is valid
   // TODO: prepare for futures (more fields - open interest)
-  if (vs.size() != 6) {
-    //    throw DataSourceException();
-  }
-  char* p;
-  return new Bar(parseDate(vs[0]), strtod(vs[1].c_str(), &p),
-                 strtod(vs[2].c_str(), &p), strtod(vs[3].c_str(), &p),
-                 strtod(vs[4].c_str(), &p), atol(vs[5].c_str()));
+  bar.time = parseDate(fields);
+  bar.open = fields.getDouble();
+  bar.high = fields.getDouble();
+  bar.low = fields.getDouble();
+  bar.close = fields.getDouble();
+  bar.volume = fields.getULong();
+  return true;
 }
 
-inline DateTime FileDataSourceFormat3::parseDate(const std::string& date) const
+inline DateTime FileDataSourceFormat3::parseDate(FieldScanner& fields) const
     throw(DateException) {
-  return DateTime(Date(date, us), TimeDuration(0, 0, 0, 0));
+  return scanDate(fields, us).time();
 }
 
-inline DateTime FileDataSourceFormat4::parseDate(const std::string& date) const
+inline DateTime FileDataSourceFormat4::parseDate(FieldScanner& fields) const
     throw(DateException) {
-  return DateTime(Date(date, iso, ""), TimeDuration(0, 0, 0, 0));
+  return scanDate(fields, iso).time();
 }
 
 inline DataSource::DataXPtr FileDataSource::makeBars(
@@ -844,9 +1508,12 @@ inline DataSource::DataXPtr FileDataSource::makeBars(
   std::string fileName(
       FileName(_flatData).makePath(_path, symbol, addExtension(symbol, ext)));
 
+  // the file is normally mapped in memory and parsed in place, the stream is
+  // only used if it can't be mapped
+  MappedFile mapped(fileName);
   std::ifstream _file;
-  _file.open(fileName.c_str(), ios_base::in | ios_base::binary);
-  if (!_file) {
+  if (!mapped) _file.open(fileName.c_str(), ios_base::in | ios_base::binary);
+  if (!mapped && !_file) {
     // error opening the file - throw exception
     fileNotFoundErrorHandler(symbol, fileName);
     return 0;
@@ -855,14 +1522,22 @@ inline DataSource::DataXPtr FileDataSource::makeBars(
       {
         //				__asm int 3;
       }
+      std::string stamp(getFileStamp(fileName));
+      // the index is only needed to find the start of a range
+      DateIndexPtr index(range ? getDateIndex(fileName, stamp,
+                                              mapped ? &mapped : 0)
+                               : DateIndexPtr());
+
       // parse the file and populate the bars collection with bars
-      FilePositionInfo p = parseBars(bars.get(), _file, range, symbol);
+      FilePositionInfo p =
+          mapped ? parseBars(bars.get(), mapped, range, index.get())
+                 : parseBars(bars.get(), _file, range, symbol, index.get());
       bars->setDataLocationInfo(
           tradery::makeDataFileLocationInfo(fileName, p.start(), p.count()));
       //		parseBars( bars.get(), _file, range, symbol );
       // release and return the pointer
       // have to release so it won't be deleted by the smart pointer
-      return DataXPtr(new DataX(bars, getFileStamp(fileName)));
+      return DataXPtr(new DataX(bars, stamp));
     } catch (const DataFileException) {
       throw DataSourceException(
           DATA_SOURCE_ERROR,
@@ -915,11 +1590,8 @@ collection needs to be deleted
 
 inline const std::string FileDataSource::getFileStamp(
     const std::string& fileName) const {
-  OutputBuffer ob;
-
-  ob << "File data source: " << name() << ", session: " << sessionName()
-     << ", getting file stamp";
-  //  outputSink().printLine( ob );
+  // doesn't use the session, the data source may be used outside of one, as
+  // the text data source of a binary data source
   HANDLE file =
       CreateFile(s2ws(fileName).c_str(), GENERIC_READ, FILE_SHARE_READ, 0,
                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
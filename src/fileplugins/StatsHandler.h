@@ -19,6 +19,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include <log.h>
+#include <future>
+#include <memory>
 
 class StatsHandler : public SignalHandler, public CurrentPriceSource {
  private:
@@ -36,6 +38,29 @@ class StatsHandler : public SignalHandler, public CurrentPriceSource {
   std::auto_ptr<DrawdownCurve> _bhDC;
   mutable PositionsContainerPtr _bhPos;
 
+ private:
+  typedef std::unique_ptr<DrawdownCurve> DrawdownCurvePtr;
+  typedef std::future<DrawdownCurvePtr> DrawdownCurveFuture;
+
+  // starts calculating a drawdown curve on another thread, unless it has
+  // already been calculated
+  template <class Curve>
+  static DrawdownCurveFuture startDrawdownCurve(
+      const std::auto_ptr<DrawdownCurve>& dc, const EquityCurve& ec) {
+    if (dc.get() != 0) return DrawdownCurveFuture();
+    return std::async(std::launch::async,
+                      [&ec]() { return DrawdownCurvePtr(new Curve(ec)); });
+  }
+
+  void endDrawdownCurve(std::auto_ptr<DrawdownCurve>& dc,
+                        DrawdownCurveFuture& future, const char* name) {
+    if (future.valid()) {
+      dc.reset(future.get().release());
+      LOG(log_info, "Calculated " << name << " drawdown");
+      sessionInfo().runtimeStats()->step(getDDStep());
+    }
+  }
+
  public:
   StatsHandler(const Info& info)
       : SignalHandler(info),
@@ -109,51 +134,41 @@ class StatsHandler : public SignalHandler, public CurrentPriceSource {
 
   void calcStats(const DateRange& dateRange, PositionsContainer& positions) {
     LOG(log_info, "Calculating stats");
-    sessionInfo().runtimeStats()->setMessage("Calculating statistics");
+    RuntimeStats& rts = *sessionInfo().runtimeStats();
+    rts.setMessage("Calculating statistics");
 
     double initialCapital =
         sessionInfo().runtimeParams()->positionSizing()->initialCapital();
 
     Timer timer;
-    LOG(log_info, "calculating long + short stats");
-    //    sessionInfo().runtimeStats()->setStatus( _T( "Calculating overall
-    //    stats" ) );
+    // the buy and hold stats are on other positions, so they are calculated on
+    // another thread, while this one calculates the other stats
+    PositionsContainer& bhPositions = getBHPositions();
+    _buyHoldStats.setDateRange(dateRange);
+    _buyHoldStats.setInitialCapital(initialCapital);
+    std::future<void> bhStats =
+        std::async(std::launch::async, [this, &bhPositions]() {
+          _buyHoldStats.calculateAll(bhPositions);
+        });
+
+    LOG(log_info, "calculating long + short, long and short stats");
     _totalStats.setDateRange(dateRange);
     _totalStats.setInitialCapital(initialCapital);
-    _totalStats.calculateAll(positions);
-    _totalStats.setEndingCapital(_ec->getEndingTotalEquity());
-    sessionInfo().runtimeStats()->step(getStatsStep());
-
-    LOG(log_info, "done long + short: " << timer.elapsed());
-    //    sessionInfo().runtimeStats()->setStatus( _T( "Calculating long stats"
-    //    ) );
-    std::cout << "calculating long stats" << std::endl;
     _longStats.setDateRange(dateRange);
     _longStats.setInitialCapital(initialCapital);
-    _longStats.calculateLong(positions);
-    _longStats.setEndingCapital(_ec->getEndingLongEquity());
-    sessionInfo().runtimeStats()->step(getStatsStep());
-
-    LOG(log_info, "done long: " << timer.elapsed());
-    //    sessionInfo().runtimeStats()->setStatus( _T( "Calculating short stats"
-    //    ) );
-    std::cout << "calculating short stats" << std::endl;
     _shortStats.setDateRange(dateRange);
     _shortStats.setInitialCapital(initialCapital);
-    _shortStats.calculateShort(positions);
+    StatsCalculator::calculateGroups(positions, _totalStats, _longStats,
+                                     _shortStats);
+    _totalStats.setEndingCapital(_ec->getEndingTotalEquity());
+    _longStats.setEndingCapital(_ec->getEndingLongEquity());
     _shortStats.setEndingCapital(_ec->getEndingShortEquity());
-    sessionInfo().runtimeStats()->step(getStatsStep());
+    rts.step(getStatsStep() * 3);
+    LOG(log_info, "done long + short, long and short: " << timer.elapsed());
 
-    LOG(log_info, "done short: " << timer.elapsed());
-    //    sessionInfo().runtimeStats()->setStatus( _T( "Calculating buy and hold
-    //    stats" ) );
-    std::cout << "calculating b&h stats" << std::endl;
-    _buyHoldStats.setDateRange(dateRange);
-    _buyHoldStats.setInitialCapital(initialCapital);
-    _buyHoldStats.calculateAll(getBHPositions());
+    bhStats.get();
     _buyHoldStats.setEndingCapital(_bhEc->getEndingTotalEquity());
-    sessionInfo().runtimeStats()->step(getStatsStep());
-
+    rts.step(getStatsStep());
     LOG(log_info, "done b&h: " << timer.elapsed());
   }
 
@@ -183,37 +198,26 @@ class StatsHandler : public SignalHandler, public CurrentPriceSource {
       rts.step(getEqStep());
     }
 
-    if (_totalDC.get() == 0) {
-      rts.setMessage("Calculating total drawdown");
-      rts.setStatus(RuntimeStatus::RUNNING);
-      LOG(log_info, "Calculating total drawdown");
-      //      rts.setStatus( _T( "Calculating drawdown for all positions" ) );
-      _totalDC = std::auto_ptr<DrawdownCurve>(new TotalDrawdownCurve(*_ec));
-      rts.step(getDDStep());
-    }
-    if (_shortDC.get() == 0) {
-      rts.setMessage("Calculating short drawdown");
-      rts.setStatus(RuntimeStatus::RUNNING);
-      LOG(log_info, "Calculating short drawdown");
-      //      rts.setStatus( _T( "Calculating drawdown for short positions" ) );
-      _shortDC = std::auto_ptr<DrawdownCurve>(new ShortDrawdownCurve(*_ec));
-      rts.step(getDDStep());
-    }
-
-    if (_longDC.get() == 0) {
-      rts.setMessage("Calculating long drawdown");
-      LOG(log_info, "Calculating long drawdown");
-      //      rts.setStatus( _T( "Calculating drawdown for long positions" ) );
-      _longDC = std::auto_ptr<DrawdownCurve>(new LongDrawdownCurve(*_ec));
-      rts.step(getDDStep());
-    }
-    if (_bhDC.get() == 0) {
-      rts.setMessage("Calculating Buy and Hold drawdown");
+    if (_totalDC.get() == 0 || _shortDC.get() == 0 || _longDC.get() == 0 ||
+        _bhDC.get() == 0) {
+      rts.setMessage("Calculating drawdown");
       rts.setStatus(RuntimeStatus::RUNNING);
-      LOG(log_info, "Calculating b&h drawdown");
-      //      rts.setStatus( _T( "Calculating drawdown for buy and hold" ) );
-      _bhDC = std::auto_ptr<DrawdownCurve>(new TotalDrawdownCurve(*_bhEc));
-      rts.step(getDDStep());
+      LOG(log_info, "Calculating total, short, long and b&h drawdown");
+      // the drawdown curves only read the equity curves, so they are
+      // calculated at the same time, each on its own thread
+      DrawdownCurveFuture totalDC(
+          startDrawdownCurve<TotalDrawdownCurve>(_totalDC, *_ec));
+      DrawdownCurveFuture shortDC(
+          startDrawdownCurve<ShortDrawdownCurve>(_shortDC, *_ec));
+      DrawdownCurveFuture longDC(
+          startDrawdownCurve<LongDrawdownCurve>(_longDC, *_ec));
+      DrawdownCurveFuture bhDC(
+          startDrawdownCurve<TotalDrawdownCurve>(_bhDC, *_bhEc));
+
+      endDrawdownCurve(_totalDC, totalDC, "total");
+      endDrawdownCurve(_shortDC, shortDC, "short");
+      endDrawdownCurve(_longDC, longDC, "long");
+      endDrawdownCurve(_bhDC, bhDC, "b&h");
     }
   }
 
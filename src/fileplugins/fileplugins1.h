@@ -31,6 +31,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define DATASOURCE_FORMAT1_NAME "Data source plugin format 1"
 #define DATASOURCE_FORMAT3_NAME "Data source plugin format 3"
+// formats 2 and 4 are only available through the binary data sources
+#define DATASOURCE_FORMAT2_NAME "Data source plugin format 2"
+#define DATASOURCE_FORMAT4_NAME "Data source plugin format 4"
+#define BINARY_DATASOURCE_FORMAT1_NAME \
+  "Binary data source plugin, converted from format 1"
+#define BINARY_DATASOURCE_FORMAT2_NAME \
+  "Binary data source plugin, converted from format 2"
+#define BINARY_DATASOURCE_FORMAT3_NAME \
+  "Binary data source plugin, converted from format 3"
+#define BINARY_DATASOURCE_FORMAT4_NAME \
+  "Binary data source plugin, converted from format 4"
 
 // Cfileplugins1App
 // See fileplugins1.cpp for the implementation of this class
@@ -44,6 +55,20 @@ const Info dataSourceInfoFormat1NewId(DATASOURCE_FORMAT1_NAME, "");
 const Info dataSourceInfoFormat3("3F8D0DAA-C11E-452c-A097-20127C0673E0",
                                  DATASOURCE_FORMAT3_NAME, "");
 const Info dataSourceInfoFormat3NewId(DATASOURCE_FORMAT3_NAME, "");
+const Info binaryDataSourceInfoFormat1("0E3B4C61-5A0F-4D27-9C1E-6A8B2F47D913",
+                                       BINARY_DATASOURCE_FORMAT1_NAME, "");
+const Info binaryDataSourceInfoFormat1NewId(BINARY_DATASOURCE_FORMAT1_NAME, "");
+const Info binaryDataSourceInfoFormat3("A7C25D90-3E61-4B8F-8D04-51F9E2B6C387",
+                                       BINARY_DATASOURCE_FORMAT3_NAME, "");
+const Info binaryDataSourceInfoFormat3NewId(BINARY_DATASOURCE_FORMAT3_NAME, "");
+const Info dataSourceInfoFormat2NewId(DATASOURCE_FORMAT2_NAME, "");
+const Info binaryDataSourceInfoFormat2("96DDAAD3-2446-478C-9086-13241CC5435B",
+                                       BINARY_DATASOURCE_FORMAT2_NAME, "");
+const Info binaryDataSourceInfoFormat2NewId(BINARY_DATASOURCE_FORMAT2_NAME, "");
+const Info dataSourceInfoFormat4NewId(DATASOURCE_FORMAT4_NAME, "");
+const Info binaryDataSourceInfoFormat4("DC1CF2A7-CCEA-4174-9C9D-BF34745847B7",
+                                       BINARY_DATASOURCE_FORMAT4_NAME, "");
+const Info binaryDataSourceInfoFormat4NewId(BINARY_DATASOURCE_FORMAT4_NAME, "");
 const Info symbolsSourceInfo(
     "E32C975A-ECE1-4e7f-BB49-A604F2EE8083",
     "Symbols Source plugin - symbols file specified dynamically", "");
@@ -960,6 +985,7 @@ class FileStatsHandler : public FileSignalsHandler {
   void sessionEnded(PositionsContainer& positions) {
     LOG(log_debug, "1");
 
+    Timer timer;
     RuntimeStats& rts = *sessionInfo().runtimeStats();
     std::cout << "Calculating equity date range" << std::endl;
     rts.setMessage("Calculating equity date range");
@@ -1007,6 +1033,8 @@ class FileStatsHandler : public FileSignalsHandler {
       LOG(log_debug, "done with stats");
     }
 
+    rts.setSessionEndDuration(timer.elapsed());
+    LOG(log_info, "session end processing: " << timer.elapsed());
     __super::sessionEnd();
   }
 };
@@ -1100,26 +1128,181 @@ class FileDataSourceFormat3ForWeb : public FileDataSourceFormat3 {
                               flatData, errorHandlingMode) {}
 };
 
+class FileDataSourceFormat2ForWeb : public FileDataSourceFormat2 {
+ private:
+  // this is to show a "sanitized" error message in a web environment
+  virtual void fileNotFoundErrorHandler(const std::string& symbol,
+                                        const std::string& fileName) const {
+    std::ostringstream o;
+
+    o << "No data for symbol \"" << symbol << "\"";
+    throw DataSourceException(OPENING_BARS_FILE_ERROR, o.str(), name());
+  }
+
+ public:
+  FileDataSourceFormat2ForWeb(const std::string& createString, bool flatData,
+                              ErrorHandlingMode errorHandlingMode)
+      : FileDataSourceFormat2(dataSourceInfoFormat2NewId, createString, "csv",
+                              flatData, errorHandlingMode) {}
+};
+
+class FileDataSourceFormat4ForWeb : public FileDataSourceFormat4 {
+ private:
+  // this is to show a "sanitized" error message in a web environment
+  virtual void fileNotFoundErrorHandler(const std::string& symbol,
+                                        const std::string& fileName) const {
+    std::ostringstream o;
+
+    o << "No data for symbol \"" << symbol << "\"";
+    throw DataSourceException(OPENING_BARS_FILE_ERROR, o.str(), name());
+  }
+
+ public:
+  FileDataSourceFormat4ForWeb(const std::string& createString, bool flatData,
+                              ErrorHandlingMode errorHandlingMode)
+      : FileDataSourceFormat4(dataSourceInfoFormat4NewId, createString, "csv",
+                              flatData, errorHandlingMode) {}
+};
+
+// the second element of the create strings is the error handling mode
+inline ErrorHandlingMode getErrorHandlingMode(
+    const std::vector<std::string>& createStrings) throw(PluginException) {
+  ErrorHandlingMode mode(fatal);
+
+  if (createStrings.size() > 1) {
+    if (createStrings[1] == ERROR_HANDLING_MODE_FATAL)
+      mode = fatal;
+    else if (createStrings[1] == ERROR_HANDLING_MODE_WARNING)
+      mode = warning;
+    else if (createStrings[1] == ERROR_HANDLING_MODE_IGNORE)
+      mode = ErrorHandlingMode::ignore;
+    else
+      throw PluginException("File data source plugin 1",
+                            "Unknown error hanlding mode string");
+  }
+  return mode;
+}
+
+/**
+ * Plugin for the binary data sources, which load bars from binary files made
+ * from the text files of the corresponding file data sources
+ *
+ * @see BinaryDataSource
+ */
+class BinaryDataSourcePlugin : public DataSourcePlugin {
+ private:
+  std::vector<ManagedPtr<Info> > _configs;
+  mutable std::vector<ManagedPtr<Info> >::const_iterator _i;
+
+ public:
+  BinaryDataSourcePlugin()
+      : DataSourcePlugin(Info("5D1E8B3A-92C4-4F6B-B7A0-C3E94D2F6A18", "", "")) {
+    _configs.push_back(new Info(binaryDataSourceInfoFormat1));
+    _configs.push_back(new Info(binaryDataSourceInfoFormat2));
+    _configs.push_back(new Info(binaryDataSourceInfoFormat3));
+    _configs.push_back(new Info(binaryDataSourceInfoFormat4));
+  }
+
+  virtual InfoPtr first() const throw(PluginException) {
+    _i = _configs.begin();
+    return InfoPtr(new Info(**_i));
+  }
+
+  virtual InfoPtr next() const throw(PluginException) {
+    ++_i;
+    return _i == _configs.end() ? InfoPtr() : InfoPtr(new Info(**_i));
+  }
+
+  virtual ManagedPtr<DataSource> get(
+      const UniqueId& id, const std::vector<std::string>* createStrings =
+                              0) throw(PluginException) {
+    if (createStrings == 0)
+      throw PluginException(
+          "Binary data source plugin",
+          "The createStrings parameter must not be null for this plugin");
+
+    ErrorHandlingMode mode(getErrorHandlingMode(*createStrings));
+    const std::string& path((*createStrings)[0]);
+
+    // passing false, indicating that the data files are in various
+    // subdirectories, not all in one dir (flat)
+    if (id == binaryDataSourceInfoFormat1.id())
+      return new BinaryDataSource(
+          binaryDataSourceInfoFormat1NewId, path,
+          new FileDataSourceFormat1ForWeb(path, false, mode), false, mode);
+    else if (id == binaryDataSourceInfoFormat2.id())
+      return new BinaryDataSource(
+          binaryDataSourceInfoFormat2NewId, path,
+          new FileDataSourceFormat2ForWeb(path, false, mode), false, mode);
+    else if (id == binaryDataSourceInfoFormat3.id())
+      return new BinaryDataSource(
+          binaryDataSourceInfoFormat3NewId, path,
+          new FileDataSourceFormat3ForWeb(path, false, mode), false, mode);
+    else if (id == binaryDataSourceInfoFormat4.id())
+      return new BinaryDataSource(
+          binaryDataSourceInfoFormat4NewId, path,
+          new FileDataSourceFormat4ForWeb(path, false, mode), false, mode);
+    else
+      return 0;
+  }
+
+  virtual bool canCreate() const { return false; }
+
+  virtual ManagedPtr<DataSource> create(
+      const std::vector<std::string>* createStrings =
+          0) throw(PluginException) {
+    return 0;
+  }
+
+  virtual bool canEdit(const UniqueId& id) const { return false; }
+
+  virtual ManagedPtr<DataSource> edit(const UniqueId& id) throw(
+      PluginException) {
+    return 0;
+  }
+
+  virtual bool canRemove(const UniqueId& id) const { return false; }
+
+  virtual void remove(const UniqueId& id) throw(PluginException) {}
+
+  virtual bool hasWindow(const UniqueId& id) const { return false; }
+};
+
+/**
+ * The data source plugin exported by this module
+ *
+ * Lists the text file data source configurations, followed by those of the
+ * binary data source plugin, to which it forwards the requests for them
+ */
 class FileDataSourcePlugin : public DataSourcePlugin {
  private:
   std::vector<ManagedPtr<Info> > _configs;
   mutable std::vector<ManagedPtr<Info> >::const_iterator _i;
+  mutable bool _binaryConfigs;
+  BinaryDataSourcePlugin _binaryPlugin;
 
  public:
   FileDataSourcePlugin()
-      : DataSourcePlugin(Info("C44EB64E-42A6-48ed-8C6C-3604C5B468DA", "", "")) {
+      : DataSourcePlugin(Info("C44EB64E-42A6-48ed-8C6C-3604C5B468DA", "", "")),
+        _binaryConfigs(false) {
     _configs.push_back(new Info(dataSourceInfoFormat1));
     _configs.push_back(new Info(dataSourceInfoFormat3));
   }
 
   virtual InfoPtr first() const throw(PluginException) {
+    _binaryConfigs = false;
     _i = _configs.begin();
     return InfoPtr(new Info(**_i));
   }
 
   virtual InfoPtr next() const throw(PluginException) {
+    if (_binaryConfigs) return _binaryPlugin.next();
+
     ++_i;
-    return _i == _configs.end() ? InfoPtr() : InfoPtr(new Info(**_i));
+    if (_i != _configs.end()) return InfoPtr(new Info(**_i));
+
+    _binaryConfigs = true;
+    return _binaryPlugin.first();
   }
 
   virtual ManagedPtr<DataSource> get(
@@ -1131,20 +1314,7 @@ class FileDataSourcePlugin : public DataSourcePlugin {
           "File data source plugin 1",
           "The createStrings parameter must not be null for this plugin");
 
-    ErrorHandlingMode mode(fatal);
-
-    if ((*createStrings).size() > 1) {
-      // second element of vector is the error handling mode
-      if ((*createStrings)[1] == ERROR_HANDLING_MODE_FATAL)
-        mode = fatal;
-      else if ((*createStrings)[1] == ERROR_HANDLING_MODE_WARNING)
-        mode = warning;
-      else if ((*createStrings)[1] == ERROR_HANDLING_MODE_IGNORE)
-        mode = ErrorHandlingMode::ignore;
-      else
-        throw PluginException("File data source plugin 1",
-                              "Unknown error hanlding mode string");
-    }
+    ErrorHandlingMode mode(getErrorHandlingMode(*createStrings));
 
     // passing false, indicating that the data files are in various
     // subdirectories, not all in one dir (flat)
@@ -1153,7 +1323,7 @@ class FileDataSourcePlugin : public DataSourcePlugin {
     else if (id == dataSourceInfoFormat3.id())
       return new FileDataSourceFormat3ForWeb((*createStrings)[0], false, mode);
     else
-      return 0;
+      return _binaryPlugin.get(id, createStrings);
   }
 
   virtual bool canCreate() const { return false; }
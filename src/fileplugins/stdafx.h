@@ -81,11 +81,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <tokenizer.h>
 #include <misc.h>
 #include <miscwin.h>
+#include <miscfile.h>
 #include <filesymbols.h>
 #include <simlibplugin.h>
 #include <datasource.h>
 #include <stats.h>
 #include "datasource.h"
+#include "binarydatasource.h"
 #include "symbolssource.h"
 #include "statshandler.h"
 #include <pluginhelper1.h>
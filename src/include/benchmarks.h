@@ -0,0 +1,255 @@
+/*
+Copyright (C) 2018 Adrian Michel
+http://www.amichel.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+/** @file
+ * \brief Microbenchmarks of the framework internals
+ *
+ * The benchmarks are run by the benchmarks tool. Each one prints a table of
+ * its timings to a stream. The helpers below are shared by the benchmarks
+ * implemented in core and in the tool itself.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <thread>
+#include <vector>
+#include "core.h"
+
+namespace tradery {
+namespace benchmarks {
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * Returns the seconds elapsed since a time point
+ */
+inline double seconds(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * Runs f(thread), for thread from 0 to threads - 1, each on its own thread
+ *
+ * The threads wait for each other before calling f, so they really run at the
+ * same time, and the time is measured from the moment they are all ready.
+ *
+ * @return the seconds it took for all the calls to complete
+ */
+template <class F>
+double runThreads(unsigned int threads, F f) {
+  std::atomic<unsigned int> ready(0);
+  std::atomic<bool> go(false);
+  std::vector<std::thread> t;
+  t.reserve(threads);
+  for (unsigned int n = 0; n < threads; n++)
+    t.push_back(std::thread([&ready, &go, &f, n]() {
+      ready++;
+      while (!go) std::this_thread::yield();
+      f(n);
+    }));
+
+  while (ready < threads) std::this_thread::yield();
+  Clock::time_point start(Clock::now());
+  go = true;
+  for (unsigned int n = 0; n < threads; n++) t[n].join();
+  return seconds(start);
+}
+
+/**
+ * Returns the thread counts a benchmark runs with: 1, 2, 4... up to and
+ * including maxThreads
+ */
+inline std::vector<unsigned int> threadCounts(unsigned int maxThreads) {
+  std::vector<unsigned int> counts;
+  for (unsigned int n = 1; n < maxThreads; n *= 2) counts.push_back(n);
+  counts.push_back(max2(maxThreads, 1u));
+  return counts;
+}
+
+/**
+ * Returns the p percentile, from 0 to 100, of samples sorted in ascending
+ * order
+ */
+inline double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t n = (size_t)(p / 100 * (sorted.size() - 1) + 0.5);
+  return sorted[min2(n, sorted.size() - 1)];
+}
+
+/**
+ * Cache contention: threads look up the series of a few indicators on each
+ * symbol of a shared list, as the runnables of a session do, and each series
+ * is built on the first lookup
+ *
+ * It runs with each thread count, once with the cache as it is, and once
+ * with all the lookups serialized on one lock, the way the cache used to hold
+ * its lock for the whole lookup, including the build.
+ *
+ * @param os      receives the results
+ * @param threads the max number of threads
+ * @param symbols the number of symbols
+ * @param passes  the number of times each thread goes through the symbols
+ */
+CORE_API void cacheContention(std::ostream& os, unsigned int threads,
+                              size_t symbols, size_t passes);
+
+/**
+ * Cache lookup latency: threads look up series at random in a working set
+ * larger than the cache, so lookups hit, miss and cause evictions, and the
+ * time of each lookup is recorded
+ *
+ * It runs once with the release driven eviction alone, and once with a
+ * janitor thread that also runs an eviction pass every 10 ms, the way the
+ * cache used to poll, and prints the latency percentiles of each.
+ *
+ * @param os      receives the results
+ * @param threads the number of threads
+ * @param lookups the number of lookups by each thread
+ */
+CORE_API void cacheLatency(std::ostream& os, unsigned int threads,
+                           size_t lookups);
+
+/**
+ * Thread placement: the threads of a scheduler thread pool each fill a buffer
+ * and then read it, and read the buffer of a thread on another node, with
+ * each of the thread placements
+ *
+ * On NUMA machines, the pinned placements keep the local reads on the memory
+ * of their own node, while the remote reads go to another node. Without
+ * pinning, the threads may move away from the memory they filled.
+ *
+ * @param os        receives the results
+ * @param threads   the number of pool threads
+ * @param megabytes the size of the buffer of each thread
+ * @param passes    the number of times each buffer is read
+ */
+CORE_API void threadPlacement(std::ostream& os, unsigned int threads,
+                              size_t megabytes, size_t passes);
+
+/**
+ * Cache ids: builds the ids of the series of deep expressions on each symbol,
+ * and looks them up in a map ordered by id, as the series cache does on each
+ * lookup
+ *
+ * It runs once with the ids made as strings, the way they used to be, by
+ * appending each operation to the id of its input, and once with the
+ * structural hashes, and prints the cost of each.
+ *
+ * @param os      receives the results
+ * @param symbols the number of symbols
+ * @param depth   the number of operations in the expression on each symbol
+ * @param repeats the number of times the ids are built and looked up
+ */
+CORE_API void cacheIds(std::ostream& os, size_t symbols, size_t depth,
+                       size_t repeats);
+
+/**
+ * Series kernels: times each elementwise kernel in all the instruction sets
+ * supported by the processor, and each indicator calculated with the kernels
+ * against the calculation it replaces, on random values
+ *
+ * It also checks the results: the number of values that are not the same, bit
+ * for bit, as those of the plain C++ kernels, or of the replaced calculations,
+ * is printed for each, and should be 0.
+ *
+ * @param os      receives the results
+ * @param size    the number of values
+ * @param period  the period of the indicators
+ * @param repeats the number of runs of each kernel, the fastest one is
+ *                reported
+ */
+CORE_API void seriesKernels(std::ostream& os, size_t size, unsigned int period,
+                            size_t repeats);
+
+/**
+ * Compound operations: times the compound assignment operators of a series,
+ * with a series and with a value, done in place, against the way they used to
+ * be done: a new series made through the series cache, whose values are
+ * copied back
+ *
+ * The number of values that are not the same, bit for bit, both ways is
+ * printed for each operator, and should be 0. Needs the series cache, made by
+ * tradery::init.
+ *
+ * @param os      receives the results
+ * @param size    the number of values of the series
+ * @param repeats the number of runs of each operator, the fastest one is
+ *                reported
+ */
+CORE_API void compoundOps(std::ostream& os, size_t size, size_t repeats);
+
+/**
+ * Expressions: times an expression on 4 series calculated one operation at a
+ * time, each into a new series, as the series operators used to, and fused
+ * in one pass, as the operators do now when they defer the calculation
+ *
+ * It also checks the results of the Series operators: for the expression, for
+ * an operand modified after the expression on it is made, and for a result
+ * modified after another expression is made from it. The number of values
+ * that are not the same, bit for bit, as those calculated one operation at a
+ * time is printed for each, and should be 0. Needs the series cache, made and
+ * enabled by tradery::init.
+ *
+ * @param os      receives the results
+ * @param size    the number of values of the series
+ * @param repeats the number of runs of each way, the fastest one is reported
+ */
+CORE_API void expressions(std::ostream& os, size_t size, size_t repeats);
+
+/**
+ * Positions: creates closed positions on a few symbols, and times the
+ * predefined sorts and the sum of the gains done through the position
+ * handles, the way they used to be, and on the columns of the positions
+ *
+ * @param os      receives the results
+ * @param count   the number of positions
+ * @param repeats the number of runs of each operation, the fastest one is
+ *                reported
+ */
+CORE_API void positions(std::ostream& os, size_t count, size_t repeats);
+
+/**
+ * Reference counts: 1, 8 and 32 threads copy and destroy a ManagedPtr, all of
+ * them the same one, or each its own, and do the same with a count under a
+ * lock, the way the references used to be counted
+ *
+ * @param os     receives the results
+ * @param copies the number of copies made and destroyed by each thread
+ */
+CORE_API void refCounts(std::ostream& os, size_t copies);
+
+/**
+ * Logging: threads log lines to a file, through the log, which queues them
+ * for its writer thread, and the way lines used to be logged, each written
+ * with a lock held and the file opened for it
+ *
+ * The time of the log includes writing what is still queued once the threads
+ * are done.
+ *
+ * @param os      receives the results
+ * @param threads the max number of threads
+ * @param lines   the number of lines logged by each thread
+ */
+CORE_API void logging(std::ostream& os, unsigned int threads, size_t lines);
+
+}  // namespace benchmarks
+}  // namespace tradery
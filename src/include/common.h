@@ -363,6 +363,9 @@ class RunnableRunInfo {
   const bool _errors;
   const std::string& _threadName;
   const unsigned int _cpuNumber;
+  // tasks run and stolen so far by the thread that sent the status
+  const unsigned long _threadTasks;
+  const unsigned long _threadStolenTasks;
 
  public:
   /**
@@ -373,11 +376,14 @@ class RunnableRunInfo {
    * @param dataDuration
    * @param runnableDuration
    * @param errors
+   * @param threadTasks
+   * @param threadStolenTasks
    */
   RunnableRunInfo(const std::string& status, const std::string& symbol,
                   double dataDuration, double runnableDuration,
                   unsigned __int64 dataUnitCount, bool errors,
-                  const std::string& threadName)
+                  const std::string& threadName, unsigned long threadTasks = 0,
+                  unsigned long threadStolenTasks = 0)
       : _status(status),
         _symbol(symbol),
         _dataDuration(dataDuration),
@@ -385,7 +391,9 @@ class RunnableRunInfo {
         _errors(errors),
         _dataUnitCount(dataUnitCount),
         _threadName(threadName),
-        _cpuNumber(getCurrentCPUNumber()) {}
+        _cpuNumber(getCurrentCPUNumber()),
+        _threadTasks(threadTasks),
+        _threadStolenTasks(threadStolenTasks) {}
 
   /**
    *
@@ -401,6 +409,8 @@ class RunnableRunInfo {
 
   const std::string& threadName() const { return _threadName; }
   unsigned long cpuNumber() const { return _cpuNumber; }
+  unsigned long threadTasks() const { return _threadTasks; }
+  unsigned long threadStolenTasks() const { return _threadStolenTasks; }
 
   unsigned __int64 dataUnitCount() const { return _dataUnitCount; }
 
@@ -800,7 +810,108 @@ CORE_API bool unregisterDataSource(DataSource* dataSource);
 CORE_API bool unregisterDataSource(const UniqueId& dataSourceId);
 //<!-- TODO: temporary -->
 
-CORE_API void init(unsigned int cacheSize);
+/**
+ * The order in which unused objects are evicted from the internal caches when
+ * they go over their memory budget
+ */
+enum CachePolicy {
+  // least recently used
+  lru_cache_policy,
+  // least frequently used
+  lfu_cache_policy,
+  // greedy dual size frequency - cheap to rebuild and large objects go first
+  gdsf_cache_policy
+};
+
+/**
+ * How the threads of the scheduler thread pool are placed on the processors
+ *
+ * On NUMA machines, the pinned placements keep each pool thread on one node,
+ * and the data of a symbol is loaded on the node of the thread that runs it,
+ * so the runnables work on local memory.
+ */
+enum ThreadPlacement {
+  // the threads run on any processor
+  no_placement,
+  // each thread prefers a different processor, without being restricted to it
+  ideal_processor_placement,
+  // each thread is pinned to a processor, filling the cores of a node before
+  // moving on to the next node
+  compact_placement,
+  // each thread is pinned to a processor, spreading the threads over the nodes
+  // and then over the cores of each node before using their hyperthreads
+  scatter_placement,
+  // the threads are spread over the nodes, each thread is restricted to the
+  // processors of its node
+  node_placement
+};
+
+/**
+ * Usage counters of an internal cache, used to size the cache memory
+ */
+class CacheStats {
+ public:
+  unsigned __int64 hits;
+  unsigned __int64 misses;
+  unsigned __int64 evictions;
+  // current number of cached objects and their approximate memory usage
+  unsigned __int64 items;
+  unsigned __int64 bytes;
+
+  CacheStats() : hits(0), misses(0), evictions(0), items(0), bytes(0) {}
+};
+
+/**
+ * Initializes the series and data caches
+ *
+ * The data cache is always enabled. The series cache, which shares the
+ * indicators and the results of the series operations between the systems and
+ * the symbols, is only enabled if seriesCache is true: its series are found by
+ * the way they were calculated, so the systems that modify a series, and then
+ * calculate something else from it, get the result calculated from its
+ * previous values. When disabled, every series is calculated when asked for.
+ *
+ * The caches evict their items with the policy, when the data cache is over
+ * cacheSize items, the series cache over 100 series, or either of them over
+ * cacheMemory bytes.
+ *
+ * @param cacheSize   max number of items in the data cache
+ * @param cacheMemory max memory in bytes used by each of the series and data
+ * caches, 0 for no limit
+ * @param cachePolicy eviction policy used by the caches
+ * @param seriesCache enables the series cache if true, set by the seriescache
+ * configuration option
+ */
+CORE_API void init(unsigned int cacheSize, unsigned __int64 cacheMemory = 0,
+                   CachePolicy cachePolicy = gdsf_cache_policy,
+                   bool seriesCache = false);
+/**
+ * Releases what init created, and stops the log writer thread once it has
+ * written the queued lines
+ */
 CORE_API void uninit();
 CORE_API void setDataCacheSize(unsigned int cacheSize);
+/**
+ * Configures the loading of the symbols data ahead of the runnables. Applies
+ * to the runs started after the call.
+ *
+ * @param window  number of symbols whose data each runnable thread requests
+ * ahead, 0 to disable prefetching, in which case each runnable thread loads
+ * its own data
+ * @param threads number of threads loading the data, on each NUMA node used by
+ * the thread pool
+ */
+CORE_API void setDataPrefetch(size_t window, unsigned int threads);
+/**
+ * Creates the thread pool shared by all the scheduler runs in the process.
+ * Without a pool, each run creates its own threads. The pool is destroyed by
+ * uninit.
+ *
+ * @param threads   number of threads, 0 for one per processor
+ * @param placement placement of the threads on the processors
+ */
+CORE_API void startThreadPool(unsigned int threads,
+                              ThreadPlacement placement = no_placement);
+CORE_API CacheStats getSeriesCacheStats();
+CORE_API CacheStats getDataCacheStats();
 }  // namespace tradery
\ No newline at end of file
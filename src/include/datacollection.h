@@ -53,6 +53,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *
  */
 
+#include <limits>
 #include <boost/shared_ptr.hpp>
 #include "exceptions.h"
 #include "series.h"
@@ -86,10 +87,16 @@ class BarExtraInfo {
 /**
  * \brief A series of XTime values, implemented as a vector
  *
+ * DateTime holds its ticks by value, so the vector is a contiguous array of
+ * 64 bit integers, with no allocation per value
+ *
  * @see XTime
  */
 typedef std::vector<DateTime> TimeSeriesImpl;
 
+static_assert(sizeof(DateTime) == sizeof(__int64),
+              "DateTime should only hold its ticks");
+
 typedef ManagedPtr<TimeSeriesImpl> TimeSeriesPtr;
 
 class TimeSeries {
@@ -108,6 +115,14 @@ class TimeSeries {
 
   void push_back(const DateTime& dt) { _ts->push_back(dt); }
 
+  // appends the times, taking them over if the series is empty
+  void append(std::vector<DateTime>& times) {
+    if (_ts->empty())
+      _ts->swap(times);
+    else
+      _ts->insert(_ts->end(), times.begin(), times.end());
+  }
+
   const DateTime& at(size_t index) const {
     assert(_ts);
     if (index < _ts->size())
@@ -125,6 +140,13 @@ class TimeSeries {
       return at(index);
   }
 
+  // the vector of times read through operator[], which is the one of the
+  // reference if the series is synchronized. Identifies the times without
+  // copying them
+  const TimeSeriesImpl* times() const {
+    return _s ? _s->timeSeries().times() : _ts.get();
+  }
+
   std::pair<DateTime, DateTime> unsyncStartEnd() const {
     return _ts->size() > 0
                ? std::pair<DateTime, DateTime>(_ts->operator[](0),
@@ -185,8 +207,8 @@ class Bar : public DataUnit {
   BarStatus _status;
 
  private:
-  BarStatus status(const DateTime& time, double open, double high, double low,
-                   double close, unsigned long volume) {
+  static BarStatus status(const DateTime& time, double open, double high,
+                          double low, double close, unsigned long volume) {
     return open == 0 && high == 0 && low == 0 && close == 0 && volume == 0
                ? empty
                : (high < open
@@ -316,6 +338,11 @@ class Bar : public DataUnit {
   }
   */
   bool isValid() const { return _status == valid; }
+  // same as isValid, without making the bar
+  static bool isValid(double open, double high, double low, double close,
+                      unsigned long volume) {
+    return status(DateTime(), open, high, low, close, volume) == valid;
+  }
   BarStatus getStatus() const { return _status; }
   std::string getStatusAsString() const {
     std::string str = date().toString() + ": ";
@@ -790,6 +817,67 @@ typedef DataHandler<Ticks> TickHandler;
 typedef DataCollectionBase<Bar, BarHandler> BarsBase;
 typedef DataCollectionBase<Tick, TickHandler> TicksBase;
 
+/**
+ * The values of a run of bars, with a vector for each field, as made by a data
+ * source before they are added to a bars collection all at once
+ *
+ * @see BarColumnsAddable
+ */
+class BarColumns {
+ public:
+  std::vector<DateTime> time;
+  std::vector<double> open;
+  std::vector<double> high;
+  std::vector<double> low;
+  std::vector<double> close;
+  std::vector<double> volume;
+  std::vector<double> openInterest;
+
+ public:
+  size_t size() const { return time.size(); }
+  bool empty() const { return time.empty(); }
+
+  void add(const DateTime& t, double o, double h, double l, double c,
+           unsigned long v, unsigned long oi = 0) {
+    time.push_back(t);
+    open.push_back(o);
+    high.push_back(h);
+    low.push_back(l);
+    close.push_back(c);
+    volume.push_back(v);
+    openInterest.push_back(oi);
+  }
+
+  const Bar bar(size_t index) const {
+    return Bar(time[index], open[index], high[index], low[index], close[index],
+               (unsigned long)volume[index],
+               (unsigned long)openInterest[index]);
+  }
+};
+
+/**
+ * Implemented by the bars collections that can add whole columns of values at
+ * once, instead of one bar at a time
+ *
+ * @see BarColumns
+ */
+class BarColumnsAddable {
+ public:
+  virtual ~BarColumnsAddable() {}
+
+  /**
+   * Adds the bars at the end of the collection, checking them the same way as
+   * Addable::add
+   *
+   * The values are moved into the collection when possible, so the columns
+   * should not be used afterwards
+   *
+   * @param columns the bars
+   * @exception BarException
+   */
+  virtual void addColumns(BarColumns& columns) = 0;
+};
+
 /**
  * Abstract class - base class for a collection of ticks.
  *
@@ -1686,6 +1774,62 @@ class Bars : private BarsAbstr {
   }
 };
 
+/**
+ * Several bars aligned on a common calendar, for systems that work on a
+ * portfolio of symbols at once
+ *
+ * The calendar is the union of the times of all the bars. For each bars and
+ * each time of the calendar, the index is that of the bar at that time, or of
+ * the last bar before it, or -1 if the bars start after it. The bars
+ * themselves are not synchronized, and the indexes are those of their
+ * unsynchronized bars
+ */
+class AlignedBars {
+ private:
+  std::vector<Bars> _bars;
+  std::vector<DateTime> _calendar;
+  // for each bars, one index for each time of the calendar
+  std::vector<std::vector<int> > _indexes;
+
+ public:
+  /**
+   * Aligns the bars in one call
+   *
+   * @param bars   the bars, which must all be valid
+   *
+   * @return the aligned bars
+   */
+  CORE_API static AlignedBars make(const std::vector<Bars>& bars);
+
+  const std::vector<DateTime>& calendar() const { return _calendar; }
+  size_t size() const { return _bars.size(); }
+  const Bars& bars(size_t n) const { return _bars[n]; }
+  const std::vector<int>& indexes(size_t n) const { return _indexes[n]; }
+
+  /**
+   * Returns the values of one series of all the bars on the calendar
+   *
+   * The matrix has a row for each time of the calendar and a column for each
+   * bars, in row major order, with NaN before the first bar of a bars
+   *
+   * @param series the series to get from each bars, such as &Bars::closeSeries
+   *
+   * @return the matrix
+   */
+  std::vector<double> matrix(const Series (Bars::*series)() const) const {
+    std::vector<double> m(_calendar.size() * _bars.size(),
+                          std::numeric_limits<double>::quiet_NaN());
+    for (size_t n = 0; n < _bars.size(); n++) {
+      const Series s((_bars[n].*series)());
+      const double* values = s.getArray();
+      const std::vector<int>& indexes(_indexes[n]);
+      for (size_t c = 0; c < indexes.size(); c++)
+        if (indexes[c] >= 0) m[c * _bars.size() + n] = values[indexes[c]];
+    }
+    return m;
+  }
+};
+
 typedef boost::shared_ptr<BarsBase> BarsPtr;
 typedef boost::shared_ptr<Ticks> TicksPtr;
 
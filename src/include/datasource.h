@@ -155,6 +155,22 @@ class DATASOURCE_API DataSource : public PluginConfiguration {
   virtual bool isConsistent(const std::string& stamp, const Symbol& si,
                             DateTimeRangePtr range = 0) const
       throw(DataSourceException) = 0;
+
+  /**
+   * Returns an estimate of the amount of data available for a symbol, without
+   * loading it.
+   *
+   * The value has no unit, it is only compared to the values returned for
+   * other symbols by the same data source, so the scheduler can start with the
+   * symbols that take longest to run. The default implementation returns 0,
+   * meaning no estimate.
+   *
+   * @param dataInfo the symbol
+   * @return the estimate
+   */
+  virtual unsigned __int64 dataSizeHint(const DataInfo* dataInfo) const {
+    return 0;
+  }
 };
 
 /**
@@ -189,6 +205,18 @@ class DATASOURCE_API SymbolsIterator {
   virtual SymbolConstPtr getFirst() = 0;
   virtual SymbolConstPtr getCurrent() = 0;
   virtual bool hasMore() = 0;
+  /**
+   * Gets all the symbols, from the first one
+   *
+   * The default implementation goes through the symbols with getFirst and
+   * getNext, and leaves the iterator at the first symbol. The iterators that
+   * are shared by several threads override it, to get the symbols without
+   * changing the position, so it can be called while other threads are
+   * iterating
+   *
+   * @return the symbols, in the order of the iteration
+   */
+  virtual std::vector<SymbolConstPtr> getAll();
 };
 
 typedef std::auto_ptr<SymbolsIterator> SymbolsIteratorPtr;
@@ -20,6 +20,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma warning(disable : 4800 4275 4251 4244 4003)
 
+#include <iomanip>
+#include <sstream>
 #include "strings.h"
 #include "sharedptr.h"
 
@@ -42,7 +44,11 @@ class TimeDurationAbstr {
   MISC_API static TimeDurationAbstrPtr make(__int64 hours, __int64 mins,
                                             __int64 secs, __int64 frac_sec);
   MISC_API static TimeDurationAbstrPtr make(const TimeDurationAbstr& date);
+  MISC_API static TimeDurationAbstrPtr makeFromTicks(__int64 ticks);
 
+  // the duration in microseconds, not meaningful for the special values
+  virtual __int64 ticks() const = 0;
+  virtual bool is_special() const = 0;
   virtual long hours() const = 0;
   virtual long minutes() const = 0;
   virtual long seconds() const = 0;
@@ -156,6 +162,15 @@ class DateTimeAbstr {
   virtual std::string to_simple_string() const = 0;
   virtual std::string to_iso_string() const = 0;
   virtual __int64 to_epoch_time() const = 0;
+  // the ticks of the special values, ordered the same as in the
+  // implementation: negative infinity before and positive infinity after all
+  // the other values. Not a date time isn't less or greater than anything
+  static const __int64 NEG_INFINITY_TICKS = -0x7fffffffffffffffLL - 1;
+  static const __int64 POS_INFINITY_TICKS = 0x7fffffffffffffffLL;
+  static const __int64 NOT_A_DATE_TIME_TICKS = 0x7fffffffffffffffLL - 1;
+
+  // microseconds since 1970-01-01 00:00:00, or the ticks of a special value
+  virtual __int64 ticks() const = 0;
   virtual bool operator<(const DateTimeAbstr& xtime) const = 0;
   virtual bool operator>(const DateTimeAbstr& xtime) const = 0;
   virtual bool operator>=(const DateTimeAbstr& xtime) const = 0;
@@ -173,6 +188,7 @@ class DateTimeAbstr {
   MISC_API static DateTimeAbstrPtr make(const DateAbstr& date);
   MISC_API static DateTimeAbstrPtr make(const DateTimeAbstr& time);
   MISC_API static DateTimeAbstrPtr make(__int64 time);
+  MISC_API static DateTimeAbstrPtr makeFromTicks(__int64 ticks);
   MISC_API static DateTimeAbstrPtr makeFromIsoString(
       const std::string& iso_string);
   MISC_API static DateTimeAbstrPtr makeFromDelimitedString(
@@ -1174,30 +1190,112 @@ class NotADate : public Date {};
  * on the OS and the machine it's running on.
  *
  * A time can be interpreted as a date + time of day
+ *
+ * The time is held by value, as the number of microseconds since 1970-01-01
+ * 00:00:00, with the special values encoded at the ends of the range, so
+ * copies and comparisons don't allocate or go through virtual calls, and a
+ * vector of DateTime is a contiguous array of 64 bit integers. The other
+ * operations go through a temporary DateTimeAbstr.
  */
 class DateTime {
  private:
-  DateTimeAbstrPtr _date_time;
-#if _DEBUG
-  std::string _str;
-#endif
+  __int64 _ticks;
+
+ private:
+  static bool less(__int64 ticks1, __int64 ticks2) {
+    return ticks1 != DateTimeAbstr::NOT_A_DATE_TIME_TICKS &&
+           ticks2 != DateTimeAbstr::NOT_A_DATE_TIME_TICKS && ticks1 < ticks2;
+  }
+
+  // only used for the special values, the others are handled from the ticks
+  DateTimeAbstrPtr abstr() const {
+    return DateTimeAbstr::makeFromTicks(_ticks);
+  }
+
+  static const __int64 TICKS_PER_SECOND = 1000000;
+  static const __int64 TICKS_PER_DAY = 86400 * TICKS_PER_SECOND;
+  // the times that can be represented, in seconds since 1970-01-01 00:00:00:
+  // from 1400-01-01 00:00:00 to 9999-12-31 23:59:59
+  static const __int64 MIN_SECONDS = -17987443200LL;
+  static const __int64 MAX_SECONDS = 253402300799LL;
+
+  static __int64 secondsToTicks(__int64 seconds) throw(DateException) {
+    if (seconds < MIN_SECONDS || seconds > MAX_SECONDS) {
+      std::string str;
+      str << seconds;
+      throw DateException(str, "Time out of range: " + str +
+                                   " seconds since 1970-01-01 00:00:00");
+    }
+    return seconds * TICKS_PER_SECOND;
+  }
+
+  /**
+   * Splits the ticks of a time that is not special into the date and the
+   * number of microseconds since midnight, in the proleptic Gregorian
+   * calendar
+   */
+  static void split(__int64 ticks, int& year, unsigned int& month,
+                    unsigned int& day, __int64& timeOfDay) {
+    __int64 days = ticks / TICKS_PER_DAY;
+    timeOfDay = ticks % TICKS_PER_DAY;
+    if (timeOfDay < 0) {
+      days--;
+      timeOfDay += TICKS_PER_DAY;
+    }
+
+    // days since 0000-03-01, in 400 year eras of 146097 days
+    days += 719468;
+    __int64 era = (days >= 0 ? days : days - 146096) / 146097;
+    __int64 dayOfEra = days - era * 146097;
+    __int64 yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 -
+                         dayOfEra / 146096) /
+                        365;
+    __int64 dayOfYear =
+        dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    // the months start in March
+    __int64 m = (5 * dayOfYear + 2) / 153;
+    day = (unsigned int)(dayOfYear - (153 * m + 2) / 5 + 1);
+    month = (unsigned int)(m < 10 ? m + 3 : m - 9);
+    year = (int)(yearOfEra + era * 400 + (month <= 2 ? 1 : 0));
+  }
+
+  // formats a time that is not special, as boost's simple or iso strings
+  std::string format(bool iso) const {
+    static const char* const months[] = {"Jan", "Feb", "Mar", "Apr",
+                                         "May", "Jun", "Jul", "Aug",
+                                         "Sep", "Oct", "Nov", "Dec"};
+    int year;
+    unsigned int month;
+    unsigned int day;
+    __int64 timeOfDay;
+    split(_ticks, year, month, day, timeOfDay);
+
+    __int64 seconds = timeOfDay / TICKS_PER_SECOND;
+    __int64 fraction = timeOfDay % TICKS_PER_SECOND;
+
+    std::ostringstream o;
+    o << std::setfill('0') << std::setw(4) << year;
+    if (iso)
+      o << std::setw(2) << month << std::setw(2) << day << 'T' << std::setw(2)
+        << seconds / 3600 << std::setw(2) << seconds / 60 % 60 << std::setw(2)
+        << seconds % 60;
+    else
+      o << '-' << months[month - 1] << '-' << std::setw(2) << day << ' '
+        << std::setw(2) << seconds / 3600 << ':' << std::setw(2)
+        << seconds / 60 % 60 << ':' << std::setw(2) << seconds % 60;
+    if (fraction != 0) o << (iso ? ',' : '.') << std::setw(6) << fraction;
+    return o.str();
+  }
 
  protected:
-  DateTime(DateTimeAbstrPtr date_time) : _date_time(date_time) {}
+  DateTime(DateTimeAbstrPtr date_time) : _ticks(date_time->ticks()) {}
 
  public:
   /**
    * Default constructor - Creates a DateTime object initialized to
    * not_a_date_time
    */
-  DateTime()
-      : _date_time(DateTimeAbstrPtr(DateTimeAbstr::make()))
-#if _DEBUG
-        ,
-        _str(to_simple_string())
-#endif
-  {
-  }
+  DateTime() : _ticks(DateTimeAbstr::NOT_A_DATE_TIME_TICKS) {}
   /**
    * Constructor that takes a date and a duration as parameters
    *
@@ -1205,13 +1303,7 @@ class DateTime {
    * @param duration The duration
    */
   DateTime(const Date& date, const TimeDuration& duration)
-      : _date_time(DateTimeAbstrPtr(
-            DateTimeAbstr::make(*date._date, *duration._duration)))
-#if _DEBUG
-        ,
-        _str(to_simple_string())
-#endif
-  {
+      : _ticks(DateTimeAbstr::make(*date._date, *duration._duration)->ticks()) {
   }
 
   /**
@@ -1222,39 +1314,67 @@ class DateTime {
    * @param date
    */
   DateTime(const Date& date)
-      : _date_time(DateTimeAbstrPtr(DateTimeAbstr::make(*date._date)))
-#if _DEBUG
-        ,
-        _str(to_simple_string())
-#endif
-  {
-  }
+      : _ticks(DateTimeAbstr::make(*date._date)->ticks()) {}
 
   /**
-   * Copy constructor
+   * Constructs a time from the number of seconds since 1970-01-01 00:00:00
+   *
+   * @param time   The number of seconds
+   * @exception DateException
+   *                   if the time is outside of the range supported by the
+   * library, 1400-01-01 00:00:00 to 9999-12-31 23:59:59
+   */
+  explicit DateTime(__int64 time) : _ticks(secondsToTicks(time)) {}
+
+  /**
+   * Constructs a time from its number of ticks
    *
-   * Constructs an DateTime object from another DateTime
+   * @param ticks  The number of microseconds since 1970-01-01 00:00:00, or one
+   * of the special values, as returned by ticks()
    *
-   * @param time   The source DateTime
+   * @return The time
    */
-  DateTime(const DateTime& time)
-      : _date_time(DateTimeAbstrPtr(DateTimeAbstr::make(*(time._date_time))))
-#if _DEBUG
-        ,
-        _str(to_simple_string())
-#endif
-  {
+  static DateTime fromTicks(__int64 ticks) {
+    DateTime time;
+    time._ticks = ticks;
+    return time;
   }
 
-  DateTime(__int64 time)
-      : _date_time(DateTimeAbstrPtr(DateTimeAbstr::make(time)))
-#if _DEBUG
-        ,
-        _str(to_simple_string())
-#endif
-  {
+  /**
+   * Constructs a time from its parts, in the proleptic Gregorian calendar,
+   * without making a Date and a TimeDuration
+   *
+   * The parts are not checked: the month must be from 1 to 12, the day must
+   * exist in the month, and the time of day must be less than 24 hours.
+   *
+   * @return The time
+   */
+  static DateTime fromParts(int year, unsigned int month, unsigned int day,
+                            unsigned int hours = 0, unsigned int mins = 0,
+                            unsigned int secs = 0) {
+    // the inverse of split: the years start in March, so the leap day is the
+    // last day of the year
+    __int64 y = month <= 2 ? year - 1 : year;
+    __int64 era = (y >= 0 ? y : y - 399) / 400;
+    __int64 yearOfEra = y - era * 400;
+    __int64 m = month > 2 ? month - 3 : month + 9;
+    __int64 dayOfYear = (153 * m + 2) / 5 + day - 1;
+    __int64 dayOfEra =
+        yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    // days since 1970-01-01
+    __int64 days = era * 146097 + dayOfEra - 719468;
+    __int64 seconds = ((__int64)hours * 60 + mins) * 60 + secs;
+    return fromTicks(days * TICKS_PER_DAY + seconds * TICKS_PER_SECOND);
   }
 
+  /**
+   * Returns the number of microseconds since 1970-01-01 00:00:00, or the
+   * encoding of a special value
+   *
+   * @return The number of ticks
+   */
+  __int64 ticks() const { return _ticks; }
+
   /**
    * Operator <
    *
@@ -1265,7 +1385,7 @@ class DateTime {
    * @return true if <, false otherwise
    */
   bool operator<(const DateTime& xtime) const {
-    return _date_time->operator<(*(xtime._date_time));
+    return less(_ticks, xtime._ticks);
   }
   /**
    * Operator >
@@ -1277,7 +1397,7 @@ class DateTime {
    * @return true if >, false otherwise
    */
   bool operator>(const DateTime& xtime) const {
-    return _date_time->operator>(*(xtime._date_time));
+    return less(xtime._ticks, _ticks);
   }
   /**
    * Operator >=
@@ -1289,7 +1409,7 @@ class DateTime {
    * @return true if >=, false otherwise
    */
   bool operator>=(const DateTime& xtime) const {
-    return _date_time->operator>=(*(xtime._date_time));
+    return !less(_ticks, xtime._ticks);
   }
   /**
    * Operator <=
@@ -1301,7 +1421,7 @@ class DateTime {
    * @return true if <, false otherwise
    */
   bool operator<=(const DateTime& xtime) const {
-    return _date_time->operator<=(*(xtime._date_time));
+    return !less(xtime._ticks, _ticks);
   }
   /**
    * Operator ==
@@ -1313,7 +1433,7 @@ class DateTime {
    * @return true if ==, false otherwise
    */
   bool operator==(const DateTime& xtime) const {
-    return _date_time->operator==(*(xtime._date_time));
+    return _ticks == xtime._ticks;
   }
   /**
    * Operator !=
@@ -1325,7 +1445,7 @@ class DateTime {
    * @return true if !=, false otherwise
    */
   bool operator!=(const DateTime& xtime) const {
-    return _date_time->operator!=(*(xtime._date_time));
+    return _ticks != xtime._ticks;
   }
 
   /**
@@ -1339,11 +1459,15 @@ class DateTime {
    * @return The string representation
    */
   std::string to_simple_string() const {
-    return _date_time->to_simple_string();
+    return is_special() ? abstr()->to_simple_string() : format(false);
+  }
+  std::string toString() const { return to_simple_string(); }
+  std::string to_iso_string() const {
+    return is_special() ? abstr()->to_iso_string() : format(true);
+  }
+  __int64 to_epoch_time() const {
+    return is_special() ? abstr()->to_epoch_time() : _ticks / TICKS_PER_SECOND;
   }
-  std::string toString() const { return _date_time->to_simple_string(); }
-  std::string to_iso_string() const { return _date_time->to_iso_string(); }
-  __int64 to_epoch_time() const { return _date_time->to_epoch_time(); }
 
   /**
    * accesor methods
@@ -1352,25 +1476,28 @@ class DateTime {
   /**
    * Gets the date component of the time
    */
-  const Date date() const { return Date(_date_time->date()); }
+  const Date date() const {
+    if (is_special()) return Date(abstr()->date());
+
+    int year;
+    unsigned int month;
+    unsigned int day;
+    __int64 timeOfDay;
+    split(_ticks, year, month, day, timeOfDay);
+    return Date(year, month, day);
+  }
 
   /**
    * gets the "time of day" component of the time
    */
   const TimeDuration time_of_day() const {
-    return TimeDuration(_date_time->time_of_day());
-  }
-  const TimeDuration timeOfDay() const {
-    return TimeDuration(_date_time->time_of_day());
-  }
+    if (is_special()) return TimeDuration(abstr()->time_of_day());
 
-  /**
-   * assignment operator
-   */
-  const DateTime& operator=(const DateTime& time) {
-    if (this != &time) _date_time = DateTimeAbstr::make(*(time._date_time));
-    return *this;
+    __int64 timeOfDay = _ticks % TICKS_PER_DAY;
+    if (timeOfDay < 0) timeOfDay += TICKS_PER_DAY;
+    return TimeDuration(TimeDurationAbstr::makeFromTicks(timeOfDay));
   }
+  const TimeDuration timeOfDay() const { return time_of_day(); }
 
   /**
    * Indicatas whether the current DateTime is a not_a_date_time
@@ -1380,38 +1507,44 @@ class DateTime {
    *
    * @return true if it is not a valid DateTime
    */
-  bool is_not_a_date_time() const { return _date_time->is_not_a_date_time(); }
-  bool isNotADateTime() const { return _date_time->is_not_a_date_time(); }
+  bool is_not_a_date_time() const {
+    return _ticks == DateTimeAbstr::NOT_A_DATE_TIME_TICKS;
+  }
+  bool isNotADateTime() const { return is_not_a_date_time(); }
   /**
    * Indicates whether the curerent DateTime is one of positive or negative
    * infinity
    *
    * @return true if it is a positive or negative infinity
    */
-  bool is_infinity() const { return _date_time->is_infinity(); }
-  bool isInfinity() const { return _date_time->is_infinity(); }
+  bool is_infinity() const { return is_pos_infinity() || is_neg_infinity(); }
+  bool isInfinity() const { return is_infinity(); }
   /**
    * Indicates whether the current DateTime is a positive infinity
    *
    * @return true if positive infinity
    */
-  bool is_pos_infinity() const { return _date_time->is_pos_infinity(); }
-  bool isPosInfinity() const { return _date_time->is_pos_infinity(); }
+  bool is_pos_infinity() const {
+    return _ticks == DateTimeAbstr::POS_INFINITY_TICKS;
+  }
+  bool isPosInfinity() const { return is_pos_infinity(); }
   /**
    * Indicates whether the current DateTime is a negative infinity
    *
    * @return true if negative infinity
    */
-  bool is_neg_infinity() const { return _date_time->is_neg_infinity(); }
-  bool isNegInfinity() const { return _date_time->is_neg_infinity(); }
+  bool is_neg_infinity() const {
+    return _ticks == DateTimeAbstr::NEG_INFINITY_TICKS;
+  }
+  bool isNegInfinity() const { return is_neg_infinity(); }
   /**
    * Indicates whether the current DateTime is either an infinity or not a valid
    * value
    *
    * @return true if infinity (positive or negative) or not a valid value
    */
-  bool is_special() const { return _date_time->is_special(); }
-  bool isSpecial() const { return _date_time->is_special(); }
+  bool is_special() const { return is_infinity() || is_not_a_date_time(); }
+  bool isSpecial() const { return is_special(); }
   /**
    * Subtracts a DateTime from the current DateTime and returns the
    * resulting time duration
@@ -1421,7 +1554,9 @@ class DateTime {
    * @return The resulting TimeDuration
    */
   TimeDuration operator-(const DateTime& time) const {
-    return _date_time->operator-(*(time._date_time));
+    if (is_special() || time.is_special())
+      return abstr()->operator-(*time.abstr());
+    return TimeDurationAbstr::makeFromTicks(_ticks - time._ticks);
   }
   /**
    * Adds a DateDuration to the current DateTime and returns the resulting
@@ -1432,7 +1567,8 @@ class DateTime {
    * @return The resulting DateTime
    */
   DateTime operator+(const DateDuration& dd) const {
-    return _date_time->operator+(*(dd._duration));
+    if (is_special()) return abstr()->operator+(*(dd._duration));
+    return fromTicks(_ticks + dd._duration->days() * TICKS_PER_DAY);
   }
   /**
    * Adds a DateDuration to the current DateTime, assigns the result to the
@@ -1442,9 +1578,7 @@ class DateTime {
    *
    * @return The resulting DateTime
    */
-  DateTime operator+=(const DateDuration& dd) {
-    return _date_time->operator+=(*(dd._duration));
-  }
+  DateTime operator+=(const DateDuration& dd) { return *this = *this + dd; }
   /**
    * Subtracts a DateDuration from the current DateTime and returns the
    * resulting DateTime
@@ -1454,7 +1588,8 @@ class DateTime {
    * @return The resulting DateTime
    */
   DateTime operator-(const DateDuration& dd) const {
-    return _date_time->operator-(*(dd._duration));
+    if (is_special()) return abstr()->operator-(*(dd._duration));
+    return fromTicks(_ticks - dd._duration->days() * TICKS_PER_DAY);
   }
   /**
    * Subtracts a DateDuration from the current DateTime, assigns the result to
@@ -1464,9 +1599,7 @@ class DateTime {
    *
    * @return The resulting DateTime
    */
-  DateTime operator-=(const DateDuration& dd) {
-    return _date_time->operator-=(*(dd._duration));
-  }
+  DateTime operator-=(const DateDuration& dd) { return *this = *this - dd; }
   /**
    * Adds a TimeDuration to the current DateTime and returns the resulting
    * DateTime
@@ -1476,7 +1609,9 @@ class DateTime {
    * @return The resulting DateTime
    */
   DateTime operator+(const TimeDuration& td) const {
-    return _date_time->operator+(*(td._duration));
+    if (is_special() || td._duration->is_special())
+      return abstr()->operator+(*(td._duration));
+    return fromTicks(_ticks + td._duration->ticks());
   }
   /**
    * Adds a TimeDuration to the current DateTime, assigns the result to the
@@ -1486,9 +1621,7 @@ class DateTime {
    *
    * @return The resulting DateTime
    */
-  DateTime operator+=(const TimeDuration& td) {
-    return _date_time->operator+=(*(td._duration));
-  }
+  DateTime operator+=(const TimeDuration& td) { return *this = *this + td; }
   /**
    * Subtracts a TimeDuration from the current DateTime and returns the
    * resulting DateTime
@@ -1498,7 +1631,9 @@ class DateTime {
    * @return The resulting DateTime
    */
   DateTime operator-(const TimeDuration& td) const {
-    return _date_time->operator-(*(td._duration));
+    if (is_special() || td._duration->is_special())
+      return abstr()->operator-(*(td._duration));
+    return fromTicks(_ticks - td._duration->ticks());
   }
   /**
    * Subtracts a TimeDuration from the current DateTime, assigns the result to
@@ -1508,9 +1643,7 @@ class DateTime {
    *
    * @return The resulting DateTime
    */
-  DateTime operator-=(const TimeDuration& td) {
-    return _date_time->operator-=(*(td._duration));
-  }
+  DateTime operator-=(const TimeDuration& td) { return *this = *this - td; }
 };
 
 class PosInfinityDateTime : public DateTime {
@@ -23,6 +23,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define DEFAULT_REVERSE_HEARTBEAT_PERIOD 10
 #define DEFAULT_INITIAL_CAPITAL 100000.00
 #define DEFAULT_CACHE_SIZE 200
+// in MB, 0 for no limit
+#define DEFAULT_CACHE_MEMORY 0
+#define DEFAULT_CACHE_POLICY gdsf_cache_policy
+// the series cache is off by default, see tradery::init
+#define DEFAULT_SERIES_CACHE false
+// number of symbols loaded ahead by each runnable thread, 0 to disable
+#define DEFAULT_PREFETCH_WINDOW 2
+#define DEFAULT_PREFETCH_THREADS 2
+// 0 for one thread per processor
+#define DEFAULT_POOL_THREADS 0
+#define DEFAULT_THREAD_PLACEMENT no_placement
 #define DEFAULT_SLIPPAGE_VALUE 0
 #define DEFAULT_COMMISION_VALUE 0
 #define DEFAULT_MAX_LINES_PER_FILE 200
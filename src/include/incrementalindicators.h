@@ -0,0 +1,867 @@
+/*
+Copyright (C) 2018 Adrian Michel
+http://www.amichel.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <math.h>
+#include <deque>
+#include <vector>
+#include <nlohmann\json.hpp>
+#include "misc.h"
+#include "datacollection.h"
+
+/* @cond */
+namespace tradery {
+/* @endcond */
+
+/**
+ * \defgroup IncrementalIndicators Incremental indicators
+ *
+ * Indicators updated one bar at a time, in constant time, or amortized
+ * constant time for the rolling min, max and Aroon, for generating signals on
+ * the newest bar without recalculating the whole history.
+ *
+ * Each indicator does the same arithmetic, in the same order, as the batch
+ * series with the same name, so after each update, value() is the same, bit
+ * for bit, as the last value of the batch series calculated on all the bars
+ * so far, as long as the batch series is calculated on more bars than its
+ * lookback, which is when the batch calculation starts producing values.
+ * Before the first value, value() is 0, as the batch series.
+ *
+ * The state is saved with to_json, for example at the end of a backtest, and
+ * restored with the constructor that takes the json, to continue with the
+ * bars that come after.
+ *
+ * Example:
+ * \code
+ * IncrementalRSI rsi(14);
+ * for (size_t bar = 0; bar < close.size(); bar++) rsi.update(close[bar]);
+ *
+ * nlohmann::json state;
+ * rsi.to_json(state);
+ * ...
+ * IncrementalRSI resumed(state);
+ * resumed.update(newClose);
+ * \endcode
+ * @{
+ */
+
+/**
+ * Base class of the incremental indicators
+ */
+class IncrementalIndicator {
+ protected:
+  // the number of bars processed
+  size_t _bars;
+  double _value;
+
+ protected:
+  IncrementalIndicator() : _bars(0), _value(0) {}
+  IncrementalIndicator(const nlohmann::json& j)
+      : _bars(j.at("bars").get<size_t>()),
+        _value(j.at("value").get<double>()) {}
+
+ public:
+  virtual ~IncrementalIndicator() {}
+
+  /**
+   * Returns the number of bars processed so far
+   */
+  size_t bars() const { return _bars; }
+
+  /**
+   * Returns the value at the last bar, 0 if there is no value yet
+   */
+  double value() const { return _value; }
+
+  /**
+   * Saves the state
+   *
+   * @param j      the json object to save to
+   */
+  virtual void to_json(nlohmann::json& j) const {
+    j["bars"] = _bars;
+    j["value"] = _value;
+  }
+};
+
+/**
+ * Base class of the indicators calculated on a series of values
+ */
+class IncrementalSeriesIndicator : public IncrementalIndicator {
+ protected:
+  IncrementalSeriesIndicator() {}
+  IncrementalSeriesIndicator(const nlohmann::json& j)
+      : IncrementalIndicator(j) {}
+
+ public:
+  /**
+   * Adds the value of the next bar
+   *
+   * @param value  the value
+   * @return the indicator value at the new bar
+   */
+  virtual double update(double value) = 0;
+};
+
+/**
+ * Base class of the indicators calculated on the high, low and close prices
+ */
+class IncrementalBarsIndicator : public IncrementalIndicator {
+ protected:
+  IncrementalBarsIndicator() {}
+  IncrementalBarsIndicator(const nlohmann::json& j) : IncrementalIndicator(j) {}
+
+ public:
+  /**
+   * Adds the next bar
+   *
+   * @return the indicator value at the new bar
+   */
+  virtual double update(double high, double low, double close) = 0;
+  double update(const Bar& bar) {
+    return update(bar.getHigh(), bar.getLow(), bar.getClose());
+  }
+};
+
+/**
+ * The last values of a series, up to a fixed count
+ */
+class RollingWindow {
+ private:
+  std::vector<double> _values;
+  size_t _next;
+  size_t _count;
+
+ public:
+  RollingWindow(size_t size) : _values(size), _next(0), _count(0) {}
+  RollingWindow(const nlohmann::json& j)
+      : _values(j.at("size").get<size_t>()), _next(0), _count(0) {
+    const nlohmann::json& values = j.at("values");
+    for (nlohmann::json::const_iterator i = values.begin(); i != values.end();
+         i++)
+      push(i->get<double>());
+  }
+
+  size_t size() const { return _values.size(); }
+  size_t count() const { return _count; }
+  bool full() const { return _count == _values.size(); }
+
+  /**
+   * Adds a value, replacing the oldest one if the window is full
+   */
+  void push(double value) {
+    if (_values.empty()) return;
+
+    _values[_next] = value;
+    _next = (_next + 1) % _values.size();
+    if (_count < _values.size()) _count++;
+  }
+
+  /**
+   * Returns the values in order, index 0 being the oldest
+   */
+  double operator[](size_t index) const {
+    assert(index < _count);
+    return _values[((full() ? _next : 0) + index) % _values.size()];
+  }
+
+  void to_json(nlohmann::json& j) const {
+    j["size"] = _values.size();
+    nlohmann::json values = nlohmann::json::array();
+    for (size_t n = 0; n < _count; n++) values.push_back((*this)[n]);
+    j["values"] = values;
+  }
+};
+
+/**
+ * The values of a window of the last bars that can still be the best of the
+ * window, in order, the best one first. Better is true if the first value is
+ * strictly better than the second. The earliest of equal values is kept first.
+ */
+template <class Better>
+class MonotonicWindow {
+ private:
+  typedef std::pair<size_t, double> Entry;
+  std::deque<Entry> _entries;
+
+ public:
+  MonotonicWindow() {}
+  MonotonicWindow(const nlohmann::json& j) {
+    for (nlohmann::json::const_iterator i = j.begin(); i != j.end(); i++)
+      _entries.push_back(
+          Entry(i->at(0).get<size_t>(), i->at(1).get<double>()));
+  }
+
+  /**
+   * Adds the value of a bar and drops the bars before first
+   */
+  void push(size_t bar, double value, size_t first) {
+    while (!_entries.empty() && Better()(value, _entries.back().second))
+      _entries.pop_back();
+    _entries.push_back(Entry(bar, value));
+    while (_entries.front().first < first) _entries.pop_front();
+  }
+
+  size_t bestBar() const { return _entries.front().first; }
+  double best() const { return _entries.front().second; }
+
+  void to_json(nlohmann::json& j) const {
+    j = nlohmann::json::array();
+    for (std::deque<Entry>::const_iterator i = _entries.begin();
+         i != _entries.end(); i++)
+      j.push_back(nlohmann::json::array({i->first, i->second}));
+  }
+};
+
+/**
+ * Simple moving average, same as Series::SMA
+ */
+class IncrementalSMA : public IncrementalSeriesIndicator {
+ private:
+  const unsigned int _period;
+  RollingWindow _window;
+  double _sum;
+
+ public:
+  IncrementalSMA(unsigned int period)
+      : _period(period), _window(period), _sum(0) {}
+  IncrementalSMA(const nlohmann::json& j)
+      : IncrementalSeriesIndicator(j),
+        _period(j.at("period").get<unsigned int>()),
+        _window(j.at("window")),
+        _sum(j.at("sum").get<double>()) {}
+
+  virtual double update(double value) {
+    if (_period == 0) return _value;
+
+    if (_window.full()) {
+      _value = _value + (value - _window[0]) / (double)_period;
+    } else {
+      _sum += value;
+      if (_window.count() + 1 == _period) _value = _sum / (double)_period;
+    }
+    _window.push(value);
+    _bars++;
+    return _value;
+  }
+
+  virtual void to_json(nlohmann::json& j) const {
+    IncrementalSeriesIndicator::to_json(j);
+    j["period"] = _period;
+    _window.to_json(j["window"]);
+    j["sum"] = _sum;
+  }
+};
+
+/**
+ * Exponential moving average, same as Series::EMA
+ */
+class IncrementalEMA : public IncrementalSeriesIndicator {
+ private:
+  const unsigned int _period;
+  const double _exp;
+  double _sum;
+
+ public:
+  IncrementalEMA(unsigned int period)
+      : _period(period), _exp(2 / ((double)period + 1)), _sum(0) {}
+  IncrementalEMA(unsigned int period, double exp)
+      : _period(period), _exp(exp), _sum(0) {}
+  IncrementalEMA(const nlohmann::json& j)
+      : IncrementalSeriesIndicator(j),
+        _period(j.at("period").get<unsigned int>()),
+        _exp(j.at("exp").get<double>()),
+        _sum(j.at("sum").get<double>()) {}
+
+  virtual double update(double value) {
+    if (_period == 0) return _value;
+
+    if (_bars < _period) {
+      _sum += value;
+      if (_bars + 1 == _period) _value = _sum / (double)_period;
+    } else
+      _value = _exp * (value - _value) + _value;
+    _bars++;
+    return _value;
+  }
+
+  virtual void to_json(nlohmann::json& j) const {
+    IncrementalSeriesIndicator::to_json(j);
+    j["period"] = _period;
+    j["exp"] = _exp;
+    j["sum"] = _sum;
+  }
+};
+
+/**
+ * Weighted moving average, same as Series::WMA
+ */
+class IncrementalWMA : public IncrementalSeriesIndicator {
+ private:
+  const unsigned int _period;
+  const double _sigma;
+  IncrementalSMA _sma;
+  double _sum;
+
+ public:
+  IncrementalWMA(unsigned int period)
+      : _period(period),
+        _sigma((period + 1) * period / 2),
+        _sma(period),
+        _sum(0) {}
+  IncrementalWMA(const nlohmann::json& j)
+      : IncrementalSeriesIndicator(j),
+        _period(j.at("period").get<unsigned int>()),
+        _sigma((_period + 1) * _period / 2),
+        _sma(j.at("sma")),
+        _sum(j.at("sum").get<double>()) {}
+
+  virtual double update(double value) {
+    if (_period == 0) return _value;
+
+    double sma = _sma.value();
+    _sma.update(value);
+    if (_bars < _period) {
+      _sum += (_bars + 1) * value;
+      if (_bars + 1 == _period) _value = _sum / _sigma;
+    } else
+      _value = _value - sma * (float)_period / _sigma +
+               (double)_period * value / _sigma;
+    _bars++;
+    return _value;
+  }
+
+  virtual void to_json(nlohmann::json& j) const {
+    IncrementalSeriesIndicator::to_json(j);
+    j["period"] = _period;
+    _sma.to_json(j["sma"]);
+    j["sum"] = _sum;
+  }
+};
+
+/**
+ * Standard deviation, same as Series::StdDev
+ */
+class IncrementalStdDev : public IncrementalSeriesIndicator {
+ private:
+  const unsigned int _period;
+  const double _nbDev;
+  RollingWindow _window;
+  double _total1;
+  double _total2;
+
+ public:
+  IncrementalStdDev(unsigned int period, double nbDev)
+      : _period(period),
+        _nbDev(nbDev),
+        _window(period),
+        _total1(0),
+        _total2(0) {}
+  IncrementalStdDev(const nlohmann::json& j)
+      : IncrementalSeriesIndicator(j),
+        _period(j.at("period").get<unsigned int>()),
+        _nbDev(j.at("nbDev").get<double>()),
+        _window(j.at("window")),
+        _total1(j.at("total1").get<double>()),
+        _total2(j.at("total2").get<double>()) {}
+
+  virtual double update(double value) {
+    // TA-Lib rejects periods under 2
+    if (_period < 2) return _value;
+
+    _window.push(value);
+    _total1 += value;
+    _total2 += value * value;
+    if (_window.full()) {
+      double mean1 = _total1 / (double)_period;
+      double mean2 = _total2 / (double)_period;
+      double variance = mean2 - mean1 * mean1;
+      _value = variance < 0.00000001 ? 0 : sqrt(variance) * _nbDev;
+
+      double trailing = _window[0];
+      _total1 -= trailing;
+      _total2 -= trailing * trailing;
+    }
+    _bars++;
+    return _value;
+  }
+
+  virtual void to_json(nlohmann::json& j) const {
+    IncrementalSeriesIndicator::to_json(j);
+    j["period"] = _period;
+    j["nbDev"] = _nbDev;
+    _window.to_json(j["window"]);
+    j["total1"] = _total1;
+    j["total2"] = _total2;
+  }
+};
+
+class SmallerValue {
+ public:
+  bool operator()(double x, double y) const { return x < y; }
+};
+
+class LargerValue {
+ public:
+  bool operator()(double x, double y) const { return x > y; }
+};
+
+/**
+ * Rolling min or max, same as Series::Min and Series::Max
+ */
+template <class Better>
+class IncrementalExtreme : public IncrementalSeriesIndicator {
+ private:
+  const unsigned int _period;
+  MonotonicWindow<Better> _window;
+
+ public:
+  IncrementalExtreme(unsigned int period) : _period(period) {}
+  IncrementalExtreme(const nlohmann::json& j)
+      : IncrementalSeriesIndicator(j),
+        _period(j.at("period").get<unsigned int>()),
+        _window(j.at("window")) {}
+
+  virtual double update(double value) {
+    if (_period < 2) return _value;
+
+    _window.push(_bars, value, _bars + 1 > _period ? _bars + 1 - _period : 0);
+    if (_bars + 1 >= _period) _value = _window.best();
+    _bars++;
+    return _value;
+  }
+
+  virtual void to_json(nlohmann::json& j) const {
+    IncrementalSeriesIndicator::to_json(j);
+    j["period"] = _period;
+    _window.to_json(j["window"]);
+  }
+};
+
+typedef IncrementalExtreme<SmallerValue> IncrementalMin;
+typedef IncrementalExtreme<LargerValue> IncrementalMax;
+
+/**
+ * Aroon up or down, same as Series::AroonUp and Series::AroonDown
+ */
+template <class Better>
+class IncrementalAroon : public IncrementalSeriesIndicator {
+ private:
+  const unsigned int _period;
+  MonotonicWindow<Better> _window;
+
+ public:
+  IncrementalAroon(unsigned int period) : _period(period) {}
+  IncrementalAroon(const nlohmann::json& j)
+      : IncrementalSeriesIndicator(j),
+        _period(j.at("period").get<unsigned int>()),
+        _window(j.at("window")) {}
+
+  virtual double update(double value) {
+    if (_period == 0) return _value;
+
+    // the window is the last period + 1 bars
+    _window.push(_bars, value, _bars > _period ? _bars - _period : 0);
+    if (_bars >= _period) {
+      int x = (int)(_period - (_bars - _window.bestBar()));
+      _value = x < 0 ? 0 : x * 100 / _period;
+    }
+    _bars++;
+    return _value;
+  }
+
+  virtual void to_json(nlohmann::json& j) const {
+    IncrementalSeriesIndicator::to_json(j);
+    j["period"] = _period;
+    _window.to_json(j["window"]);
+  }
+};
+
+typedef IncrementalAroon<LargerValue> IncrementalAroonUp;
+typedef IncrementalAroon<SmallerValue> IncrementalAroonDown;
+
+/**
+ * Relative strength index, same as Series::RSI
+ */
+class IncrementalRSI : public IncrementalSeriesIndicator {
+ private:
+  const unsigned int _period;
+  double _previous;
+  double _gain;
+  double _loss;
+
+ private:
+  void calculate() {
+    double total = _gain + _loss;
+    _value = -0.00000001 < total && total < 0.00000001
+                 ? 0.0
+                 : 100.0 * (_gain / total);
+  }
+
+ public:
+  IncrementalRSI(unsigned int period)
+      : _period(period), _previous(0), _gain(0), _loss(0) {}
+  IncrementalRSI(const nlohmann::json& j)
+      : IncrementalSeriesIndicator(j),
+        _period(j.at("period").get<unsigned int>()),
+        _previous(j.at("previous").get<double>()),
+        _gain(j.at("gain").get<double>()),
+        _loss(j.at("loss").get<double>()) {}
+
+  virtual double update(double value) {
+    if (_period < 2) return _value;
+
+    if (_bars > 0) {
+      double change = value - _previous;
+      if (_bars > _period) {
+        _loss *= (_period - 1);
+        _gain *= (_period - 1);
+      }
+      if (change < 0)
+        _loss -= change;
+      else
+        _gain += change;
+      if (_bars >= _period) {
+        _loss /= _period;
+        _gain /= _period;
+        calculate();
+      }
+    }
+    _previous = value;
+    _bars++;
+    return _value;
+  }
+
+  virtual void to_json(nlohmann::json& j) const {
+    IncrementalSeriesIndicator::to_json(j);
+    j["period"] = _period;
+    j["previous"] = _previous;
+    j["gain"] = _gain;
+    j["loss"] = _loss;
+  }
+};
+
+/**
+ * Bollinger bands, same as Series::BBandUpper and Series::BBandLower. The
+ * value is the middle band.
+ */
+class IncrementalBBands : public IncrementalSeriesIndicator {
+ private:
+  const unsigned int _period;
+  const double _stdDev;
+  RollingWindow _window;
+  double _total;
+  double _total2;
+  double _upper;
+  double _lower;
+
+ public:
+  IncrementalBBands(unsigned int period, double stdDev)
+      : _period(period),
+        _stdDev(stdDev),
+        _window(period),
+        _total(0),
+        _total2(0),
+        _upper(0),
+        _lower(0) {}
+  IncrementalBBands(const nlohmann::json& j)
+      : IncrementalSeriesIndicator(j),
+        _period(j.at("period").get<unsigned int>()),
+        _stdDev(j.at("stdDev").get<double>()),
+        _window(j.at("window")),
+        _total(j.at("total").get<double>()),
+        _total2(j.at("total2").get<double>()),
+        _upper(j.at("upper").get<double>()),
+        _lower(j.at("lower").get<double>()) {}
+
+  double upper() const { return _upper; }
+  double lower() const { return _lower; }
+
+  virtual double update(double value) {
+    if (_period < 2) return _value;
+
+    _window.push(value);
+    _total += value;
+    _total2 += value * value;
+    if (_window.full()) {
+      // the middle band and the deviation are calculated as by TA_BBANDS,
+      // the deviation from the mean of the squares and the moving average
+      _value = _total / _period;
+      double variance = _total2 / _period - _value * _value;
+      double deviation =
+          variance < 0.00000001 ? 0.0 : sqrt(variance) * _stdDev;
+      _upper = _value + deviation;
+      _lower = _value - deviation;
+
+      double trailing = _window[0];
+      _total -= trailing;
+      _total2 -= trailing * trailing;
+    }
+    _bars++;
+    return _value;
+  }
+
+  virtual void to_json(nlohmann::json& j) const {
+    IncrementalSeriesIndicator::to_json(j);
+    j["period"] = _period;
+    j["stdDev"] = _stdDev;
+    _window.to_json(j["window"]);
+    j["total"] = _total;
+    j["total2"] = _total2;
+    j["upper"] = _upper;
+    j["lower"] = _lower;
+  }
+};
+
+/**
+ * True range, same as Bars::TrueRange
+ */
+class IncrementalTrueRange : public IncrementalBarsIndicator {
+ private:
+  double _close;
+
+ public:
+  IncrementalTrueRange() : _close(0) {}
+  IncrementalTrueRange(const nlohmann::json& j)
+      : IncrementalBarsIndicator(j), _close(j.at("close").get<double>()) {}
+
+  using IncrementalBarsIndicator::update;
+  virtual double update(double high, double low, double close) {
+    if (_bars == 0)
+      _value = high - low;
+    else
+      _value = max3(high - low, fabs(_close - high), fabs(_close - low));
+    _close = close;
+    _bars++;
+    return _value;
+  }
+
+  virtual void to_json(nlohmann::json& j) const {
+    IncrementalBarsIndicator::to_json(j);
+    j["close"] = _close;
+  }
+};
+
+/**
+ * Average true range, same as Bars::ATR
+ */
+class IncrementalATR : public IncrementalBarsIndicator {
+ private:
+  const unsigned int _period;
+  IncrementalTrueRange _trueRange;
+  double _sum;
+
+ public:
+  IncrementalATR(unsigned int period) : _period(period), _sum(0) {}
+  IncrementalATR(const nlohmann::json& j)
+      : IncrementalBarsIndicator(j),
+        _period(j.at("period").get<unsigned int>()),
+        _trueRange(j.at("trueRange")),
+        _sum(j.at("sum").get<double>()) {}
+
+  using IncrementalBarsIndicator::update;
+  virtual double update(double high, double low, double close) {
+    if (_period == 0) return _value;
+
+    double trueRange = _trueRange.update(high, low, close);
+    // the true range of the first bar is not used, as by TA_ATR
+    if (_bars > 0) {
+      if (_period == 1)
+        _value = trueRange;
+      else if (_bars <= _period) {
+        _sum += trueRange;
+        if (_bars == _period) _value = _sum / _period;
+      } else {
+        _value *= _period - 1;
+        _value += trueRange;
+        _value /= _period;
+      }
+    }
+    _bars++;
+    return _value;
+  }
+
+  virtual void to_json(nlohmann::json& j) const {
+    IncrementalBarsIndicator::to_json(j);
+    j["period"] = _period;
+    _trueRange.to_json(j["trueRange"]);
+    j["sum"] = _sum;
+  }
+};
+
+/**
+ * MACD, same as Series::MACD, MACDSignal and MACDHist, or with one period,
+ * Series::MACDFix, MACDSignalFix and MACDHistFix. The value is the MACD.
+ *
+ * As TA_MACD, the fast average starts at the same bar as the slow one, from
+ * the average of the last fast period values, and the MACD, the signal and
+ * the histogram all start at the first bar of the signal.
+ */
+class IncrementalMACD : public IncrementalSeriesIndicator {
+ private:
+  unsigned int _fastPeriod;
+  unsigned int _slowPeriod;
+  const unsigned int _signalPeriod;
+  double _fastK;
+  double _slowK;
+  const double _signalK;
+  bool _valid;
+
+  RollingWindow _window;
+  double _slowSum;
+  double _fast;
+  double _slow;
+  double _macdSum;
+  double _signalEMA;
+
+  double _signal;
+  double _hist;
+
+ private:
+  static double k(unsigned int period) { return 2.0 / ((double)(period + 1)); }
+
+ public:
+  IncrementalMACD(unsigned int fastPeriod, unsigned int slowPeriod,
+                  unsigned int signalPeriod)
+      : _fastPeriod(fastPeriod),
+        _slowPeriod(slowPeriod),
+        _signalPeriod(signalPeriod),
+        _fastK(k(fastPeriod)),
+        _slowK(k(slowPeriod)),
+        _signalK(k(signalPeriod)),
+        _valid(fastPeriod >= 2 && slowPeriod >= 2 && signalPeriod >= 1),
+        _window(min2(fastPeriod, slowPeriod)),
+        _slowSum(0),
+        _fast(0),
+        _slow(0),
+        _macdSum(0),
+        _signalEMA(0),
+        _signal(0),
+        _hist(0) {
+    if (_slowPeriod < _fastPeriod) {
+      std::swap(_slowPeriod, _fastPeriod);
+      std::swap(_slowK, _fastK);
+    }
+  }
+
+  // the MACD with fixed 12 and 26 periods
+  IncrementalMACD(unsigned int signalPeriod)
+      : _fastPeriod(12),
+        _slowPeriod(26),
+        _signalPeriod(signalPeriod),
+        _fastK(0.15),
+        _slowK(0.075),
+        _signalK(k(signalPeriod)),
+        _valid(signalPeriod >= 1),
+        _window(12),
+        _slowSum(0),
+        _fast(0),
+        _slow(0),
+        _macdSum(0),
+        _signalEMA(0),
+        _signal(0),
+        _hist(0) {}
+
+  IncrementalMACD(const nlohmann::json& j)
+      : IncrementalSeriesIndicator(j),
+        _fastPeriod(j.at("fastPeriod").get<unsigned int>()),
+        _slowPeriod(j.at("slowPeriod").get<unsigned int>()),
+        _signalPeriod(j.at("signalPeriod").get<unsigned int>()),
+        _fastK(j.at("fastK").get<double>()),
+        _slowK(j.at("slowK").get<double>()),
+        _signalK(j.at("signalK").get<double>()),
+        _valid(j.at("valid").get<bool>()),
+        _window(j.at("window")),
+        _slowSum(j.at("slowSum").get<double>()),
+        _fast(j.at("fast").get<double>()),
+        _slow(j.at("slow").get<double>()),
+        _macdSum(j.at("macdSum").get<double>()),
+        _signalEMA(j.at("signalEMA").get<double>()),
+        _signal(j.at("signal").get<double>()),
+        _hist(j.at("hist").get<double>()) {}
+
+  double signal() const { return _signal; }
+  double hist() const { return _hist; }
+
+  virtual double update(double value) {
+    if (!_valid) return _value;
+
+    // the slow average starts from the average of the first slow period
+    // values, and the fast one from the average of the fast period values up
+    // to the same bar
+    _window.push(value);
+    if (_bars + 1 < _slowPeriod)
+      _slowSum += value;
+    else if (_bars + 1 == _slowPeriod) {
+      _slowSum += value;
+      _slow = _slowSum / _slowPeriod;
+      double fastSum = 0;
+      for (size_t n = 0; n < _window.count(); n++) fastSum += _window[n];
+      _fast = fastSum / _fastPeriod;
+    } else {
+      _slow = ((value - _slow) * _slowK) + _slow;
+      _fast = ((value - _fast) * _fastK) + _fast;
+    }
+
+    if (_bars + 1 >= _slowPeriod) {
+      double macd = _fast - _slow;
+      // the index of the value in the MACD series, from which the signal is
+      // calculated
+      size_t n = _bars + 1 - _slowPeriod;
+      if (n + 1 < _signalPeriod)
+        _macdSum += macd;
+      else {
+        if (n + 1 == _signalPeriod) {
+          _macdSum += macd;
+          _signalEMA = _macdSum / _signalPeriod;
+        } else
+          _signalEMA = ((macd - _signalEMA) * _signalK) + _signalEMA;
+
+        _value = macd;
+        _signal = _signalEMA;
+        _hist = _value - _signal;
+      }
+    }
+    _bars++;
+    return _value;
+  }
+
+  virtual void to_json(nlohmann::json& j) const {
+    IncrementalSeriesIndicator::to_json(j);
+    j["fastPeriod"] = _fastPeriod;
+    j["slowPeriod"] = _slowPeriod;
+    j["signalPeriod"] = _signalPeriod;
+    j["fastK"] = _fastK;
+    j["slowK"] = _slowK;
+    j["signalK"] = _signalK;
+    j["valid"] = _valid;
+    _window.to_json(j["window"]);
+    j["slowSum"] = _slowSum;
+    j["fast"] = _fast;
+    j["slow"] = _slow;
+    j["macdSum"] = _macdSum;
+    j["signalEMA"] = _signalEMA;
+    j["signal"] = _signal;
+    j["hist"] = _hist;
+  }
+};
+
+//@}
+
+}  // namespace tradery
@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include <sys/timeb.h>
+#include <atomic>
 #include <iostream>
 #include <fstream>
 #include <iomanip>
@@ -60,16 +61,27 @@ namespace tradery {
 class LogException {};
 
 // this is the diagnostic logging
+//
+// The level is checked before the message is formatted, and the formatted
+// lines are queued without locking and written by a background thread, which
+// keeps the log file open. Lines of level log_error and above are written
+// before xlog returns.
 
 class LOG_API Log {
  private:
-  static Level _globalLevel;
+  static std::atomic<Level> _globalLevel;
   Level _level;
   Level _thisLevel;
 
   static std::string _logToFile;
   static bool _logToDebugOutput;
   static bool _logToConsole;
+  // lines as json objects instead of text
+  static std::atomic<bool> _logJson;
+  // added to json lines if not empty
+  static std::string _sessionId;
+  // the size over which the log file is rotated, 0 for no limit
+  static unsigned __int64 _maxFileSize;
   static tradery::Mutex _mutex;
 
  public:
@@ -100,14 +112,10 @@ class LOG_API Log {
   }
 
   static bool checkLevel(Level level) {
-    Lock lock(_mutex);
-    return _globalLevel <= level;
+    return _globalLevel.load(std::memory_order_relaxed) <= level;
   }
 
-  static Level level() {
-    Lock lock(_mutex);
-    return _globalLevel;
-  }
+  static Level level() { return _globalLevel; }
 
   static std::string header(Level level, const char* func) {
     assert(func != 0);
@@ -120,21 +128,11 @@ class LOG_API Log {
 
   static void setLevel(Level level);
 
-  static void setDebugLevel() {
-    Lock lock(_mutex);
-    _globalLevel = log_debug;
-  }
-
-  static void setNormalLevel() {
-    Lock lock(_mutex);
-    _globalLevel = log_info;
-  }
+  static void setDebugLevel() { _globalLevel = log_debug; }
 
-  static bool isDebugLevel() {
-    Lock lock(_mutex);
+  static void setNormalLevel() { _globalLevel = log_info; }
 
-    return _globalLevel == log_debug;
-  }
+  static bool isDebugLevel() { return _globalLevel == log_debug; }
 
   static void flipLevel();
 
@@ -155,7 +153,9 @@ class LOG_API Log {
     Lock lock(_mutex);
     return !_logToFile.empty();
   }
-  static const std::string& getLogFileName() {
+  // by value, as the name can be changed by another thread once the lock is
+  // released
+  static std::string getLogFileName() {
     Lock lock(_mutex);
     return _logToFile;
   }
@@ -168,6 +168,34 @@ class LOG_API Log {
     return _logToDebugOutput;
   }
 
+  static void setLogJson(bool json = true) { _logJson = json; }
+  static bool logJson() { return _logJson; }
+  static void setSessionId(const std::string& sessionId) {
+    Lock lock(_mutex);
+    _sessionId = sessionId;
+  }
+  static std::string sessionId() {
+    Lock lock(_mutex);
+    return _sessionId;
+  }
+  // once the log file reaches this size, it is renamed to file.1, file.2 etc
+  // and a new file is started
+  static void setMaxFileSize(unsigned __int64 bytes) {
+    Lock lock(_mutex);
+    _maxFileSize = bytes;
+  }
+  static unsigned __int64 maxFileSize() {
+    Lock lock(_mutex);
+    return _maxFileSize;
+  }
+
+  // writes all the queued lines
+  static void flush();
+  // stops the writer thread once it has written the queued lines. Called on
+  // exit, before the dll is unloaded, as the thread can't be joined then. The
+  // lines logged after this are written by flush
+  static void shutdown();
+
   static void xlog(Level level, const char* function, const std::string& value);
   static void xlog(Level level, const std::string& function,
                    const std::string& value);
@@ -226,11 +254,17 @@ class FileLog : public Log {
 }  // namespace tradery
 
 using tradery::operator<<;
-#define LOG(level, value) \
-  tradery::Log::xlog(level, __FUNCTION__, std::string() << value);
+// the message is only formatted if the level is enabled
+#define LOG(level, value)                                           \
+  if (!tradery::Log::checkLevel(level)) {                           \
+  } else                                                            \
+    tradery::Log::xlog(level, __FUNCTION__, std::string() << value);
 #define LOG1(level, value1, value2) LOG(level, value1 << " - " << value2)
-#define FILE_LOG(fileName, level, value) \
-  tradery::Log::xfilelog(fileName, level, __FUNCTION__, std::string() << value);
+#define FILE_LOG(fileName, level, value)                                \
+  if (!tradery::Log::checkLevel(level)) {                               \
+  } else                                                                \
+    tradery::Log::xfilelog(fileName, level, __FUNCTION__,               \
+                           std::string() << value);
 
 class LogEntryExit {
  private:
@@ -251,15 +285,17 @@ class LogEntryExit {
  public:
   LogEntryExit(Level level, char* name, const std::string& message)
       : m_level(level), m_name(name), m_message(message), m_id(getId()) {
-    tradery::Log::xlog(m_level, const_cast<char*>(m_name.c_str()),
-                       std::string()
-                           << m_message << " - entry [" << m_id << "]");
+    if (tradery::Log::checkLevel(m_level))
+      tradery::Log::xlog(m_level, const_cast<char*>(m_name.c_str()),
+                         std::string()
+                             << m_message << " - entry [" << m_id << "]");
   }
 
   ~LogEntryExit() {
-    tradery::Log::xlog(m_level, const_cast<char*>(m_name.c_str()),
-                       std::string()
-                           << m_message << " - exit [" << m_id << "]");
+    if (tradery::Log::checkLevel(m_level))
+      tradery::Log::xlog(m_level, const_cast<char*>(m_name.c_str()),
+                         std::string()
+                             << m_message << " - exit [" << m_id << "]");
   }
 };
 
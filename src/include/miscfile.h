@@ -167,4 +167,80 @@ class MISCWIN_API SpecialFileWrite : public SpecialFile<std::ofstream> {
 typedef boost::shared_ptr<SpecialFileRead> SpecialFileReadPtr;
 typedef boost::shared_ptr<SpecialFileWrite> SpecialFileWritePtr;
 
+/**
+ * Read only view of a whole file mapped in memory
+ *
+ * Lets parsers scan a file in place, without copying it into stream buffers
+ * or strings. The view is valid for the lifetime of the object.
+ *
+ * An empty file is mapped as an empty range. If the file can't be opened or
+ * mapped, the object evaluates to false and the caller can fall back on
+ * regular file io.
+ */
+class MappedFile {
+ private:
+  HANDLE _file;
+  HANDLE _mapping;
+  const char* _data;
+  unsigned __int64 _size;
+  bool _open;
+
+  // not copyable
+  MappedFile(const MappedFile&);
+  const MappedFile& operator=(const MappedFile&);
+
+  void close() {
+    if (_data != 0) UnmapViewOfFile(_data);
+    if (_mapping != 0) CloseHandle(_mapping);
+    if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+    _data = 0;
+    _mapping = 0;
+    _file = INVALID_HANDLE_VALUE;
+  }
+
+ public:
+  MappedFile(const std::string& fileName)
+      : _file(INVALID_HANDLE_VALUE),
+        _mapping(0),
+        _data(0),
+        _size(0),
+        _open(false) {
+    _file = CreateFile(s2ws(fileName).c_str(), GENERIC_READ, FILE_SHARE_READ,
+                       0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (_file == INVALID_HANDLE_VALUE) return;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(_file, &size) ||
+        (unsigned __int64)size.QuadPart > (size_t)-1) {
+      close();
+      return;
+    }
+    _size = size.QuadPart;
+
+    // a file of size 0 can't be mapped
+    if (_size > 0) {
+      _mapping = CreateFileMapping(_file, 0, PAGE_READONLY, 0, 0, 0);
+      if (_mapping == 0) {
+        close();
+        return;
+      }
+
+      _data = (const char*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+      if (_data == 0) {
+        close();
+        return;
+      }
+    }
+    _open = true;
+  }
+
+  ~MappedFile() { close(); }
+
+  operator bool() const { return _open; }
+
+  const char* begin() const { return _data; }
+  const char* end() const { return _data + _size; }
+  unsigned __int64 size() const { return _size; }
+};
+
 }  // namespace tradery
\ No newline at end of file
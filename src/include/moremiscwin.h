@@ -24,5 +24,38 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define MISCWIN_API __declspec(dllimport)
 #endif
 
+#include <vector>
+
 MISCWIN_API void setCurrentThreadIdealProcessor(unsigned int processor);
 MISCWIN_API unsigned long getCurrentCPUNumber();
+
+/**
+ * A logical processor and its place in the machine topology
+ */
+class LogicalProcessor {
+ public:
+  // index of the processor in the affinity masks
+  unsigned int processor;
+  // physical core, shared by the hyperthreads of the core
+  unsigned int core;
+  // NUMA node, 0 on machines without NUMA
+  unsigned int node;
+
+  LogicalProcessor() : processor(0), core(0), node(0) {}
+};
+
+typedef std::vector<LogicalProcessor> LogicalProcessors;
+
+/**
+ * Returns the logical processors the process can run on, ordered by node, core
+ * and processor.
+ *
+ * Only the processor group of the calling thread is reported, so on machines
+ * with more than 64 logical processors, the others are ignored.
+ */
+MISCWIN_API LogicalProcessors getProcessorTopology();
+/**
+ * Restricts the current thread to the processors in a mask, as returned by
+ * getProcessorTopology
+ */
+MISCWIN_API void setCurrentThreadAffinity(unsigned __int64 mask);
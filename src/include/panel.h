@@ -0,0 +1,347 @@
+/*
+Copyright (C) 2018 Adrian Michel
+http://www.amichel.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+/** @file
+ * \brief Panel data - the bars of all the session symbols on one calendar
+ */
+
+#include <math.h>
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include "system.h"
+
+namespace tradery {
+
+/**
+ * \defgroup Panel Panel data
+ *
+ * Cross-sectional systems, which compare the symbols of the session with each
+ * other at each date (rank by momentum, pairs, sector rotation etc), work on a
+ * panel: the bars of all the symbols aligned on one calendar, with a row for
+ * each date and a column for each symbol.
+ *
+ * A PanelSystem receives the panel of the session symbols, and is called once
+ * for each date with the whole cross-section, instead of once for each symbol.
+ *
+ * The CrossSection operations calculate ranks, z-scores and the top or bottom
+ * symbols of a row of the panel in one call.
+ * @{
+ */
+
+/**
+ * The values of the bars held in a panel
+ */
+enum PanelField {
+  panel_open,
+  panel_high,
+  panel_low,
+  panel_close,
+  panel_volume,
+  panel_fields
+};
+
+class Panel;
+typedef boost::shared_ptr<const Panel> PanelPtr;
+
+/**
+ * The bars of a list of symbols, aligned on the union of their times
+ *
+ * Each field is held as a matrix with a row for each date of the calendar and
+ * a column for each symbol, in row major order, so the values of all the
+ * symbols at one date are contiguous. A symbol that doesn't have a bar at a
+ * date has NaN values there, and a bar index of -1.
+ *
+ * A panel is not modified once made, and the systems that ask for the panel of
+ * the same data share the same one, so it is only made once in the process,
+ * and can be read from all the threads without locking.
+ */
+class Panel {
+ private:
+  std::vector<std::string> _symbols;
+  // holds on to the data of the bars for as long as the panel is used
+  std::vector<BarsPtr> _data;
+  AlignedBars _aligned;
+  // the bar index of each symbol at each date, -1 if it doesn't have a bar
+  std::vector<int> _barIndexes;
+  std::vector<double> _fields[panel_fields];
+
+ private:
+  Panel(const std::vector<std::string>& symbols,
+        const std::vector<BarsPtr>& data);
+
+  size_t cell(size_t date, size_t symbol) const {
+    assert(date < dateCount() && symbol < symbolCount());
+    return date * _symbols.size() + symbol;
+  }
+
+ public:
+  /**
+   * Returns the panel of the symbols of the session of a plugin configuration
+   *
+   * The symbols are those of the session symbols iterator which have bars
+   * data, in the order of the iterator, and the data is that of the session
+   * data source and range.
+   *
+   * The panel is made the first time it is asked for, and shared with the
+   * other callers for as long as it is in use. The callers asking for the
+   * same panel while it is being made wait for it, the others don't.
+   *
+   * The iterator position is not changed, so the other systems using the
+   * session iterator are not affected, and the data of the symbols is loaded
+   * concurrently.
+   *
+   * @param config the plugin configuration, normally the system asking for the
+   * panel
+   *
+   * @return the panel, which has no symbols if none of them has data
+   */
+  CORE_API static PanelPtr make(const PluginConfiguration& config);
+
+  size_t dateCount() const { return _aligned.calendar().size(); }
+  size_t symbolCount() const { return _symbols.size(); }
+  bool empty() const { return _symbols.empty() || dateCount() == 0; }
+
+  const std::vector<DateTime>& dates() const { return _aligned.calendar(); }
+  const DateTime& date(size_t date) const { return dates()[date]; }
+  const std::vector<std::string>& symbols() const { return _symbols; }
+  const std::string& symbol(size_t symbol) const { return _symbols[symbol]; }
+  const Bars& bars(size_t symbol) const { return _aligned.bars(symbol); }
+
+  /**
+   * Returns the bar of a symbol at a date, in its bars
+   *
+   * @return the bar index, or -1 if the symbol doesn't have a bar at the date
+   */
+  int barIndex(size_t date, size_t symbol) const {
+    return _barIndexes[cell(date, symbol)];
+  }
+  bool hasBar(size_t date, size_t symbol) const {
+    return barIndex(date, symbol) >= 0;
+  }
+
+  double value(PanelField field, size_t date, size_t symbol) const {
+    assert(field < panel_fields);
+    return _fields[field][cell(date, symbol)];
+  }
+
+  /**
+   * Returns the values of a field of all the symbols at a date
+   *
+   * @return the symbolCount() values, in the order of the symbols
+   */
+  const double* row(PanelField field, size_t date) const {
+    assert(field < panel_fields && date < dateCount());
+    return &_fields[field][date * _symbols.size()];
+  }
+
+  /**
+   * Returns a whole field, with symbolCount() values for each date
+   */
+  const std::vector<double>& matrix(PanelField field) const {
+    assert(field < panel_fields);
+    return _fields[field];
+  }
+};
+
+/**
+ * Cross-sectional operations, on the values of all the symbols at one date,
+ * such as a row of a panel
+ *
+ * NaN values, which are the symbols without a bar at the date, are left out:
+ * their result is NaN, and they are never selected.
+ */
+class CrossSection {
+ private:
+  static bool isNaN(double value) { return value != value; }
+
+  // the indexes of the values that are not NaN
+  static std::vector<size_t> valid(const double* values, size_t count) {
+    std::vector<size_t> indexes;
+    indexes.reserve(count);
+    for (size_t n = 0; n < count; n++)
+      if (!isNaN(values[n])) indexes.push_back(n);
+    return indexes;
+  }
+
+  template <class Compare>
+  static std::vector<size_t> select(const double* values, size_t count,
+                                    size_t n, Compare compare) {
+    std::vector<size_t> indexes(valid(values, count));
+    n = min2(n, indexes.size());
+    std::partial_sort(indexes.begin(), indexes.begin() + n, indexes.end(),
+                      [values, compare](size_t a, size_t b) {
+                        // ties keep the order of the symbols
+                        return compare(values[a], values[b]) ||
+                               (values[a] == values[b] && a < b);
+                      });
+    indexes.resize(n);
+    return indexes;
+  }
+
+ public:
+  /**
+   * Ranks the values in ascending order, from 1 for the smallest to the
+   * number of values that are not NaN for the largest. Equal values get the
+   * average of their ranks.
+   *
+   * @param values the values
+   * @param count  the number of values
+   * @param r      the ranks, of count values
+   */
+  static void rank(const double* values, size_t count, double* r) {
+    std::vector<size_t> indexes(valid(values, count));
+    std::sort(indexes.begin(), indexes.end(), [values](size_t a, size_t b) {
+      return values[a] < values[b];
+    });
+
+    std::fill(r, r + count, std::numeric_limits<double>::quiet_NaN());
+    // the equal values are next to each other, from first to last
+    for (size_t first = 0, last = 0; first < indexes.size(); first = last) {
+      double value = values[indexes[first]];
+      for (last = first + 1;
+           last < indexes.size() && values[indexes[last]] == value; last++)
+        ;
+      double average = (first + last + 1) / 2.0;
+      for (size_t n = first; n < last; n++) r[indexes[n]] = average;
+    }
+  }
+
+  static std::vector<double> rank(const double* values, size_t count) {
+    std::vector<double> r(count);
+    if (count > 0) rank(values, count, &r[0]);
+    return r;
+  }
+
+  /**
+   * Calculates the z-score of each value: its distance from the mean of the
+   * values, in population standard deviations. The z-scores are 0 if all the
+   * values are equal.
+   *
+   * @param values the values
+   * @param count  the number of values
+   * @param r      the z-scores, of count values
+   */
+  static void zscore(const double* values, size_t count, double* r) {
+    double sum = 0;
+    size_t validCount = 0;
+    for (size_t n = 0; n < count; n++)
+      if (!isNaN(values[n])) {
+        sum += values[n];
+        validCount++;
+      }
+    double mean = validCount > 0 ? sum / validCount : 0;
+
+    double squares = 0;
+    for (size_t n = 0; n < count; n++)
+      if (!isNaN(values[n]))
+        squares += (values[n] - mean) * (values[n] - mean);
+    double stdDev = validCount > 0 ? sqrt(squares / validCount) : 0;
+
+    for (size_t n = 0; n < count; n++)
+      r[n] = isNaN(values[n])
+                 ? values[n]
+                 : (stdDev > 0 ? (values[n] - mean) / stdDev : 0);
+  }
+
+  static std::vector<double> zscore(const double* values, size_t count) {
+    std::vector<double> r(count);
+    if (count > 0) zscore(values, count, &r[0]);
+    return r;
+  }
+
+  /**
+   * Returns the indexes of the n largest values, largest first
+   *
+   * Fewer than n indexes are returned if there are fewer values that are not
+   * NaN
+   */
+  static std::vector<size_t> top(const double* values, size_t count,
+                                 size_t n) {
+    return select(values, count, n,
+                  [](double a, double b) { return a > b; });
+  }
+
+  /**
+   * Returns the indexes of the n smallest values, smallest first
+   */
+  static std::vector<size_t> bottom(const double* values, size_t count,
+                                    size_t n) {
+    return select(values, count, n,
+                  [](double a, double b) { return a < b; });
+  }
+};
+
+/**
+ * Base class for a user defined cross-sectional system
+ *
+ * The system runs once for each pass over the session symbols, on the panel
+ * of all of them, and onDate is called for each date of the panel calendar,
+ * in order. The positions on any of the symbols are created on the bars of
+ * the panel, for example:
+ *
+ * \code
+ * void onDate(size_t date) {
+ *   const Panel& p(panel());
+ *   std::vector<size_t> best(
+ *       CrossSection::top(p.row(panel_close, date), p.symbolCount(), 5));
+ *   for (size_t n = 0; n < best.size(); n++)
+ *     buyAtClose(p.bars(best[n]), p.barIndex(date, best[n]), 100, "top 5");
+ * }
+ * \endcode
+ *
+ * The scheduler still hands the system one symbol at a time: it only runs on
+ * the first symbol of the panel, and skips the others.
+ */
+template <class T>
+class PanelSystem : public BarSystem<T> {
+ private:
+  PanelPtr _panel;
+
+ public:
+  PanelSystem(const Info& info, const std::string& userString = "")
+      : BarSystem<T>(info, userString) {}
+
+  const Panel& panel() const {
+    assert(_panel);
+    return *_panel;
+  }
+
+  virtual bool init(const std::string& symbol) {
+    if (!_panel) _panel = Panel::make(*this);
+    return !_panel->empty() && symbol == _panel->symbol(0) &&
+           BarSystem<T>::init(symbol);
+  }
+
+  virtual void run() {
+    for (size_t date = 0; date < _panel->dateCount(); date++) onDate(date);
+  }
+
+  /**
+   * Called for each date of the panel, in order
+   *
+   * @param date   the date index in the panel
+   */
+  virtual void onDate(size_t date) {}
+};
+
+/** @} */
+
+}  // namespace tradery
@@ -53,6 +53,9 @@ class RuntimeStats {
   virtual unsigned int getTotalBarCount() const = 0;
   virtual void setMessage(const std::string& message) = 0;
   virtual void setStatus(RuntimeStatus status) = 0;
+  // the time spent processing the results at the end of the session, such as
+  // the statistics and the equity and drawdown curves, in seconds
+  virtual void setSessionEndDuration(double seconds) = 0;
   // virtual void setCurrentSymbol(const std::string& symbol) = 0;
   virtual void to_json(nlohmann::json& j) const = 0;
   virtual std::string to_json() const = 0;
@@ -27,6 +27,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define CORE_API __declspec(dllimport)
 #endif
 
+#include <functional>
 #include "misc.h"
 #include "synchronizer.h"
 
@@ -47,6 +48,25 @@ enum MAType {
   TT3 = 8
 };
 
+/**
+ * Arithmetic operations on series, see Series::operation
+ */
+enum SeriesOperation {
+  // series op series
+  add_operation,
+  subtract_operation,
+  multiply_operation,
+  divide_operation,
+  // series op value
+  add_value_operation,
+  subtract_value_operation,
+  multiply_by_value_operation,
+  divide_by_value_operation,
+  // value op series
+  subtract_from_value_operation,
+  divide_value_by_operation
+};
+
 class Series;
 
 class SeriesIndicatorsAbstr {
@@ -192,6 +212,8 @@ class SeriesAbstr {
   virtual size_t unsyncSize() const = 0;
   virtual size_t size() const = 0;
   virtual void push_back(double value) = 0;
+  // appends the values, taking them over if the series is empty
+  virtual void append(std::vector<double>& values) = 0;
   virtual const double* getArray() const = 0;
   virtual const std::vector<double>& getVector() const = 0;
 
@@ -364,6 +386,33 @@ class CORE_API Series : public SeriesIndicatorsAbstr {
 
   Series(const Series& series) : _series(series._series) {}
 
+  /**
+   * Applies an arithmetic operation to two series, or to a series and a
+   * value. This is what the arithmetic operators use.
+   *
+   * If the operands are series of the cache, such as the bar series and the
+   * indicators, which are not modified once made, the result is only
+   * calculated when its values are first needed. Operations on results that
+   * have not been calculated yet are fused with them, so an expression such as
+   * (s1 + s2) / (s3 - s4) * 2 is calculated in a single pass over s1 to s4,
+   * without storing the intermediate series, and only the result of the whole
+   * expression goes through the series cache. Otherwise, the result is
+   * calculated right away, so it never depends on later changes to the
+   * operands.
+   *
+   * @param op      the operation
+   * @param series1 the first operand
+   * @param series2 the second operand
+   * @return the result
+   * @exception OperationOnUnequalSizeSeriesException
+   *                   Thrown if the two series are of different sizes
+   */
+  static SeriesAbstrPtr operation(SeriesOperation op, const Series& series1,
+                                  const Series& series2)
+      throw(OperationOnUnequalSizeSeriesException);
+  static SeriesAbstrPtr operation(SeriesOperation op, const Series& series,
+                                  double value);
+
   virtual SynchronizerPtr synchronizer() const {
     return _series->synchronizer();
   }
@@ -445,6 +494,16 @@ class CORE_API Series : public SeriesIndicatorsAbstr {
    */
   virtual void push_back(double value) { _series->push_back(value); }
 
+  /**
+   * Adds the values to the end of the series. The values are moved into the
+   * series if it is empty, so they should not be used afterwards
+   *
+   * <B>Not thread safe</B>
+   *
+   * @param values the values to be added
+   */
+  virtual void append(std::vector<double>& values) { _series->append(values); }
+
   /**
    * \brief Series assignment operator
    *
@@ -530,7 +589,7 @@ class CORE_API Series : public SeriesIndicatorsAbstr {
    */
   Series operator*(const Series& series) const
       throw(OperationOnUnequalSizeSeriesException) {
-    return Series((*_series) * series._series);
+    return Series(operation(multiply_operation, *this, series));
   }
   /**
    * Multiplication operator - multiplies the values in the current series with
@@ -565,7 +624,9 @@ class CORE_API Series : public SeriesIndicatorsAbstr {
    * @return The new series containing the result of the multiplication
    * @exception OperationOnUnequalSizeSeriesException
    */
-  Series operator*(double value) const { return Series((*_series) * value); }
+  Series operator*(double value) const {
+    return Series(operation(multiply_by_value_operation, *this, value));
+  }
   /**
    * \brief Multiplication operator - multiplies the elements of the current
    * series with a constant value and stores the result in the current series
@@ -601,7 +662,7 @@ class CORE_API Series : public SeriesIndicatorsAbstr {
    */
   Series operator+(const Series& series) const
       throw(OperationOnUnequalSizeSeriesException) {
-    return Series((*_series) + series._series);
+    return Series(operation(add_operation, *this, series));
   }
   /**
    * Addition operator - adds the values in the current series with the
@@ -655,7 +716,9 @@ class CORE_API Series : public SeriesIndicatorsAbstr {
    * @return The new series containing the result of the add
    * @exception OperationOnUnequalSizeSeriesException
    */
-  Series operator+(double value) const { return Series((*_series) + value); }
+  Series operator+(double value) const {
+    return Series(operation(add_value_operation, *this, value));
+  }
   /**
    * \brief Addition operator - adds the elements of the current series with a
    * constant value and stores the result in the current series
@@ -721,7 +784,7 @@ class CORE_API Series : public SeriesIndicatorsAbstr {
    */
   Series operator-(const Series& series) const
       throw(OperationOnUnequalSizeSeriesException) {
-    return Series((*_series) - series._series);
+    return Series(operation(subtract_operation, *this, series));
   }
   /**
    * \brief Subtraction operator -= subtracts the elements of a series from the
@@ -789,7 +852,9 @@ class CORE_API Series : public SeriesIndicatorsAbstr {
    * @return The new series containing the result of the subtraction
    * @exception OperationOnUnequalSizeSeriesException
    */
-  Series operator-(double value) const { return Series((*_series) - value); }
+  Series operator-(double value) const {
+    return Series(operation(subtract_value_operation, *this, value));
+  }
   /**
    * \brief Subtraction operator -= sbutracts a value from the elements of the
    * current series and stores the result in the current series
@@ -858,7 +923,7 @@ class CORE_API Series : public SeriesIndicatorsAbstr {
    */
   Series operator/(const Series& series) const
       throw(OperationOnUnequalSizeSeriesException, DivideByZeroException) {
-    return Series((*_series) / series._series);
+    return Series(operation(divide_operation, *this, series));
   }
   /**
    * \brief Operator /= divides the current Series by the corresponding values
@@ -927,7 +992,7 @@ class CORE_API Series : public SeriesIndicatorsAbstr {
    *                   Thrown if the value is 0
    */
   Series operator/(double value) const throw(DivideByZeroException) {
-    return Series((*_series) / value);
+    return Series(operation(divide_by_value_operation, *this, value));
   }
   /**
    * \brief Operator /= divides the current Series by a value. The result is
@@ -1436,4 +1501,76 @@ CORE_API Series operator*(double value, const Series& series);
 CORE_API inline Series operator/(double value, const Series& series) throw(
     DivideByZeroException);
 
+/**
+ * Indicators requested together, typically by a system in init, so they can be
+ * calculated at the same time
+ *
+ * The request methods only declare the indicators, which are all calculated
+ * by calculate:
+ * - indicators that come out of the same calculation, such as the upper and
+ * lower Bollinger bands of a series, or the MACD and its signal and
+ * histogram, are calculated only once
+ * - the calculations that are independent of each other are run in parallel,
+ * on the calling thread and on the threads of the scheduler pool that have
+ * nothing else to do, or only on the calling thread if there is no pool
+ *
+ * The results are the same series that the indicator methods return, and
+ * they go through the series cache the same way.
+ *
+ * Example:
+ * \code
+ * IndicatorRequests requests;
+ * requests.BBandUpper(_bbUpper, closeSeries(), 20, 2);
+ * requests.BBandLower(_bbLower, closeSeries(), 20, 2);
+ * requests.add(_movingAverage, [this]() { return closeSeries().SMA(20); });
+ * requests.calculate();
+ * \endcode
+ *
+ * The results must stay valid until calculate returns. The calculations
+ * passed to add run on other threads, so they should only calculate
+ * indicators on series that are already calculated.
+ */
+class CORE_API IndicatorRequests {
+ public:
+  typedef std::function<Series()> Calculation;
+
+ private:
+  class Requests;
+  Requests* _requests;
+
+ private:
+  IndicatorRequests(const IndicatorRequests&);
+  IndicatorRequests& operator=(const IndicatorRequests&);
+
+ public:
+  IndicatorRequests();
+  ~IndicatorRequests();
+
+  void BBandUpper(Series& result, const Series& series, unsigned int period,
+                  double stdDev);
+  void BBandLower(Series& result, const Series& series, unsigned int period,
+                  double stdDev);
+  void MACD(Series& result, const Series& series, unsigned int fastPeriod,
+            unsigned int slowPeriod, unsigned int signalPeriod);
+  void MACDSignal(Series& result, const Series& series,
+                  unsigned int fastPeriod, unsigned int slowPeriod,
+                  unsigned int signalPeriod);
+  void MACDHist(Series& result, const Series& series, unsigned int fastPeriod,
+                unsigned int slowPeriod, unsigned int signalPeriod);
+  /**
+   * Requests any other indicator
+   *
+   * @param result      receives the indicator
+   * @param calculation calculates the indicator
+   */
+  void add(Series& result, const Calculation& calculation);
+
+  /**
+   * Calculates all the indicators requested since the last call, and sets
+   * the results. If a calculation throws, the exception is passed on once
+   * all the other calculations have completed.
+   */
+  void calculate();
+};
+
 }  // namespace tradery
@@ -21,6 +21,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma warning(disable : 4800 4275 4251 4244 4003)
 
 #include <assert.h>
+#include <atomic>
 #include <list>
 #include <vector>
 #include "threadsync.h"
@@ -58,6 +59,27 @@ namespace tradery {
  * it points to p1 = p2; \endcode
  */
 
+/**
+ * Interface for objects that need to know when references to a counted
+ * object are released, such as the cache, which can only evict objects that
+ * are no longer in use
+ *
+ * released is called by the thread releasing the reference, right after the
+ * count is decreased, so it should only do a minimal amount of work, and never
+ * try to acquire or release references to the same object
+ */
+class ReleaseListener {
+ public:
+  virtual ~ReleaseListener() {}
+
+  /**
+   * Called each time a reference is released
+   *
+   * @param count  the reference count after the release
+   */
+  virtual void released(int count) = 0;
+};
+
 /**
  * Reference counter class
  *
@@ -66,119 +88,65 @@ namespace tradery {
  * This class is normally only used internally by the library, and never
  * instantiated explicitly by user code.
  *
- * id is here just for diagnostic purposes - it shows the id of the data item
- * that's being counted.
- *
- * RefCountable is thread safe
+ * RefCountable is thread safe. The count is an atomic, so adding and releasing
+ * references never locks
  *
  * @see ManagedPtr
  */
 class RefCountable {
  protected:
-  MISC_API static int _totalCount;
-  mutable int ref_count;
-  mutable Mutex _m;
-  std::string _id;
+  mutable std::atomic<int> ref_count;
+  std::atomic<ReleaseListener*> _listener;
 
  public:
-  RefCountable() : ref_count(1) {
-#ifdef _DEBUG
-    if (false) {
-      std::ostringstream o;
-      o << "Ref countable - in one param constructor- "
-        << ": " << _totalCount << std::endl;
-      //			tsprint( o, std::cout );
-    }
-#endif
-  };
+  RefCountable() : ref_count(1), _listener(0) {}
 
   // copy constructor
-  RefCountable(const RefCountable& rc) : ref_count(rc.getCount()) {
-#ifdef _DEBUG
-    if (false) {
-      std::ostringstream o;
-      o << "Ref countable - in copy constructor - "
-        << ": " << ref_count << std::endl;
-      //			tsprint( o, std::cout );
-    }
-#endif
-  }
+  RefCountable(const RefCountable& rc)
+      : ref_count(rc.getCount()), _listener(0) {}
 
   ~RefCountable() {
     // when destroying the RefCountable, all references to T must have been
     // released cannot destroy a RefCountable which has the reference count != 0
-    assert(ref_count == 0);
-#ifdef _DEBUG
-    if (false) {
-      std::ostringstream o;
-      o << "Ref countable - in destructor - "
-        << ": " << ref_count << std::endl;
-      //			tsprint( o, std::cout );
-    }
-#endif
+    assert(getCount() == 0);
   }
 
   void addRef() const {
-    Lock lock(_m);
-    ++_totalCount;
-    ++ref_count;
-
-#ifdef _DEBUG
-    if (false) {
-      std::ostringstream o;
-      //			o << _T( "addRef - " ) << _id << _T( ": " ) <<
-      //_totalCount << std::endl;
-      o << "addRef - " << ref_count << std::endl;
-      //			tsprint( o, std::cout );
-    }
-#endif
+    // a new reference can only be made from an existing one, so there is
+    // nothing to synchronize with
+    ref_count.fetch_add(1, std::memory_order_relaxed);
   };
 
   bool release() {
-    Lock lock(_m);
-    --_totalCount;
-    --ref_count;
+    // the listener is read while this reference still pins the object: once
+    // the count is decreased, another thread may clear it and delete the
+    // object, so this must not be touched after the decrement
+    ReleaseListener* listener = _listener.load(std::memory_order_acquire);
+    // the thread that releases the last reference must see all the changes
+    // made through the other references before it deletes the object
+    int count = ref_count.fetch_sub(1, std::memory_order_acq_rel) - 1;
     // cannot release more times than addRef-ed
+    assert(count >= 0);
 
-    assert(getCount() >= 0);
-#ifdef _DEBUG
-    if (false) {
-      std::ostringstream o;
-      //			o << _T( "release - " ) << _id << _T( ": " ) <<
-      //_totalCount << std::endl;
-      o << "release - " << ref_count << std::endl;
-      //			tsprint( o, std::cout );
-    }
-#endif
+    if (listener != 0) listener->released(count);
 
-    return ref_count == 0;
+    return count == 0;
   };
 
-  // assignment operator
-  /*  RefCountable& operator=( const RefCountable& rc )
-  {
-  Lock lock( _m );
-  tsprint( _T( "in RefCountable op=\n" ), std::cout );
-
-  if ( this != &rc )
-  {
-  _count = rc.getCount();
-  _id = rc._id;
-  }
-  if ( false )
-  {
-  std::wostringstream o;
-  o << _T( "Ref countable - in operator = - " ) << _id << _T( ": " ) << _count
-  << std::endl; tsprint( o, std::cout );
-  }
-  return *this;
+  /**
+   * Sets or clears (if 0) the object to be notified on each release
+   *
+   * A release running at the same time may still notify the previous listener,
+   * after the object is gone, so a listener must outlive the objects it
+   * listens to
+   *
+   * @param listener the listener
+   */
+  void setListener(ReleaseListener* listener) {
+    _listener.store(listener, std::memory_order_release);
   }
-  */
-  int getCount() const {
-    Lock lock(_m);
 
-    return ref_count;
-  }
+  int getCount() const { return ref_count.load(std::memory_order_acquire); }
 };
 
 /**
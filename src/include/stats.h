@@ -22,6 +22,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <float.h>
 #include <fstream>
 #include <algorithm>
+#include <map>
+#include <memory>
+#include <vector>
 #include "series.h"
 #include "core.h"
 #include "log.h"
@@ -956,7 +959,11 @@ class CORE_API StatsCalculator : public Stats, public PositionHandler {
 
  private:
   /* @cond */
+  friend class StatsGroupsHandler;
+
   void onPosition(Position pos);
+  // the stats of all the positions, from the open and closed ones
+  void sumAllPosStats();
 
   /* @endcond */
 
@@ -1016,6 +1023,25 @@ class CORE_API StatsCalculator : public Stats, public PositionHandler {
    * @see PositionsContainer
    */
   void calculateAll(PositionsContainer& positions);
+  /**
+   * Calculates the statistics on all positions, on long positions only and on
+   * short positions only, in one pass over a PositionsContainer.
+   *
+   * Gives the same results as calling calculateAll, calculateLong and
+   * calculateShort on each of the StatsCalculator objects.
+   *
+   * @param positions The positions container on which to calculate the
+   * statistics
+   * @param allStats  The statistics on all positions
+   * @param longStats The statistics on long positions
+   * @param shortStats The statistics on short positions
+   *
+   * @see PositionsContainer
+   */
+  static void calculateGroups(PositionsContainer& positions,
+                              StatsCalculator& allStats,
+                              StatsCalculator& longStats,
+                              StatsCalculator& shortStats);
 };
 
 class ProcessPosition {
@@ -1143,71 +1169,68 @@ class ProcessPositions : public ProcessPositionsBase {
   }
 };
 
-typedef tradery::ManagedPtr<ProcessPositions> ProcessPositionsPtr;
+typedef std::shared_ptr<ProcessPositions> ProcessPositionsPtr;
 
-class DateToProcessPositions : public tradery::PositionHandler {
- private:
-  typedef std::map<Date, ProcessPositionsPtr> DPPMap;
+// the number of days from the start of a date range to a date, which is the
+// index of the date in the arrays indexed by day
+inline long daySlot(const DateRange& range, const Date& date) {
+  return (date - range.from()).days();
+}
 
-  DPPMap _map;
+// the number of days in a date range, 0 if the range is empty
+inline size_t daySlots(const DateRange& range) {
+  return range.from() <= range.to() ? daySlot(range, range.to()) + 1 : 0;
+}
 
+/**
+ * The entries and exits of positions, by day, in the order they have to be
+ * processed
+ */
+class DateToProcessPositions : public tradery::PositionHandler {
  private:
-  void insertPosition(Position pos) {
-    DPPMap::iterator i = _map.find(pos.getEntryDate());
-    if (i == _map.end())
-      i = _map.insert(DPPMap::value_type(
-                          pos.getEntryDate(),
-                          ProcessPositionsPtr(new ProcessPositions())))
-              .first;
-
-    ProcessPositionsPtr pp = i->second;
-
-    pp->insertEntry(pos);
+  const DateRange& _range;
+  // the positions to process, by day slot, null for days without any
+  std::vector<ProcessPositionsPtr> _slots;
 
-    if (pos.isClosed()) {
-      i = _map.find(pos.getCloseDate());
-      if (i == _map.end())
-        i = _map.insert(DPPMap::value_type(
-                            pos.getCloseDate(),
-                            ProcessPositionsPtr(new ProcessPositions())))
-                .first;
+ private:
+  ProcessPositions& slot(const Date& date) {
+    long n = daySlot(_range, date);
+    // the range contains the dates of all the bars, so all the positions
+    assert(n >= 0 && (size_t)n < _slots.size());
 
-      ProcessPositionsPtr pp1 = i->second;
+    ProcessPositionsPtr& pp = _slots[n];
+    if (!pp) pp.reset(new ProcessPositions());
+    return *pp;
+  }
 
-      pp1->insertExit(pos);
-    }
+  void insertPosition(Position pos) {
+    slot(pos.getEntryDate()).insertEntry(pos);
+    if (pos.isClosed()) slot(pos.getCloseDate()).insertExit(pos);
   }
 
  public:
-  DateToProcessPositions(const PositionsContainer& pc) {
+  DateToProcessPositions(const PositionsContainer& pc, const DateRange& range)
+      : _range(range), _slots(daySlots(range)) {
     pc.forEachConst(*this);
   }
 
   virtual void onPositionConst(const Position pos) { insertPosition(pos); }
 
-  ProcessPosition* getFirst(Date& date) {
-    DPPMap::iterator i = _map.find(date);
-    if (i != _map.end()) {
-      return i->second->getFirst();
-    } else
-      return 0;
+  ProcessPosition* getFirst(size_t slot) {
+    return _slots[slot] ? _slots[slot]->getFirst() : 0;
   }
 
-  ProcessPosition* getNext(Date& date) {
-    DPPMap::iterator i = _map.find(date);
-    if (i != _map.end()) {
-      return i->second->getNext();
-    } else
-      return 0;
+  ProcessPosition* getNext(size_t slot) {
+    return _slots[slot] ? _slots[slot]->getNext() : 0;
   }
 
   void dump(std::ostream& os) const {
     os << "****** all positions to process *******" << std::endl;
-    for (DPPMap::const_iterator i = _map.begin(); i != _map.end(); i++) {
-      const ProcessPositionsPtr pp = i->second;
-
-      os << i->first.to_simple_string() << std::endl;
-      pp->dump(os);
+    for (size_t n = 0; n < _slots.size(); n++) {
+      if (_slots[n]) {
+        os << (_range.from() + Days((long)n)).to_simple_string() << std::endl;
+        _slots[n]->dump(os);
+      }
     }
     os << "***************************************" << std::endl;
   }
@@ -1236,6 +1259,7 @@ class Eq {
   }
 
   void adjust(Position pos, double adj) { _total += adj; }
+  void adjust(double adj) { _total += adj; }
 
   Eq& operator+=(const Eq& eq) {
     _total += eq.getTotal();
@@ -1279,6 +1303,16 @@ class Equity {
     pos.isLong() ? _lg.adjust(pos, adj) : _sh.adjust(pos, adj);
   }
 
+  void adjustLong(double adj) {
+    _all.adjust(adj);
+    _lg.adjust(adj);
+  }
+
+  void adjustShort(double adj) {
+    _all.adjust(adj);
+    _sh.adjust(adj);
+  }
+
   void dump(std::ostream& os) {
     //      os << _T( "total: " ) << _total << _T( ", long: " ) << _lg << _T( ",
     //      short: " ) << _sh << _T( ", cash: " ) << _cash << std::endl;
@@ -1298,19 +1332,127 @@ class Equity {
 #define LAST_BAR_INDEX(pos) \
   (pos.getCloseBar() - (pos.getDuration() > 0 ? 1 : 0))
 
-typedef std::map<Date, Equity> EquityCurveBase;
+typedef std::vector<std::pair<Date, Equity> > EquityCurveBase;
 
 /**
- * An equity curve collection, implemented as map <Date
- * - Equity>
+ * An equity curve collection, with one Date - Equity pair for each day of the
+ * equity date range, in date order
  *
+ * The days are indexed by their number of days from the start of the range,
+ * and the changes in equity from the positions are accumulated per symbol: for
+ * each bar, the shares held from the previous bar are the running sum of the
+ * changes in shares at the bars where positions start and stop being held, so
+ * the equity is calculated in one pass over the days and the bars of the
+ * symbols, instead of going through the bars of each position.
  */
 class EquityCurve : public EquityCurveBase {
  private:
-  mutable std::vector<double> _total;
-  mutable std::vector<double> _short;
-  mutable std::vector<double> _long;
-  mutable std::vector<double> _cash;
+  /**
+   * The bars of a symbol with positions, and the shares held by these
+   * positions, as changes at the bars where they start and stop being held.
+   *
+   * The bars are walked in order, one day at a time, adding the gain of the
+   * shares held to the equity of the day of each bar.
+   */
+  class SymbolEquity {
+   private:
+    const BarsPtr _data;
+    // the day slot and the close of each bar
+    std::vector<size_t> _slots;
+    std::vector<double> _closes;
+    // the changes in the long and short shares held, by bar, with one more
+    // element for the changes after the last bar
+    std::vector<double> _longShares;
+    std::vector<double> _shortShares;
+    // the shares held at the last bar walked
+    double _long;
+    double _short;
+    // the next bar to walk
+    size_t _next;
+    // one past the last bar at which shares are held
+    size_t _end;
+
+   public:
+    const BarsAbstr* const bars;
+    bool active;
+
+   private:
+    void add(std::vector<Equity>& equity, size_t bar, double longShares,
+             double shortShares) const {
+      double change = _closes[bar] - _closes[bar - 1];
+      Equity& eq = equity[_slots[bar]];
+      if (longShares != 0) eq.adjustLong(longShares * change);
+      if (shortShares != 0) eq.adjustShort(-shortShares * change);
+    }
+
+   public:
+    SymbolEquity(BarsPtr data, const BarsAbstr* bars, const DateRange& range,
+                 size_t days)
+        : _data(data),
+          _slots(bars->size()),
+          _closes(bars->size()),
+          _longShares(bars->size() + 1),
+          _shortShares(bars->size() + 1),
+          _long(0),
+          _short(0),
+          _next(0),
+          _end(0),
+          bars(bars),
+          active(false) {
+      assert(days > 0);
+      for (size_t n = 0; n < bars->size(); n++) {
+        long slot = daySlot(range, bars->date(n));
+        // the range contains the dates of all the bars
+        assert(slot >= 0 && (size_t)slot < days);
+        _slots[n] = (size_t)std::min(std::max(slot, 0L), (long)days - 1);
+        _closes[n] = bars->close(n);
+      }
+    }
+
+    double close(size_t bar) const { return _closes[bar]; }
+
+    // true if shares are held after the last bar walked
+    bool holding() const { return _next < _end; }
+
+    // walks the bars up to the day slot, adding the gains of the shares held,
+    // and returns true if shares are still held after that
+    bool walk(size_t slot, std::vector<Equity>& equity) {
+      for (; _next < _slots.size() && _slots[_next] <= slot; _next++) {
+        _long += _longShares[_next];
+        _short += _shortShares[_next];
+        if (_long != 0 || _short != 0) add(equity, _next, _long, _short);
+      }
+      return holding();
+    }
+
+    /**
+     * Holds shares from the bar after first to last. The symbol must have been
+     * walked up to the current day: the bars of the current day that were
+     * already walked are added right away, the others when they are walked.
+     */
+    void hold(bool isLong, double shares, size_t first, size_t last,
+              std::vector<Equity>& equity) {
+      size_t from = first + 1;
+      for (; from <= last && from < _next; from++)
+        add(equity, from, isLong ? shares : 0, isLong ? 0 : shares);
+
+      if (from <= last) {
+        std::vector<double>& changes(isLong ? _longShares : _shortShares);
+        changes[from] += shares;
+        changes[last + 1] -= shares;
+        _end = std::max(_end, last + 1);
+      }
+    }
+  };
+
+  typedef std::shared_ptr<SymbolEquity> SymbolEquityPtr;
+  typedef std::map<std::string, SymbolEquityPtr> SymbolsEquity;
+
+ private:
+  std::vector<double> _total;
+  std::vector<double> _short;
+  std::vector<double> _long;
+  std::vector<double> _cash;
   //  const PositionsEntries _entries;
   const SessionInfo& _si;
   // used to count the currently open positions
@@ -1321,6 +1463,13 @@ class EquityCurve : public EquityCurveBase {
   unsigned int _openPosCount;
   ManagedPtr<const PositionEqualPredicate> _pred;
 
+  SymbolsEquity _symbols;
+  // the symbols with shares still held, which are walked each day
+  std::vector<SymbolEquity*> _activeSymbols;
+  // the equity changes of each day, then the equity, in the same order as the
+  // curve
+  std::vector<Equity> _equity;
+
   // used to calculate exposure: 1 - total cash / total equity
   // the total amount of equity over the whole period
   //
@@ -1328,15 +1477,48 @@ class EquityCurve : public EquityCurveBase {
   Eq _shortSum;
   Eq _longSum;
 
-  void onExitPosition(Position pos, const BarsAbstr* bars) {
+  SymbolEquity& symbolEquity(const std::string& symbol) {
+    SymbolEquityPtr& se = _symbols[symbol];
+    if (!se) {
+      BarsPtr data = _si.getData(symbol);
+
+      const BarsAbstr* bars = 0;
+
+      try {
+        // we'll assume the data is bars
+        // todo: should handle other types
+        bars = dynamic_cast<const BarsAbstr*>(data.get());
+        // there should be data for the symbol - we have a position
+        assert(bars != 0);
+        assert(bars->size() > 0);
+
+      } catch (const std::bad_cast&) {
+        assert(false);
+      }
+      se.reset(new SymbolEquity(data, bars, _edr, _equity.size()));
+    }
+    return *se;
+  }
+
+  void walk(size_t slot) {
+    for (size_t n = 0; n < _activeSymbols.size();) {
+      if (_activeSymbols[n]->walk(slot, _equity))
+        n++;
+      else {
+        _activeSymbols[n]->active = false;
+        _activeSymbols[n] = _activeSymbols.back();
+        _activeSymbols.pop_back();
+      }
+    }
+  }
+
+  void onExitPosition(Position pos, const SymbolEquity& se, Equity& ec) {
     assert(pos.isClosed());
     --_openPosCount;
     // for positions opened and closed on the same bar, use the close of the
     // same bar,
     // for others, use the close of the previous bar
-    Bar b = bars->getBar(LAST_BAR_INDEX(pos));
-    Equity& ec = get(pos.getCloseDate());
-    ec.adjustExit(pos, b.getClose());
+    ec.adjustExit(pos, se.close(LAST_BAR_INDEX(pos)));
   }
 
   /**
@@ -1344,45 +1526,37 @@ class EquityCurve : public EquityCurveBase {
    * position/date as a result of this, each date equity will be the delta from
    * the previous date
    */
-  void onEntryPosition(Position pos, const BarsAbstr* bars) {
-#ifdef EQOUT
-      LOG( ( log_debug, "onEntryPosition: " << pos.getSymbol() );
-#endif
-      assert( pos );
-      assert( bars != 0 );
-
-      ++_openPosCount;
-
-      // calculate for the whole duration of the position, the end bar exclusive
-      // if it's still open, to the most recent bar
-      size_t endBar = pos.isClosed() ? LAST_BAR_INDEX( pos ) : bars->size() - 1;
-
-      double prevClose =  0;
-
-      // for all bars the position was open
-      for( size_t n = pos.getEntryBar(); n <= endBar; n++ )
-      {
-      // get current bar
-      Bar b = bars->getBar(n);
-      // get current bar time stamp
-      Date d = b.time().date();
-
+  void onEntryPosition(Position pos, size_t slot, SymbolEquity& se,
+                       Equity& ec) {
 #ifdef EQOUT
-      LOG(log_info, d.to_simple_string() << "-");
+    LOG(log_debug, "onEntryPosition: " << pos.getSymbol());
 #endif
-      Equity& eq = get(d);
-
-      // process the entry
-      if (n == pos.getEntryBar()) {
-        eq.adjustEntry(pos);
-        // increase the equity with the amount the position is worth at the end
-        // of the bar, but only if the position was held at least one bar
-        eq.adjust(pos, pos.getGain(b.getClose()));
-      } else
-        eq.adjust(pos, pos.getGain(prevClose, b.getClose()));
-
-      prevClose = b.getClose();
+    assert(pos);
+
+    ++_openPosCount;
+
+    // calculate for the whole duration of the position, the end bar exclusive
+    // if it's still open, to the most recent bar
+    size_t entryBar = pos.getEntryBar();
+    size_t endBar = pos.isClosed() ? LAST_BAR_INDEX(pos) : se.bars->size() - 1;
+
+    // process the entry
+    ec.adjustEntry(pos);
+    // increase the equity with the amount the position is worth at the end
+    // of the bar, but only if the position was held at least one bar
+    ec.adjust(pos, pos.getGain(se.close(entryBar)));
+
+    // the gains of the following bars
+    if (endBar > entryBar) {
+      // the symbol may not have been walked up to the current day yet
+      se.walk(slot, _equity);
+      se.hold(pos.isLong(), (double)pos.getShares(), entryBar, endBar,
+              _equity);
+      if (!se.active && se.holding()) {
+        se.active = true;
+        _activeSymbols.push_back(&se);
       }
+    }
   }
 
   /**
@@ -1409,50 +1583,34 @@ class EquityCurve : public EquityCurveBase {
 
     Equity prevEquity(initialCapital);
 
-    for (Date d = _edr.from(); d <= _edr.to(); d = d + Days(1)) {
-      // get current equity
-      Equity& ec = get(d);
+    for (size_t slot = 0; slot < _equity.size(); slot++) {
+      // get current equity, with the gains of the positions held
+      walk(slot);
+      Equity& ec = _equity[slot];
       ec += prevEquity;
-      // if no value for the current day, create a new equity entry with the
-      // most recent value
 
-      for (ProcessPosition* pp = _dpp.getFirst(d); pp != 0;
-           pp = _dpp.getNext(d)) {
+      for (ProcessPosition* pp = _dpp.getFirst(slot); pp != 0;
+           pp = _dpp.getNext(slot)) {
         Position pos = pp->get();
         assert(pos);
 
         // the position should be valid
-
-        BarsPtr data = _si.getData(pos.getSymbol());
-
-        const BarsAbstr* bars = 0;
-
-        try {
-          // we'll assume the data is bars
-          // todo: should handle other types
-          bars = dynamic_cast<const BarsAbstr*>(data.get());
-          // there should be data for the symbol - we have a position
-          assert(bars != 0);
-          assert(bars->size() > 0);
-
-        } catch (const std::bad_cast&) {
-          assert(false);
-        }
+        SymbolEquity& se = symbolEquity(pos.getSymbol());
 
         if (pp->entry()) {
           // do position sizing and equity curve processing for each entry/exit,
           // in order.
           if (_doPosSizing && pos.applyPositionSizing()) {
-            if (!posSizing(pos, bars, ec)) continue;
+            if (!posSizing(pos, se.bars, ec)) continue;
           }
 
-          onEntryPosition(pos, bars);
+          onEntryPosition(pos, slot, se, ec);
 
         } else {
 #ifdef EQOUT
-          LOG(log_info, d.to_simple_string() << "-");
+          LOG(log_info, slot << "-");
 #endif
-          onExitPosition(pp->get(), bars);
+          onExitPosition(pp->get(), se, ec);
         }
       }
 
@@ -1461,21 +1619,25 @@ class EquityCurve : public EquityCurveBase {
       _longSum += ec.getLong();
 
       prevEquity = ec;
-
-      //        std::cout << d.to_simple_string() << _T( " - " );
     }
-  }
 
-  // gets an equity at a certain date. If there isn't any, it creates a new one
-  // based on the current eq point
-  Equity& get(const Date& date) {
-    Equity* eq = getEquity(date);
-    if (eq == 0) {
-      eq = insert(date, Equity());
-      assert(eq != 0);
+    __super::reserve(_equity.size());
+    _total.reserve(_equity.size());
+    _long.reserve(_equity.size());
+    _short.reserve(_equity.size());
+    _cash.reserve(_equity.size());
+    Date d = _edr.from();
+    for (size_t slot = 0; slot < _equity.size(); slot++, d = d + Days(1)) {
+      const Equity& eq = _equity[slot];
+      __super::push_back(__super::value_type(d, eq));
+      _total.push_back(eq.getAll().getTotal());
+      _long.push_back(eq.getLong().getTotal());
+      _short.push_back(eq.getShort().getTotal());
+      _cash.push_back(eq.getAll().getCash());
     }
-
-    return *eq;
+    _equity.clear();
+    _activeSymbols.clear();
+    _symbols.clear();
   }
 
   // returns false if the position has been disabled and doesn't need further
@@ -1578,47 +1740,12 @@ class EquityCurve : public EquityCurveBase {
     }
   }
 
-  /**
-   * Gets the equity for a specific date.
-   *
-   * @param date
-   *
-   * @return Pointer to Equity if found, 0 if not
-   */
-  Equity* getEquity(const Date& date) {
-    iterator i = __super::find(date);
-
-    return i == end() ? 0 : &(i->second);
-  }
-
-  double getCash(const Date& date) {
-    Equity* eq = getEquity(date);
-    assert(eq != 0);
-    return eq->getAll().getCash();
-  }
-
-  /**
-   * Adds equity for a date for which there is no equity
-   *
-   * Precondition: no equity for that date
-   *
-   * @param date   The date for which to add equity
-   * @param eq
-   *
-   * @return Pointer to the added equity
-   */
-  Equity* insert(const Date& date, const Equity& eq) {
-    assert(__super::find(date) == end());
-    // todo: handle this case in release mode
-
-    __super::insert(__super::value_type(date, eq));
-    return &((*this)[date]);
-  }
-
  public:
   const Equity* getEquity(const Date& date) const {
-    const_iterator i = __super::find(date);
-    return i == end() ? 0 : &(i->second);
+    if (empty()) return 0;
+    // one element per day, from the first one
+    long slot = (date - front().first).days();
+    return slot >= 0 && (size_t)slot < size() ? &(*this)[slot].second : 0;
   }
 
   /**
@@ -1636,9 +1763,10 @@ class EquityCurve : public EquityCurveBase {
               PositionsContainer& pc, bool doPosSizing)
       : _edr(edr),
         _si(si),
-        _dpp(pc),
+        _dpp(pc, edr),
         _openPosCount(0),
-        _doPosSizing(doPosSizing) {
+        _doPosSizing(doPosSizing),
+        _equity(daySlots(edr)) {
     // needs to be sorted by entry time so we can do position counting
     //    _dpp.dump( std::cout );
     //    DebugBreak();
@@ -1646,34 +1774,18 @@ class EquityCurve : public EquityCurveBase {
   }
 
  private:
-  const double* getAsArray(std::vector<double>& v,
-                           const Eq& (Equity::*f)() const,
-                           double (Eq::*g)() const) const {
-    if (v.size() < __super::size()) {
-      for (__super::const_iterator i = __super::begin(); i != __super::end();
-           i++)
-        v.push_back(((i->second.*f)().*g)());
-    }
-
-    return reinterpret_cast<double*>(&(v.front()));
+  static const double* getAsArray(const std::vector<double>& v) {
+    return v.empty() ? 0 : &v.front();
   }
 
  public:
-  const double* getTotal() const {
-    return getAsArray(_total, &Equity::getAll, &Eq::getTotal);
-  }
+  const double* getTotal() const { return getAsArray(_total); }
 
-  const double* getLong() const {
-    return getAsArray(_long, &Equity::getLong, &Eq::getTotal);
-  }
+  const double* getLong() const { return getAsArray(_long); }
 
-  const double* getShort() const {
-    return getAsArray(_short, &Equity::getShort, &Eq::getTotal);
-  }
+  const double* getShort() const { return getAsArray(_short); }
 
-  const double* getCash() const {
-    return getAsArray(_cash, &Equity::getAll, &Eq::getCash);
-  }
+  const double* getCash() const { return getAsArray(_cash); }
 
   double getEndingTotalEquity() const {
     if (empty()) {
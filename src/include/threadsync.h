@@ -146,6 +146,7 @@ class ConditionAbstr {
   virtual ~ConditionAbstr() {}
   virtual void wait(NonRecursiveLockAbstr& lock) = 0;
   virtual void notify_one() = 0;
+  virtual void notify_all() = 0;
 
   MISC_API static ConditionAbstr* make();
 };
@@ -161,6 +162,7 @@ class Condition {
   void wait(NonRecursiveLock& lock) { _condition->wait(*(lock._lock)); }
 
   void notify_one() { _condition->notify_one(); }
+  void notify_all() { _condition->notify_all(); }
 };
 
 }  // namespace tradery
@@ -45,7 +45,6 @@ MISC_API int idcount = 0;
 MISC_API int ObjCount::_objCount;
 MISC_API int ObjCount::_totalObjects;
 MISC_API std::wostream& ObjCount::_os = std::wcout;
-MISC_API int RefCountable::_totalCount = 0;
 
 static boost::posix_time::ptime EPOCH(boost::gregorian::date(1970, 1, 1));
 
@@ -561,6 +560,8 @@ class TimeDurationImpl : public TimeDurationAbstr {
   TimeDurationImpl(boost::posix_time::time_duration duration)
       : _duration(duration) {}
 
+  virtual __int64 ticks() const { return _duration.total_microseconds(); }
+  virtual bool is_special() const { return _duration.is_special(); }
   virtual long hours() const { return _duration.hours(); }
   virtual long minutes() const { return _duration.minutes(); }
   virtual long seconds() const { return _duration.seconds(); }
@@ -791,6 +792,13 @@ class DateTimeImpl : public DateTimeAbstr {
     return diff.total_seconds();
   }
 
+  __int64 ticks() const {
+    if (_time.is_pos_infinity()) return POS_INFINITY_TICKS;
+    if (_time.is_neg_infinity()) return NEG_INFINITY_TICKS;
+    if (_time.is_not_a_date_time()) return NOT_A_DATE_TIME_TICKS;
+    return (_time - EPOCH).total_microseconds();
+  }
+
   virtual DateAbstrPtr date() const {
     return DateAbstrPtr(new DateImpl(_time.date()));
   }
@@ -955,6 +963,11 @@ TimeDurationAbstrPtr TimeDurationAbstr::make(__int64 hours, __int64 mins,
       new TimeDurationImpl(hours, mins, secs, frac_secs));
 }
 
+TimeDurationAbstrPtr TimeDurationAbstr::makeFromTicks(__int64 ticks) {
+  return TimeDurationAbstrPtr(
+      new TimeDurationImpl(boost::posix_time::microseconds(ticks)));
+}
+
 DateAbstrPtr DateAbstr::make(unsigned int year, unsigned int month,
                              unsigned int day) {
   return DateAbstrPtr(new DateImpl(year, month, day));
@@ -1004,6 +1017,25 @@ DateTimeAbstrPtr DateTimeAbstr::make(__int64 time) {
   return DateTimeAbstrPtr(new DateTimeImpl(t));
 }
 
+DateTimeAbstrPtr DateTimeAbstr::makeFromTicks(__int64 ticks) {
+  switch (ticks) {
+    case POS_INFINITY_TICKS:
+      return makePosInfinity();
+    case NEG_INFINITY_TICKS:
+      return makeNegInfinity();
+    case NOT_A_DATE_TIME_TICKS:
+      return makeNotADateTime();
+    default: {
+      // the fractional seconds are in the resolution of the implementation,
+      // which may be finer than microseconds
+      __int64 factor =
+          boost::posix_time::time_duration::ticks_per_second() / 1000000;
+      return DateTimeAbstrPtr(new DateTimeImpl(
+          EPOCH + boost::posix_time::time_duration(0, 0, 0, ticks * factor)));
+    }
+  }
+}
+
 // make special values
 MISC_API DateAbstrPtr DateAbstr::makePosInfinity() {
   return DateAbstrPtr(
@@ -1145,6 +1177,7 @@ class ConditionImpl : public ConditionAbstr {
   }
 
   void notify_one() { _condition.notify_one(); }
+  void notify_all() { _condition.notify_all(); }
 };
 
 ConditionAbstr* ConditionAbstr::make() { return new ConditionImpl(); }
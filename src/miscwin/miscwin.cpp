@@ -22,6 +22,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <thread.h>
 #include <shlobj.h>
 #include <miscfile.h>
+#include <moremiscwin.h>
 #include <io.h>
 #include <sys/types.h>  // For stat().
 #include <sys/stat.h>   // For stat().
@@ -30,9 +31,16 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <wininet.h>
 #include <Processthreadsapi.h>
 #include <WinBase.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
 
 using namespace tradery;
 
+static void flushLog(bool wait);
+
 BEGIN_MESSAGE_MAP(CMiscWinApp, CWinApp)
 END_MESSAGE_MAP()
 
@@ -56,6 +64,9 @@ BOOL CMiscWinApp::InitInstance() {
 }
 
 int CMiscWinApp::ExitInstance() {
+  // this runs under the loader lock, so the writer thread is not joined here,
+  // only what is left in the queue is written. See Log::shutdown
+  flushLog(false);
   curl_global_cleanup();
 
   return CWinApp::ExitInstance();
@@ -267,42 +278,327 @@ MISCWIN_API unsigned long getCurrentCPUNumber() {
   //::GetCurrentProcessorNumber();
 }
 
+class LogicalProcessorLess {
+ public:
+  bool operator()(const LogicalProcessor& p1,
+                  const LogicalProcessor& p2) const {
+    if (p1.node != p2.node) return p1.node < p2.node;
+    if (p1.core != p2.core) return p1.core < p2.core;
+    return p1.processor < p2.processor;
+  }
+};
+
+MISCWIN_API LogicalProcessors getProcessorTopology() {
+  LogicalProcessors processors;
+
+  DWORD_PTR processMask;
+  DWORD_PTR systemMask;
+  if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+    return processors;
+
+  std::map<unsigned int, LogicalProcessor> topology;
+  for (unsigned int n = 0; n < sizeof(DWORD_PTR) * 8; n++) {
+    if (processMask & ((DWORD_PTR)1 << n)) {
+      // without topology information, each processor is its own core
+      topology[n].processor = n;
+      topology[n].core = n;
+    }
+  }
+
+  DWORD size = 0;
+  GetLogicalProcessorInformation(0, &size);
+  std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(
+      size / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+  if (!info.empty() && GetLogicalProcessorInformation(&info[0], &size)) {
+    unsigned int core = 0;
+    for (size_t n = 0; n < info.size(); n++) {
+      if (info[n].Relationship != RelationProcessorCore &&
+          info[n].Relationship != RelationNumaNode)
+        continue;
+
+      for (std::map<unsigned int, LogicalProcessor>::iterator i =
+               topology.begin();
+           i != topology.end(); i++) {
+        if (info[n].ProcessorMask & ((ULONG_PTR)1 << i->first)) {
+          if (info[n].Relationship == RelationProcessorCore)
+            i->second.core = core;
+          else
+            i->second.node = info[n].NumaNode.NodeNumber;
+        }
+      }
+
+      if (info[n].Relationship == RelationProcessorCore) core++;
+    }
+  } else
+    LOG(log_error,
+        "GetLogicalProcessorInformation failed with error: " << GetLastError());
+
+  for (std::map<unsigned int, LogicalProcessor>::const_iterator i =
+           topology.begin();
+       i != topology.end(); i++)
+    processors.push_back(i->second);
+
+  std::sort(processors.begin(), processors.end(), LogicalProcessorLess());
+  return processors;
+}
+
+MISCWIN_API void setCurrentThreadAffinity(unsigned __int64 mask) {
+  if (::SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)mask) == 0)
+    LOG(log_error, "SetThreadAffinityMask failed with error: " << GetLastError());
+}
+
 ////////////////////////////////
 // log related static variables
 ////////////////////////////////
-Level tradery::Log::_globalLevel;
+std::atomic<Level> tradery::Log::_globalLevel(log_debug);
 std::string tradery::Log::_logToFile;
 bool tradery::Log::_logToDebugOutput = false;
 bool tradery::Log::_logToConsole = false;
+std::atomic<bool> tradery::Log::_logJson(false);
+std::string tradery::Log::_sessionId;
+unsigned __int64 tradery::Log::_maxFileSize = 0;
 tradery::Mutex Log::_mutex;
 
 LOG_API unsigned __int64 LogEntryExit::m_crtId(0);
 LOG_API tradery::Mutex LogEntryExit::m_mx;
 
-class ConsoleLog : public Log {
- public:
-  ConsoleLog(Level level, const char* func) : Log(level, func) {}
+/**
+ * Writes the log lines queued by all the threads, in a background thread
+ *
+ * Queuing a line is a compare and swap on the head of a list, so threads
+ * logging at the same time don't wait for each other, or for the writes. A
+ * thread only locks to wake up the writer when the list was empty. The writer
+ * takes the whole list at once, and writes it in the order the lines were
+ * queued.
+ *
+ * The log file stays open until the log file name changes, and is rotated
+ * once it reaches the maximum size, if there is one.
+ *
+ * The writer thread is stopped and joined by Log::shutdown. The lines logged
+ * after that, or left when the dll is unloaded without a shutdown, are only
+ * written by flush.
+ */
+class LogWriter {
+ private:
+  class Line {
+   public:
+    Line* next;
+    const std::string text;
+
+    Line(const std::string& text) : next(0), text(text) {}
+  };
+
+ private:
+  // the queued lines, most recent first
+  std::atomic<Line*> _pending;
+  std::once_flag _started;
+  std::thread _thread;
+  std::mutex _wakeMutex;
+  std::condition_variable _wake;
+  // set to make the writer thread exit, guarded by _wakeMutex
+  bool _stop;
+
+  // serializes the writes, by the background thread or by flush. The members
+  // below are only accessed with it locked
+  std::mutex _writeMutex;
+  std::ofstream _file;
+  std::string _fileName;
+  unsigned __int64 _fileSize;
+  unsigned int _rotations;
+  tradery::t_dostream _dos;
 
-  virtual std::ostream& getOstream() { return std::cout; }
-};
+ private:
+  LogWriter() : _pending(0), _stop(false), _fileSize(0), _rotations(0) {}
 
-class OutputDebugLog : public Log {
-  tradery::t_dostream _dos;
+  void run() {
+    for (bool stop = false; !stop;) {
+      {
+        std::unique_lock<std::mutex> lock(_wakeMutex);
+        _wake.wait(lock,
+                   [this]() { return _stop || _pending.load() != 0; });
+        stop = _stop;
+      }
+      // the lines queued before the stop are written before exiting
+      flush(true);
+    }
+  }
+
+  void open() {
+    _file.open(_fileName.c_str(), std::ios_base::out | std::ios_base::app);
+    _file.seekp(0, std::ios_base::end);
+    _fileSize = _file ? (unsigned __int64)_file.tellp() : 0;
+  }
+
+  // renames the current file to file.n, and starts a new one
+  void rotate() {
+    _file.close();
+    std::ostringstream rotated;
+    rotated << _fileName << '.' << ++_rotations;
+    std::remove(rotated.str().c_str());
+    std::rename(_fileName.c_str(), rotated.str().c_str());
+    open();
+  }
+
+  void write(Line* lines) {
+    // empty if not logging to a file
+    std::string fileName(Log::getLogFileName());
+    bool console = Log::logToConsole();
+    bool debugOutput = Log::logToDebugOutput();
+    unsigned __int64 maxFileSize = Log::maxFileSize();
+
+    if (fileName != _fileName) {
+      _file.close();
+      _fileName = fileName;
+      _rotations = 0;
+      if (!_fileName.empty()) open();
+    }
+
+    while (lines != 0) {
+      std::auto_ptr<Line> line(lines);
+      lines = lines->next;
+
+      if (_file.is_open()) {
+        if (maxFileSize > 0 && _fileSize > 0 &&
+            _fileSize + line->text.size() + 1 > maxFileSize)
+          rotate();
+        _file << line->text << '\n';
+        _fileSize += line->text.size() + 1;
+      }
+      if (console) std::cout << line->text << std::endl;
+      if (debugOutput) _dos << line->text << std::endl;
+    }
+    if (_file.is_open()) _file.flush();
+  }
 
  public:
-  OutputDebugLog(Level level, const char* func) : Log(level, func) {}
+  static LogWriter& instance() {
+    // never destroyed, as static objects may still log while they are
+    // destroyed, after the writer thread is stopped
+    static LogWriter* writer = new LogWriter();
+    return *writer;
+  }
+
+  void add(const std::string& text) {
+    std::call_once(_started,
+                   [this]() { _thread = std::thread(&LogWriter::run, this); });
+
+    Line* line = new Line(text);
+    Line* head = _pending.load(std::memory_order_relaxed);
+    do
+      line->next = head;
+    while (!_pending.compare_exchange_weak(head, line,
+                                           std::memory_order_release,
+                                           std::memory_order_relaxed));
+
+    if (head == 0) {
+      std::lock_guard<std::mutex> lock(_wakeMutex);
+      _wake.notify_one();
+    }
+  }
+
+  /**
+   * Stops the writer thread and waits for it to exit, once it has written the
+   * lines queued so far. A thread is no longer started after this.
+   */
+  void stop() {
+    // waits for a thread being started by add, or makes sure none will be
+    std::call_once(_started, []() {});
+    {
+      std::lock_guard<std::mutex> lock(_wakeMutex);
+      _stop = true;
+      _wake.notify_one();
+    }
+    if (_thread.joinable()) _thread.join();
+  }
 
-  virtual std::ostream& getOstream() { return _dos; }
+  /**
+   * Writes the queued lines in the calling thread
+   *
+   * @param wait   if false, gives up if another thread is writing, which is
+   * needed when the dll is unloaded, as the writer thread may have been
+   * terminated while holding the lock
+   */
+  void flush(bool wait) {
+    std::unique_lock<std::mutex> lock(_writeMutex, std::defer_lock);
+    if (wait)
+      lock.lock();
+    else if (!lock.try_lock())
+      return;
+
+    Line* lines = _pending.exchange(0, std::memory_order_acquire);
+    // reverse the list, so the lines are in the order they were queued
+    Line* first = 0;
+    while (lines != 0) {
+      Line* next = lines->next;
+      lines->next = first;
+      first = lines;
+      lines = next;
+    }
+    write(first);
+  }
 };
 
+static void flushLog(bool wait) { LogWriter::instance().flush(wait); }
+
+
+static std::string jsonString(const std::string& str) {
+  std::ostringstream o;
+  o << '"';
+  for (size_t n = 0; n < str.size(); n++) {
+    unsigned char c = str[n];
+    switch (c) {
+      case '"':
+        o << "\\\"";
+        break;
+      case '\\':
+        o << "\\\\";
+        break;
+      case '\n':
+        o << "\\n";
+        break;
+      case '\r':
+        o << "\\r";
+        break;
+      case '\t':
+        o << "\\t";
+        break;
+      default:
+        if (c < 0x20)
+          o << "\\u" << std::setw(4) << std::setfill('0') << std::hex
+            << (unsigned int)c << std::dec;
+        else
+          o << c;
+    }
+  }
+  o << '"';
+  return o.str();
+}
+
+// a json object per line, with the session id if there is one
+static std::string jsonLine(Level level, const char* function,
+                            const std::string& value) {
+  std::string levelStr(Log::levelToString(level));
+  levelStr.erase(levelStr.find_last_not_of(' ') + 1);
+  std::string sessionId(Log::sessionId());
+
+  std::ostringstream o;
+  o << "{\"time\":" << jsonString(timeStamp(true))
+    << ",\"thread\":" << GetCurrentThreadId()
+    << ",\"process\":" << GetCurrentProcessId()
+    << ",\"level\":" << jsonString(levelStr);
+  if (!sessionId.empty()) o << ",\"session\":" << jsonString(sessionId);
+  o << ",\"function\":" << jsonString(function)
+    << ",\"message\":" << jsonString(value) << "}";
+  return o.str();
+}
+
 MISCWIN_API void tradery::Log::xfilelog(const std::string& fileName,
                                         Level level, char* function,
                                         const std::string& value) {
-  tradery::Lock lock(_mutex);
-
   if (Log::checkLevel(level)) {
     std::string h = Log::header(level, function);
 
+    tradery::Lock lock(_mutex);
     try {
       FileLog fileLog(fileName, level, function);
       fileLog << h << value << std::endl;
@@ -314,31 +610,13 @@ MISCWIN_API void tradery::Log::xfilelog(const std::string& fileName,
 
 MISCWIN_API void tradery::Log::xlog(Level level, const char* function,
                                     const std::string& value) {
-  tradery::Lock lock(_mutex);
-
   if (Log::checkLevel(level)) {
-    std::string h = Log::header(level, function);
-
-    if (Log::logToFile()) {
-      try {
-        FileLog fileLog(level, function);
-        fileLog << h << value << std::endl;
-      } catch (const LogException&) {
-        // could not open log file - now what?
-      }
-    }
-
-    if (Log::logToConsole()) {
-      ConsoleLog consoleLog(level, function);
-      consoleLog << h << value << std::endl;
-      ;
-    }
-
-    if (Log::logToDebugOutput()) {
-      OutputDebugLog odl(level, function);
-      odl << h << value << std::endl;
-      ;
-    }
+    LogWriter& writer = LogWriter::instance();
+    writer.add(logJson() ? jsonLine(level, function, value)
+                         : Log::header(level, function) + value);
+    // errors are on disk before the caller goes on, in case it's about to
+    // crash
+    if (level >= log_error) writer.flush(true);
   }
 }
 
@@ -347,6 +625,13 @@ MISCWIN_API void tradery::Log::xlog(Level level, const std::string& function,
   xlog(level, function.c_str(), value);
 }
 
+MISCWIN_API void tradery::Log::flush() { flushLog(true); }
+
+MISCWIN_API void tradery::Log::shutdown() {
+  LogWriter::instance().stop();
+  flushLog(true);
+}
+
 void tradery::Log::flipLevel() {
   if (isDebugLevel())
     setNormalLevel();
@@ -354,11 +639,7 @@ void tradery::Log::flipLevel() {
     setDebugLevel();
 }
 
-MISCWIN_API void tradery::Log::setLevel(Level level) {
-  Lock lock(_mutex);
-
-  _globalLevel = level;
-}
+MISCWIN_API void tradery::Log::setLevel(Level level) { _globalLevel = level; }
 
 //**************************
 // Thread code
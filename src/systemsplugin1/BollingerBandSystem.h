@@ -36,13 +36,16 @@ class BollingerBandSystem : public BarSystem<BollingerBandSystem> {
   PriceStatus _status;
 
   virtual bool init() {
-    // calculate the lower and upper Bollinger bands,
-    // period 20 bars, 2 standard deviations
-    _bbUpper = closeSeries().BBandUpper(20, 2);
-    _bbLower = closeSeries().BBandLower(20, 2);
-
-    // calculate the 20 day simple moving average of the close prices
-    _movingAverage = closeSeries().SMA(20);
+    IndicatorRequests requests;
+    // the lower and upper Bollinger bands, period 20 bars, 2 standard
+    // deviations, which are calculated together
+    requests.BBandUpper(_bbUpper, closeSeries(), 20, 2);
+    requests.BBandLower(_bbLower, closeSeries(), 20, 2);
+
+    // the 20 day simple moving average of the close prices, calculated at the
+    // same time as the bands
+    requests.add(_movingAverage, [this]() { return closeSeries().SMA(20); });
+    requests.calculate();
 
     _status = neutral;
 
@@ -98,6 +98,13 @@ LPCSTR EQUITY_CURVE_FILE = "equitycurvefile";
 LPCSTR SYMBOLS_TO_CHART_FILE = "symchartfile";
 LPCSTR CHART_DESCRIPTION_FILE = "chartdescriptionfile";
 LPCSTR CHART_ROOT_PATH = "chartrootpath";
+LPCSTR CACHE_MEMORY = "cachememory";
+LPCSTR CACHE_POLICY = "cachepolicy";
+LPCSTR SERIES_CACHE = "seriescache";
+LPCSTR PREFETCH_WINDOW = "prefetchwindow";
+LPCSTR PREFETCH_THREADS = "prefetchthreads";
+LPCSTR POOL_THREADS = "poolthreads";
+LPCSTR THREAD_PLACEMENT = "threadplacement";
 
 // position sizing options
 LPCSTR INITIAL_CAPITAL = "initialcapital";
@@ -329,6 +336,38 @@ void Configuration::init(const std::string& cmdLine, bool validate) {
             po::value<unsigned __int64>()->default_value(DEFAULT_CACHE_SIZE),
             "the internal simlib cache max number of items, currently used "
             "only because symbol info is needed to calculate stats")(
+            CACHE_MEMORY,
+            po::value<unsigned __int64>()->default_value(DEFAULT_CACHE_MEMORY),
+            "max memory in MB used by each of the series and data caches, 0 "
+            "for no limit")(
+            CACHE_POLICY,
+            po::value<unsigned long>()->default_value(
+                (unsigned long)DEFAULT_CACHE_POLICY),
+            "cache eviction policy: 0-2 (least recently used, least frequently "
+            "used, greedy dual size frequency)")(
+            SERIES_CACHE,
+            po::value<bool>()->default_value(DEFAULT_SERIES_CACHE),
+            "enables the series cache, which shares the indicators and the "
+            "series arithmetic between the systems, and bounds it with the "
+            "cache policy and memory. Only for systems that don't modify the "
+            "series they calculate from, as the cached series are found by "
+            "how they were calculated, not by their values")(
+            PREFETCH_WINDOW,
+            po::value<unsigned long>()->default_value(DEFAULT_PREFETCH_WINDOW),
+            "number of symbols whose data is loaded ahead by each running "
+            "thread, 0 to disable")(
+            PREFETCH_THREADS,
+            po::value<unsigned long>()->default_value(DEFAULT_PREFETCH_THREADS),
+            "number of threads loading data ahead of the running systems")(
+            POOL_THREADS,
+            po::value<unsigned long>()->default_value(DEFAULT_POOL_THREADS),
+            "number of threads running the systems, shared by all sessions, 0 "
+            "for one per processor")(
+            THREAD_PLACEMENT,
+            po::value<unsigned long>()->default_value(
+                (unsigned long)DEFAULT_THREAD_PLACEMENT),
+            "placement of the threads running the systems: 0-4 (none, ideal "
+            "processor, compact, scatter, per NUMA node)")(
             DEFSLIPPAGEVALUE,
             po::value<double>()->default_value(DEFAULT_SLIPPAGE_VALUE),
             "the default slippage value")(
@@ -706,6 +745,14 @@ void Configuration::init(const std::string& cmdLine, bool validate) {
     _runtimeStatsFile = vm["runtimestatsfile"].as<std::string>();
 
     _cacheSize = vm["cachesize"].as<unsigned __int64>();
+    _cacheMemory = vm[CACHE_MEMORY].as<unsigned __int64>() * 1024 * 1024;
+    _cachePolicy = (CachePolicy)vm[CACHE_POLICY].as<unsigned long>();
+    _seriesCache = vm[SERIES_CACHE].as<bool>();
+    _prefetchWindow = vm[PREFETCH_WINDOW].as<unsigned long>();
+    _prefetchThreads = vm[PREFETCH_THREADS].as<unsigned long>();
+    _poolThreads = vm[POOL_THREADS].as<unsigned long>();
+    _threadPlacement =
+        (ThreadPlacement)vm[THREAD_PLACEMENT].as<unsigned long>();
     _defSlippageValue = vm["defslippagevalue"].as<double>();
     //    std::cout << "in cmd line, slippage value: " << _defSlippageValue;
     _defCommissionValue = vm["defcommissionvalue"].as<double>();
@@ -119,6 +119,13 @@ class Configuration : public RunSystemContext, private ConfigurationData {
   size_t reverseHeartBeatPeriod() const { return _reverseHeartBeatPeriod; }
   size_t heartBeatTimeout() const { return _heartBeatTimeout; }
   size_t cacheSize() const { return _cacheSize; }
+  unsigned __int64 cacheMemory() const { return _cacheMemory; }
+  CachePolicy cachePolicy() const { return _cachePolicy; }
+  bool seriesCache() const { return _seriesCache; }
+  size_t prefetchWindow() const { return _prefetchWindow; }
+  unsigned long prefetchThreads() const { return _prefetchThreads; }
+  unsigned long poolThreads() const { return _poolThreads; }
+  ThreadPlacement threadPlacement() const { return _threadPlacement; }
   double defCommissionValue() const { return _defCommissionValue; }
   double defSlippageValue() const { return _defSlippageValue; }
   const std::string& defSlippageId() const { return _defSlippageId; }
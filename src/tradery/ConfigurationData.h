@@ -78,6 +78,14 @@ class ConfigurationData {
   PositionSizingParamsImpl _posSizingParams;
 
   size_t _cacheSize;
+  // in bytes
+  unsigned __int64 _cacheMemory;
+  CachePolicy _cachePolicy;
+  bool _seriesCache;
+  size_t _prefetchWindow;
+  unsigned long _prefetchThreads;
+  unsigned long _poolThreads;
+  ThreadPlacement _threadPlacement;
 
   double _defSlippageValue;
   double _defCommissionValue;
@@ -116,8 +116,8 @@ void ProcessingThread::run(ThreadContext* threadContext) {
       // the threads == number of cpus, decrement for each new instance until we
       // get to 1 thread for any additional task
       //
-      // todo: this should be done by using a thread pool, and dynamically
-      // allocating tasks to threads as they come
+      // this only applies to sessions run in a separate process, sessions run
+      // in process share the process thread pool
       ;
 
       // then run
@@ -161,7 +161,9 @@ class XRunnableRunInfoHandler : public RunnableRunInfoHandler {
     _count++;
     LOG(log_debug, (status.errors() ? "!" : "+")
                        << "[" << status.threadName() << ":"
-                       << status.cpuNumber() << "] " << status.status()
+                       << status.cpuNumber() << ":" << status.threadTasks()
+                       << "/" << status.threadStolenTasks() << "] "
+                       << status.status()
                        << " on \"" << status.symbol() << "\"");
     _runTimer.restart();
     _runsCounter.incTotalBarCount(status.dataUnitCount());
@@ -35,6 +35,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define PERCENTAGE_DONE "percentageDone"
 #define SYSTEM_COUNT "systemCount"
 #define MESSAGE "message"
+#define SESSION_END_DURATION "sessionEndDuration"
 
 class RuntimeStatsImpl : public RuntimeStats,
                          public tradery_thrift_api::RuntimeStats {
@@ -47,9 +48,13 @@ class RuntimeStatsImpl : public RuntimeStats,
   mutable Mutex _mutex;
 
   double _extraPct;
+  // not part of the thrift RuntimeStats
+  double _sessionEndDuration;
 
  public:
-  RuntimeStatsImpl() : _extraPct(0) { setStatus(RuntimeStatus::READY); }
+  RuntimeStatsImpl() : _extraPct(0), _sessionEndDuration(0) {
+    setStatus(RuntimeStatus::READY);
+  }
 
   RuntimeStatsImpl(const nlohmann::json& j) {
     __super::duration = j[DURATION].get<double>();
@@ -71,6 +76,7 @@ class RuntimeStatsImpl : public RuntimeStats,
     __super::status =
         (tradery_thrift_api::RuntimeStatus::type)j[STATUS].get<unsigned int>();
     __super::message = j[MESSAGE].get<std::string>();
+    _sessionEndDuration = j.value(SESSION_END_DURATION, 0.0);
   }
 
   void setTotalSymbols(unsigned int totalSymbols) {
@@ -167,6 +173,11 @@ class RuntimeStatsImpl : public RuntimeStats,
     __super::message = message;
   }
 
+  virtual void setSessionEndDuration(double seconds) {
+    Lock lock(_mutex);
+    _sessionEndDuration = seconds;
+  }
+
   void to_json(nlohmann::json& j) const {
     j = nlohmann::json{{DURATION, __super::duration},
                        {PROCESSED_SYMBOL_COUNT, __super::processedSymbolCount},
@@ -183,7 +194,8 @@ class RuntimeStatsImpl : public RuntimeStats,
                        {PERCENTAGE_DONE, __super::percentageDone},
                        {CURRENT_SYMBOL, __super::currentSymbol},
                        {STATUS, __super::status},
-                       {MESSAGE, __super::message}};
+                       {MESSAGE, __super::message},
+                       {SESSION_END_DURATION, _sessionEndDuration}};
   }
 
   std::string to_json() const {
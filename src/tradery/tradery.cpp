@@ -74,7 +74,12 @@ int _tmain(int argc, TCHAR* argv[], TCHAR* envp[]) {
 #define CONFIG COMMON_CONFIG "\"tradery_release.conf\""
 #endif
       config = boost::make_shared<Configuration>(CONFIG, false);
-      tradery::init(config->cacheSize());
+      tradery::init(config->cacheSize(), config->cacheMemory(),
+                    config->cachePolicy(), config->seriesCache());
+      tradery::setDataPrefetch(config->prefetchWindow(),
+                               config->prefetchThreads());
+      tradery::startThreadPool(config->poolThreads(),
+                               config->threadPlacement());
     } catch (ConfigurationException& e) {
       LOG(log_error, "ConfigurationException: " << e.what());
       return config_error;